@@ -0,0 +1,45 @@
+/**
+* \file Accuracy.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+namespace Emblem
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief How far sin, cos, tan, exp, ln and log10 may stray from the
+* correctly rounded result, in exchange for speed.
+*
+* The approximate tiers evaluate polynomials after range reduction, see
+* FastMath.h for the largest errors measured for each. Square roots are
+* always exact, as the hardware instruction is already cheap.
+*/
+enum class Accuracy
+{
+    /** \brief The standard library functions. */
+    Exact,
+    /** \brief Within about 1e-12. */
+    High,
+    /** \brief Within about 1e-7, near float precision. */
+    Medium,
+    /** \brief Within about 1e-4. */
+    Low
+};
+
+} // namespace Emblem
@@ -0,0 +1,974 @@
+/**
+* \file BatchEvaluator.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Expression.h"
+#include "Program.h"
+#include "BatchTiling.h"
+#include "FastMath.h"
+#include "Interval.h"
+#include "LookupTableCache.h"
+#include "Internal\IntervalArithmetic.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \struct BatchInput
+* \brief Values of one symbol for a batch, either one value per row or one
+* uniform value shared by every row.
+*
+* Per-row values are read in place during evaluation from wherever they
+* live: a column of their own, one channel of an interleaved buffer or a
+* member of an array of structs.
+*/
+template <class T>
+struct BatchInput
+{
+    BatchInput()
+        : pData(nullptr), stride(0), value()
+    {
+    }
+
+    /** \brief Column of one value per row. */
+    static BatchInput Varying(const T* pColumn)
+    {
+        return Strided(pColumn, sizeof(T));
+    }
+
+    /**
+    * \brief One value per row, each byteStride bytes after the previous,
+    * such as one channel of an interleaved buffer.
+    */
+    static BatchInput Strided(const T* pFirst, std::ptrdiff_t byteStride)
+    {
+        BatchInput input;
+        input.pData = pFirst;
+        input.stride = byteStride;
+        return input;
+    }
+
+    /** \brief A member of an array of structs, e.g. Member(pRows, &Row::x). */
+    template <class Struct>
+    static BatchInput Member(const Struct* pRows, T Struct::* pMember)
+    {
+        return Strided(&(pRows->*pMember), sizeof(Struct));
+    }
+
+    /** \brief The same value for every row of the batch. */
+    static BatchInput Uniform(const T& rValue)
+    {
+        BatchInput input;
+        input.value = rValue;
+        return input;
+    }
+
+    bool isUniform() const
+    {
+        return pData == nullptr;
+    }
+
+    /** \brief Value of the first row, null for uniform inputs. */
+    const T* pData;
+    /** \brief Distance in bytes from one row's value to the next. */
+    std::ptrdiff_t stride;
+    /** \brief Value of uniform inputs. */
+    T value;
+};
+
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Operand of a batch step, values a stride apart or, with a null
+* pData, a value broadcast to every row.
+*/
+template <class T>
+struct BatchOperand
+{
+    const T* pData;
+    std::ptrdiff_t stride;
+    T value;
+};
+
+/** \brief Reads a contiguous column. */
+template <class T>
+struct ColumnReader
+{
+    T operator[](std::size_t row) const
+    {
+        return pData[row];
+    }
+
+    const T* pData;
+};
+
+/**
+* \brief Reads values a fixed number of bytes apart, which vectorizing
+* compilers turn into gathers where the target has them.
+*/
+template <class T>
+struct StridedReader
+{
+    T operator[](std::size_t row) const
+    {
+        return *reinterpret_cast<const T*>(pBytes + static_cast<std::ptrdiff_t>(row) * stride);
+    }
+
+    const char* pBytes;
+    std::ptrdiff_t stride;
+};
+
+/** \brief Reads the same value for every row. */
+template <class T>
+struct UniformReader
+{
+    T operator[](std::size_t) const
+    {
+        return value;
+    }
+
+    T value;
+};
+
+template <class T, class Function, class Reader>
+void ApplyRows(Function function, const Reader& rA, T* pResults, std::size_t rowCount)
+{
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        pResults[i] = function(rA[i]);
+    }
+}
+
+template <class T, class Function, class ReaderA, class ReaderB>
+void ApplyRows(Function function, const ReaderA& rA, const ReaderB& rB,
+               T* pResults, std::size_t rowCount)
+{
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        pResults[i] = function(rA[i], rB[i]);
+    }
+}
+
+/** \brief Applies the function row by row to an operand that is not uniform. */
+template <class T, class Function>
+void ApplyToColumn(Function function, const BatchOperand<T>& rA,
+                   T* pResults, std::size_t rowCount)
+{
+    if (rA.stride == static_cast<std::ptrdiff_t>(sizeof(T)))
+    {
+        const ColumnReader<T> a = { rA.pData };
+        ApplyRows(function, a, pResults, rowCount);
+    }
+    else
+    {
+        const StridedReader<T> a = { reinterpret_cast<const char*>(rA.pData), rA.stride };
+        ApplyRows(function, a, pResults, rowCount);
+    }
+}
+
+template <class T, class Function, class ReaderA>
+void ApplyToColumnsWith(Function function, const ReaderA& rA, const BatchOperand<T>& rB,
+                        T* pResults, std::size_t rowCount)
+{
+    if (rB.pData == nullptr)
+    {
+        const UniformReader<T> b = { rB.value };
+        ApplyRows(function, rA, b, pResults, rowCount);
+    }
+    else if (rB.stride == static_cast<std::ptrdiff_t>(sizeof(T)))
+    {
+        const ColumnReader<T> b = { rB.pData };
+        ApplyRows(function, rA, b, pResults, rowCount);
+    }
+    else
+    {
+        const StridedReader<T> b = { reinterpret_cast<const char*>(rB.pData), rB.stride };
+        ApplyRows(function, rA, b, pResults, rowCount);
+    }
+}
+
+/**
+* \brief Applies the function row by row, at least one operand is not
+* uniform. Each combination of layouts gets a loop of its own.
+*/
+template <class T, class Function>
+void ApplyToColumns(Function function, const BatchOperand<T>& rA, const BatchOperand<T>& rB,
+                    T* pResults, std::size_t rowCount)
+{
+    if (rA.pData == nullptr)
+    {
+        const UniformReader<T> a = { rA.value };
+        ApplyToColumnsWith(function, a, rB, pResults, rowCount);
+    }
+    else if (rA.stride == static_cast<std::ptrdiff_t>(sizeof(T)))
+    {
+        const ColumnReader<T> a = { rA.pData };
+        ApplyToColumnsWith(function, a, rB, pResults, rowCount);
+    }
+    else
+    {
+        const StridedReader<T> a = { reinterpret_cast<const char*>(rA.pData), rA.stride };
+        ApplyToColumnsWith(function, a, rB, pResults, rowCount);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Binary operation over a batch, the switch is hoisted out of the row loop. */
+template <class T>
+void ApplyBinary(OpCode opCode, const BatchOperand<T>& rA, const BatchOperand<T>& rB,
+                 T* pResults, std::size_t rowCount)
+{
+    switch (opCode)
+    {
+    case OpCode::Add:
+        ApplyToColumns([](const T& rX, const T& rY) { return FuncAdd(rX, rY); },
+                       rA, rB, pResults, rowCount);
+        break;
+    case OpCode::Subtract:
+        ApplyToColumns([](const T& rX, const T& rY) { return FuncSub(rX, rY); },
+                       rA, rB, pResults, rowCount);
+        break;
+    case OpCode::Multiply:
+        ApplyToColumns([](const T& rX, const T& rY) { return FuncMul(rX, rY); },
+                       rA, rB, pResults, rowCount);
+        break;
+    case OpCode::Divide:
+        ApplyToColumns([](const T& rX, const T& rY) { return FuncDiv(rX, rY); },
+                       rA, rB, pResults, rowCount);
+        break;
+    case OpCode::Pow:
+        ApplyToColumns([](const T& rX, const T& rY) { return FuncPow(rX, rY); },
+                       rA, rB, pResults, rowCount);
+        break;
+    default:
+        assert(0);
+        break;
+    }
+}
+
+/** \brief Unary operation over a column. */
+template <class T>
+void ApplyUnary(OpCode opCode, const BatchOperand<T>& rA, T* pResults, std::size_t rowCount)
+{
+    switch (opCode)
+    {
+    case OpCode::Sin:
+        ApplyToColumn([](const T& rX) { return FuncSin(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Cos:
+        ApplyToColumn([](const T& rX) { return FuncCos(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Tan:
+        ApplyToColumn([](const T& rX) { return FuncTan(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Identity:
+        ApplyToColumn([](const T& rX) { return FuncIdentity(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Abs:
+        ApplyToColumn([](const T& rX) { return FuncAbs(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Negate:
+        ApplyToColumn([](const T& rX) { return FuncNegate(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Exp:
+        ApplyToColumn([](const T& rX) { return FuncExp(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Ln:
+        ApplyToColumn([](const T& rX) { return FuncLn(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Log10:
+        ApplyToColumn([](const T& rX) { return FuncLog10(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Sqrt:
+        ApplyToColumn([](const T& rX) { return FuncSqrt(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Square:
+        ApplyToColumn([](const T& rX) { return FuncSquare(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Cube:
+        ApplyToColumn([](const T& rX) { return FuncCube(rX); }, rA, pResults, rowCount);
+        break;
+    case OpCode::Reciprocal:
+        ApplyToColumn([](const T& rX) { return FuncReciprocal(rX); }, rA, pResults, rowCount);
+        break;
+    default:
+        assert(0);
+        break;
+    }
+}
+
+/**
+* \brief Applies the tier's approximation if the operation has one,
+* returning whether it did.
+*/
+template <Accuracy A, class T>
+bool ApplyApproximateUnary(OpCode opCode, const BatchOperand<T>& rA, T* pResults, std::size_t rowCount)
+{
+    switch (opCode)
+    {
+    case OpCode::Sin:
+        ApplyToColumn([](const T& rX) { return FastSin<A>(rX); }, rA, pResults, rowCount);
+        return true;
+    case OpCode::Cos:
+        ApplyToColumn([](const T& rX) { return FastCos<A>(rX); }, rA, pResults, rowCount);
+        return true;
+    case OpCode::Tan:
+        ApplyToColumn([](const T& rX) { return FastTan<A>(rX); }, rA, pResults, rowCount);
+        return true;
+    case OpCode::Exp:
+        ApplyToColumn([](const T& rX) { return FastExp<A>(rX); }, rA, pResults, rowCount);
+        return true;
+    case OpCode::Ln:
+        ApplyToColumn([](const T& rX) { return FastLn<A>(rX); }, rA, pResults, rowCount);
+        return true;
+    case OpCode::Log10:
+        ApplyToColumn([](const T& rX) { return FastLog10<A>(rX); }, rA, pResults, rowCount);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** \brief Unary operation over a column, approximated as far as the accuracy allows. */
+template <class T>
+void ApplyUnary(OpCode opCode, Accuracy accuracy, const BatchOperand<T>& rA,
+                T* pResults, std::size_t rowCount)
+{
+    bool isApplied = false;
+    switch (accuracy)
+    {
+    case Accuracy::Exact:
+        break;
+    case Accuracy::High:
+        isApplied = ApplyApproximateUnary<Accuracy::High>(opCode, rA, pResults, rowCount);
+        break;
+    case Accuracy::Medium:
+        isApplied = ApplyApproximateUnary<Accuracy::Medium>(opCode, rA, pResults, rowCount);
+        break;
+    case Accuracy::Low:
+        isApplied = ApplyApproximateUnary<Accuracy::Low>(opCode, rA, pResults, rowCount);
+        break;
+    }
+    if (!isApplied)
+    {
+        ApplyUnary(opCode, rA, pResults, rowCount);
+    }
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class BatchEvaluator
+* \brief Evaluates an expression over many rows of symbol values at once.
+*
+* The expression is flattened into steps, and each step is applied to a
+* whole column of rows before the next, so the per-node dispatch is paid
+* once per batch rather than once per row.
+*
+* Every symbol is bound per call as either varying, one value per row, or
+* uniform, one value for the whole batch. Varying values are read in place
+* at any byte stride, so rows kept as an array of structs or in an
+* interleaved buffer need not be copied into columns first. Steps that depend only on
+* constants and uniform symbols are computed once and broadcast, so the
+* cost per row is only that of the steps depending on varying symbols.
+* Symbols are bound by position, in order of first occurrence in the
+* expression; see symbols().
+*
+* Rows are computed a tile at a time, so that the intermediate columns of
+* a tile are still in cache when the next step reads them. The tile size
+* comes from BatchTiling unless pinned with setTileRows().
+*
+* With setAccuracy() the transcendental functions use the approximations
+* of FastMath.h, which vectorize. With setDomains() they are read from
+* lookup tables instead, where the ranges of their operands are known.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class BatchEvaluator
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::SymbolNode<T, Alloc> SymbolNode;
+    typedef Internal::ConstantNode<T, Alloc> ConstantNode;
+    typedef Internal::OpCode OpCode;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef Emblem::BatchInput<T> BatchInput;
+    typedef std::unordered_map<std::string, BatchInput> InputMap;
+    typedef std::unordered_map<std::string, Interval<T>> DomainMap;
+
+    explicit BatchEvaluator(const ExpressionType& rExpression);
+
+    /**
+    * \brief Evaluates every row of the batch.
+    * \param pInputs One input per entry of symbols(), in that order.
+    * \param pResults Receives one value per row, must not overlap the
+    * inputs.
+    */
+    void evaluate(const BatchInput* pInputs, std::size_t rowCount, T* pResults) const;
+
+    /** \brief Evaluates the batch, looking the inputs up by symbol name. */
+    void evaluate(const InputMap& rInputs, std::size_t rowCount, T* pResults) const;
+
+    /** \brief Symbol names in positional order. */
+    const std::vector<std::string>& symbols() const
+    {
+        return mSymbols;
+    }
+
+    /** \brief Number of operations in the expression. */
+    std::size_t operationCount() const;
+
+    /**
+    * \brief Number of operations computed for every row with the inputs
+    * given, the others are computed once per batch.
+    */
+    std::size_t rowOperationCount(const BatchInput* pInputs) const;
+
+    /**
+    * \brief Pins the number of rows computed at a time, zero leaves the
+    * choice to BatchTiling::Instance().
+    */
+    void setTileRows(std::size_t tileRows)
+    {
+        mTileRows = tileRows;
+    }
+
+    /** \brief Number of rows computed at a time with the inputs given. */
+    std::size_t tileRows(const BatchInput* pInputs) const;
+
+    /** \brief Sets how accurate sin, cos, tan, exp, ln and log10 must be, Exact by default. */
+    void setAccuracy(Accuracy accuracy)
+    {
+        mAccuracy = accuracy;
+    }
+
+    Accuracy accuracy() const
+    {
+        return mAccuracy;
+    }
+
+    /**
+    * \brief Declares the values the symbols take, replacing any earlier
+    * domains.
+    *
+    * Ranges are propagated through the expression, and sin, cos, tan,
+    * exp, ln and log10 of an operand with a bounded range are read from
+    * lookup tables of LookupTableCache::Instance(), each within maxError
+    * of the exact function. Symbols without a domain are unbounded. Rows
+    * with values outside their domains are not accurate.
+    */
+    void setDomains(const DomainMap& rDomains, T maxError);
+
+    /** \brief Number of operations read from lookup tables. */
+    std::size_t tableCount() const
+    {
+        return static_cast<std::size_t>(std::count_if(
+                                            mTables.begin(), mTables.end(),
+                                            [](const TablePtr& pTable) { return pTable != nullptr; }));
+    }
+
+private:
+    /**
+    * \brief Single flattened node. Operands are the steps at
+    * mOperands[firstOperand, firstOperand + operandCount), and index is
+    * the constant or symbol of a push.
+    */
+    struct Step
+    {
+        OpCode opCode;
+        std::uint32_t index;
+        std::uint32_t firstOperand;
+        std::uint32_t operandCount;
+    };
+
+    typedef Internal::BatchOperand<T> BatchOperand;
+    typedef typename LookupTableCache<T>::TablePtr TablePtr;
+
+    bool isOperation(const Step& rStep) const
+    {
+        return rStep.operandCount != 0;
+    }
+
+    void findUniformSteps(const BatchInput* pInputs, std::vector<char>& rIsUniform) const;
+
+    /**
+    * \brief Assigns workspace columns to the varying steps, returning how
+    * many columns are needed.
+    */
+    std::size_t assignColumns(const std::vector<char>& rIsUniform,
+                              std::vector<std::uint32_t>& rColumns) const;
+
+    std::size_t chooseTileRows(std::size_t columnCount) const
+    {
+        return (mTileRows != 0) ? mTileRows
+               : BatchTiling::Instance().tileRows(columnCount, sizeof(T));
+    }
+
+    // Steps in post-order, the head is last.
+    std::vector<Step> mSteps;
+    std::vector<std::uint32_t> mOperands;
+    std::vector<T> mConstants;
+    std::vector<std::string> mSymbols;
+    std::size_t mTileRows;
+    Accuracy mAccuracy;
+    // Table of each step, null where the step is computed. Empty without
+    // domains.
+    std::vector<TablePtr> mTables;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+BatchEvaluator<T, Alloc>::BatchEvaluator(const ExpressionType& rExpression)
+    : mTileRows(0), mAccuracy(Accuracy::Exact)
+{
+    using namespace Internal;
+
+    const TermNode* pHead = rExpression.mExpressionTree.head();
+    if (pHead == nullptr)
+    {
+        return;
+    }
+
+    rExpression.canonicalHash(mSymbols);
+    std::unordered_map<std::string, std::uint32_t> symbolSlots;
+    for (std::size_t i = 0; i < mSymbols.size(); ++i)
+    {
+        symbolSlots[mSymbols[i]] = static_cast<std::uint32_t>(i);
+    }
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    // Post-order, the steps of the operands are left on a stack for the
+    // operator to collect.
+    std::vector<Frame> nodeStack;
+    std::vector<std::uint32_t> pendingSteps;
+    const Frame head = { pHead, pHead->operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const TermNode* pNode = rFrame.pNode;
+        Step step = { OpCode::Count, 0, static_cast<std::uint32_t>(mOperands.size()),
+                      static_cast<std::uint32_t>(rFrame.operandCount)
+                    };
+        if (pNode->isSymbol())
+        {
+            step.opCode = OpCode::PushSymbol;
+            step.index = symbolSlots[static_cast<const SymbolNode*>(pNode)->GetSymbol().toString()];
+        }
+        else if (!pNode->isOperator())
+        {
+            step.opCode = OpCode::PushConstant;
+            step.index = static_cast<std::uint32_t>(mConstants.size());
+            mConstants.push_back(static_cast<const ConstantNode*>(pNode)->GetValue());
+        }
+        else if (const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode))
+        {
+            step.opCode = ToOpCode(pNaryOp->GetOperator());
+        }
+        else if (const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode))
+        {
+            step.opCode = ToOpCode(pBinaryOp->GetOperator());
+        }
+        else
+        {
+            step.opCode = ToOpCode(static_cast<const UnaryOperatorNode*>(pNode)->GetOperator());
+        }
+
+        const std::size_t first = pendingSteps.size() - rFrame.operandCount;
+        mOperands.insert(mOperands.end(), pendingSteps.begin() + first, pendingSteps.end());
+        pendingSteps.erase(pendingSteps.begin() + first, pendingSteps.end());
+        pendingSteps.push_back(static_cast<std::uint32_t>(mSteps.size()));
+        mSteps.push_back(step);
+        nodeStack.pop_back();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void BatchEvaluator<T, Alloc>::findUniformSteps(
+    const BatchInput* pInputs, std::vector<char>& rIsUniform) const
+{
+    rIsUniform.resize(mSteps.size());
+    for (std::size_t i = 0; i < mSteps.size(); ++i)
+    {
+        const Step& rStep = mSteps[i];
+        if (rStep.opCode == OpCode::PushSymbol)
+        {
+            rIsUniform[i] = pInputs[rStep.index].isUniform();
+            continue;
+        }
+
+        bool isUniform = true;
+        for (std::size_t j = 0; j < rStep.operandCount; ++j)
+        {
+            isUniform = isUniform && rIsUniform[mOperands[rStep.firstOperand + j]];
+        }
+        rIsUniform[i] = isUniform;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t BatchEvaluator<T, Alloc>::operationCount() const
+{
+    return static_cast<std::size_t>(std::count_if(
+                                        mSteps.begin(), mSteps.end(),
+                                        [this](const Step& rStep) { return isOperation(rStep); }));
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void BatchEvaluator<T, Alloc>::setDomains(const DomainMap& rDomains, T maxError)
+{
+    using namespace Internal;
+
+    mTables.clear();
+    if (rDomains.empty())
+    {
+        return;
+    }
+
+    std::vector<Interval<T>> ranges(mSteps.size());
+    mTables.resize(mSteps.size());
+    for (std::size_t i = 0; i < mSteps.size(); ++i)
+    {
+        const Step& rStep = mSteps[i];
+        const std::uint32_t* pOperands = mOperands.data() + rStep.firstOperand;
+        if (rStep.opCode == OpCode::PushConstant)
+        {
+            ranges[i] = Interval<T>::Point(mConstants[rStep.index]);
+        }
+        else if (rStep.opCode == OpCode::PushSymbol)
+        {
+            auto domainIter = rDomains.find(mSymbols[rStep.index]);
+            if (domainIter != rDomains.end())
+            {
+                ranges[i] = domainIter->second;
+            }
+        }
+        else if (rStep.operandCount == 1)
+        {
+            const Interval<T>& rOperand = ranges[pOperands[0]];
+            ranges[i] = IntervalOf(rStep.opCode, rOperand);
+            if (rOperand.isBounded())
+            {
+                mTables[i] = LookupTableCache<T>::Instance().getOrCreate(rStep.opCode, rOperand, maxError);
+            }
+        }
+        else
+        {
+            Interval<T> range = ranges[pOperands[0]];
+            for (std::size_t j = 1; j < rStep.operandCount; ++j)
+            {
+                range = IntervalOf(rStep.opCode, range, ranges[pOperands[j]]);
+            }
+            ranges[i] = range;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t BatchEvaluator<T, Alloc>::rowOperationCount(const BatchInput* pInputs) const
+{
+    std::vector<char> isUniform;
+    findUniformSteps(pInputs, isUniform);
+
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < mSteps.size(); ++i)
+    {
+        if (isOperation(mSteps[i]) && !isUniform[i])
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t BatchEvaluator<T, Alloc>::tileRows(const BatchInput* pInputs) const
+{
+    std::vector<char> isUniform;
+    findUniformSteps(pInputs, isUniform);
+    std::vector<std::uint32_t> columns;
+    return chooseTileRows(assignColumns(isUniform, columns));
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t BatchEvaluator<T, Alloc>::assignColumns(
+    const std::vector<char>& rIsUniform, std::vector<std::uint32_t>& rColumns) const
+{
+    // Varying symbols read their input in place and the head writes
+    // straight to the results, the other varying steps get a column that
+    // is reused once the parent has consumed it.
+    static const std::uint32_t NoColumn = static_cast<std::uint32_t>(-1);
+    const std::size_t headStep = mSteps.size() - 1;
+    rColumns.assign(mSteps.size(), NoColumn);
+    std::vector<std::uint32_t> freeColumns;
+    std::uint32_t columnCount = 0;
+    for (std::size_t i = 0; i < mSteps.size(); ++i)
+    {
+        const Step& rStep = mSteps[i];
+        if (rIsUniform[i] || (rStep.opCode == OpCode::PushSymbol))
+        {
+            continue;
+        }
+
+        // Row by row, a step reads its operands before writing, so it may
+        // write over the first one. Sums and products write before reading
+        // their later operands, which must keep their own columns.
+        for (std::size_t j = 0; j < rStep.operandCount; ++j)
+        {
+            const std::uint32_t column = rColumns[mOperands[rStep.firstOperand + j]];
+            if (column == NoColumn)
+            {
+                continue;
+            }
+            if ((j == 0) || (rStep.operandCount == 2))
+            {
+                freeColumns.push_back(column);
+            }
+        }
+        if (i != headStep)
+        {
+            if (freeColumns.empty())
+            {
+                rColumns[i] = columnCount++;
+            }
+            else
+            {
+                rColumns[i] = freeColumns.back();
+                freeColumns.pop_back();
+            }
+        }
+        for (std::size_t j = 1; (rStep.operandCount > 2) && (j < rStep.operandCount); ++j)
+        {
+            const std::uint32_t column = rColumns[mOperands[rStep.firstOperand + j]];
+            if (column != NoColumn)
+            {
+                freeColumns.push_back(column);
+            }
+        }
+    }
+    return columnCount;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void BatchEvaluator<T, Alloc>::evaluate(
+    const BatchInput* pInputs, std::size_t rowCount, T* pResults) const
+{
+    using namespace Internal;
+
+    if (mSteps.empty())
+    {
+        assert(0);
+        return;
+    }
+    if (rowCount == 0)
+    {
+        return;
+    }
+
+    std::vector<char> isUniform;
+    findUniformSteps(pInputs, isUniform);
+
+    // Uniform steps are computed once for the whole batch.
+    std::vector<T> values(mSteps.size());
+    for (std::size_t i = 0; i < mSteps.size(); ++i)
+    {
+        const Step& rStep = mSteps[i];
+        const std::uint32_t* pOperands = mOperands.data() + rStep.firstOperand;
+        if (!isUniform[i])
+        {
+            continue;
+        }
+        if (rStep.opCode == OpCode::PushConstant)
+        {
+            values[i] = mConstants[rStep.index];
+        }
+        else if (rStep.opCode == OpCode::PushSymbol)
+        {
+            values[i] = pInputs[rStep.index].value;
+        }
+        else if (rStep.operandCount == 1)
+        {
+            const LookupTable<T>* pTable = mTables.empty() ? nullptr : mTables[i].get();
+            values[i] = (pTable != nullptr) ? (*pTable)(values[pOperands[0]])
+                        : ApplyUnary(rStep.opCode, mAccuracy, values[pOperands[0]]);
+        }
+        else
+        {
+            T value = values[pOperands[0]];
+            for (std::size_t j = 1; j < rStep.operandCount; ++j)
+            {
+                value = ApplyBinary(rStep.opCode, value, values[pOperands[j]]);
+            }
+            values[i] = value;
+        }
+    }
+
+    const std::size_t headStep = mSteps.size() - 1;
+    if (isUniform[headStep])
+    {
+        std::fill(pResults, pResults + rowCount, values[headStep]);
+        return;
+    }
+
+    std::vector<std::uint32_t> columns;
+    const std::size_t columnCount = assignColumns(isUniform, columns);
+    const std::size_t tileRows = std::min(chooseTileRows(columnCount), rowCount);
+    std::vector<T> workspace(columnCount * tileRows);
+
+    for (std::size_t begin = 0; begin < rowCount; begin += tileRows)
+    {
+        const std::size_t tileRowCount = std::min(tileRows, rowCount - begin);
+        T* pTileResults = pResults + begin;
+        const auto operand = [&](std::uint32_t step) -> BatchOperand
+        {
+            BatchOperand result = { nullptr, sizeof(T), values[step] };
+            if (isUniform[step])
+            {
+                return result;
+            }
+            const Step& rStep = mSteps[step];
+            if (rStep.opCode == OpCode::PushSymbol)
+            {
+                const BatchInput& rInput = pInputs[rStep.index];
+                const char* pFirst = reinterpret_cast<const char*>(rInput.pData);
+                result.pData = reinterpret_cast<const T*>(
+                                   pFirst + static_cast<std::ptrdiff_t>(begin) * rInput.stride);
+                result.stride = rInput.stride;
+            }
+            else
+            {
+                result.pData = &workspace[columns[step] * tileRows];
+            }
+            return result;
+        };
+
+        for (std::size_t i = 0; i < mSteps.size(); ++i)
+        {
+            const Step& rStep = mSteps[i];
+            const std::uint32_t* pOperands = mOperands.data() + rStep.firstOperand;
+            if (isUniform[i] || !isOperation(rStep))
+            {
+                continue;
+            }
+
+            T* pColumn = (i == headStep) ? pTileResults : &workspace[columns[i] * tileRows];
+            if (rStep.operandCount == 1)
+            {
+                const LookupTable<T>* pTable = mTables.empty() ? nullptr : mTables[i].get();
+                if (pTable != nullptr)
+                {
+                    ApplyToColumn([pTable](const T& rX) { return (*pTable)(rX); },
+                                  operand(pOperands[0]), pColumn, tileRowCount);
+                }
+                else
+                {
+                    ApplyUnary(rStep.opCode, mAccuracy, operand(pOperands[0]), pColumn, tileRowCount);
+                }
+                continue;
+            }
+
+            // Sums and products are folded left to right, as Expression does.
+            BatchOperand accumulator = operand(pOperands[0]);
+            for (std::size_t j = 1; j < rStep.operandCount; ++j)
+            {
+                const BatchOperand next = operand(pOperands[j]);
+                if ((accumulator.pData == nullptr) && (next.pData == nullptr))
+                {
+                    accumulator.value = ApplyBinary(rStep.opCode, accumulator.value, next.value);
+                    continue;
+                }
+                ApplyBinary(rStep.opCode, accumulator, next, pColumn, tileRowCount);
+                accumulator.pData = pColumn;
+                accumulator.stride = sizeof(T);
+            }
+        }
+
+        if (mSteps[headStep].opCode == OpCode::PushSymbol)
+        {
+            ApplyToColumn([](const T& rX) { return rX; },
+                          operand(static_cast<std::uint32_t>(headStep)),
+                          pTileResults, tileRowCount);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void BatchEvaluator<T, Alloc>::evaluate(
+    const InputMap& rInputs, std::size_t rowCount, T* pResults) const
+{
+    std::vector<BatchInput> inputs;
+    inputs.reserve(mSymbols.size());
+    for (const std::string& rSymbol : mSymbols)
+    {
+        inputs.push_back(rInputs.at(rSymbol));
+    }
+    evaluate(inputs.data(), rowCount, pResults);
+}
+
+} // namespace Emblem
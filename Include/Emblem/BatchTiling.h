@@ -0,0 +1,175 @@
+/**
+* \file BatchTiling.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Internal/CacheSize.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace Emblem
+{
+
+/**
+* \class BatchTiling
+* \brief Chooses how many rows BatchEvaluator computes at a time.
+*
+* A batch is evaluated in tiles of rows, small enough that the
+* intermediate columns of one tile stay in cache while the steps of the
+* expression pass over them. The cache budget for those columns is set
+* once per process to half the level 2 cache the operating system
+* reports, leaving room for the inputs and results. Where the size is
+* not reported it is calibrated instead, by timing a chain of column
+* passes over a range of working set sizes. setCacheBudget() pins it.
+*/
+class BatchTiling
+{
+public:
+    /** \brief Fewest rows in a tile, below which per-step overhead dominates. */
+    static const std::size_t MinTileRows = 64;
+    /** \brief Range of cache budgets chosen, and calibrated over. */
+    static const std::size_t MinCacheBudget = 16 * 1024;
+    static const std::size_t MaxCacheBudget = 4 * 1024 * 1024;
+
+    BatchTiling()
+        : mCacheBudget(0)
+    {
+    }
+
+    /** \brief Tiling used by every BatchEvaluator without a pinned tile size. */
+    static BatchTiling& Instance()
+    {
+        static BatchTiling sTiling;
+        return sTiling;
+    }
+
+    /** \brief Bytes of intermediates per tile, detected on first use. */
+    std::size_t cacheBudget()
+    {
+        std::size_t budget = mCacheBudget.load();
+        if (budget == 0)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            budget = mCacheBudget.load();
+            if (budget == 0)
+            {
+                budget = DetectCacheBudget();
+                mCacheBudget.store(budget);
+            }
+        }
+        return budget;
+    }
+
+    /** \brief Pins the budget, or with zero detects it again on next use. */
+    void setCacheBudget(std::size_t bytes)
+    {
+        mCacheBudget.store(bytes);
+    }
+
+    /**
+    * \brief Rows per tile for a step program that keeps columnCount
+    * intermediate columns of valueSize bytes, besides the results.
+    */
+    std::size_t tileRows(std::size_t columnCount, std::size_t valueSize)
+    {
+        const std::size_t rowBytes = (columnCount + 1) * valueSize;
+        const std::size_t rows = cacheBudget() / rowBytes;
+        return (rows < MinTileRows) ? MinTileRows : rows - rows % 16;
+    }
+
+    /**
+    * \brief Half the level 2 data cache, or the calibrated budget where the
+    * operating system does not report the cache size.
+    */
+    static std::size_t DetectCacheBudget()
+    {
+        const std::size_t cacheSize = Internal::DataCacheSize(2);
+        if (cacheSize == 0)
+        {
+            return Calibrate();
+        }
+        const std::size_t budget = cacheSize / 2;
+        return (budget < MinCacheBudget) ? MinCacheBudget
+               : ((budget > MaxCacheBudget) ? MaxCacheBudget : budget);
+    }
+
+    /**
+    * \brief Measures the working set size that a chain of column passes
+    * runs fastest with, doubling from MinCacheBudget up to MaxCacheBudget.
+    */
+    static std::size_t Calibrate()
+    {
+        typedef std::chrono::steady_clock Clock;
+        const std::size_t ColumnCount = 8;
+        const std::size_t RowCount = 64 * 1024;
+        const std::size_t MinBudget = MinCacheBudget;
+        const std::size_t MaxBudget = MaxCacheBudget;
+
+        std::vector<double> input(RowCount);
+        for (std::size_t i = 0; i < RowCount; ++i)
+        {
+            input[i] = 1.0 / (i + 1.0);
+        }
+        std::vector<double> workspace(MaxBudget / sizeof(double));
+        volatile double sink = 0.0;
+
+        std::size_t bestBudget = MaxBudget;
+        Clock::duration bestTime = Clock::duration::max();
+        for (std::size_t budget = MinBudget; budget <= MaxBudget; budget *= 2)
+        {
+            const std::size_t tileRows = budget / (ColumnCount * sizeof(double));
+            Clock::duration time = Clock::duration::max();
+            for (int repeat = 0; repeat < 3; ++repeat)
+            {
+                const Clock::time_point start = Clock::now();
+                for (std::size_t begin = 0; begin < RowCount; begin += tileRows)
+                {
+                    const std::size_t rowCount = std::min(tileRows, RowCount - begin);
+                    const double* pPrevious = &input[begin];
+                    for (std::size_t column = 0; column < ColumnCount; ++column)
+                    {
+                        double* pColumn = &workspace[column * tileRows];
+                        for (std::size_t i = 0; i < rowCount; ++i)
+                        {
+                            pColumn[i] = pPrevious[i] * 0.999 + 0.5;
+                        }
+                        pPrevious = pColumn;
+                    }
+                    sink = sink + pPrevious[rowCount - 1];
+                }
+                time = std::min(time, Clock::now() - start);
+            }
+            if (time < bestTime)
+            {
+                bestTime = time;
+                bestBudget = budget;
+            }
+        }
+        return bestBudget;
+    }
+
+private:
+    std::atomic<std::size_t> mCacheBudget;
+    std::mutex mMutex;
+};
+
+} // namespace Emblem
@@ -0,0 +1,392 @@
+/**
+* \file ChebyshevApproximation.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Interval.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace Emblem
+{
+
+/**
+* \class ChebyshevApproximation
+* \brief Piecewise Chebyshev polynomial standing in for a function of one
+* variable over an interval.
+*
+* The interval is bisected until each piece is fitted within the
+* tolerance. A piece interpolates the function at the Chebyshev nodes of
+* degree MaxDegree, drops the trailing coefficients too small to matter
+* and is then checked against the function at evenly spaced samples, four
+* per node. A piece is kept once its coefficients have decayed and its
+* error is within half the tolerance, the rest is margin for the points
+* between samples. Pieces are found through a table indexed by the
+* position in the interval, so an evaluation costs one lookup and one
+* Clenshaw recurrence whatever the number of pieces. The column
+* evaluate() runs the recurrences of several points side by side.
+*
+* The error is only verified at the samples checked, see
+* maxObservedError(). Between them it rests on the coefficients having
+* decayed, which holds for functions smooth on a piece but is not a
+* bound: the function is only known at the points it is evaluated at.
+* A discontinuity or singularity stops the bisection at MaxDepth with
+* pieces that fail their check, and meetsTolerance() is then false.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T>
+class ChebyshevApproximation
+{
+public:
+    /** \brief Highest degree of the polynomial of a piece. */
+    static const std::size_t MaxDegree = 16;
+
+    /** \brief Most bisections of the interval, up to 4096 pieces. */
+    static const std::size_t MaxDepth = 12;
+
+    /** \brief Empty approximation, see empty(). */
+    ChebyshevApproximation()
+        : mTolerance(0), mMaxObservedError(0), mInverseCellWidth(0), mLastCell(0),
+          mStride(1), mCoefficientCount(0), mIsDepthLimited(false)
+    {
+    }
+
+    /**
+    * \brief Fits the function over the bounded interval.
+    * \param function Callable taking and returning T.
+    * \param tolerance Absolute error allowed.
+    */
+    template <class Function>
+    static ChebyshevApproximation Fit(Function function, const Interval<T>& rInterval, T tolerance);
+
+    /** \brief Approximate value at x, extrapolated outside the interval. */
+    T operator()(const T& rX) const
+    {
+        T t;
+        const T* pCoefficients = locate(rX, t);
+        T b1 = T(0);
+        T b2 = T(0);
+        for (std::size_t k = mStride - 1; k > 0; --k)
+        {
+            const T b0 = pCoefficients[k] + 2 * t * b1 - b2;
+            b2 = b1;
+            b1 = b0;
+        }
+        return pCoefficients[0] + t * b1 - b2;
+    }
+
+    /** \brief Approximate values at count points. */
+    void evaluate(const T* pX, std::size_t count, T* pResults) const;
+
+    const Interval<T>& interval() const
+    {
+        return mInterval;
+    }
+
+    T tolerance() const
+    {
+        return mTolerance;
+    }
+
+    std::size_t pieceCount() const
+    {
+        return mCenters.size();
+    }
+
+    /** \brief Number of significant coefficients over all pieces. */
+    std::size_t coefficientCount() const
+    {
+        return mCoefficientCount;
+    }
+
+    std::size_t memoryUsage() const
+    {
+        return sizeof(ChebyshevApproximation) + (mCoefficients.size() + 2 * mCenters.size()) * sizeof(T) +
+               mCellPieces.size() * sizeof(std::uint32_t);
+    }
+
+    /** \brief Largest error against the function at the samples checked. */
+    T maxObservedError() const
+    {
+        return mMaxObservedError;
+    }
+
+    /**
+    * \brief True if every piece passed its check before MaxDepth was
+    * reached. The error is verified at the samples only, see the class.
+    */
+    bool meetsTolerance() const
+    {
+        return !empty() && !mIsDepthLimited && (mMaxObservedError <= mTolerance);
+    }
+
+    /** \brief True if nothing was fitted. */
+    bool empty() const
+    {
+        return mCenters.empty();
+    }
+
+private:
+    ChebyshevApproximation(const Interval<T>& rInterval, T tolerance)
+        : mInterval(rInterval), mTolerance(tolerance), mMaxObservedError(0),
+          mInverseCellWidth(0), mLastCell(0), mStride(1), mCoefficientCount(0),
+          mIsDepthLimited(false)
+    {
+    }
+
+    /** \brief Coefficients of the piece holding x, and x within it. */
+    const T* locate(const T& rX, T& rT) const
+    {
+        assert(!empty());
+        const T position = (rX - mInterval.lower) * mInverseCellWidth;
+        const T clamped = std::max(T(0), std::min(position, mLastCell));
+        const std::uint32_t piece = mCellPieces[static_cast<std::size_t>(clamped)];
+        rT = (rX - mCenters[piece]) * mInverseHalfWidths[piece];
+        return mCoefficients.data() + piece * mStride;
+    }
+
+    /**
+    * \brief Fits a single piece, returning the largest error at the
+    * samples. rIsResolved is false if the coefficients have not decayed.
+    */
+    template <class Function>
+    static T FitPiece(Function& rFunction, T lower, T upper, T tolerance,
+                      std::vector<T>& rCoefficients, bool& rIsResolved);
+
+    static T Clenshaw(const std::vector<T>& rCoefficients, T t)
+    {
+        T b1 = T(0);
+        T b2 = T(0);
+        for (std::size_t k = rCoefficients.size() - 1; k > 0; --k)
+        {
+            const T b0 = rCoefficients[k] + 2 * t * b1 - b2;
+            b2 = b1;
+            b1 = b0;
+        }
+        return rCoefficients[0] + t * b1 - b2;
+    }
+
+    Interval<T> mInterval;
+    T mTolerance;
+    T mMaxObservedError;
+    T mInverseCellWidth;
+    T mLastCell;
+
+    // Per piece, in order along the interval. The coefficients of piece i
+    // start at mCoefficients[i * mStride], padded with zeros to the
+    // longest piece so that every recurrence has the same length.
+    std::vector<T> mCenters;
+    std::vector<T> mInverseHalfWidths;
+    std::vector<T> mCoefficients;
+    std::size_t mStride;
+    std::size_t mCoefficientCount;
+    bool mIsDepthLimited;
+
+    // Piece covering each of the 2^depth cells of the interval.
+    std::vector<std::uint32_t> mCellPieces;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+const std::size_t ChebyshevApproximation<T>::MaxDegree;
+
+template <class T>
+const std::size_t ChebyshevApproximation<T>::MaxDepth;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+template <class Function>
+ChebyshevApproximation<T> ChebyshevApproximation<T>::Fit(
+    Function function, const Interval<T>& rInterval, T tolerance)
+{
+    assert(rInterval.isBounded() && (tolerance > 0));
+
+    ChebyshevApproximation result(rInterval, tolerance);
+
+    // Pieces are dyadic, piece (depth, index) covers
+    // [index, index + 1) / 2^depth of the interval.
+    struct Piece
+    {
+        std::size_t depth;
+        std::size_t index;
+    };
+    std::vector<Piece> pieces;
+    std::vector<Piece> pending(1, Piece { 0, 0 });
+    std::vector<T> coefficients;
+    std::vector<std::vector<T>> pieceCoefficients;
+    std::size_t depth = 0;
+    const T width = rInterval.upper - rInterval.lower;
+    while (!pending.empty())
+    {
+        const Piece piece = pending.back();
+        pending.pop_back();
+
+        const T scale = width / static_cast<T>(std::size_t(1) << piece.depth);
+        const T lower = rInterval.lower + scale * static_cast<T>(piece.index);
+        const T upper = (piece.index + 1 == (std::size_t(1) << piece.depth))
+                        ? rInterval.upper : rInterval.lower + scale * static_cast<T>(piece.index + 1);
+        bool isResolved = false;
+        const T error = FitPiece(function, lower, upper, tolerance, coefficients, isResolved);
+        const bool isAccepted = isResolved && (error <= tolerance / 2);
+        if (!isAccepted && (piece.depth < MaxDepth))
+        {
+            // Left half last, so that pieces are taken in order.
+            pending.push_back(Piece { piece.depth + 1, 2 * piece.index + 1 });
+            pending.push_back(Piece { piece.depth + 1, 2 * piece.index });
+            continue;
+        }
+        result.mIsDepthLimited = result.mIsDepthLimited || !isAccepted;
+
+        result.mMaxObservedError = std::max(result.mMaxObservedError,
+                                            (error == error) ? error : std::numeric_limits<T>::infinity());
+        result.mCenters.push_back((lower + upper) / 2);
+        result.mInverseHalfWidths.push_back((upper > lower) ? 2 / (upper - lower) : T(0));
+        result.mStride = std::max(result.mStride, coefficients.size());
+        result.mCoefficientCount += coefficients.size();
+        pieceCoefficients.push_back(coefficients);
+        pieces.push_back(piece);
+        depth = std::max(depth, piece.depth);
+    }
+
+    result.mCoefficients.assign(pieces.size() * result.mStride, T(0));
+    for (std::size_t i = 0; i < pieces.size(); ++i)
+    {
+        std::copy(pieceCoefficients[i].begin(), pieceCoefficients[i].end(),
+                  result.mCoefficients.begin() + i * result.mStride);
+    }
+
+    const std::size_t cellCount = std::size_t(1) << depth;
+    result.mInverseCellWidth = (width > 0) ? static_cast<T>(cellCount) / width : T(0);
+    result.mLastCell = static_cast<T>(cellCount - 1);
+    result.mCellPieces.resize(cellCount);
+    for (std::size_t i = 0; i < pieces.size(); ++i)
+    {
+        const std::size_t shift = depth - pieces[i].depth;
+        std::fill(result.mCellPieces.begin() + (pieces[i].index << shift),
+                  result.mCellPieces.begin() + ((pieces[i].index + 1) << shift),
+                  static_cast<std::uint32_t>(i));
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+void ChebyshevApproximation<T>::evaluate(const T* pX, std::size_t count, T* pResults) const
+{
+    // Each recurrence waits on its previous step, so a block of points is
+    // advanced together to keep the pipeline full.
+    const std::size_t BlockSize = 8;
+    std::size_t i = 0;
+    for (; i + BlockSize <= count; i += BlockSize)
+    {
+        const T* pCoefficients[BlockSize];
+        T t[BlockSize];
+        T b1[BlockSize];
+        T b2[BlockSize];
+        for (std::size_t j = 0; j < BlockSize; ++j)
+        {
+            pCoefficients[j] = locate(pX[i + j], t[j]);
+            b1[j] = T(0);
+            b2[j] = T(0);
+        }
+        for (std::size_t k = mStride - 1; k > 0; --k)
+        {
+            for (std::size_t j = 0; j < BlockSize; ++j)
+            {
+                const T b0 = pCoefficients[j][k] + 2 * t[j] * b1[j] - b2[j];
+                b2[j] = b1[j];
+                b1[j] = b0;
+            }
+        }
+        for (std::size_t j = 0; j < BlockSize; ++j)
+        {
+            pResults[i + j] = pCoefficients[j][0] + t[j] * b1[j] - b2[j];
+        }
+    }
+    for (; i < count; ++i)
+    {
+        pResults[i] = (*this)(pX[i]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+template <class Function>
+T ChebyshevApproximation<T>::FitPiece(
+    Function& rFunction, T lower, T upper, T tolerance,
+    std::vector<T>& rCoefficients, bool& rIsResolved)
+{
+    const T pi = T(3.14159265358979323846);
+    const std::size_t nodeCount = MaxDegree + 1;
+    const T center = (lower + upper) / 2;
+    const T halfWidth = (upper - lower) / 2;
+
+    // Interpolation at the Chebyshev nodes of the first kind.
+    T values[nodeCount];
+    for (std::size_t k = 0; k < nodeCount; ++k)
+    {
+        const T node = std::cos(pi * (static_cast<T>(k) + T(0.5)) / nodeCount);
+        values[k] = rFunction(center + halfWidth * node);
+    }
+    rCoefficients.assign(nodeCount, T(0));
+    for (std::size_t j = 0; j < nodeCount; ++j)
+    {
+        T sum = T(0);
+        for (std::size_t k = 0; k < nodeCount; ++k)
+        {
+            sum += values[k] * std::cos(pi * static_cast<T>(j) * (static_cast<T>(k) + T(0.5)) / nodeCount);
+        }
+        rCoefficients[j] = sum * ((j == 0) ? T(1) : T(2)) / nodeCount;
+    }
+
+    // The coefficients of a function the degree resolves decay quickly,
+    // a large tail means the piece is too wide.
+    const T tail = std::abs(rCoefficients[nodeCount - 1]) + std::abs(rCoefficients[nodeCount - 2]);
+    rIsResolved = (tail <= tolerance / 4);
+
+    T dropped = T(0);
+    while ((rCoefficients.size() > 1) && (dropped + std::abs(rCoefficients.back()) <= tolerance / 8))
+    {
+        dropped += std::abs(rCoefficients.back());
+        rCoefficients.pop_back();
+    }
+
+    // Check at evenly spaced points, both ends included.
+    const std::size_t sampleCount = 4 * nodeCount;
+    T error = T(0);
+    for (std::size_t i = 0; i <= sampleCount; ++i)
+    {
+        const T t = T(-1) + 2 * static_cast<T>(i) / sampleCount;
+        const T x = (i == sampleCount) ? upper : center + halfWidth * t;
+        const T difference = std::abs(Clenshaw(rCoefficients, t) - rFunction(x));
+        error = (difference == difference) ? std::max(error, difference)
+                : std::numeric_limits<T>::infinity();
+    }
+    return error;
+}
+
+} // namespace Emblem
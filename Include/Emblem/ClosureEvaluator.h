@@ -0,0 +1,599 @@
+/**
+* \file ClosureEvaluator.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Expression.h"
+#include "Program.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Where a closure takes an operand from. */
+enum class ClosureOperand : std::uint8_t
+{
+    /** \brief Result of another closure. */
+    Closure,
+    /** \brief Symbol value, by position. */
+    Symbol,
+    /** \brief Constant stored in the closure. */
+    Constant
+};
+
+/**
+* \brief Node of a closure tree: a function specialized for its operation
+* and the kinds of its operands, and the operands it applies it to.
+*
+* A sum or product is preceded by one record per operand, with no
+* function, the operand's index and kind as operands and its constant.
+* The sum's own operands are the position of the first record and the
+* number of records.
+*/
+template <class T>
+struct Closure
+{
+    typedef T (*Function)(const Closure* pClosures, const Closure& rClosure,
+                          const T* pSymbolValues);
+
+    Function pFunction;
+    /** \brief Index of the closure or symbol of each operand. */
+    std::uint32_t operands[2];
+    /** \brief Value of each constant operand. */
+    T constants[2];
+};
+
+template <class T, ClosureOperand Kind>
+struct LoadOperand;
+
+template <class T>
+struct LoadOperand<T, ClosureOperand::Closure>
+{
+    static T Load(const Closure<T>* pClosures, std::uint32_t index, const T&,
+                  const T* pSymbolValues)
+    {
+        const Closure<T>& rOperand = pClosures[index];
+        return rOperand.pFunction(pClosures, rOperand, pSymbolValues);
+    }
+};
+
+template <class T>
+struct LoadOperand<T, ClosureOperand::Symbol>
+{
+    static T Load(const Closure<T>*, std::uint32_t index, const T&, const T* pSymbolValues)
+    {
+        return pSymbolValues[index];
+    }
+};
+
+template <class T>
+struct LoadOperand<T, ClosureOperand::Constant>
+{
+    static T Load(const Closure<T>*, std::uint32_t, const T& rConstant, const T*)
+    {
+        return rConstant;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////
+
+// The opcode and accuracy are template arguments, so the switches in
+// ApproximateUnary and ApplyBinary fold away and each function does
+// one operation.
+template <class T, OpCode Op, Accuracy Acc, ClosureOperand A>
+T EvaluateUnaryClosure(const Closure<T>* pClosures, const Closure<T>& rClosure,
+                       const T* pSymbolValues)
+{
+    return ApproximateUnary<Acc>::Apply(Op, LoadOperand<T, A>::Load(pClosures, rClosure.operands[0],
+                                                                    rClosure.constants[0], pSymbolValues));
+}
+
+template <class T, OpCode Op, ClosureOperand A, ClosureOperand B>
+T EvaluateBinaryClosure(const Closure<T>* pClosures, const Closure<T>& rClosure,
+                        const T* pSymbolValues)
+{
+    const T a = LoadOperand<T, A>::Load(pClosures, rClosure.operands[0],
+                                        rClosure.constants[0], pSymbolValues);
+    const T b = LoadOperand<T, B>::Load(pClosures, rClosure.operands[1],
+                                        rClosure.constants[1], pSymbolValues);
+    return ApplyBinary(Op, a, b);
+}
+
+/** \brief Loads the operand described by a record of a sum or product. */
+template <class T>
+T LoadRecordOperand(const Closure<T>* pClosures, const Closure<T>& rRecord,
+                    const T* pSymbolValues)
+{
+    typedef ClosureOperand K;
+    switch (static_cast<K>(rRecord.operands[1]))
+    {
+    case K::Closure:
+        return LoadOperand<T, K::Closure>::Load(pClosures, rRecord.operands[0],
+                                                rRecord.constants[0], pSymbolValues);
+    case K::Symbol:
+        return pSymbolValues[rRecord.operands[0]];
+    default:
+        return rRecord.constants[0];
+    }
+}
+
+/**
+* \brief Folds the records of a sum or product left to right in a loop,
+* so the depth of the closure tree does not grow with their number.
+*/
+template <class T, OpCode Op>
+T EvaluateNaryClosure(const Closure<T>* pClosures, const Closure<T>& rClosure,
+                      const T* pSymbolValues)
+{
+    const Closure<T>* pRecord = pClosures + rClosure.operands[0];
+    const Closure<T>* const pEnd = pRecord + rClosure.operands[1];
+    T value = LoadRecordOperand(pClosures, *pRecord, pSymbolValues);
+    for (++pRecord; pRecord != pEnd; ++pRecord)
+    {
+        value = ApplyBinary(Op, value, LoadRecordOperand(pClosures, *pRecord, pSymbolValues));
+    }
+    return value;
+}
+
+template <class T, OpCode Op, Accuracy Acc = Accuracy::Exact>
+typename Closure<T>::Function UnaryClosureFunction(ClosureOperand a)
+{
+    typedef ClosureOperand K;
+    static const typename Closure<T>::Function Functions[] =
+    {
+        &EvaluateUnaryClosure<T, Op, Acc, K::Closure>,
+        &EvaluateUnaryClosure<T, Op, Acc, K::Symbol>,
+        &EvaluateUnaryClosure<T, Op, Acc, K::Constant>
+    };
+    return Functions[static_cast<int>(a)];
+}
+
+/** \brief As UnaryClosureFunction(), for an opcode FastMath.h approximates. */
+template <class T, OpCode Op>
+typename Closure<T>::Function TranscendentalClosureFunction(Accuracy accuracy, ClosureOperand a)
+{
+    switch (accuracy)
+    {
+    case Accuracy::High: return UnaryClosureFunction<T, Op, Accuracy::High>(a);
+    case Accuracy::Medium: return UnaryClosureFunction<T, Op, Accuracy::Medium>(a);
+    case Accuracy::Low: return UnaryClosureFunction<T, Op, Accuracy::Low>(a);
+    default: return UnaryClosureFunction<T, Op>(a);
+    }
+}
+
+template <class T, OpCode Op>
+typename Closure<T>::Function BinaryClosureFunction(ClosureOperand a, ClosureOperand b)
+{
+    typedef ClosureOperand K;
+    static const typename Closure<T>::Function Functions[3][3] =
+    {
+        {
+            &EvaluateBinaryClosure<T, Op, K::Closure, K::Closure>,
+            &EvaluateBinaryClosure<T, Op, K::Closure, K::Symbol>,
+            &EvaluateBinaryClosure<T, Op, K::Closure, K::Constant>
+        },
+        {
+            &EvaluateBinaryClosure<T, Op, K::Symbol, K::Closure>,
+            &EvaluateBinaryClosure<T, Op, K::Symbol, K::Symbol>,
+            &EvaluateBinaryClosure<T, Op, K::Symbol, K::Constant>
+        },
+        {
+            &EvaluateBinaryClosure<T, Op, K::Constant, K::Closure>,
+            &EvaluateBinaryClosure<T, Op, K::Constant, K::Symbol>,
+            &EvaluateBinaryClosure<T, Op, K::Constant, K::Constant>
+        }
+    };
+    return Functions[static_cast<int>(a)][static_cast<int>(b)];
+}
+
+/** \brief Function specialized for the unary opcode, accuracy and operand kind. */
+template <class T>
+typename Closure<T>::Function UnaryClosureFunction(OpCode opCode, Accuracy accuracy,
+                                                   ClosureOperand a)
+{
+    switch (opCode)
+    {
+    case OpCode::Sin: return TranscendentalClosureFunction<T, OpCode::Sin>(accuracy, a);
+    case OpCode::Cos: return TranscendentalClosureFunction<T, OpCode::Cos>(accuracy, a);
+    case OpCode::Tan: return TranscendentalClosureFunction<T, OpCode::Tan>(accuracy, a);
+    case OpCode::Identity: return UnaryClosureFunction<T, OpCode::Identity>(a);
+    case OpCode::Abs: return UnaryClosureFunction<T, OpCode::Abs>(a);
+    case OpCode::Negate: return UnaryClosureFunction<T, OpCode::Negate>(a);
+    case OpCode::Exp: return TranscendentalClosureFunction<T, OpCode::Exp>(accuracy, a);
+    case OpCode::Ln: return TranscendentalClosureFunction<T, OpCode::Ln>(accuracy, a);
+    case OpCode::Log10: return TranscendentalClosureFunction<T, OpCode::Log10>(accuracy, a);
+    case OpCode::Sqrt: return UnaryClosureFunction<T, OpCode::Sqrt>(a);
+    case OpCode::Square: return UnaryClosureFunction<T, OpCode::Square>(a);
+    case OpCode::Cube: return UnaryClosureFunction<T, OpCode::Cube>(a);
+    case OpCode::Reciprocal: return UnaryClosureFunction<T, OpCode::Reciprocal>(a);
+    default: break;
+    }
+    assert(0);
+    return nullptr;
+}
+
+/** \brief Function specialized for the binary opcode and operand kinds. */
+template <class T>
+typename Closure<T>::Function BinaryClosureFunction(OpCode opCode, ClosureOperand a,
+                                                    ClosureOperand b)
+{
+    switch (opCode)
+    {
+    case OpCode::Add: return BinaryClosureFunction<T, OpCode::Add>(a, b);
+    case OpCode::Subtract: return BinaryClosureFunction<T, OpCode::Subtract>(a, b);
+    case OpCode::Multiply: return BinaryClosureFunction<T, OpCode::Multiply>(a, b);
+    case OpCode::Divide: return BinaryClosureFunction<T, OpCode::Divide>(a, b);
+    case OpCode::Pow: return BinaryClosureFunction<T, OpCode::Pow>(a, b);
+    default: break;
+    }
+    assert(0);
+    return nullptr;
+}
+
+/** \brief Function folding the records of a sum or product. */
+template <class T>
+typename Closure<T>::Function NaryClosureFunction(OpCode opCode)
+{
+    switch (opCode)
+    {
+    case OpCode::Add: return &EvaluateNaryClosure<T, OpCode::Add>;
+    case OpCode::Multiply: return &EvaluateNaryClosure<T, OpCode::Multiply>;
+    default: break;
+    }
+    assert(0);
+    return nullptr;
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class ClosureEvaluator
+* \brief Expression compiled to a tree of closures, each a plain function
+* specialized for its operation and the kinds of its operands.
+*
+* A product of a symbol and a constant, say, is a single function reading
+* both directly, with no virtual calls, no dispatch on node types and no
+* intermediate stack. Compiling is a single pass filling one contiguous
+* array, cheap enough for formulas evaluated only some thousand times.
+*
+* Evaluation recurses once per level of the tree, so trees deeper than
+* MaxDepth are not compiled and leave the evaluator empty. Sums and
+* products wider than MaxChainedOperands loop over their operands, so
+* their width does not add to the depth. Symbols are
+* bound by position in the same order as Program; see symbols().
+*
+* The accuracy given to the constructor picks the approximations of
+* FastMath.h for the transcendental functions into their closures.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class ClosureEvaluator
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::SymbolNode<T, Alloc> SymbolNode;
+    typedef Internal::ConstantNode<T, Alloc> ConstantNode;
+    typedef Internal::Closure<T> Closure;
+    typedef Internal::ClosureOperand ClosureOperand;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef typename ExpressionType::ValueMap ValueMap;
+
+    /** \brief Deepest tree compiled, deeper ones would risk the call stack. */
+    static const std::size_t MaxDepth = 4096;
+
+    /** \brief Widest sum or product folded by a chain of closures, not a loop. */
+    static const std::size_t MaxChainedOperands = 8;
+
+    /** \brief Compiles the expression, approximating sin, cos, tan, exp, ln and log10 as allowed. */
+    explicit ClosureEvaluator(const ExpressionType& rExpression,
+                              Accuracy accuracy = Accuracy::Exact);
+
+    /**
+    * \brief Evaluates the expression with symbol values given by position.
+    * \param pSymbolValues One value per entry of symbols(), in that order.
+    */
+    T evaluate(const T* pSymbolValues) const
+    {
+        assert(!empty());
+        const Closure& rHead = mClosures.back();
+        return rHead.pFunction(mClosures.data(), rHead, pSymbolValues);
+    }
+
+    /** \brief Evaluates the expression, looking the symbols up in the map. */
+    T evaluate(const ValueMap& rValues) const;
+
+    /** \brief Symbol names in positional order. */
+    const std::vector<std::string>& symbols() const
+    {
+        return mSymbols;
+    }
+
+    /**
+    * \brief Number of closures, one per operation and one per operand of a
+    * sum or product wider than MaxChainedOperands.
+    */
+    std::size_t closureCount() const
+    {
+        return mClosures.size();
+    }
+
+    /** \brief True if the expression was empty or too deep to compile. */
+    bool empty() const
+    {
+        return mClosures.empty();
+    }
+
+    Accuracy accuracy() const
+    {
+        return mAccuracy;
+    }
+
+    std::size_t memoryUsage() const;
+
+private:
+    /** \brief Operand of a closure being built. */
+    struct Operand
+    {
+        ClosureOperand kind;
+        std::uint32_t index;
+        T constant;
+        std::size_t depth;
+    };
+
+    Operand emitUnary(Internal::OpCode opCode, const Operand& rA);
+    Operand emitBinary(Internal::OpCode opCode, const Operand& rA, const Operand& rB);
+    Operand emitNary(Internal::OpCode opCode, const Operand* pOperands, std::size_t count);
+
+    std::vector<Closure> mClosures;
+    std::vector<std::string> mSymbols;
+    Accuracy mAccuracy;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::size_t ClosureEvaluator<T, Alloc>::MaxDepth;
+
+template <class T, class Alloc>
+const std::size_t ClosureEvaluator<T, Alloc>::MaxChainedOperands;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+ClosureEvaluator<T, Alloc>::ClosureEvaluator(const ExpressionType& rExpression,
+                                             Accuracy accuracy)
+    : mAccuracy(accuracy)
+{
+    using namespace Internal;
+
+    const TermNode* pHead = rExpression.mExpressionTree.head();
+    if (pHead == nullptr)
+    {
+        return;
+    }
+
+    rExpression.canonicalHash(mSymbols);
+    std::unordered_map<std::string, std::uint32_t> symbolSlots;
+    for (std::size_t i = 0; i < mSymbols.size(); ++i)
+    {
+        symbolSlots[mSymbols[i]] = static_cast<std::uint32_t>(i);
+    }
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    // Post-order, so every closure follows those of its operands and the
+    // head comes last. Operands are left on a stack for the operator.
+    std::vector<Frame> nodeStack;
+    std::vector<Operand> operands;
+    const Frame head = { pHead, pHead->operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const TermNode* pNode = rFrame.pNode;
+        const std::size_t first = operands.size() - rFrame.operandCount;
+        Operand result = { ClosureOperand::Constant, 0, T(), 0 };
+        if (pNode->isSymbol())
+        {
+            result.kind = ClosureOperand::Symbol;
+            result.index = symbolSlots[static_cast<const SymbolNode*>(pNode)->GetSymbol().toString()];
+        }
+        else if (!pNode->isOperator())
+        {
+            result.constant = static_cast<const ConstantNode*>(pNode)->GetValue();
+        }
+        else if (const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode))
+        {
+            // Folded left to right, as Expression does. Short ones are
+            // chained, which saves the loop, wider ones loop.
+            const OpCode opCode = ToOpCode(pNaryOp->GetOperator());
+            if (rFrame.operandCount > MaxChainedOperands)
+            {
+                result = emitNary(opCode, operands.data() + first, rFrame.operandCount);
+            }
+            else
+            {
+                result = operands[first];
+                for (std::size_t i = first + 1; i < operands.size(); ++i)
+                {
+                    result = emitBinary(opCode, result, operands[i]);
+                }
+            }
+        }
+        else if (const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode))
+        {
+            result = emitBinary(ToOpCode(pBinaryOp->GetOperator()),
+                                operands[first], operands[first + 1]);
+        }
+        else
+        {
+            result = emitUnary(ToOpCode(static_cast<const UnaryOperatorNode*>(pNode)->GetOperator()),
+                               operands[first]);
+        }
+
+        if (result.depth > MaxDepth)
+        {
+            mClosures.clear();
+            mClosures.shrink_to_fit();
+            return;
+        }
+        operands.erase(operands.begin() + first, operands.end());
+        operands.push_back(result);
+        nodeStack.pop_back();
+    }
+
+    // A lone symbol or constant still needs a closure to call.
+    if (operands.back().kind != ClosureOperand::Closure)
+    {
+        emitUnary(OpCode::Identity, operands.back());
+    }
+    mClosures.shrink_to_fit();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename ClosureEvaluator<T, Alloc>::Operand
+ClosureEvaluator<T, Alloc>::emitUnary(Internal::OpCode opCode, const Operand& rA)
+{
+    Closure closure;
+    closure.pFunction = Internal::UnaryClosureFunction<T>(opCode, mAccuracy, rA.kind);
+    closure.operands[0] = rA.index;
+    closure.operands[1] = 0;
+    closure.constants[0] = rA.constant;
+    closure.constants[1] = T();
+
+    const Operand result = { ClosureOperand::Closure, static_cast<std::uint32_t>(mClosures.size()),
+                             T(), rA.depth + 1
+                           };
+    mClosures.push_back(closure);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename ClosureEvaluator<T, Alloc>::Operand
+ClosureEvaluator<T, Alloc>::emitBinary(Internal::OpCode opCode, const Operand& rA,
+                                       const Operand& rB)
+{
+    Closure closure;
+    closure.pFunction = Internal::BinaryClosureFunction<T>(opCode, rA.kind, rB.kind);
+    closure.operands[0] = rA.index;
+    closure.operands[1] = rB.index;
+    closure.constants[0] = rA.constant;
+    closure.constants[1] = rB.constant;
+
+    const Operand result = { ClosureOperand::Closure, static_cast<std::uint32_t>(mClosures.size()),
+                             T(), std::max(rA.depth, rB.depth) + 1
+                           };
+    mClosures.push_back(closure);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename ClosureEvaluator<T, Alloc>::Operand
+ClosureEvaluator<T, Alloc>::emitNary(Internal::OpCode opCode, const Operand* pOperands,
+                                     std::size_t count)
+{
+    const std::uint32_t first = static_cast<std::uint32_t>(mClosures.size());
+    std::size_t depth = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Closure record;
+        record.pFunction = nullptr;
+        record.operands[0] = pOperands[i].index;
+        record.operands[1] = static_cast<std::uint32_t>(pOperands[i].kind);
+        record.constants[0] = pOperands[i].constant;
+        record.constants[1] = T();
+        mClosures.push_back(record);
+        depth = std::max(depth, pOperands[i].depth);
+    }
+
+    Closure closure;
+    closure.pFunction = Internal::NaryClosureFunction<T>(opCode);
+    closure.operands[0] = first;
+    closure.operands[1] = static_cast<std::uint32_t>(count);
+    closure.constants[0] = T();
+    closure.constants[1] = T();
+
+    const Operand result = { ClosureOperand::Closure, static_cast<std::uint32_t>(mClosures.size()),
+                             T(), depth + 1
+                           };
+    mClosures.push_back(closure);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T ClosureEvaluator<T, Alloc>::evaluate(const ValueMap& rValues) const
+{
+    std::vector<T> symbolValues;
+    symbolValues.reserve(mSymbols.size());
+    for (const std::string& rSymbol : mSymbols)
+    {
+        symbolValues.push_back(rValues.at(rSymbol));
+    }
+    return evaluate(symbolValues.data());
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t ClosureEvaluator<T, Alloc>::memoryUsage() const
+{
+    std::size_t usage = sizeof(ClosureEvaluator);
+    usage += mClosures.capacity() * sizeof(Closure);
+    for (const std::string& rSymbol : mSymbols)
+    {
+        usage += sizeof(std::string) + rSymbol.capacity();
+    }
+    return usage;
+}
+
+} // namespace Emblem
@@ -0,0 +1,155 @@
+/**
+* \file CostModel.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace Emblem
+{
+
+/**
+* \struct CostModel
+* \brief Relative cost of each kind of operation, and how much effort
+* Expression::minimizeOperations() may spend.
+*
+* Costs are in arbitrary units; only their ratios matter. The defaults
+* approximate scalar double precision latency on current desktop CPUs.
+*/
+struct CostModel
+{
+    CostModel()
+        : addition(1.0), multiplication(1.0), division(4.0), power(40.0),
+          squareRoot(4.0), transcendental(20.0), other(0.5),
+          maxFactoringDepth(16), maxSumTerms(256)
+    {
+    }
+
+    double addition;
+    double multiplication;
+    /** \brief Division and reciprocal. */
+    double division;
+    double power;
+    double squareRoot;
+    /** \brief sin, cos, tan, exp, ln and log10. */
+    double transcendental;
+    /** \brief Negation, absolute value and identity. */
+    double other;
+
+    /**
+    * \brief Deepest nesting of common factors pulled out of one sum.
+    * Zero only collects like terms.
+    */
+    std::size_t maxFactoringDepth;
+
+    /** \brief Sums with more terms than this are left as they are. */
+    std::size_t maxSumTerms;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \struct OperationCount
+* \brief Number of operations of each kind needed to evaluate an expression.
+*/
+struct OperationCount
+{
+    OperationCount()
+        : additions(0), multiplications(0), divisions(0), powers(0),
+          squareRoots(0), transcendentals(0), others(0)
+    {
+    }
+
+    /** \brief Additions and subtractions. */
+    std::size_t additions;
+    /** \brief Multiplies, including those inside squares and cubes. */
+    std::size_t multiplications;
+    std::size_t divisions;
+    std::size_t powers;
+    std::size_t squareRoots;
+    std::size_t transcendentals;
+    std::size_t others;
+
+    std::size_t total() const
+    {
+        return additions + multiplications + divisions + powers +
+               squareRoots + transcendentals + others;
+    }
+
+    double cost(const CostModel& rCostModel) const
+    {
+        return additions * rCostModel.addition +
+               multiplications * rCostModel.multiplication +
+               divisions * rCostModel.division +
+               powers * rCostModel.power +
+               squareRoots * rCostModel.squareRoot +
+               transcendentals * rCostModel.transcendental +
+               others * rCostModel.other;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Operation counts before and after an optimization pass. */
+struct OptimizationReport
+{
+    OperationCount before;
+    OperationCount after;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \struct BackendCosts
+* \brief Time each evaluation backend takes, in nanoseconds, by which
+* Evaluator chooses between them.
+*
+* The defaults approximate double precision on current desktop CPUs;
+* Evaluator::CalibrateCosts() measures the host instead.
+*/
+struct BackendCosts
+{
+    BackendCosts()
+        : treeWalkOperation(40.0), closureOperation(7.5), closureCompileOperation(250.0),
+          programOperation(7.0), programCompileOperation(450.0),
+          batchOperation(2.5), batchCall(2000.0), batchCompileOperation(250.0),
+          parallelCall(20000.0)
+    {
+    }
+
+    /** \brief Walking the tree, per operation. */
+    double treeWalkOperation;
+    /** \brief Running a ClosureEvaluator, per operation. */
+    double closureOperation;
+    /** \brief Compiling a ClosureEvaluator, per operation. */
+    double closureCompileOperation;
+    /** \brief Running a Program, per operation. */
+    double programOperation;
+    /** \brief Compiling a Program, per operation. */
+    double programCompileOperation;
+    /** \brief Running a BatchEvaluator, per operation and row. */
+    double batchOperation;
+    /** \brief Fixed cost of one BatchEvaluator call. */
+    double batchCall;
+    /** \brief Building a BatchEvaluator, per operation. */
+    double batchCompileOperation;
+    /** \brief Splitting the tree and scheduling tasks for one parallel call. */
+    double parallelCall;
+};
+
+} // namespace Emblem
@@ -0,0 +1,685 @@
+/**
+* \file Evaluator.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "BatchEvaluator.h"
+#include "ClosureEvaluator.h"
+#include "EvaluatorOptions.h"
+#include "Expression.h"
+#include "ParallelOptions.h"
+#include "Program.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Emblem
+{
+
+/**
+* \class Evaluator
+* \brief Evaluates an expression with whichever backend the cost model
+* predicts to be fastest for the expected workload.
+*
+* A backend's predicted cost is the time to compile it plus, for every
+* expected call, its time per call for the size of the expression and
+* the rows per call. Any backend serves every kind of call: scalar calls
+* on the batch backend are one-row batches, and batch calls on the others
+* loop over the rows.
+*
+* Like a tiered JIT, the choice is revisited once the calls reach the hot
+* call count, and again every time they double, assuming as many calls of
+* the observed batch size are still to come. A backend that has to be
+* compiled is built in the background from a copy of the expression, and
+* calls keep using the current backend until it is ready.
+*
+* Symbols are bound by position in the same order as Program and
+* BatchEvaluator; see symbols(). An Evaluator must not be called from
+* several threads at once.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class Evaluator
+{
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef typename ExpressionType::ValueMap ValueMap;
+    typedef Emblem::ClosureEvaluator<T, Alloc> ClosureEvaluatorType;
+    typedef Emblem::Program<T, Alloc> ProgramType;
+    typedef Emblem::BatchEvaluator<T, Alloc> BatchEvaluatorType;
+    typedef Emblem::BatchInput<T> BatchInput;
+
+    /** \brief Selects a backend for the workload and compiles it. */
+    explicit Evaluator(const ExpressionType& rExpression,
+                       const EvaluatorOptions& rOptions = EvaluatorOptions());
+
+    /** \brief Evaluates the expression, looking the symbols up in the map. */
+    T evaluate(const ValueMap& rValues);
+
+    /**
+    * \brief Evaluates the expression with symbol values given by position.
+    * \param pSymbolValues One value per entry of symbols(), in that order.
+    */
+    T evaluate(const T* pSymbolValues);
+
+    /** \brief Evaluates every row of a batch, see BatchEvaluator::evaluate(). */
+    void evaluate(const BatchInput* pInputs, std::size_t rowCount, T* pResults);
+
+    EvaluationBackend backend() const
+    {
+        return mBackend;
+    }
+
+    /** \brief Symbol names in positional order. */
+    const std::vector<std::string>& symbols() const
+    {
+        return mSymbols;
+    }
+
+    std::size_t callCount() const
+    {
+        return mCallCount;
+    }
+
+    /** \brief Whether a faster backend is being compiled in the background. */
+    bool isCompiling() const
+    {
+        return static_cast<bool>(mpPendingTier);
+    }
+
+    /** \brief Waits for a background compile and switches to its backend. */
+    void waitForCompile();
+
+    /** \brief Predicted time to compile the backend, in nanoseconds. */
+    static double CompileCost(EvaluationBackend backend, std::size_t operationCount,
+                              const BackendCosts& rCosts);
+
+    /**
+    * \brief Predicted time of one call, in nanoseconds. Infinite for the
+    * parallel backend without a second thread, or on trees of fewer nodes
+    * than ParallelOptions::taskThreshold allows to split.
+    */
+    static double CallCost(EvaluationBackend backend, std::size_t operationCount,
+                           std::size_t nodeCount, std::size_t batchSize,
+                           std::size_t threadCount, const BackendCosts& rCosts);
+
+    /** \brief Backend with the least predicted cost for the workload. */
+    static EvaluationBackend SelectBackend(std::size_t operationCount, std::size_t nodeCount,
+                                           std::size_t calls, std::size_t batchSize,
+                                           std::size_t threadCount, const BackendCosts& rCosts);
+
+    /**
+    * \brief Measures the costs of the backends on this host, taking some
+    * milliseconds. The parallel call cost is left at its default.
+    */
+    static BackendCosts CalibrateCosts();
+
+private:
+    Evaluator(const Evaluator&);
+    Evaluator& operator=(const Evaluator&);
+
+    /** \brief Backend compiled away from the evaluator. */
+    struct Tier
+    {
+        Tier(EvaluationBackend tierBackend, const ExpressionType& rExpression,
+             Accuracy tierAccuracy)
+            : backend(tierBackend), expression(rExpression), accuracy(tierAccuracy),
+              isReady(false)
+        {
+        }
+
+        EvaluationBackend backend;
+        ExpressionType expression;
+        Accuracy accuracy;
+        std::unique_ptr<ClosureEvaluatorType> pClosureEvaluator;
+        std::unique_ptr<ProgramType> pProgram;
+        std::unique_ptr<BatchEvaluatorType> pBatchEvaluator;
+        std::atomic<bool> isReady;
+    };
+
+    static void Compile(Tier& rTier);
+
+    template <class Function>
+    static double MinimumTime(Function function);
+
+    ThreadPool& threadPool() const
+    {
+        return (mOptions.pThreadPool != nullptr) ? *mOptions.pThreadPool : ThreadPool::Instance();
+    }
+
+    bool isCompiled(EvaluationBackend backend) const;
+    void adopt(Tier& rTier);
+    void countCall(std::size_t rowCount);
+    void reviewBackend();
+    T evaluateRow(const T* pSymbolValues);
+
+    ExpressionType mExpression;
+    EvaluatorOptions mOptions;
+    std::vector<std::string> mSymbols;
+    std::size_t mOperationCount;
+    std::size_t mNodeCount;
+    EvaluationBackend mBackend;
+    /** \brief False once closures failed to compile, the tree being too deep. */
+    bool mCanUseClosures;
+    std::unique_ptr<ClosureEvaluatorType> mpClosureEvaluator;
+    std::unique_ptr<ProgramType> mpProgram;
+    std::unique_ptr<BatchEvaluatorType> mpBatchEvaluator;
+    std::shared_ptr<Tier> mpPendingTier;
+    std::size_t mCallCount;
+    std::size_t mRowCount;
+    std::size_t mNextReview;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Evaluator<T, Alloc>::Evaluator(const ExpressionType& rExpression,
+                               const EvaluatorOptions& rOptions)
+    : mExpression(rExpression), mOptions(rOptions),
+      mOperationCount(rExpression.operationCount().total()),
+      mNodeCount(rExpression.nodeCount()),
+      mBackend(EvaluationBackend::TreeWalk), mCanUseClosures(true),
+      mCallCount(0), mRowCount(0), mNextReview(rOptions.hotCallCount)
+{
+    mExpression.canonicalHash(mSymbols);
+
+    mBackend = SelectBackend(mOperationCount, mNodeCount, mOptions.expectedCalls,
+                             mOptions.batchSize, threadPool().threadCount(), mOptions.costs);
+    if (mBackend == EvaluationBackend::Closure)
+    {
+        mpClosureEvaluator.reset(new ClosureEvaluatorType(mExpression, mOptions.accuracy));
+        if (mpClosureEvaluator->empty())
+        {
+            mpClosureEvaluator.reset();
+            mCanUseClosures = false;
+            mBackend = EvaluationBackend::TreeWalk;
+        }
+    }
+    else if (mBackend == EvaluationBackend::Program)
+    {
+        mpProgram.reset(new ProgramType(mExpression));
+        mpProgram->setAccuracy(mOptions.accuracy);
+    }
+    else if (mBackend == EvaluationBackend::Batch)
+    {
+        mpBatchEvaluator.reset(new BatchEvaluatorType(mExpression));
+        mpBatchEvaluator->setAccuracy(mOptions.accuracy);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Evaluator<T, Alloc>::Compile(Tier& rTier)
+{
+    if (rTier.backend == EvaluationBackend::Closure)
+    {
+        rTier.pClosureEvaluator.reset(new ClosureEvaluatorType(rTier.expression, rTier.accuracy));
+    }
+    else if (rTier.backend == EvaluationBackend::Program)
+    {
+        rTier.pProgram.reset(new ProgramType(rTier.expression));
+    }
+    else if (rTier.backend == EvaluationBackend::Batch)
+    {
+        rTier.pBatchEvaluator.reset(new BatchEvaluatorType(rTier.expression));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Evaluator<T, Alloc>::adopt(Tier& rTier)
+{
+    if (rTier.pClosureEvaluator && rTier.pClosureEvaluator->empty())
+    {
+        mCanUseClosures = false;
+        return;
+    }
+
+    mBackend = rTier.backend;
+    if (rTier.pClosureEvaluator)
+    {
+        mpClosureEvaluator = std::move(rTier.pClosureEvaluator);
+    }
+    if (rTier.pProgram)
+    {
+        mpProgram = std::move(rTier.pProgram);
+        mpProgram->setAccuracy(mOptions.accuracy);
+    }
+    if (rTier.pBatchEvaluator)
+    {
+        mpBatchEvaluator = std::move(rTier.pBatchEvaluator);
+        mpBatchEvaluator->setAccuracy(mOptions.accuracy);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool Evaluator<T, Alloc>::isCompiled(EvaluationBackend backend) const
+{
+    switch (backend)
+    {
+    case EvaluationBackend::Closure: return static_cast<bool>(mpClosureEvaluator);
+    case EvaluationBackend::Program: return static_cast<bool>(mpProgram);
+    case EvaluationBackend::Batch: return static_cast<bool>(mpBatchEvaluator);
+    default: return true;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+double Evaluator<T, Alloc>::CompileCost(
+    EvaluationBackend backend, std::size_t operationCount, const BackendCosts& rCosts)
+{
+    const double operations = static_cast<double>(operationCount);
+    switch (backend)
+    {
+    case EvaluationBackend::Closure: return operations * rCosts.closureCompileOperation;
+    case EvaluationBackend::Program: return operations * rCosts.programCompileOperation;
+    case EvaluationBackend::Batch: return operations * rCosts.batchCompileOperation;
+    default: return 0.0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+double Evaluator<T, Alloc>::CallCost(
+    EvaluationBackend backend, std::size_t operationCount, std::size_t nodeCount,
+    std::size_t batchSize, std::size_t threadCount, const BackendCosts& rCosts)
+{
+    const double operations = static_cast<double>(operationCount);
+    const double rows = static_cast<double>(std::max<std::size_t>(batchSize, 1));
+    switch (backend)
+    {
+    case EvaluationBackend::TreeWalk:
+        return rows * operations * rCosts.treeWalkOperation;
+    case EvaluationBackend::Closure:
+        return rows * operations * rCosts.closureOperation;
+    case EvaluationBackend::Program:
+        return rows * operations * rCosts.programOperation;
+    case EvaluationBackend::Batch:
+        return rCosts.batchCall + rows * operations * rCosts.batchOperation;
+    case EvaluationBackend::Parallel:
+        // The split is decided on nodes, leaves included, as in ParallelEvaluation.
+        if ((threadCount < 2) || (nodeCount < 2 * ParallelOptions().taskThreshold))
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        return rows * (rCosts.parallelCall +
+                       operations * rCosts.treeWalkOperation / static_cast<double>(threadCount));
+    }
+    assert(0);
+    return std::numeric_limits<double>::infinity();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+EvaluationBackend Evaluator<T, Alloc>::SelectBackend(
+    std::size_t operationCount, std::size_t nodeCount, std::size_t calls,
+    std::size_t batchSize, std::size_t threadCount, const BackendCosts& rCosts)
+{
+    static const EvaluationBackend Backends[] =
+    {
+        EvaluationBackend::TreeWalk, EvaluationBackend::Closure, EvaluationBackend::Program,
+        EvaluationBackend::Batch, EvaluationBackend::Parallel
+    };
+
+    EvaluationBackend best = EvaluationBackend::TreeWalk;
+    double bestCost = std::numeric_limits<double>::infinity();
+    for (EvaluationBackend backend : Backends)
+    {
+        const double cost = CompileCost(backend, operationCount, rCosts) +
+                            static_cast<double>(calls) *
+                            CallCost(backend, operationCount, nodeCount, batchSize,
+                                     threadCount, rCosts);
+        if (cost < bestCost)
+        {
+            best = backend;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Evaluator<T, Alloc>::countCall(std::size_t rowCount)
+{
+    if (mpPendingTier && mpPendingTier->isReady.load(std::memory_order_acquire))
+    {
+        adopt(*mpPendingTier);
+        mpPendingTier.reset();
+    }
+
+    ++mCallCount;
+    mRowCount += rowCount;
+    if ((mOptions.hotCallCount != 0) && (mCallCount == mNextReview))
+    {
+        mNextReview *= 2;
+        reviewBackend();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Evaluator<T, Alloc>::reviewBackend()
+{
+    static const EvaluationBackend Backends[] =
+    {
+        EvaluationBackend::TreeWalk, EvaluationBackend::Closure, EvaluationBackend::Program,
+        EvaluationBackend::Batch, EvaluationBackend::Parallel
+    };
+
+    if (mpPendingTier)
+    {
+        return;
+    }
+
+    // Backends already compiled cost only their calls.
+    const std::size_t batchSize = std::max<std::size_t>(mRowCount / mCallCount, 1);
+    const std::size_t threadCount = threadPool().threadCount();
+    EvaluationBackend best = mBackend;
+    double bestCost = std::numeric_limits<double>::infinity();
+    for (EvaluationBackend backend : Backends)
+    {
+        if ((backend == EvaluationBackend::Closure) && !mCanUseClosures)
+        {
+            continue;
+        }
+        double cost = static_cast<double>(mCallCount) *
+                      CallCost(backend, mOperationCount, mNodeCount, batchSize, threadCount,
+                               mOptions.costs);
+        if (!isCompiled(backend))
+        {
+            cost += CompileCost(backend, mOperationCount, mOptions.costs);
+        }
+        if ((cost < bestCost) || ((cost == bestCost) && (backend == mBackend)))
+        {
+            best = backend;
+            bestCost = cost;
+        }
+    }
+
+    if (isCompiled(best))
+    {
+        mBackend = best;
+        return;
+    }
+
+    const std::shared_ptr<Tier> pTier = std::make_shared<Tier>(best, mExpression, mOptions.accuracy);
+    mpPendingTier = pTier;
+    threadPool().submit([pTier]()
+    {
+        Compile(*pTier);
+        pTier->isReady.store(true, std::memory_order_release);
+    });
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Evaluator<T, Alloc>::waitForCompile()
+{
+    if (!mpPendingTier)
+    {
+        return;
+    }
+
+    // Helps with queued tasks, the compile may be behind them.
+    while (!mpPendingTier->isReady.load(std::memory_order_acquire))
+    {
+        if (!threadPool().runPendingTask())
+        {
+            std::this_thread::yield();
+        }
+    }
+    adopt(*mpPendingTier);
+    mpPendingTier.reset();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Evaluator<T, Alloc>::evaluate(const ValueMap& rValues)
+{
+    countCall(1);
+    switch (mBackend)
+    {
+    case EvaluationBackend::TreeWalk:
+        return mExpression.evaluate(rValues);
+    case EvaluationBackend::Closure:
+        return mpClosureEvaluator->evaluate(rValues);
+    case EvaluationBackend::Program:
+        return mpProgram->evaluate(rValues);
+    default:
+        break;
+    }
+
+    std::vector<T> symbolValues;
+    symbolValues.reserve(mSymbols.size());
+    for (const std::string& rSymbol : mSymbols)
+    {
+        symbolValues.push_back(rValues.at(rSymbol));
+    }
+    return evaluateRow(symbolValues.data());
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Evaluator<T, Alloc>::evaluate(const T* pSymbolValues)
+{
+    countCall(1);
+    return evaluateRow(pSymbolValues);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Evaluator<T, Alloc>::evaluate(const BatchInput* pInputs, std::size_t rowCount, T* pResults)
+{
+    countCall(rowCount);
+    if (mBackend == EvaluationBackend::Batch)
+    {
+        mpBatchEvaluator->evaluate(pInputs, rowCount, pResults);
+        return;
+    }
+
+    std::vector<T> symbolValues(mSymbols.size());
+    for (std::size_t row = 0; row < rowCount; ++row)
+    {
+        for (std::size_t i = 0; i < mSymbols.size(); ++i)
+        {
+            const BatchInput& rInput = pInputs[i];
+            symbolValues[i] = rInput.isUniform()
+                              ? rInput.value
+                              : *reinterpret_cast<const T*>(
+                                  reinterpret_cast<const char*>(rInput.pData) +
+                                  static_cast<std::ptrdiff_t>(row) * rInput.stride);
+        }
+        pResults[row] = evaluateRow(symbolValues.data());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Evaluator<T, Alloc>::evaluateRow(const T* pSymbolValues)
+{
+    if (mBackend == EvaluationBackend::Closure)
+    {
+        return mpClosureEvaluator->evaluate(pSymbolValues);
+    }
+    if (mBackend == EvaluationBackend::Program)
+    {
+        return mpProgram->evaluate(pSymbolValues);
+    }
+    if (mBackend == EvaluationBackend::Batch)
+    {
+        std::vector<BatchInput> inputs;
+        inputs.reserve(mSymbols.size());
+        for (std::size_t i = 0; i < mSymbols.size(); ++i)
+        {
+            inputs.push_back(BatchInput::Uniform(pSymbolValues[i]));
+        }
+        T result = T();
+        mpBatchEvaluator->evaluate(inputs.data(), 1, &result);
+        return result;
+    }
+
+    ValueMap values;
+    for (std::size_t i = 0; i < mSymbols.size(); ++i)
+    {
+        values[mSymbols[i]] = pSymbolValues[i];
+    }
+    if (mBackend == EvaluationBackend::Parallel)
+    {
+        ParallelOptions options;
+        options.pThreadPool = &threadPool();
+        return mExpression.evaluateParallel(values, options);
+    }
+    return mExpression.evaluate(values);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+template <class Function>
+double Evaluator<T, Alloc>::MinimumTime(Function function)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::duration best = Clock::duration::max();
+    for (int repeat = 0; repeat < 3; ++repeat)
+    {
+        const Clock::time_point start = Clock::now();
+        function();
+        best = std::min(best, Clock::now() - start);
+    }
+    return static_cast<double>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(best).count());
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+BackendCosts Evaluator<T, Alloc>::CalibrateCosts()
+{
+    const std::size_t CompileCount = 8;
+    const std::size_t CallCount = 512;
+    const std::size_t RowCount = 1024;
+
+    // Arithmetic mixed with transcendentals, like typical formulas.
+    const typename ExpressionType::Symbol x("x"), y("y");
+    ExpressionType expression = x * y;
+    for (int i = 1; i <= 16; ++i)
+    {
+        expression = std::move(expression) + sin(x * T(i) + y) * (y - T(i)) / (x * x + T(i));
+    }
+    const double operations = static_cast<double>(expression.operationCount().total());
+
+    const ClosureEvaluatorType closureEvaluator(expression);
+    const ProgramType program(expression);
+    const BatchEvaluatorType batchEvaluator(expression);
+    const std::vector<std::string>& symbols = program.symbols();
+    ValueMap values;
+    values[symbols[0]] = T(0.5);
+    values[symbols[1]] = T(1.5);
+    const T symbolValues[] = { T(0.5), T(1.5) };
+    std::vector<T> column(RowCount, T(0.5));
+    std::vector<T> results(RowCount);
+    const BatchInput columns[] = { BatchInput::Varying(column.data()), BatchInput::Varying(column.data()) };
+    const BatchInput uniforms[] = { BatchInput::Uniform(T(0.5)), BatchInput::Uniform(T(1.5)) };
+    volatile T sink = T();
+
+    BackendCosts costs;
+    costs.treeWalkOperation = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CallCount; ++i)
+        {
+            sink = expression.evaluate(values);
+        }
+    }) / (CallCount * operations);
+    costs.closureOperation = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CallCount; ++i)
+        {
+            sink = closureEvaluator.evaluate(symbolValues);
+        }
+    }) / (CallCount * operations);
+    costs.closureCompileOperation = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CompileCount; ++i)
+        {
+            const ClosureEvaluatorType compiled(expression);
+            sink = static_cast<T>(compiled.closureCount());
+        }
+    }) / (CompileCount * operations);
+    costs.programOperation = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CallCount; ++i)
+        {
+            sink = program.evaluate(symbolValues);
+        }
+    }) / (CallCount * operations);
+    costs.programCompileOperation = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CompileCount; ++i)
+        {
+            const ProgramType compiled(expression);
+            sink = static_cast<T>(compiled.stackSize());
+        }
+    }) / (CompileCount * operations);
+
+    costs.batchOperation = MinimumTime([&]()
+    {
+        batchEvaluator.evaluate(columns, RowCount, results.data());
+    }) / (RowCount * operations);
+    const double batchRowCall = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CallCount; ++i)
+        {
+            batchEvaluator.evaluate(uniforms, 1, results.data());
+        }
+    }) / CallCount;
+    costs.batchCall = std::max(batchRowCall - operations * costs.batchOperation, 0.0);
+    costs.batchCompileOperation = MinimumTime([&]()
+    {
+        for (std::size_t i = 0; i < CompileCount; ++i)
+        {
+            const BatchEvaluatorType compiled(expression);
+            sink = static_cast<T>(compiled.operationCount());
+        }
+    }) / (CompileCount * operations);
+    return costs;
+}
+
+} // namespace Emblem
@@ -0,0 +1,331 @@
+/**
+* \file EvaluatorCache.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "Expression.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+/** \brief Memory used by an evaluator, from its memoryUsage() if it has one. */
+template <class Evaluator>
+auto MemoryUsage(const Evaluator& rEvaluator, int)
+-> decltype(static_cast<std::size_t>(rEvaluator.memoryUsage()))
+{
+    return static_cast<std::size_t>(rEvaluator.memoryUsage());
+}
+
+template <class Evaluator>
+std::size_t MemoryUsage(const Evaluator&, long)
+{
+    return sizeof(Evaluator);
+}
+
+} // namespace Internal
+
+/**
+* \class EvaluatorCache
+* \brief Thread-safe LRU cache of evaluators keyed by expression structure.
+*
+* Expressions are keyed by their canonical hash, so a formula that only
+* differs from a cached one by the names of its symbols reuses the cached
+* evaluator. Evaluators must therefore take their symbol values
+* positionally; every lookup reports the symbols of the requested
+* expression in that positional order.
+*
+* Entries are evicted least recently used first once the memory budget is
+* exceeded. The size of an entry is taken from the evaluator's
+* memoryUsage() member when it has one, and sizeof otherwise, plus the
+* copy of the expression kept to tell hash collisions apart.
+* \tparam Evaluator Type of the cached evaluator.
+* \tparam T Type of evaluation in expression.
+*/
+template <class Evaluator, class T = double, class Alloc = std::allocator<T>>
+class EvaluatorCache
+{
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef std::shared_ptr<const Evaluator> EvaluatorPtr;
+
+    /**
+    * \brief Builds an evaluator for the expression whose positional
+    * arguments are the given symbols, in order.
+    */
+    typedef std::function<EvaluatorPtr(
+        const ExpressionType&, const std::vector<std::string>&)> Factory;
+
+    struct Result
+    {
+        /** \brief Cached or newly built evaluator, null if find() missed. */
+        EvaluatorPtr pEvaluator;
+        /** \brief Symbols of the requested expression in positional order. */
+        std::vector<std::string> symbols;
+        bool isHit;
+    };
+
+    struct Statistics
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::size_t entryCount;
+        std::size_t memoryUsage;
+        std::size_t memoryBudget;
+    };
+
+    static const std::size_t DefaultMemoryBudget = 64 * 1024 * 1024;
+
+    explicit EvaluatorCache(std::size_t memoryBudget = DefaultMemoryBudget)
+        : mMemoryBudget(memoryBudget), mMemoryUsage(0),
+          mHits(0), mMisses(0), mEvictions(0)
+    {
+    }
+
+    /** \brief Process-wide cache for this evaluator type. */
+    static EvaluatorCache& Instance()
+    {
+        static EvaluatorCache sCache;
+        return sCache;
+    }
+
+    /**
+    * \brief Returns the cached evaluator for the expression, building and
+    * caching one with the factory on a miss.
+    *
+    * The factory runs without the cache locked, so concurrent misses on
+    * the same structure may both build; the first one inserted is kept.
+    */
+    Result getOrCreate(const ExpressionType& rExpression, const Factory& rFactory);
+
+    /** \brief Looks up the expression without building on a miss. */
+    Result find(const ExpressionType& rExpression);
+
+    void setMemoryBudget(std::size_t memoryBudget)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mMemoryBudget = memoryBudget;
+        evict();
+    }
+
+    std::size_t memoryBudget() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMemoryBudget;
+    }
+
+    /** \brief Drops all entries. Counters are left untouched. */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEntries.clear();
+        mIndex.clear();
+        mMemoryUsage = 0;
+    }
+
+    Statistics statistics() const;
+
+private:
+    EvaluatorCache(const EvaluatorCache&);
+    EvaluatorCache& operator=(const EvaluatorCache&);
+
+    struct Entry
+    {
+        std::uint64_t key;
+        ExpressionType expression;
+        EvaluatorPtr pEvaluator;
+        std::size_t size;
+    };
+    typedef std::list<Entry> EntryList;
+
+    EvaluatorPtr lookup(std::uint64_t key, const ExpressionType& rExpression);
+    void evict();
+
+    /** \brief Memory held by the nodes of an expression's tree. */
+    static std::size_t TreeMemoryUsage(const ExpressionType& rExpression)
+    {
+        // Every node is counted as the largest kind of node.
+        const std::size_t nodeSize = std::max(
+                                         std::max(sizeof(Internal::SymbolNode<T, Alloc>),
+                                                  sizeof(Internal::NaryOperatorNode<T, Alloc>)),
+                                         std::max(sizeof(Internal::BinaryOperatorNode<T, Alloc>),
+                                                  sizeof(Internal::UnaryOperatorNode<T, Alloc>)));
+        return rExpression.nodeCount() * nodeSize;
+    }
+
+    mutable std::mutex mMutex;
+
+    // Most recently used first.
+    EntryList mEntries;
+    std::unordered_map<std::uint64_t, typename EntryList::iterator> mIndex;
+
+    std::size_t mMemoryBudget;
+    std::size_t mMemoryUsage;
+    std::uint64_t mHits;
+    std::uint64_t mMisses;
+    std::uint64_t mEvictions;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class Evaluator, class T, class Alloc>
+const std::size_t EvaluatorCache<Evaluator, T, Alloc>::DefaultMemoryBudget;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class Evaluator, class T, class Alloc>
+typename EvaluatorCache<Evaluator, T, Alloc>::Result
+EvaluatorCache<Evaluator, T, Alloc>::getOrCreate(
+    const ExpressionType& rExpression, const Factory& rFactory)
+{
+    Result result;
+    const std::uint64_t key = rExpression.canonicalHash(result.symbols);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        result.pEvaluator = lookup(key, rExpression);
+    }
+
+    result.isHit = (result.pEvaluator != nullptr);
+    if (result.isHit)
+    {
+        return result;
+    }
+
+    EvaluatorPtr pEvaluator = rFactory(rExpression, result.symbols);
+    if (pEvaluator == nullptr)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto indexIter = mIndex.find(key);
+    if (indexIter != mIndex.end())
+    {
+        Entry& rEntry = *indexIter->second;
+        if (rEntry.expression.isRenamingOf(rExpression))
+        {
+            // Another thread built the same structure first.
+            mEntries.splice(mEntries.begin(), mEntries, indexIter->second);
+            result.pEvaluator = rEntry.pEvaluator;
+            return result;
+        }
+
+        // Hash collision between different structures, newest wins.
+        mMemoryUsage -= rEntry.size;
+        mEntries.erase(indexIter->second);
+        mIndex.erase(indexIter);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.expression = rExpression;
+    entry.pEvaluator = pEvaluator;
+    entry.size = sizeof(Entry) + TreeMemoryUsage(rExpression) +
+                 Internal::MemoryUsage(*pEvaluator, 0);
+
+    mMemoryUsage += entry.size;
+    mEntries.push_front(std::move(entry));
+    mIndex[key] = mEntries.begin();
+    evict();
+
+    result.pEvaluator = pEvaluator;
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class Evaluator, class T, class Alloc>
+typename EvaluatorCache<Evaluator, T, Alloc>::Result
+EvaluatorCache<Evaluator, T, Alloc>::find(const ExpressionType& rExpression)
+{
+    Result result;
+    const std::uint64_t key = rExpression.canonicalHash(result.symbols);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    result.pEvaluator = lookup(key, rExpression);
+    result.isHit = (result.pEvaluator != nullptr);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class Evaluator, class T, class Alloc>
+typename EvaluatorCache<Evaluator, T, Alloc>::Statistics
+EvaluatorCache<Evaluator, T, Alloc>::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Statistics statistics;
+    statistics.hits = mHits;
+    statistics.misses = mMisses;
+    statistics.evictions = mEvictions;
+    statistics.entryCount = mEntries.size();
+    statistics.memoryUsage = mMemoryUsage;
+    statistics.memoryBudget = mMemoryBudget;
+    return statistics;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class Evaluator, class T, class Alloc>
+typename EvaluatorCache<Evaluator, T, Alloc>::EvaluatorPtr
+EvaluatorCache<Evaluator, T, Alloc>::lookup(
+    std::uint64_t key, const ExpressionType& rExpression)
+{
+    auto indexIter = mIndex.find(key);
+    if ((indexIter == mIndex.end()) ||
+            !indexIter->second->expression.isRenamingOf(rExpression))
+    {
+        ++mMisses;
+        return EvaluatorPtr();
+    }
+
+    ++mHits;
+    mEntries.splice(mEntries.begin(), mEntries, indexIter->second);
+    return indexIter->second->pEvaluator;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class Evaluator, class T, class Alloc>
+void EvaluatorCache<Evaluator, T, Alloc>::evict()
+{
+    while ((mMemoryUsage > mMemoryBudget) && !mEntries.empty())
+    {
+        const Entry& rEntry = mEntries.back();
+        mMemoryUsage -= rEntry.size;
+        mIndex.erase(rEntry.key);
+        mEntries.pop_back();
+        ++mEvictions;
+    }
+}
+
+} // namespace Emblem
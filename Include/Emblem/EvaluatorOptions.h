@@ -0,0 +1,83 @@
+/**
+* \file EvaluatorOptions.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Accuracy.h"
+#include "CostModel.h"
+
+#include <cstddef>
+
+namespace Emblem
+{
+
+class ThreadPool;
+
+/** \brief Ways Evaluator can evaluate an expression. */
+enum class EvaluationBackend
+{
+    /** \brief Expression::evaluate(), nothing to compile. */
+    TreeWalk,
+    /** \brief ClosureEvaluator, specialized closures that are cheap to compile. */
+    Closure,
+    /** \brief Program, a compiled stack machine. */
+    Program,
+    /** \brief BatchEvaluator, one step at a time over many rows. */
+    Batch,
+    /** \brief Expression::evaluateParallel(), for very large trees. */
+    Parallel
+};
+
+/**
+* \struct EvaluatorOptions
+* \brief Expected workload of an Evaluator, from which it picks a backend.
+*/
+struct EvaluatorOptions
+{
+    EvaluatorOptions()
+        : expectedCalls(1), batchSize(1), hotCallCount(1024), pThreadPool(nullptr),
+          accuracy(Accuracy::Exact)
+    {
+    }
+
+    /** \brief Number of times the expression is expected to be evaluated. */
+    std::size_t expectedCalls;
+
+    /** \brief Typical number of rows per call, one for scalar calls. */
+    std::size_t batchSize;
+
+    /**
+    * \brief Calls after which the choice is revisited with the observed
+    * workload, doubling each time. A faster backend is then compiled in
+    * the background and used once ready. Zero keeps the first choice.
+    */
+    std::size_t hotCallCount;
+
+    /** \brief Pool for background compiles and parallel calls, ThreadPool::Instance() if null. */
+    ThreadPool* pThreadPool;
+
+    /**
+    * \brief Loosest accuracy allowed for sin, cos, tan, exp, ln and log10.
+    * The closure, program and batch backends use the approximations of
+    * FastMath.h, the tree walk and parallel backends stay exact.
+    */
+    Accuracy accuracy;
+
+    BackendCosts costs;
+};
+
+} // namespace Emblem
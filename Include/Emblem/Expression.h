@@ -18,11 +18,29 @@
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 
 #include "Internal\BinaryTree.h"
 #include "Internal\TermNode.h"
+#include "Internal\CanonicalHash.h"
+#include "Internal\StrengthReduction.h"
+#include "Internal\OperationCount.h"
+#include "Internal\Reassociation.h"
+#include "Internal\OperationMinimizer.h"
+#include "Internal\ParallelEvaluation.h"
+#include "Internal\ValueEvaluation.h"
+#include "Internal\TaylorSeries.h"
+#include "ChebyshevApproximation.h"
+#include "CostModel.h"
+#include "OptimizationFlags.h"
+#include "ParallelOptions.h"
+#include "ThreadPool.h"
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -33,6 +51,14 @@ namespace Emblem
 {
 template <class T, class Alloc> class Expression;
 template <class T, class Alloc> class Symbol;
+template <class T, class Alloc> class IncrementalEvaluator;
+template <class T, class Alloc> class Program;
+template <class T, class Alloc> class BatchEvaluator;
+template <class T, class Alloc> class ClosureEvaluator;
+template <class T, class Alloc> class MixedPrecisionEvaluator;
+template <class T, class Alloc> class Polynomial;
+template <class T, class Alloc> class Parser;
+template <class T, class Alloc> class Serializer;
 }
 
 template <class T, class Alloc>
@@ -87,6 +113,13 @@ Emblem::Expression<T, Alloc> log10(const Emblem::Symbol<T, Alloc>& rA);
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> sqrt(const Emblem::Symbol<T, Alloc>& rA);
 
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(const Emblem::Expression<T, Alloc>&, const T&);
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(Emblem::Expression<T, Alloc>&&, const T&);
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(const Emblem::Symbol<T, Alloc>& rA, const T& rB);
+
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> operator+(
     const T& rA, const Emblem::Expression<T, Alloc>& rB);
@@ -145,6 +178,9 @@ class Expression
     typedef Internal::ConstantNode<T, Alloc> ConstantNode;
     typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
     typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::SumNode<T, Alloc> SumNode;
+    typedef Internal::ProductNode<T, Alloc> ProductNode;
 
     typedef Internal::BinaryOperator<T> BinaryOperator;
     typedef Internal::UnaryOperator<T> UnaryOperator;
@@ -185,6 +221,65 @@ public:
         return pNode->evaluate(rValues);
     }
 
+    /**
+    * \brief Evaluates the expression with independent subtrees running
+    * concurrently on a thread pool.
+    *
+    * Meant for very large expressions evaluated once per input, the tree
+    * is split anew on every call. Expressions below twice the task
+    * threshold, or without independent subtrees that large, are evaluated
+    * sequentially. As for evaluate(), a symbol without a value throws
+    * std::out_of_range, here on the calling thread once the tasks are done.
+    */
+    T evaluateParallel(const ValueMap& rValues,
+                       const ParallelOptions& rOptions = ParallelOptions()) const
+    {
+        const TermNode* pNode = mExpressionTree.head();
+        if (pNode == nullptr)
+        {
+            assert(0);
+            return T();
+        }
+
+        ThreadPool& rPool = (rOptions.pThreadPool != nullptr)
+                            ? *rOptions.pThreadPool : ThreadPool::Instance();
+        const Internal::ParallelEvaluation<T, Alloc> evaluation(pNode, rOptions.taskThreshold);
+        return evaluation.evaluate(rValues, rPool);
+    }
+
+    /**
+    * \brief Evaluates the expression with values of another type, such as
+    * Pack<T, N> to compute N results in one walk of the tree.
+    *
+    * Constants are converted to V, which broadcasts them for packs, and the
+    * operators reach the math functions for V by argument dependent lookup.
+    * Every symbol must have a value.
+    */
+    template <class V>
+    V evaluateAs(const std::unordered_map<std::string, V>& rValues) const
+    {
+        const TermNode* pNode = mExpressionTree.head();
+        if (pNode == nullptr)
+        {
+            assert(0);
+            return V();
+        }
+        return Internal::EvaluateAs(pNode, rValues);
+    }
+
+    /**
+    * \brief Copies the expression node for node into one evaluated with
+    * values of type U, such as float for a cheaper evaluation.
+    *
+    * Constants are converted with static_cast and may be rounded.
+    */
+    template <class U, class UAlloc = std::allocator<U>>
+    Expression<U, UAlloc> cast() const
+    {
+        return Convert<U, UAlloc>(mExpressionTree.head(),
+                                  [](const TermNode*, Expression<U, UAlloc>&) { return false; });
+    }
+
     /**
     * \brief Substitutes the supplied expression for the given symbol
     *
@@ -202,9 +297,92 @@ public:
 
     void simplify();
 
-    /** */
+    /**
+    * \brief Rewrites the expression into a cheaper equivalent form.
+    *
+    * Replaces pow with exponents 2, 3 and -1 by a square, cube and
+    * reciprocal, and cheapens divisions. Rewrites that may change results
+    * beyond rounding, such as expanding larger powers into multiplies,
+    * need OptimizationFlags::fastMath.
+    * With OptimizationFlags::reassociate long sums and products are
+    * first rebalanced to logarithmic depth.
+    */
+    void optimize(const OptimizationFlags& rFlags = OptimizationFlags());
+
+    /**
+    * \brief Rewrites sums and products to need fewer operations.
+    *
+    * Collects like terms, pulls out common factors and coefficients, and
+    * keeps a rewrite only where it is cheaper under the cost model. The
+    * result is equal in real arithmetic but may differ by rounding, so
+    * this is never applied implicitly.
+    */
+    OptimizationReport minimizeOperations(const CostModel& rCostModel = CostModel());
+
+    /** \brief Operations needed for one evaluation of the expression. */
+    OperationCount operationCount() const
+    {
+        return Internal::CountOperations(mExpressionTree.head());
+    }
+
+    /** \brief Number of nodes in the tree, cached along with the hash. */
+    std::size_t nodeCount() const
+    {
+        const TermNode* pHead = mExpressionTree.head();
+        return (pHead != nullptr) ? pHead->GetSubtreeSize() : 0;
+    }
+
+    /**
+    * \brief Derivative with respect to the symbol. Empty if the expression
+    * contains an operator without a derivative rule.
+    */
     Expression derivative(const Symbol&) const;
 
+    /**
+    * \brief Fits a piecewise Chebyshev approximation of the expression over
+    * the interval of the symbol, for expressions of that one symbol
+    * evaluated many times.
+    *
+    * The expression is sampled until every piece is within the absolute
+    * tolerance, see ChebyshevApproximation for what is guaranteed. Empty
+    * if the expression has a symbol other than the one given.
+    */
+    ChebyshevApproximation<T> approximate(const Symbol& rSymbol, const Interval<T>& rInterval,
+                                          T tolerance) const
+    {
+        std::vector<std::string> symbols;
+        canonicalHash(symbols);
+        if ((symbols.size() > 1) || (!symbols.empty() && (symbols[0] != rSymbol.toString())))
+        {
+            return ChebyshevApproximation<T>();
+        }
+
+        ValueMap values;
+        T& rValue = values[rSymbol];
+        return ChebyshevApproximation<T>::Fit(
+                   [this, &values, &rValue](const T& rX)
+        {
+            rValue = rX;
+            return evaluate(values);
+        }, rInterval, tolerance);
+    }
+
+    /**
+    * \brief Taylor polynomial of the expression around the point, up to
+    * the total order given.
+    *
+    * The polynomial is in the offsets of the symbols from the point, in
+    * nested Horner form. It is in the symbols listed, the others are fixed
+    * at their values in the point; with none listed it is in every
+    * symbol of the point. Every symbol of the expression needs a value.
+    *
+    * The coefficients come from one walk of the tree with truncated
+    * power series in place of values, so their cost grows with the number
+    * of coefficients rather than with the size of repeated derivatives.
+    */
+    Expression taylor(const ValueMap& rPoint, std::size_t order,
+                      const std::vector<Symbol>& rSymbols = std::vector<Symbol>()) const;
+
     // Operators
     ///////////////////////////////////////////////////
     ///////////////// Addition ////////////////////////
@@ -357,17 +535,109 @@ public:
 
     void Output(std::ostream& rOut) const;
 
+    /**
+    * \brief Structural hash of the expression.
+    *
+    * Stable across processes and platforms. Cached per node as the
+    * expression is built, so this is a constant time lookup.
+    */
+    std::uint64_t hash() const
+    {
+        const TermNode* pHead = mExpressionTree.head();
+        return (pHead != nullptr) ? pHead->GetHash() : 0;
+    }
+
+    /**
+    * \brief Structural equality.
+    *
+    * Expressions are equal if their trees have the same shape, operators,
+    * symbols and bitwise identical constants. Sums and products compare by
+    * their operands, so (x + y) + z built from binary nodes, as the Parser
+    * and the rewrites may, equals the sum x + y + z. Exits early on hash
+    * mismatch.
+    */
+    bool operator==(const Expression& rB) const
+    {
+        const TermNode* pHeadA = mExpressionTree.head();
+        const TermNode* pHeadB = rB.mExpressionTree.head();
+        if ((pHeadA == nullptr) || (pHeadB == nullptr))
+        {
+            return pHeadA == pHeadB;
+        }
+
+        return Internal::IsStructurallyEqual(pHeadA, pHeadB);
+    }
+
+    bool operator!=(const Expression& rB) const
+    {
+        return !(*this == rB);
+    }
+
+    /**
+    * \brief Structural hash that ignores the names of symbols.
+    *
+    * Symbols are numbered in order of first occurrence, so expressions
+    * that only differ by renaming their symbols share the hash. The symbol
+    * names are written to rSymbols in that order.
+    */
+    std::uint64_t canonicalHash(std::vector<std::string>& rSymbols) const
+    {
+        return Internal::CanonicalHash(mExpressionTree.head(), rSymbols);
+    }
+
+    /** \brief Whether the expressions are equal up to renaming their symbols. */
+    bool isRenamingOf(const Expression& rB) const
+    {
+        return Internal::IsRenaming(mExpressionTree.head(), rB.mExpressionTree.head());
+    }
+
 private:
     static Expression BinaryOp(
         ExpressionTree& rA, const BinaryOperator& rOperator,
         ExpressionTree& rB)
     {
+        // A third operand of an addition or multiplication turns the chain
+        // into one n-ary node. Only the left operand is flattened, so the
+        // operands still combine in the order they were written.
+        if ((rOperator == BinaryOperator::Addition) ||
+                (rOperator == BinaryOperator::Multiplication))
+        {
+            NaryOperatorNode* pChain = nullptr;
+            if (Internal::IsNaryOperation(rA.head(), rOperator))
+            {
+                pChain = static_cast<NaryOperatorNode*>(rA.release());
+            }
+            else if (Internal::IsBinaryOperation(rA.head(), rOperator))
+            {
+                TermNode* pPair = rA.release();
+                pChain = (rOperator == BinaryOperator::Addition)
+                         ? static_cast<NaryOperatorNode*>(new SumNode())
+                         : static_cast<NaryOperatorNode*>(new ProductNode());
+                pChain->append(pPair->mpLeftNode);
+                pChain->append(pPair->mpRightNode);
+                pPair->mpLeftNode = nullptr;
+                pPair->mpRightNode = nullptr;
+                delete pPair;
+            }
+
+            if (pChain != nullptr)
+            {
+                pChain->append(rB.release());
+                pChain->GetHash();
+
+                Expression result;
+                result.mExpressionTree.insertToHead(pChain);
+                return result;
+            }
+        }
+
         BinaryOperatorNode* pOperationNode(new BinaryOperatorNode(rOperator));
         pOperationNode->mpLeftNode = rA.release();
         pOperationNode->mpRightNode = rB.release();
 
         pOperationNode->mpLeftNode->mpParentNode = pOperationNode;
         pOperationNode->mpRightNode->mpParentNode = pOperationNode;
+        pOperationNode->GetHash();
 
         Expression result;
         result.mExpressionTree.insertToHead(pOperationNode);
@@ -380,17 +650,35 @@ private:
         UnaryOperatorNode* pOperationNode(new UnaryOperatorNode(rOperator));
         pOperationNode->mpLeftNode = rA.release();
         pOperationNode->mpLeftNode->mpParentNode = pOperationNode;
+        pOperationNode->GetHash();
 
         Expression result;
         result.mExpressionTree.insertToHead(pOperationNode);
         return result;
     }
 
+    /**
+    * Copies the tree under pHead into an expression over U. Where
+    * replace(pNode, rResult) returns true, rResult stands for the subtree
+    * under pNode, which is then not visited.
+    */
+    template <class U, class UAlloc, class Replace>
+    static Expression<U, UAlloc> Convert(const TermNode* pHead, Replace replace);
+
     static void Substitute(
         ExpressionTree& rExpr, const Symbol& rSymbol,
         ExpressionTree& rSubExpr);
 
     friend class Symbol;
+    friend class IncrementalEvaluator<T, Alloc>;
+    friend class Program<T, Alloc>;
+    friend class BatchEvaluator<T, Alloc>;
+    friend class ClosureEvaluator<T, Alloc>;
+    friend class MixedPrecisionEvaluator<T, Alloc>;
+    template <class, class> friend class Expression;
+    friend class Polynomial<T, Alloc>;
+    friend class Parser<T, Alloc>;
+    friend class Serializer<T, Alloc>;
 
     friend Emblem::Expression<T, Alloc> (::sin)(const Emblem::Expression<T, Alloc>&);
     friend Emblem::Expression<T, Alloc> (::cos)(const Emblem::Expression<T, Alloc>&);
@@ -419,6 +707,10 @@ private:
     friend Emblem::Expression<T, Alloc> (::log10)(const Emblem::Symbol<T, Alloc>&);
     friend Emblem::Expression<T, Alloc> (::sqrt)(const Emblem::Symbol<T, Alloc>&);
 
+    friend Emblem::Expression<T, Alloc> (::pow)(const Emblem::Expression<T, Alloc>&, const T&);
+    friend Emblem::Expression<T, Alloc> (::pow)(Emblem::Expression<T, Alloc>&&, const T&);
+    friend Emblem::Expression<T, Alloc> (::pow)(const Emblem::Symbol<T, Alloc>&, const T&);
+
     friend Emblem::Expression<T, Alloc> (::operator+)(const T& rA,
             const Emblem::Expression<T, Alloc>& rB);
     friend Emblem::Expression<T, Alloc> (::operator-)(const T& rA,
@@ -448,6 +740,43 @@ void Expression<T, Alloc>::simplify()
 
 ///////////////////////////////////////////////////////////////////////
 
+template <class T, class Alloc>
+void Expression<T, Alloc>::optimize(const OptimizationFlags& rFlags)
+{
+    TermNode* pHead = mExpressionTree.release();
+    if (pHead == nullptr)
+    {
+        return;
+    }
+
+    if (rFlags.reassociate)
+    {
+        const Internal::Reassociation<T, Alloc> reassociation;
+        pHead = reassociation.run(pHead);
+    }
+
+    const Internal::StrengthReduction<T, Alloc> strengthReduction(rFlags);
+    mExpressionTree.insertToHead(strengthReduction.run(pHead));
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+OptimizationReport Expression<T, Alloc>::minimizeOperations(const CostModel& rCostModel)
+{
+    OptimizationReport report;
+    report.before = operationCount();
+    if (mExpressionTree.head() != nullptr)
+    {
+        const Internal::OperationMinimizer<T, Alloc> minimizer(rCostModel);
+        mExpressionTree.insertToHead(minimizer.run(mExpressionTree.head()));
+    }
+    report.after = operationCount();
+    return report;
+}
+
+///////////////////////////////////////////////////////////////////////
+
 template <class T, class Alloc>
 void Expression<T, Alloc>::Substitute(
     ExpressionTree& rExpr, const Symbol& rSymbol,
@@ -472,43 +801,115 @@ void Expression<T, Alloc>::Substitute(
     {
         const TermNode* pCurNode = nodeStack.top();
         nodeStack.pop();
-        if ((pCurNode == nullptr) || pCurNode->isLeaf())
-        {
-            continue;
-        }
 
-        if (pCurNode->mpLeftNode->isSymbol())
+        for (std::size_t i = 0; i < pCurNode->operandCount(); ++i)
         {
-            const SymbolNode* pLeftSymbol =
-                dynamic_cast<const SymbolNode*>(pCurNode->mpLeftNode);
-            assert(pLeftSymbol != nullptr);
-            if (pLeftSymbol->GetSymbol() == rSymbol)
+            TermNode* pOperand = pCurNode->operand(i);
+            if (!pOperand->isSymbol())
+            {
+                nodeStack.push(pOperand);
+                continue;
+            }
+
+            const SymbolNode* pSymbol = dynamic_cast<const SymbolNode*>(pOperand);
+            assert(pSymbol != nullptr);
+            if (pSymbol->GetSymbol() == rSymbol)
             {
                 ExpressionTree exprSub = rSubExpr.clone();
-                rExpr.replace(pCurNode->mpLeftNode, exprSub.release());
+                pOperand->mpParentNode->setOperand(i, exprSub.release());
+                delete pOperand;
             }
         }
-        else
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+template <class U, class UAlloc, class Replace>
+Expression<U, UAlloc> Expression<T, Alloc>::Convert(const TermNode* pHead, Replace replace)
+{
+    typedef Expression<U, UAlloc> Result;
+
+    if (pHead == nullptr)
+    {
+        return Result();
+    }
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    std::vector<Frame> nodeStack;
+    std::vector<Result> results;
+    Result replacement;
+    if (replace(pHead, replacement))
+    {
+        return replacement;
+    }
+    const Frame head = { pHead, pHead->operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
         {
-            nodeStack.push(pCurNode->mpLeftNode);
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            if (replace(pOperand, replacement))
+            {
+                results.push_back(std::move(replacement));
+                replacement = Result();
+                continue;
+            }
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
         }
 
-        if (pCurNode->mpRightNode->isSymbol())
+        const TermNode* pNode = rFrame.pNode;
+        const std::size_t first = results.size() - rFrame.operandCount;
+        if (pNode->isSymbol())
         {
-            const SymbolNode* pRightSymbol =
-                dynamic_cast<const SymbolNode*>(pCurNode->mpRightNode);
-            assert(pRightSymbol != nullptr);
-            if (pRightSymbol->GetSymbol() == rSymbol)
+            const std::string name = static_cast<const SymbolNode*>(pNode)->GetSymbol().toString();
+            results.push_back(Result(Emblem::Symbol<U, UAlloc>(name.c_str())));
+        }
+        else if (!pNode->isOperator())
+        {
+            results.push_back(Result(static_cast<U>(static_cast<const ConstantNode*>(pNode)->GetValue())));
+        }
+        else if (const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode))
+        {
+            const Internal::BinaryOperator<U>& rOperator =
+                Internal::ConvertOperator<U>(pNaryOp->GetOperator());
+            Result result = std::move(results[first]);
+            for (std::size_t i = first + 1; i < results.size(); ++i)
             {
-                ExpressionTree exprSub = rSubExpr.clone();
-                rExpr.replace(pCurNode->mpRightNode, exprSub.release());
+                result = Result::BinaryOp(result.mExpressionTree, rOperator, results[i].mExpressionTree);
             }
+            results.resize(first);
+            results.push_back(std::move(result));
+        }
+        else if (const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode))
+        {
+            Result result = Result::BinaryOp(results[first].mExpressionTree,
+                                             Internal::ConvertOperator<U>(pBinaryOp->GetOperator()),
+                                             results[first + 1].mExpressionTree);
+            results.resize(first);
+            results.push_back(std::move(result));
         }
         else
         {
-            nodeStack.push(pCurNode->mpRightNode);
+            results.back() = Result::UnaryOp(
+                                 results.back().mExpressionTree,
+                                 Internal::ConvertOperator<U>(
+                                     static_cast<const UnaryOperatorNode*>(pNode)->GetOperator()));
         }
+        nodeStack.pop_back();
     }
+    return std::move(results.back());
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -705,6 +1106,30 @@ Emblem::Expression<T, Alloc> sqrt(Emblem::Expression<T, Alloc>&& rTree)
 
 ///////////////////////////////////////////////////////////////////////
 
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(const Emblem::Expression<T, Alloc>& rTree, const T& rExponent)
+{
+    using namespace Emblem;
+    using namespace Emblem::Internal;
+    Expression<T, Alloc> exponent(rExponent);
+    return Expression<T, Alloc>::BinaryOp(
+               rTree.mExpressionTree.clone(), BinaryOperator<T>::Pow, exponent.mExpressionTree);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(Emblem::Expression<T, Alloc>&& rTree, const T& rExponent)
+{
+    using namespace Emblem;
+    using namespace Emblem::Internal;
+    Expression<T, Alloc> exponent(rExponent);
+    return Expression<T, Alloc>::BinaryOp(
+               rTree.mExpressionTree, BinaryOperator<T>::Pow, exponent.mExpressionTree);
+}
+
+///////////////////////////////////////////////////////////////////////
+
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> operator+(
     const T& rA, const Emblem::Expression<T, Alloc>& rB)
@@ -817,20 +1242,124 @@ std::ostream& operator<<(
     return rOut;
 }
 
+///////////////////////////////////////////////////////////////////////
+
+namespace std
+{
+template <class T, class Alloc>
+struct hash<Emblem::Expression<T, Alloc>>
+{
+    size_t operator()(const Emblem::Expression<T, Alloc>& rExpr) const
+    {
+        return static_cast<size_t>(rExpr.hash());
+    }
+};
+} // namespace std
+
 #include "Internal\Derivative.h"
 #include "Emblem/Symbol.h"
 
 ///////////////////////////////////////////////////////////////////////
 
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> Emblem::Expression<T, Alloc>::taylor(
+    const ValueMap& rPoint, std::size_t order, const std::vector<Symbol>& rSymbols) const
+{
+    typedef Internal::TaylorSeries<T> Series;
+
+    std::vector<std::string> names;
+    for (const Symbol& rSymbol : rSymbols)
+    {
+        names.push_back(rSymbol.toString());
+    }
+    if (names.empty())
+    {
+        for (const auto& rValue : rPoint)
+        {
+            names.push_back(rValue.first);
+        }
+        std::sort(names.begin(), names.end());
+    }
+
+    const typename Series::BasisPtr pBasis =
+        std::make_shared<const Internal::MonomialBasis>(names.size(), order);
+    std::unordered_map<std::string, Series> values;
+    for (const auto& rValue : rPoint)
+    {
+        values[rValue.first] = Series(rValue.second);
+    }
+    for (std::size_t v = 0; v < names.size(); ++v)
+    {
+        values[names[v]] = Series::Variable(pBasis, v, rPoint.at(names[v]));
+    }
+    const Series series = evaluateAs(values);
+
+    std::vector<Expression> offsets;
+    for (const std::string& rName : names)
+    {
+        const T value = rPoint.at(rName);
+        const Symbol symbol(rName.c_str());
+        offsets.push_back((value == T(0)) ? Expression(symbol) : symbol - value);
+    }
+
+    // Horner form, one symbol at a time. Part a of a level is the
+    // polynomial in the later symbols multiplying offset^a, and monomial
+    // the index of the product of the earlier powers.
+    std::function<Expression(std::size_t, std::size_t, std::size_t)> build =
+        [&](std::size_t v, std::size_t remainingOrder, std::size_t monomial) -> Expression
+    {
+        if (v == names.size())
+        {
+            const T coefficient = series[monomial];
+            return (coefficient == T(0)) ? Expression() : Expression(coefficient);
+        }
+
+        std::vector<std::size_t> monomials(1, monomial);
+        for (std::size_t a = 1; a <= remainingOrder; ++a)
+        {
+            monomials.push_back(pBasis->product(monomials.back(), pBasis->variable(v)));
+        }
+        Expression polynomial;
+        for (std::size_t a = remainingOrder + 1; a-- > 0;)
+        {
+            if (polynomial.mExpressionTree.head() != nullptr)
+            {
+                polynomial = polynomial * offsets[v];
+            }
+            Expression part = build(v + 1, remainingOrder - a, monomials[a]);
+            if (part.mExpressionTree.head() == nullptr)
+            {
+                continue;
+            }
+            polynomial = (polynomial.mExpressionTree.head() == nullptr)
+                         ? std::move(part) : polynomial + part;
+        }
+        return polynomial;
+    };
+
+    Expression result = build(0, order, 0);
+    return (result.mExpressionTree.head() == nullptr) ? Expression(T(0)) : result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> Emblem::Expression<T, Alloc>::derivative(
     const Symbol& rSymbol) const
 {
     const TermNode* pHead = mExpressionTree.head();
+    Expression derivative;
+    if (pHead == nullptr)
+    {
+        return derivative;
+    }
 
+    // Left empty when an operator has no derivative rule.
     TermNode* pDerivative = Internal::Derivative(pHead, rSymbol);
-    Expression derivative;
-    derivative.mExpressionTree.insertToHead(pDerivative);
+    if (pDerivative != nullptr)
+    {
+        derivative.mExpressionTree.insertToHead(pDerivative);
+    }
     return derivative;
 }
 /** \mainpage Emblem
@@ -0,0 +1,469 @@
+/**
+* \file FastMath.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Accuracy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Bit layout and range reduction constants of a floating point type. */
+template <class T>
+struct FastMathTraits;
+
+template <>
+struct FastMathTraits<double>
+{
+    typedef std::uint64_t Bits;
+    static const int MantissaBits = 52;
+    static const int ExponentBias = 1023;
+
+    /** \brief Adding and subtracting 1.5 * 2^52 rounds to the nearest integer. */
+    static double RoundingShift() { return 6755399441055744.0; }
+    /**
+    * \brief pi / 2 in three parts. The first two have enough trailing zero
+    * bits that their products with quadrants below 2^20 are exact.
+    */
+    static double HalfPi1() { return 1.57079632673412561417e+00; }
+    static double HalfPi2() { return 6.07710050630396597660e-11; }
+    static double HalfPi3() { return 2.02226624879595063154e-21; }
+    /** \brief ln(2) in two parts, the first exact when multiplied by an exponent. */
+    static double Ln2High() { return 6.93147180369123816490e-01; }
+    static double Ln2Low() { return 1.90821492927058770002e-10; }
+    /** \brief Arguments of exp beyond which the result overflows or is below the normal range. */
+    static double MaxExp() { return 709.782712893384; }
+    static double MinExp() { return -708.3964185322641; }
+};
+
+template <>
+struct FastMathTraits<float>
+{
+    typedef std::uint32_t Bits;
+    static const int MantissaBits = 23;
+    static const int ExponentBias = 127;
+
+    static float RoundingShift() { return 12582912.0f; }
+    static float HalfPi1() { return 1.5703125f; }
+    static float HalfPi2() { return 4.837512969970703125e-4f; }
+    static float HalfPi3() { return 7.54978995489188216e-8f; }
+    static float Ln2High() { return 0.693359375f; }
+    static float Ln2Low() { return -2.12194440e-4f; }
+    static float MaxExp() { return 88.7228317f; }
+    static float MinExp() { return -87.3365479f; }
+};
+
+/**
+* \brief Number of polynomial terms each tier evaluates. The truncation
+* errors are the documented errors of the functions.
+*/
+template <Accuracy A>
+struct FastMathTerms;
+
+template <>
+struct FastMathTerms<Accuracy::High>
+{
+    static const int Sin = 6;
+    static const int Cos = 6;
+    static const int Exp = 12;
+    static const int Ln = 8;
+};
+
+template <>
+struct FastMathTerms<Accuracy::Medium>
+{
+    static const int Sin = 4;
+    static const int Cos = 4;
+    static const int Exp = 8;
+    static const int Ln = 5;
+};
+
+template <>
+struct FastMathTerms<Accuracy::Low>
+{
+    static const int Sin = 2;
+    static const int Cos = 3;
+    static const int Exp = 5;
+    static const int Ln = 3;
+};
+
+/** \brief sin(r) = r + r z P(z) with z = r^2, Taylor coefficients of P. */
+template <class T>
+const T* SinTerms()
+{
+    static const T terms[] =
+    {
+        T(-1.0 / 6), T(1.0 / 120), T(-1.0 / 5040), T(1.0 / 362880),
+        T(-1.0 / 39916800), T(1.0 / 6227020800.0)
+    };
+    return terms;
+}
+
+/** \brief cos(r) = 1 + z Q(z) with z = r^2, Taylor coefficients of Q. */
+template <class T>
+const T* CosTerms()
+{
+    static const T terms[] =
+    {
+        T(-1.0 / 2), T(1.0 / 24), T(-1.0 / 720), T(1.0 / 40320),
+        T(-1.0 / 3628800), T(1.0 / 479001600)
+    };
+    return terms;
+}
+
+/** \brief Taylor coefficients of exp(r). */
+template <class T>
+const T* ExpTerms()
+{
+    static const T terms[] =
+    {
+        T(1), T(1), T(1.0 / 2), T(1.0 / 6), T(1.0 / 24), T(1.0 / 120), T(1.0 / 720),
+        T(1.0 / 5040), T(1.0 / 40320), T(1.0 / 362880), T(1.0 / 3628800), T(1.0 / 39916800)
+    };
+    return terms;
+}
+
+/** \brief ln(m) = 2 s L(s^2) with s = (m - 1) / (m + 1), coefficients of L. */
+template <class T>
+const T* LnTerms()
+{
+    static const T terms[] =
+    {
+        T(1), T(1.0 / 3), T(1.0 / 5), T(1.0 / 7), T(1.0 / 9), T(1.0 / 11), T(1.0 / 13), T(1.0 / 15)
+    };
+    return terms;
+}
+
+/**
+* \brief Horner's rule over N terms, unrolled at compile time so that the
+* loops calling it stay free of control flow and vectorize.
+*/
+template <int N>
+struct Horner
+{
+    template <class T>
+    static T Evaluate(const T* pTerms, const T& rZ)
+    {
+        return Horner<N - 1>::Evaluate(pTerms + 1, rZ) * rZ + pTerms[0];
+    }
+};
+
+template <>
+struct Horner<1>
+{
+    template <class T>
+    static T Evaluate(const T* pTerms, const T&)
+    {
+        return pTerms[0];
+    }
+};
+
+/** \brief Evaluates the first N terms of a polynomial in z. */
+template <int N, class T>
+T EvaluateTerms(const T* pTerms, const T& rZ)
+{
+    return Horner<N>::Evaluate(pTerms, rZ);
+}
+
+template <class To, class From>
+To BitCast(const From& rValue)
+{
+    static_assert(sizeof(To) == sizeof(From), "BitCast needs types of equal size");
+    To result;
+    std::memcpy(&result, &rValue, sizeof(To));
+    return result;
+}
+
+/**
+* \brief Subtracts the nearest multiple q of pi / 2 from x, returning the
+* remainder in [-pi / 4, pi / 4] and q in rQuadrant.
+*
+* Rounding by adding and subtracting a shift keeps the function free of
+* calls and branches, so loops over it vectorize. It assumes the compiler
+* does not reassociate floating point arithmetic.
+*/
+template <class T>
+inline T ReduceHalfPi(const T& rX, std::int32_t& rQuadrant)
+{
+    typedef FastMathTraits<T> Traits;
+    const T shift = Traits::RoundingShift();
+    const T q = (rX * T(0.636619772367581343076) + shift) - shift;
+    // Only the quadrant modulo 4 matters. The bounds, taken first, also
+    // replace NaN, so the conversion stays defined; r is NaN then anyway.
+    const T bound = T(1 << 30);
+    rQuadrant = static_cast<std::int32_t>(std::min(bound, std::max(-bound, q)));
+    return ((rX - q * Traits::HalfPi1()) - q * Traits::HalfPi2()) - q * Traits::HalfPi3();
+}
+
+/** \brief sin(x + quadrant pi / 2) from the reduced argument. */
+template <Accuracy A, class T>
+inline T SinOfQuadrant(const T& rR, std::int32_t quadrant)
+{
+    typedef FastMathTerms<A> Terms;
+    const T z = rR * rR;
+    const T s = rR + rR * z * EvaluateTerms<Terms::Sin>(SinTerms<T>(), z);
+    const T c = T(1) + z * EvaluateTerms<Terms::Cos>(CosTerms<T>(), z);
+    const T result = (quadrant & 1) ? c : s;
+    return (quadrant & 2) ? -result : result;
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+//
+// Approximations of the transcendental functions for the tiers of
+// Accuracy, for float and double. None branches or calls the library, so
+// loops over them vectorize; see the column overloads.
+//
+// Largest errors measured on double against long double references:
+//
+//            sin, cos      tan          exp          ln, log10
+//   High     4e-13 abs     6e-13 rel    1e-14 rel    4e-14 rel
+//   Medium   3e-8 abs      4e-8 rel     7e-9 rel     2e-9 rel
+//   Low      4e-5 abs      6e-5 rel     6e-5 rel     4e-6 rel
+//
+// sin, cos and tan hold these for |x| <= 1e6, beyond which the reduction
+// by pi / 2 loses accuracy, and tan relative to its value away from its
+// poles. exp flushes results below the normal range to zero. With float
+// the High and Medium tiers are as accurate as float allows.
+//
+///////////////////////////////////////////////////////////////////////
+
+template <Accuracy A, class T>
+inline T FastSin(const T& rX)
+{
+    if (A == Accuracy::Exact)
+    {
+        return std::sin(rX);
+    }
+    std::int32_t quadrant;
+    const T r = Internal::ReduceHalfPi(rX, quadrant);
+    return Internal::SinOfQuadrant<A>(r, quadrant);
+}
+
+template <Accuracy A, class T>
+inline T FastCos(const T& rX)
+{
+    if (A == Accuracy::Exact)
+    {
+        return std::cos(rX);
+    }
+    std::int32_t quadrant;
+    const T r = Internal::ReduceHalfPi(rX, quadrant);
+    return Internal::SinOfQuadrant<A>(r, quadrant + 1);
+}
+
+template <Accuracy A, class T>
+inline T FastTan(const T& rX)
+{
+    if (A == Accuracy::Exact)
+    {
+        return std::tan(rX);
+    }
+    typedef Internal::FastMathTerms<A> Terms;
+    std::int32_t quadrant;
+    const T r = Internal::ReduceHalfPi(rX, quadrant);
+    const T z = r * r;
+    const T s = r + r * z * Internal::EvaluateTerms<Terms::Sin>(Internal::SinTerms<T>(), z);
+    const T c = T(1) + z * Internal::EvaluateTerms<Terms::Cos>(Internal::CosTerms<T>(), z);
+    // tan(r + pi / 2) = -cos(r) / sin(r)
+    const bool isOdd = (quadrant & 1) != 0;
+    return (isOdd ? -c : s) / (isOdd ? s : c);
+}
+
+/** \brief Sine and cosine from one range reduction and one pair of polynomials. */
+template <Accuracy A, class T>
+inline void FastSinCos(const T& rX, T& rSin, T& rCos)
+{
+    if (A == Accuracy::Exact)
+    {
+        rSin = std::sin(rX);
+        rCos = std::cos(rX);
+        return;
+    }
+    typedef Internal::FastMathTerms<A> Terms;
+    std::int32_t quadrant;
+    const T r = Internal::ReduceHalfPi(rX, quadrant);
+    const T z = r * r;
+    const T s = r + r * z * Internal::EvaluateTerms<Terms::Sin>(Internal::SinTerms<T>(), z);
+    const T c = T(1) + z * Internal::EvaluateTerms<Terms::Cos>(Internal::CosTerms<T>(), z);
+    // As SinOfQuadrant(), cos(x) being sin(x) one quadrant further on.
+    const bool isOdd = (quadrant & 1) != 0;
+    const T sine = isOdd ? c : s;
+    const T cosine = isOdd ? s : c;
+    rSin = (quadrant & 2) ? -sine : sine;
+    rCos = ((quadrant + 1) & 2) ? -cosine : cosine;
+}
+
+template <Accuracy A, class T>
+inline T FastExp(const T& rX)
+{
+    if (A == Accuracy::Exact)
+    {
+        return std::exp(rX);
+    }
+    typedef Internal::FastMathTraits<T> Traits;
+    typedef typename Traits::Bits Bits;
+    typedef Internal::FastMathTerms<A> Terms;
+
+    // exp(x) = 2^n exp(r) with |r| <= ln(2) / 2.
+    // The bounds come first so that NaN is replaced too, see ReduceHalfPi().
+    const T x = std::min(Traits::MaxExp(), std::max(Traits::MinExp(), rX));
+    const T shift = Traits::RoundingShift();
+    const T q = (x * T(1.44269504088896340736) + shift) - shift;
+    const std::int32_t n = static_cast<std::int32_t>(q);
+    const T r = (x - q * Traits::Ln2High()) - q * Traits::Ln2Low();
+    const T p = Internal::EvaluateTerms<Terms::Exp>(Internal::ExpTerms<T>(), r);
+
+    // 2^n is applied in two factors, as 2^n alone overflows at the top of the range.
+    const std::int32_t half = n / 2;
+    const T scale1 = Internal::BitCast<T>(static_cast<Bits>(half + Traits::ExponentBias) << Traits::MantissaBits);
+    const T scale2 = Internal::BitCast<T>(static_cast<Bits>(n - half + Traits::ExponentBias) << Traits::MantissaBits);
+    const T result = p * scale1 * scale2;
+
+    // See FastLn() for why special cases are blended in.
+    const bool isSpecial = !((rX >= Traits::MinExp()) && (rX <= Traits::MaxExp()));
+    const T special = (rX > Traits::MaxExp()) ? std::numeric_limits<T>::infinity()
+                      : ((rX < Traits::MinExp()) ? T(0) : rX);
+    return result * (isSpecial ? T(0) : T(1)) + (isSpecial ? special : T(0));
+}
+
+template <Accuracy A, class T>
+inline T FastLn(const T& rX)
+{
+    if (A == Accuracy::Exact)
+    {
+        return std::log(rX);
+    }
+    typedef Internal::FastMathTraits<T> Traits;
+    typedef typename Traits::Bits Bits;
+    typedef Internal::FastMathTerms<A> Terms;
+
+    // Subnormals are scaled into the normal range by 2^54 first.
+    const bool isSubnormal = rX < std::numeric_limits<T>::min();
+    const T scale = isSubnormal ? T(18014398509481984.0) : T(1);
+    const T scaleExponent = isSubnormal ? T(54) : T(0);
+
+    // ln(x) = e ln(2) + ln(m) with m in [sqrt(1/2), sqrt(2)].
+    const Bits bits = Internal::BitCast<Bits>(rX * scale);
+    const Bits mantissaMask = (Bits(1) << Traits::MantissaBits) - 1;
+    const std::int32_t exponent = static_cast<std::int32_t>(bits >> Traits::MantissaBits)
+                                  - Traits::ExponentBias;
+    const T mantissa = Internal::BitCast<T>((bits & mantissaMask)
+                                            | (static_cast<Bits>(Traits::ExponentBias) << Traits::MantissaBits));
+    const bool isAboveRoot2 = mantissa > T(1.41421356237309504880);
+    const T m = mantissa * (isAboveRoot2 ? T(0.5) : T(1));
+    const T e = static_cast<T>(exponent) - scaleExponent + (isAboveRoot2 ? T(1) : T(0));
+
+    const T f = m - T(1);
+    const T s = f / (T(2) + f);
+    const T lnM = T(2) * s * Internal::EvaluateTerms<Terms::Ln>(Internal::LnTerms<T>(), s * s);
+    const T result = e * Traits::Ln2High() + (lnM + e * Traits::Ln2Low());
+
+    // result is finite for any input, so zero, negative, infinite and NaN
+    // inputs are blended in arithmetically. Selecting them instead lets
+    // the compiler move the computation into a branch, which stops loops
+    // from vectorizing.
+    const bool isSpecial = !(rX > T(0)) || (rX == std::numeric_limits<T>::infinity());
+    const T special = (rX == T(0)) ? -std::numeric_limits<T>::infinity()
+                      : ((rX < T(0)) ? std::numeric_limits<T>::quiet_NaN() : rX);
+    return result * (isSpecial ? T(0) : T(1)) + (isSpecial ? special : T(0));
+}
+
+template <Accuracy A, class T>
+inline T FastLog10(const T& rX)
+{
+    if (A == Accuracy::Exact)
+    {
+        return std::log10(rX);
+    }
+    return FastLn<A>(rX) * T(0.434294481903251827651);
+}
+
+///////////////////////////////////////////////////////////////////////
+//
+// Vector kernels: the functions above over a column of count values.
+// pResults may be pValues.
+//
+///////////////////////////////////////////////////////////////////////
+
+template <Accuracy A, class T>
+void FastSin(const T* pValues, std::size_t count, T* pResults)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        pResults[i] = FastSin<A>(pValues[i]);
+    }
+}
+
+template <Accuracy A, class T>
+void FastCos(const T* pValues, std::size_t count, T* pResults)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        pResults[i] = FastCos<A>(pValues[i]);
+    }
+}
+
+template <Accuracy A, class T>
+void FastTan(const T* pValues, std::size_t count, T* pResults)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        pResults[i] = FastTan<A>(pValues[i]);
+    }
+}
+
+template <Accuracy A, class T>
+void FastExp(const T* pValues, std::size_t count, T* pResults)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        pResults[i] = FastExp<A>(pValues[i]);
+    }
+}
+
+template <Accuracy A, class T>
+void FastLn(const T* pValues, std::size_t count, T* pResults)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        pResults[i] = FastLn<A>(pValues[i]);
+    }
+}
+
+template <Accuracy A, class T>
+void FastLog10(const T* pValues, std::size_t count, T* pResults)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        pResults[i] = FastLog10<A>(pValues[i]);
+    }
+}
+
+} // namespace Emblem
@@ -0,0 +1,349 @@
+/**
+* \file IncrementalEvaluator.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "Expression.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stack>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+
+/**
+* \class IncrementalEvaluator
+* \brief Evaluates an expression repeatedly, recomputing only the nodes
+* whose inputs changed since the previous evaluation.
+*
+* Every node value is cached. Changing a symbol marks the path from its
+* leaves to the head dirty, and the next evaluate() recomputes just
+* those nodes.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class IncrementalEvaluator
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::SymbolNode<T, Alloc> SymbolNode;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef Emblem::Symbol<T, Alloc> SymbolType;
+    typedef typename ExpressionType::ValueMap ValueMap;
+
+    explicit IncrementalEvaluator(const ExpressionType& rExpression);
+
+    /**
+    * \brief Sets the value of a symbol, marking its ancestors dirty if it changed.
+    *
+    * Symbols not referenced by the expression are ignored.
+    */
+    void setValue(const SymbolType& rSymbol, const T& rValue)
+    {
+        setValue(rSymbol.toString(), rValue);
+    }
+
+    void setValue(const std::string& rSymbol, const T& rValue);
+
+    /** \brief Applies every entry of the value map, see setValue(). */
+    void setValues(const ValueMap& rValues)
+    {
+        for (const auto& rEntry : rValues)
+        {
+            setValue(rEntry.first, rEntry.second);
+        }
+    }
+
+    /**
+    * \brief Recomputes the dirty nodes and returns the value of the expression.
+    *
+    * All symbols of the expression must have been given a value, otherwise
+    * an assertion is triggered.
+    */
+    T evaluate();
+
+    T evaluate(const ValueMap& rValues)
+    {
+        setValues(rValues);
+        return evaluate();
+    }
+
+    /** \brief Number of nodes recomputed by the last call to evaluate(). */
+    std::size_t recomputedNodeCount() const
+    {
+        return mRecomputedCount;
+    }
+
+    /** \brief Total number of nodes in the expression. */
+    std::size_t nodeCount() const
+    {
+        return mNodes.size();
+    }
+
+private:
+    static const std::size_t NoNode = static_cast<std::size_t>(-1);
+
+    enum class Kind { Constant, Symbol, Binary, Unary, Nary };
+
+    struct NodeEntry
+    {
+        const TermNode* pNode;
+        Kind kind;
+        std::size_t parent;
+        /** \brief Operands are mOperands[firstOperand, firstOperand + operandCount). */
+        std::size_t firstOperand;
+        std::size_t operandCount;
+        bool isDirty;
+    };
+
+    void markAncestorsDirty(std::size_t index);
+    T compute(const NodeEntry& rEntry) const;
+
+    ExpressionType mExpression;
+
+    // Nodes in post-order, so children always precede their parent.
+    std::vector<NodeEntry> mNodes;
+    std::vector<std::size_t> mOperands;
+    std::vector<T> mValues;
+    std::vector<std::size_t> mDirtyNodes;
+
+    std::unordered_map<std::string, std::vector<std::size_t>> mSymbolNodes;
+    std::unordered_map<std::string, bool> mIsSymbolSet;
+    std::size_t mUnsetSymbolCount;
+    std::size_t mRecomputedCount;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::size_t IncrementalEvaluator<T, Alloc>::NoNode;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+IncrementalEvaluator<T, Alloc>::IncrementalEvaluator(
+    const ExpressionType& rExpression)
+    : mExpression(rExpression), mUnsetSymbolCount(0), mRecomputedCount(0)
+{
+    const TermNode* pHead = mExpression.mExpressionTree.head();
+    if (pHead == nullptr)
+    {
+        return;
+    }
+
+    // Iterative post-order walk, recording each node's children by index.
+    std::unordered_map<const TermNode*, std::size_t> indices;
+    std::stack<std::pair<const TermNode*, bool>> nodeStack;
+    nodeStack.push(std::make_pair(pHead, false));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNode = nodeStack.top().first;
+        const bool isExpanded = nodeStack.top().second;
+        nodeStack.pop();
+
+        if (!isExpanded)
+        {
+            nodeStack.push(std::make_pair(pNode, true));
+            for (std::size_t i = pNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push(std::make_pair((const TermNode*)pNode->operand(i), false));
+            }
+            continue;
+        }
+
+        const std::size_t index = mNodes.size();
+        indices[pNode] = index;
+
+        NodeEntry entry;
+        entry.pNode = pNode;
+        entry.parent = NoNode;
+        entry.firstOperand = mOperands.size();
+        entry.operandCount = pNode->operandCount();
+        entry.isDirty = false;
+        for (std::size_t i = 0; i < entry.operandCount; ++i)
+        {
+            const std::size_t operand = indices[pNode->operand(i)];
+            mNodes[operand].parent = index;
+            mOperands.push_back(operand);
+        }
+
+        if (pNode->isSymbol())
+        {
+            entry.kind = Kind::Symbol;
+            const SymbolNode* pSymbolNode = dynamic_cast<const SymbolNode*>(pNode);
+            assert(pSymbolNode != nullptr);
+            const std::string& rName = pSymbolNode->GetSymbol().toString();
+            std::vector<std::size_t>& rSymbolNodes = mSymbolNodes[rName];
+            if (rSymbolNodes.empty())
+            {
+                mIsSymbolSet[rName] = false;
+                ++mUnsetSymbolCount;
+            }
+            rSymbolNodes.push_back(index);
+        }
+        else if (pNode->isOperator())
+        {
+            if (dynamic_cast<const NaryOperatorNode*>(pNode) != nullptr)
+            {
+                entry.kind = Kind::Nary;
+            }
+            else
+            {
+                entry.kind = (dynamic_cast<const BinaryOperatorNode*>(pNode) != nullptr) ?
+                             Kind::Binary : Kind::Unary;
+            }
+            entry.isDirty = true;
+            mDirtyNodes.push_back(index);
+        }
+        else
+        {
+            entry.kind = Kind::Constant;
+        }
+
+        mNodes.push_back(entry);
+    }
+
+    mValues.resize(mNodes.size());
+    for (std::size_t i = 0; i < mNodes.size(); ++i)
+    {
+        if (mNodes[i].kind == Kind::Constant)
+        {
+            mValues[i] = mNodes[i].pNode->evaluate(ValueMap());
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void IncrementalEvaluator<T, Alloc>::setValue(
+    const std::string& rSymbol, const T& rValue)
+{
+    auto symbolIter = mSymbolNodes.find(rSymbol);
+    if (symbolIter == mSymbolNodes.end())
+    {
+        return;
+    }
+
+    bool& rIsSet = mIsSymbolSet[rSymbol];
+    const std::vector<std::size_t>& rIndices = symbolIter->second;
+    if (rIsSet && (mValues[rIndices.front()] == rValue))
+    {
+        return;
+    }
+
+    if (!rIsSet)
+    {
+        rIsSet = true;
+        --mUnsetSymbolCount;
+    }
+
+    for (std::size_t index : rIndices)
+    {
+        mValues[index] = rValue;
+        markAncestorsDirty(index);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void IncrementalEvaluator<T, Alloc>::markAncestorsDirty(std::size_t index)
+{
+    // Stop at the first dirty ancestor, everything above it is already queued.
+    std::size_t parent = mNodes[index].parent;
+    while ((parent != NoNode) && !mNodes[parent].isDirty)
+    {
+        mNodes[parent].isDirty = true;
+        mDirtyNodes.push_back(parent);
+        parent = mNodes[parent].parent;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T IncrementalEvaluator<T, Alloc>::evaluate()
+{
+    mRecomputedCount = 0;
+    if (mNodes.empty())
+    {
+        assert(0);
+        return T();
+    }
+
+    if (mUnsetSymbolCount != 0)
+    {
+        assert(0);
+        return T();
+    }
+
+    // Post-order indices guarantee children are recomputed before parents.
+    std::sort(mDirtyNodes.begin(), mDirtyNodes.end());
+    for (std::size_t index : mDirtyNodes)
+    {
+        NodeEntry& rEntry = mNodes[index];
+        mValues[index] = compute(rEntry);
+        rEntry.isDirty = false;
+    }
+    mRecomputedCount = mDirtyNodes.size();
+    mDirtyNodes.clear();
+
+    return mValues.back();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T IncrementalEvaluator<T, Alloc>::compute(const NodeEntry& rEntry) const
+{
+    const std::size_t* pOperands = &mOperands[rEntry.firstOperand];
+    if (rEntry.kind == Kind::Binary)
+    {
+        const BinaryOperatorNode* pBinaryOp =
+            static_cast<const BinaryOperatorNode*>(rEntry.pNode);
+        return pBinaryOp->GetOperator()(mValues[pOperands[0]], mValues[pOperands[1]]);
+    }
+
+    if (rEntry.kind == Kind::Nary)
+    {
+        const NaryOperatorNode* pNaryOp =
+            static_cast<const NaryOperatorNode*>(rEntry.pNode);
+        T value = mValues[pOperands[0]];
+        for (std::size_t i = 1; i < rEntry.operandCount; ++i)
+        {
+            value = pNaryOp->GetOperator()(value, mValues[pOperands[i]]);
+        }
+        return value;
+    }
+
+    assert(rEntry.kind == Kind::Unary);
+    const UnaryOperatorNode* pUnaryOp =
+        static_cast<const UnaryOperatorNode*>(rEntry.pNode);
+    return pUnaryOp->GetOperator()(mValues[pOperands[0]]);
+}
+
+} // namespace Emblem
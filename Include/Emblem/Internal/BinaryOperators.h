@@ -31,10 +31,21 @@ class BinaryOperator
 {
     typedef T(*Operator)(const T&, const T&);
 public:
+    /** \brief Identifies the operation independently of its function pointer. */
+    enum class Type
+    {
+        Addition,
+        Subtraction,
+        Multiplication,
+        Division,
+        Pow
+    };
+
     BinaryOperator(
+        Type type,
         Operator op,
         const std::string& rString)
-        : mOperator(op), mString(rString)
+        : mType(type), mOperator(op), mString(rString)
     {
     }
 
@@ -48,6 +59,11 @@ public:
         return mString;
     }
 
+    Type GetType() const
+    {
+        return mType;
+    }
+
     bool operator==(const BinaryOperator& rOther) const
     {
         return mOperator == rOther.mOperator;
@@ -60,6 +76,7 @@ public:
     static BinaryOperator Pow;
 
 private:
+    const Type mType;
     const Operator mOperator;
     const std::string mString;
 };
@@ -84,19 +101,19 @@ T FuncPow(const T& rA, const T& rB) { return pow(rA, rB); }
 ///////////////////////////////////////////////////////////////////////
 
 template <class T>
-BinaryOperator<T> BinaryOperator<T>::Addition(FuncAdd<T>, " + ");
+BinaryOperator<T> BinaryOperator<T>::Addition(Type::Addition, FuncAdd<T>, " + ");
 
 template <class T>
-BinaryOperator<T> BinaryOperator<T>::Subtraction(FuncSub<T>, " - ");
+BinaryOperator<T> BinaryOperator<T>::Subtraction(Type::Subtraction, FuncSub<T>, " - ");
 
 template <class T>
-BinaryOperator<T> BinaryOperator<T>::Multiplication(FuncMul<T>, " * ");
+BinaryOperator<T> BinaryOperator<T>::Multiplication(Type::Multiplication, FuncMul<T>, " * ");
 
 template <class T>
-BinaryOperator<T> BinaryOperator<T>::Division(FuncDiv<T>, " / ");
+BinaryOperator<T> BinaryOperator<T>::Division(Type::Division, FuncDiv<T>, " / ");
 
 template <class T>
-BinaryOperator<T> BinaryOperator<T>::Pow(FuncPow<T>, " ^ ");
+BinaryOperator<T> BinaryOperator<T>::Pow(Type::Pow, FuncPow<T>, " ^ ");
 
 } // namespace Internal
 } // namespace Emblem
\ No newline at end of file
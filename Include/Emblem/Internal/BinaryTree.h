@@ -22,7 +22,7 @@
 #include <vector>
 
 #include <stack>
-#include <set>
+#include <utility>
 #include <memory>
 #include <iterator>
 
@@ -56,30 +56,77 @@ public:
     {
         pNode->mpParentNode = (NodeType*)this;
         mpLeftNode = pNode;
+        onChildChanged();
     }
 
     void setRight(NodeType* pNode)
     {
         pNode->mpParentNode = (NodeType*)this;
         mpRightNode = pNode;
+        onChildChanged();
     }
 
     virtual NodeType* clone() const = 0;
 
+    /** \brief Deep copy of the subtree, made without recursion. */
     NodeType* cloneTree() const
     {
-        NodeType* pClone = clone();
-        if (mpLeftNode != nullptr)
+        // Children are linked directly rather than through setLeft/setRight,
+        // the clone is identical so any state cached on it is still valid.
+        NodeType* pRoot = clone();
+        pRoot->mpParentNode = nullptr;
+
+        std::vector<std::pair<const NodeType*, NodeType*>> nodeStack;
+        nodeStack.reserve(64);
+        nodeStack.push_back(std::make_pair((const NodeType*)this, pRoot));
+        while (!nodeStack.empty())
         {
-            pClone->setLeft(mpLeftNode->cloneTree());
+            const NodeType* pOriginal = nodeStack.back().first;
+            NodeType* pClone = nodeStack.back().second;
+            nodeStack.pop_back();
+
+            if (pOriginal->mpLeftNode != nullptr)
+            {
+                pClone->mpLeftNode = pOriginal->mpLeftNode->clone();
+                pClone->mpLeftNode->mpParentNode = pClone;
+                nodeStack.push_back(std::make_pair(
+                                        (const NodeType*)pOriginal->mpLeftNode, pClone->mpLeftNode));
+            }
+
+            if (pOriginal->mpRightNode != nullptr)
+            {
+                pClone->mpRightNode = pOriginal->mpRightNode->clone();
+                pClone->mpRightNode->mpParentNode = pClone;
+                nodeStack.push_back(std::make_pair(
+                                        (const NodeType*)pOriginal->mpRightNode, pClone->mpRightNode));
+            }
         }
 
+        return pRoot;
+    }
+
+    /**
+    * \brief Called whenever a child of this node is replaced, so derived
+    * nodes can drop state computed from their subtree.
+    */
+    virtual void onChildChanged() {}
+
+    /**
+    * \brief Unlinks the children and appends them to the list, so
+    * BinaryTree::clear() can tear a tree down without recursion.
+    */
+    virtual void detachChildren(std::vector<NodeType*>& rChildren)
+    {
+        if (mpLeftNode != nullptr)
+        {
+            rChildren.push_back(mpLeftNode);
+            mpLeftNode = nullptr;
+        }
         if (mpRightNode != nullptr)
         {
-            pClone->setRight(mpRightNode->cloneTree());
+            rChildren.push_back(mpRightNode);
+            mpRightNode = nullptr;
         }
-
-        return pClone;
     }
 };
 
@@ -129,12 +176,12 @@ public:
         if (pParentNode->mpLeftNode == pNodeToReplace)
         {
             delete pParentNode->mpLeftNode;
-            pParentNode->mpLeftNode = pReplacementNode;
+            pParentNode->setLeft(pReplacementNode);
         }
         else
         {
             delete pParentNode->mpRightNode;
-            pParentNode->mpRightNode = pReplacementNode;
+            pParentNode->setRight(pReplacementNode);
         }
 
     }
@@ -246,32 +293,20 @@ void BinaryTree<NodeType>::clear()
         return;
     }
 
-    std::set<NodeType*> nodes;
-
-    std::stack<NodeType*> nodesToWalk;
-    nodesToWalk.push(mpHead);
+    // Each node hands its children over before it is deleted, so no node
+    // destructor ever walks a subtree.
+    std::vector<NodeType*> nodesToDelete;
+    nodesToDelete.reserve(64);
+    nodesToDelete.push_back(mpHead);
     mpHead = nullptr;
 
-    while (!nodesToWalk.empty())
+    while (!nodesToDelete.empty())
     {
-        NodeType* pNode = nodesToWalk.top();
-        nodesToWalk.pop();
-        if (pNode == nullptr)
-        {
-            continue;
-        }
-
-        nodes.insert(pNode);
-        nodesToWalk.push(pNode->mpLeftNode);
-        nodesToWalk.push(pNode->mpRightNode);
-    }
+        NodeType* pNode = nodesToDelete.back();
+        nodesToDelete.pop_back();
 
-    for (NodeType* pNode : nodes)
-    {
-        pNode->mpLeftNode = nullptr;
-        pNode->mpRightNode = nullptr;
+        pNode->detachChildren(nodesToDelete);
         pNode->mpParentNode = nullptr;
-
         delete pNode;
     }
 }
@@ -307,6 +342,8 @@ const NodeType* BinaryTree<NodeType>::insertChildLeft(
     }
     pParentNode->mpLeftNode = pChildNode;
     pChildNode->mpParentNode = pParentNode;
+    pChildNode->onChildChanged();
+    pParentNode->onChildChanged();
 
     return pChildNode;
 }
@@ -329,6 +366,8 @@ const NodeType* BinaryTree<NodeType>::insertChildRight(
     }
     pParentNode->mpRightNode = pChildNode;
     pChildNode->mpParentNode = pParentNode;
+    pChildNode->onChildChanged();
+    pParentNode->onChildChanged();
 
     return pChildNode;
 }
@@ -0,0 +1,81 @@
+/**
+* \file CacheSize.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Size in bytes of the level 1 or 2 data cache of one core, as the
+* operating system reports it, or zero where it does not.
+*/
+inline std::size_t DataCacheSize(unsigned level)
+{
+#ifdef _WIN32
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        return 0;
+    }
+
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(
+        length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!GetLogicalProcessorInformation(infos.data(), &length))
+    {
+        return 0;
+    }
+
+    for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& rInfo : infos)
+    {
+        if ((rInfo.Relationship == RelationCache) && (rInfo.Cache.Level == level) &&
+                ((rInfo.Cache.Type == CacheData) || (rInfo.Cache.Type == CacheUnified)))
+        {
+            return rInfo.Cache.Size;
+        }
+    }
+    return 0;
+#elif defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    // glibc reads these from the processor, other C libraries lack them.
+    const long size = (level == 1) ? sysconf(_SC_LEVEL1_DCACHE_SIZE)
+                      : ((level == 2) ? sysconf(_SC_LEVEL2_CACHE_SIZE) : 0);
+    return (size > 0) ? static_cast<std::size_t>(size) : 0;
+#else
+    (void)level;
+    return 0;
+#endif
+}
+
+} // namespace Internal
+} // namespace Emblem
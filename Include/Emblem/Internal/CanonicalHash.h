@@ -0,0 +1,233 @@
+/**
+* \file CanonicalHash.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Hash.h"
+#include "TermNode.h"
+
+#include <cstdint>
+#include <stack>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Structural hash of a subtree with every symbol replaced by the
+* position of its first occurrence, reading leaves left to right.
+*
+* Two expressions that differ only by a renaming of their symbols have the
+* same canonical hash. The symbols are appended to rSymbols in that order.
+*/
+template <class T, class Alloc>
+std::uint64_t CanonicalHash(
+    const TermNode<T, Alloc>* pHead, std::vector<std::string>& rSymbols)
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef SymbolNode<T, Alloc> SymbolNode;
+
+    rSymbols.clear();
+    if (pHead == nullptr)
+    {
+        return 0;
+    }
+
+    std::unordered_map<std::string, std::uint64_t> symbolIndices;
+    std::vector<std::uint64_t> hashes;
+    std::stack<std::pair<const TermNode*, bool>> nodeStack;
+    nodeStack.push(std::make_pair(pHead, false));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNode = nodeStack.top().first;
+        const bool isExpanded = nodeStack.top().second;
+        nodeStack.pop();
+
+        if (!pNode->isOperator())
+        {
+            if (!pNode->isSymbol())
+            {
+                // Constants carry no names, their cached hash is canonical.
+                hashes.push_back(pNode->GetHash());
+                continue;
+            }
+
+            const SymbolNode* pSymbol = dynamic_cast<const SymbolNode*>(pNode);
+            assert(pSymbol != nullptr);
+            const std::string& rName = pSymbol->GetSymbol().toString();
+            auto symbolIter = symbolIndices.find(rName);
+            if (symbolIter == symbolIndices.end())
+            {
+                symbolIter = symbolIndices.insert(
+                                 std::make_pair(rName, (std::uint64_t)rSymbols.size())).first;
+                rSymbols.push_back(rName);
+            }
+            hashes.push_back(HashCombine(
+                                 static_cast<std::uint64_t>(HashTag::Symbol), symbolIter->second));
+            continue;
+        }
+
+        if (!isExpanded)
+        {
+            nodeStack.push(std::make_pair(pNode, true));
+            for (std::size_t i = pNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push(std::make_pair((const TermNode*)pNode->operand(i), false));
+            }
+            continue;
+        }
+
+        // Sums and products, binary or n-ary, hash as in TermNode.
+        const BinaryOperator<T>* pChainOperator = pNode->chainOperator();
+        if (pChainOperator != nullptr)
+        {
+            const std::size_t first = hashes.size() - pNode->operandCount();
+            std::uint64_t hash = ChainHashStart(*pChainOperator, pNode->operand(0), hashes[first]);
+            for (std::size_t i = first + 1; i < hashes.size(); ++i)
+            {
+                hash = HashCombine(hash, hashes[i]);
+            }
+            hashes.resize(first);
+            hashes.push_back(hash);
+            continue;
+        }
+
+        const BinaryOperatorNode* pBinaryOp =
+            dynamic_cast<const BinaryOperatorNode*>(pNode);
+        if (pBinaryOp != nullptr)
+        {
+            const std::uint64_t rightHash = hashes.back();
+            hashes.pop_back();
+            const std::uint64_t leftHash = hashes.back();
+            hashes.pop_back();
+
+            std::uint64_t hash = HashCombine(
+                                     static_cast<std::uint64_t>(HashTag::BinaryOperator),
+                                     static_cast<std::uint64_t>(pBinaryOp->GetOperator().GetType()));
+            hash = HashCombine(hash, leftHash);
+            hashes.push_back(HashCombine(hash, rightHash));
+        }
+        else
+        {
+            const UnaryOperatorNode* pUnaryOp =
+                dynamic_cast<const UnaryOperatorNode*>(pNode);
+            assert(pUnaryOp != nullptr);
+            const std::uint64_t operandHash = hashes.back();
+            hashes.pop_back();
+
+            const std::uint64_t hash = HashCombine(
+                                           static_cast<std::uint64_t>(HashTag::UnaryOperator),
+                                           static_cast<std::uint64_t>(pUnaryOp->GetOperator().GetType()));
+            hashes.push_back(HashCombine(hash, operandHash));
+        }
+    }
+
+    assert(hashes.size() == 1);
+    return hashes.back();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Whether two subtrees are identical up to a one-to-one renaming
+* of their symbols, comparing sums and products as IsStructurallyEqual().
+*/
+template <class T, class Alloc>
+bool IsRenaming(const TermNode<T, Alloc>* pA, const TermNode<T, Alloc>* pB)
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef SymbolNode<T, Alloc> SymbolNode;
+
+    std::unordered_map<std::string, std::string> namesAToB;
+    std::unordered_map<std::string, std::string> namesBToA;
+    std::vector<const TermNode*> operandsA;
+    std::vector<const TermNode*> operandsB;
+
+    std::stack<std::pair<const TermNode*, const TermNode*>> nodeStack;
+    nodeStack.push(std::make_pair(pA, pB));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNodeA = nodeStack.top().first;
+        const TermNode* pNodeB = nodeStack.top().second;
+        nodeStack.pop();
+
+        if ((pNodeA == nullptr) || (pNodeB == nullptr))
+        {
+            if (pNodeA != pNodeB)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (pNodeA->isSymbol() && pNodeB->isSymbol())
+        {
+            const std::string& rNameA =
+                dynamic_cast<const SymbolNode*>(pNodeA)->GetSymbol().toString();
+            const std::string& rNameB =
+                dynamic_cast<const SymbolNode*>(pNodeB)->GetSymbol().toString();
+
+            const auto mappedA = namesAToB.insert(std::make_pair(rNameA, rNameB));
+            const auto mappedB = namesBToA.insert(std::make_pair(rNameB, rNameA));
+            if ((mappedA.first->second != rNameB) || (mappedB.first->second != rNameA))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (pNodeA->chainOperator() != nullptr)
+        {
+            if (!FlattenChainPair(pNodeA, pNodeB, operandsA, operandsB))
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < operandsA.size(); ++i)
+            {
+                nodeStack.push(std::make_pair(operandsA[i], operandsB[i]));
+            }
+            continue;
+        }
+
+        if (!pNodeA->isEquivalent(*pNodeB) ||
+                (pNodeA->operandCount() != pNodeB->operandCount()))
+        {
+            return false;
+        }
+
+        for (std::size_t i = pNodeA->operandCount(); i-- > 0;)
+        {
+            nodeStack.push(std::make_pair(
+                               (const TermNode*)pNodeA->operand(i),
+                               (const TermNode*)pNodeB->operand(i)));
+        }
+    }
+
+    return true;
+}
+
+} // namespace Internal
+} // namespace Emblem
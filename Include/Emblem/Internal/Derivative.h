@@ -24,6 +24,9 @@
 
 #include "../Symbol.h"
 
+#include <cstddef>
+#include <vector>
+
 namespace Emblem
 {
 namespace Internal
@@ -32,35 +35,55 @@ namespace Internal
 template <class T, class Alloc>
 using ExpressionTree = BinaryTree<TermNode<T, Alloc>>;
 
+/*
+* The rules below build the derivative of a single node from the
+* derivatives of its operands, left to right, and take ownership of those
+* on success. They return nullptr for operators without a rule, leaving
+* the operand derivatives with the caller.
+*/
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperatorDerivative(
+    const BinaryOperatorNode<T, Alloc>* pBinaryOp, TermNode<T, Alloc>* const* ppOperandDerivatives);
 template <class T, class Alloc>
 TermNode<T, Alloc>* OperatorDerivative(
-    const BinaryOperatorNode<T, Alloc>* pBinaryOp, const Symbol<T, Alloc>& rSymbol);
+    const UnaryOperatorNode<T, Alloc>* pUnaryOp, TermNode<T, Alloc>* const* ppOperandDerivatives);
 template <class T, class Alloc>
 TermNode<T, Alloc>* OperatorDerivative(
-    const UnaryOperatorNode<T, Alloc>* pUnaryOp, const Symbol<T, Alloc>& rSymbol);
+    const NaryOperatorNode<T, Alloc>* pNaryOp, TermNode<T, Alloc>* const* ppOperandDerivatives);
 
 template <class T, class Alloc>
-TermNode<T, Alloc>* Derivative(const TermNode<T, Alloc>* pNode, const Symbol<T, Alloc>& rSymbol)
+TermNode<T, Alloc>* NodeDerivative(
+    const TermNode<T, Alloc>* pNode, TermNode<T, Alloc>* const* ppOperandDerivatives,
+    const Symbol<T, Alloc>& rSymbol)
 {
     typedef ConstantNode<T, Alloc> ConstantNode;
     typedef SymbolNode<T, Alloc> SymbolNode;
     typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
     typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef NaryOperatorNode<T, Alloc> NaryOperatorNode;
 
     if (pNode->isOperator())
     {
+        const NaryOperatorNode* pNaryOp =
+            dynamic_cast<const NaryOperatorNode*>(pNode);
+        if (pNaryOp != nullptr)
+        {
+            return OperatorDerivative(pNaryOp, ppOperandDerivatives);
+        }
+
         const BinaryOperatorNode* pBinaryOp =
             dynamic_cast<const BinaryOperatorNode*>(pNode);
         if (pBinaryOp != nullptr)
         {
-            return OperatorDerivative(pBinaryOp, rSymbol);
+            return OperatorDerivative(pBinaryOp, ppOperandDerivatives);
         }
         else
         {
             const UnaryOperatorNode* pUnaryOp =
                 dynamic_cast<const UnaryOperatorNode*>(pNode);
             assert(pUnaryOp != nullptr);
-            return OperatorDerivative(pUnaryOp, rSymbol);
+            return OperatorDerivative(pUnaryOp, ppOperandDerivatives);
         }
     }
     else
@@ -87,9 +110,70 @@ TermNode<T, Alloc>* Derivative(const TermNode<T, Alloc>* pNode, const Symbol<T,
     }
 }
 
+/**
+* \brief Derivative of the subtree with respect to the symbol, or nullptr
+* if it contains an operator without a derivative rule.
+*
+* The subtree is walked with an explicit stack, so its depth is not
+* limited by the call stack.
+*/
+template <class T, class Alloc>
+TermNode<T, Alloc>* Derivative(const TermNode<T, Alloc>* pNode, const Symbol<T, Alloc>& rSymbol)
+{
+    typedef TermNode<T, Alloc> TermNode;
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    // Post-order, as in TermNode::evaluate(): the derivatives of the
+    // operands are pushed in order, then the operator replaces them with
+    // its own.
+    std::vector<Frame> nodeStack;
+    std::vector<TermNode*> derivatives;
+    nodeStack.reserve(64);
+    derivatives.reserve(64);
+
+    const Frame head = { pNode, pNode->operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const std::size_t first = derivatives.size() - rFrame.operandCount;
+        TermNode* pDerivative =
+            NodeDerivative(rFrame.pNode, derivatives.data() + first, rSymbol);
+        if (pDerivative == nullptr)
+        {
+            ExpressionTree<T, Alloc> tree;
+            for (TermNode* pPending : derivatives)
+            {
+                tree.insertToHead(pPending);
+            }
+            return nullptr;
+        }
+
+        derivatives.erase(derivatives.begin() + first, derivatives.end());
+        derivatives.push_back(pDerivative);
+        nodeStack.pop_back();
+    }
+
+    return derivatives.back();
+}
+
 template <class T, class Alloc>
 TermNode<T, Alloc>* OperatorDerivative(
-    const BinaryOperatorNode<T, Alloc>* pBinaryOp, const Symbol<T, Alloc>& rSymbol)
+    const BinaryOperatorNode<T, Alloc>* pBinaryOp, TermNode<T, Alloc>* const* ppOperandDerivatives)
 {
     typedef TermNode<T, Alloc> TermNode;
     typedef BinaryOperator<T> BinaryOperator;
@@ -101,9 +185,9 @@ TermNode<T, Alloc>* OperatorDerivative(
     if ((rOperator == BinaryOperator::Addition) ||
             (rOperator == BinaryOperator::Subtraction))
     {
-        pDerivative = pBinaryOp->clone();
-        pDerivative->setLeft(Derivative(pBinaryOp->mpLeftNode, rSymbol));
-        pDerivative->setRight(Derivative(pBinaryOp->mpRightNode, rSymbol));
+        pDerivative = new BinaryOperatorNode(rOperator);
+        pDerivative->setLeft(ppOperandDerivatives[0]);
+        pDerivative->setRight(ppOperandDerivatives[1]);
     }
     else if (rOperator == BinaryOperator::Multiplication)
     {
@@ -114,11 +198,11 @@ TermNode<T, Alloc>* OperatorDerivative(
         pDerivative->setLeft(pLeftTerm);
         pDerivative->setRight(pRightTerm);
 
-        pLeftTerm->setLeft(Derivative(pBinaryOp->mpLeftNode, rSymbol));
-        pLeftTerm->setRight(pBinaryOp->mpRightNode->clone());
+        pLeftTerm->setLeft(ppOperandDerivatives[0]);
+        pLeftTerm->setRight(pBinaryOp->mpRightNode->cloneTree());
 
-        pRightTerm->setLeft(pBinaryOp->mpLeftNode->clone());
-        pRightTerm->setRight(Derivative(pBinaryOp->mpRightNode, rSymbol));
+        pRightTerm->setLeft(pBinaryOp->mpLeftNode->cloneTree());
+        pRightTerm->setRight(ppOperandDerivatives[1]);
     }
     else if (rOperator == BinaryOperator::Division)
     {
@@ -134,13 +218,13 @@ TermNode<T, Alloc>* OperatorDerivative(
         pTopTerm->setLeft(pLeftTerm);
         pTopTerm->setRight(pRightTerm);
 
-        pLeftTerm->setLeft(Derivative(pBinaryOp->mpLeftNode, rSymbol));
-        pLeftTerm->setRight(pBinaryOp->mpRightNode->clone());
+        pLeftTerm->setLeft(ppOperandDerivatives[0]);
+        pLeftTerm->setRight(pBinaryOp->mpRightNode->cloneTree());
 
-        pRightTerm->setLeft(pBinaryOp->mpLeftNode->clone());
-        pRightTerm->setRight(Derivative(pBinaryOp->mpRightNode, rSymbol));
+        pRightTerm->setLeft(pBinaryOp->mpLeftNode->cloneTree());
+        pRightTerm->setRight(ppOperandDerivatives[1]);
 
-        pBottomTerm->setLeft(pBinaryOp->mpRightNode->clone());
+        pBottomTerm->setLeft(pBinaryOp->mpRightNode->cloneTree());
         pBottomTerm->setRight(new ConstantNode(2.0));
     }
 
@@ -149,11 +233,97 @@ TermNode<T, Alloc>* OperatorDerivative(
 
 template <class T, class Alloc>
 TermNode<T, Alloc>* OperatorDerivative(
-    const UnaryOperatorNode<T, Alloc>* pUnaryOp, const Symbol<T, Alloc>& rSymbol)
+    const UnaryOperatorNode<T, Alloc>* pUnaryOp, TermNode<T, Alloc>* const* ppOperandDerivatives)
 {
+    typedef TermNode<T, Alloc> TermNode;
+    typedef BinaryOperator<T> BinaryOperator;
+    typedef UnaryOperator<T> UnaryOperator;
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef ConstantNode<T, Alloc> ConstantNode;
+
+    // The linear operators, and the powers strength reduction leaves.
+    const auto& rOperator = pUnaryOp->GetOperator();
+    if ((rOperator == UnaryOperator::Negate) ||
+            (rOperator == UnaryOperator::Identity))
+    {
+        UnaryOperatorNode* pDerivative = new UnaryOperatorNode(rOperator);
+        pDerivative->setLeft(ppOperandDerivatives[0]);
+        return pDerivative;
+    }
+    else if ((rOperator == UnaryOperator::Square) ||
+             (rOperator == UnaryOperator::Cube))
+    {
+        // (u^2)' = (2 * u) * u', (u^3)' = (3 * u^2) * u'
+        const bool isSquare = (rOperator == UnaryOperator::Square);
+        TermNode* pPower = pUnaryOp->mpLeftNode->cloneTree();
+        if (!isSquare)
+        {
+            TermNode* pSquare = new UnaryOperatorNode(UnaryOperator::Square);
+            pSquare->setLeft(pPower);
+            pPower = pSquare;
+        }
+
+        TermNode* pScaled = new BinaryOperatorNode(BinaryOperator::Multiplication);
+        pScaled->setLeft(new ConstantNode(isSquare ? T(2) : T(3)));
+        pScaled->setRight(pPower);
+
+        TermNode* pDerivative = new BinaryOperatorNode(BinaryOperator::Multiplication);
+        pDerivative->setLeft(pScaled);
+        pDerivative->setRight(ppOperandDerivatives[0]);
+        return pDerivative;
+    }
+    else if (rOperator == UnaryOperator::Reciprocal)
+    {
+        // (1/u)' = -(u' / u^2)
+        TermNode* pSquare = new UnaryOperatorNode(UnaryOperator::Square);
+        pSquare->setLeft(pUnaryOp->mpLeftNode->cloneTree());
+
+        TermNode* pQuotient = new BinaryOperatorNode(BinaryOperator::Division);
+        pQuotient->setLeft(ppOperandDerivatives[0]);
+        pQuotient->setRight(pSquare);
+
+        TermNode* pDerivative = new UnaryOperatorNode(UnaryOperator::Negate);
+        pDerivative->setLeft(pQuotient);
+        return pDerivative;
+    }
+
     return nullptr;
 }
 
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperatorDerivative(
+    const NaryOperatorNode<T, Alloc>* pNaryOp, TermNode<T, Alloc>* const* ppOperandDerivatives)
+{
+    typedef BinaryOperator<T> BinaryOperator;
+    typedef SumNode<T, Alloc> SumNode;
+    typedef ProductNode<T, Alloc> ProductNode;
+
+    const std::size_t count = pNaryOp->operandCount();
+    SumNode* pDerivative = new SumNode();
+    if (pNaryOp->GetOperator() == BinaryOperator::Addition)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            pDerivative->append(ppOperandDerivatives[i]);
+        }
+        return pDerivative;
+    }
+
+    // Product rule, one term per operand.
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        ProductNode* pTerm = new ProductNode();
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            pTerm->append((i == j) ? ppOperandDerivatives[j]
+                          : pNaryOp->operand(j)->cloneTree());
+        }
+        pDerivative->append(pTerm);
+    }
+    return pDerivative;
+}
+
 
 } // namespace Internal
 } // namespace Emblem
\ No newline at end of file
@@ -0,0 +1,235 @@
+/**
+* \file FileSystem.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class MappedFile
+* \brief Read-only memory mapping of a whole file.
+*/
+class MappedFile
+{
+public:
+    MappedFile()
+        : mpData(nullptr), mSize(0)
+    {
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /** \brief Maps the file, returns false if it cannot be opened or is empty. */
+    bool open(const std::string& rPath)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(rPath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || (size.QuadPart == 0))
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+
+        void* pView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (pView == nullptr)
+        {
+            return false;
+        }
+
+        mpData = static_cast<const unsigned char*>(pView);
+        mSize = static_cast<std::size_t>(size.QuadPart);
+#else
+        const int file = ::open(rPath.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+
+        struct stat status;
+        if ((fstat(file, &status) != 0) || (status.st_size <= 0))
+        {
+            ::close(file);
+            return false;
+        }
+
+        void* pView = mmap(nullptr, static_cast<std::size_t>(status.st_size),
+                           PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (pView == MAP_FAILED)
+        {
+            return false;
+        }
+
+        mpData = static_cast<const unsigned char*>(pView);
+        mSize = static_cast<std::size_t>(status.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+        if (mpData == nullptr)
+        {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(mpData);
+#else
+        munmap(const_cast<unsigned char*>(mpData), mSize);
+#endif
+        mpData = nullptr;
+        mSize = 0;
+    }
+
+    const unsigned char* data() const
+    {
+        return mpData;
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* mpData;
+    std::size_t mSize;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Creates the directory and any missing parents. */
+inline bool CreateDirectories(const std::string& rPath)
+{
+    for (std::size_t i = 1; i <= rPath.size(); ++i)
+    {
+        if ((i != rPath.size()) && (rPath[i] != '/') && (rPath[i] != '\\'))
+        {
+            continue;
+        }
+
+        const std::string directory = rPath.substr(0, i);
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+#ifdef _WIN32
+    const DWORD attributes = GetFileAttributesA(rPath.c_str());
+    return (attributes != INVALID_FILE_ATTRIBUTES) &&
+           ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+#else
+    struct stat status;
+    return (stat(rPath.c_str(), &status) == 0) && S_ISDIR(status.st_mode);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Writes the data to a temporary file next to the destination and
+* moves it into place, so readers never observe a partially written file.
+*/
+inline bool WriteFileAtomically(
+    const std::string& rPath, const void* pData, std::size_t size)
+{
+#ifdef _WIN32
+    const unsigned long processId = GetCurrentProcessId();
+#else
+    const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+    static std::atomic<unsigned long> sWriteCount(0);
+    const std::string temporaryPath = rPath + ".tmp" + std::to_string(processId) +
+                                      "-" + std::to_string(sWriteCount++);
+
+    std::FILE* pFile = std::fopen(temporaryPath.c_str(), "wb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+
+    const bool isWritten = (std::fwrite(pData, 1, size, pFile) == size);
+    const bool isClosed = (std::fclose(pFile) == 0);
+    if (!isWritten || !isClosed)
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    const bool isMoved = MoveFileExA(temporaryPath.c_str(), rPath.c_str(),
+                                     MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    const bool isMoved = std::rename(temporaryPath.c_str(), rPath.c_str()) == 0;
+#endif
+    if (!isMoved)
+    {
+        std::remove(temporaryPath.c_str());
+    }
+    return isMoved;
+}
+
+} // namespace Internal
+} // namespace Emblem
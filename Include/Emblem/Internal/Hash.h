@@ -0,0 +1,117 @@
+/**
+* \file Hash.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* Hashes used for structural identity of expressions. They are fixed
+* 64-bit functions rather than std::hash so that a value computed in one
+* process, or on one platform, can be compared against another.
+*/
+
+const std::uint64_t HashOffsetBasis = 14695981039346656037ULL;
+const std::uint64_t HashPrime = 1099511628211ULL;
+
+/** \brief FNV-1a hash of a block of bytes. */
+inline std::uint64_t HashBytes(const void* pData, std::size_t size)
+{
+    const unsigned char* pBytes = static_cast<const unsigned char*>(pData);
+    std::uint64_t hash = HashOffsetBasis;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= pBytes[i];
+        hash *= HashPrime;
+    }
+    return hash;
+}
+
+inline std::uint64_t HashString(const std::string& rString)
+{
+    return HashBytes(rString.data(), rString.size());
+}
+
+/** \brief Mixes a value into a running hash. Order dependent. */
+inline std::uint64_t HashCombine(std::uint64_t seed, std::uint64_t value)
+{
+    // 64-bit variant of boost::hash_combine followed by a finalizer so
+    // that small integers (operator tags) spread over all bits.
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    seed ^= seed >> 33;
+    seed *= 0xff51afd7ed558ccdULL;
+    seed ^= seed >> 33;
+    return seed;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+std::uint64_t HashValue(const T& rValue, std::true_type /*isTriviallyCopyable*/)
+{
+    return HashBytes(&rValue, sizeof(T));
+}
+
+template <class T>
+std::uint64_t HashValue(const T& rValue, std::false_type /*isTriviallyCopyable*/)
+{
+    return static_cast<std::uint64_t>(std::hash<T>()(rValue));
+}
+
+/**
+* \brief Hashes a constant by its bit pattern when possible, so that
+* distinct constants (including 0.0 and -0.0) hash differently.
+*/
+template <class T>
+std::uint64_t HashValue(const T& rValue)
+{
+    return HashValue(rValue, std::is_trivially_copyable<T>());
+}
+
+template <class T>
+bool IsBitwiseEqual(const T& rA, const T& rB, std::true_type /*isTriviallyCopyable*/)
+{
+    return std::memcmp(&rA, &rB, sizeof(T)) == 0;
+}
+
+template <class T>
+bool IsBitwiseEqual(const T& rA, const T& rB, std::false_type /*isTriviallyCopyable*/)
+{
+    return rA == rB;
+}
+
+/** \brief Equality matching HashValue(). */
+template <class T>
+bool IsBitwiseEqual(const T& rA, const T& rB)
+{
+    return IsBitwiseEqual(rA, rB, std::is_trivially_copyable<T>());
+}
+
+} // namespace Internal
+} // namespace Emblem
@@ -0,0 +1,171 @@
+/**
+* \file IntervalArithmetic.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "../Interval.h"
+#include "../Program.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Whether the interval [lower, upper] holds phase + k * period for an integer k. */
+template <class T>
+bool ContainsPeriodicPoint(const Interval<T>& rRange, T phase, T period)
+{
+    const T k = std::ceil((rRange.lower - phase) / period);
+    return phase + k * period <= rRange.upper;
+}
+
+/** \brief Range of a unary operation over every value of rA. */
+template <class T>
+Interval<T> IntervalOf(OpCode opCode, const Interval<T>& rA)
+{
+    const T pi = T(3.14159265358979323846);
+    if (!rA.isBounded() && (opCode != OpCode::Identity) && (opCode != OpCode::Negate))
+    {
+        return Interval<T>::Everything();
+    }
+
+    switch (opCode)
+    {
+    case OpCode::Sin:
+    case OpCode::Cos:
+    {
+        const T shift = (opCode == OpCode::Cos) ? pi / 2 : T(0);
+        const Interval<T> shifted(rA.lower + shift, rA.upper + shift);
+        const T a = std::sin(shifted.lower);
+        const T b = std::sin(shifted.upper);
+        return Interval<T>(ContainsPeriodicPoint(shifted, -pi / 2, 2 * pi) ? T(-1) : std::min(a, b),
+                           ContainsPeriodicPoint(shifted, pi / 2, 2 * pi) ? T(1) : std::max(a, b));
+    }
+    case OpCode::Tan:
+        return ContainsPeriodicPoint(rA, pi / 2, pi) ? Interval<T>::Everything()
+               : Interval<T>(std::tan(rA.lower), std::tan(rA.upper));
+    case OpCode::Identity:
+        return rA;
+    case OpCode::Abs:
+        return Interval<T>(rA.mignitude(), rA.magnitude());
+    case OpCode::Negate:
+        return Interval<T>(-rA.upper, -rA.lower);
+    case OpCode::Exp:
+        return Interval<T>(std::exp(rA.lower), std::exp(rA.upper));
+    case OpCode::Ln:
+    case OpCode::Log10:
+        if (rA.lower <= 0)
+        {
+            return Interval<T>::Everything();
+        }
+        return (opCode == OpCode::Ln) ? Interval<T>(std::log(rA.lower), std::log(rA.upper))
+               : Interval<T>(std::log10(rA.lower), std::log10(rA.upper));
+    case OpCode::Sqrt:
+        if (rA.lower < 0)
+        {
+            return Interval<T>::Everything();
+        }
+        return Interval<T>(std::sqrt(rA.lower), std::sqrt(rA.upper));
+    case OpCode::Square:
+        return Interval<T>(rA.mignitude() * rA.mignitude(), rA.magnitude() * rA.magnitude());
+    case OpCode::Cube:
+        return Interval<T>(rA.lower * rA.lower * rA.lower, rA.upper * rA.upper * rA.upper);
+    case OpCode::Reciprocal:
+        if (rA.contains(T(0)))
+        {
+            return Interval<T>::Everything();
+        }
+        return Interval<T>(1 / rA.upper, 1 / rA.lower);
+    default:
+        break;
+    }
+    assert(0);
+    return Interval<T>::Everything();
+}
+
+/** \brief Range of a binary operation over every pair of values of rA and rB. */
+template <class T>
+Interval<T> IntervalOf(OpCode opCode, const Interval<T>& rA, const Interval<T>& rB)
+{
+    if (!rA.isBounded() || !rB.isBounded())
+    {
+        return Interval<T>::Everything();
+    }
+
+    switch (opCode)
+    {
+    case OpCode::Add:
+        return Interval<T>(rA.lower + rB.lower, rA.upper + rB.upper);
+    case OpCode::Subtract:
+        return Interval<T>(rA.lower - rB.upper, rA.upper - rB.lower);
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    {
+        if ((opCode == OpCode::Divide) && rB.contains(T(0)))
+        {
+            return Interval<T>::Everything();
+        }
+        const Interval<T> b = (opCode == OpCode::Divide)
+                              ? Interval<T>(1 / rB.upper, 1 / rB.lower) : rB;
+        const T products[] = { rA.lower * b.lower, rA.lower * b.upper,
+                               rA.upper * b.lower, rA.upper * b.upper
+                             };
+        return Interval<T>(*std::min_element(products, products + 4),
+                           *std::max_element(products, products + 4));
+    }
+    case OpCode::Pow:
+    {
+        // A positive base is monotonic in each argument, so the corners
+        // bound the result. Otherwise only integer exponents are defined.
+        if (rA.lower > 0)
+        {
+            const T corners[] = { std::pow(rA.lower, rB.lower), std::pow(rA.lower, rB.upper),
+                                  std::pow(rA.upper, rB.lower), std::pow(rA.upper, rB.upper)
+                                };
+            return Interval<T>(*std::min_element(corners, corners + 4),
+                               *std::max_element(corners, corners + 4));
+        }
+        const T n = rB.lower;
+        if (!rB.isPoint() || (std::floor(n) != n) || ((n < 0) && rA.contains(T(0))))
+        {
+            return Interval<T>::Everything();
+        }
+        if (std::fmod(n, T(2)) != 0)
+        {
+            const T a = std::pow(rA.lower, n);
+            const T b = std::pow(rA.upper, n);
+            return Interval<T>(std::min(a, b), std::max(a, b));
+        }
+        const T a = std::pow(rA.mignitude(), n);
+        const T b = std::pow(rA.magnitude(), n);
+        return Interval<T>(std::min(a, b), std::max(a, b));
+    }
+    default:
+        break;
+    }
+    assert(0);
+    return Interval<T>::Everything();
+}
+
+} // namespace Internal
+} // namespace Emblem
@@ -0,0 +1,143 @@
+/**
+* \file OperationCount.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "TermNode.h"
+
+#include "../CostModel.h"
+
+#include <stack>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Adds the operations done by a single node, ignoring its children. */
+template <class T, class Alloc>
+void CountOperation(const TermNode<T, Alloc>* pNode, OperationCount& rCount)
+{
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+
+    if (!pNode->isOperator())
+    {
+        return;
+    }
+
+    const NaryOperatorNode<T, Alloc>* pNaryOp =
+        dynamic_cast<const NaryOperatorNode<T, Alloc>*>(pNode);
+    if (pNaryOp != nullptr)
+    {
+        const std::size_t count = pNaryOp->operandCount() - 1;
+        if (pNaryOp->GetOperator() == BinaryOperator<T>::Addition)
+        {
+            rCount.additions += count;
+        }
+        else
+        {
+            rCount.multiplications += count;
+        }
+        return;
+    }
+
+    const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode);
+    if (pBinaryOp != nullptr)
+    {
+        switch (pBinaryOp->GetOperator().GetType())
+        {
+        case BinaryOperator<T>::Type::Addition:
+        case BinaryOperator<T>::Type::Subtraction:
+            ++rCount.additions;
+            break;
+        case BinaryOperator<T>::Type::Multiplication:
+            ++rCount.multiplications;
+            break;
+        case BinaryOperator<T>::Type::Division:
+            ++rCount.divisions;
+            break;
+        case BinaryOperator<T>::Type::Pow:
+            ++rCount.powers;
+            break;
+        }
+        return;
+    }
+
+    const UnaryOperatorNode* pUnaryOp = static_cast<const UnaryOperatorNode*>(pNode);
+    switch (pUnaryOp->GetOperator().GetType())
+    {
+    case UnaryOperator<T>::Type::Sin:
+    case UnaryOperator<T>::Type::Cos:
+    case UnaryOperator<T>::Type::Tan:
+    case UnaryOperator<T>::Type::Exp:
+    case UnaryOperator<T>::Type::Ln:
+    case UnaryOperator<T>::Type::Log10:
+        ++rCount.transcendentals;
+        break;
+    case UnaryOperator<T>::Type::Sqrt:
+        ++rCount.squareRoots;
+        break;
+    case UnaryOperator<T>::Type::Square:
+        ++rCount.multiplications;
+        break;
+    case UnaryOperator<T>::Type::Cube:
+        rCount.multiplications += 2;
+        break;
+    case UnaryOperator<T>::Type::Reciprocal:
+        ++rCount.divisions;
+        break;
+    default:
+        ++rCount.others;
+        break;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Operations needed to evaluate the subtree once, node by node. */
+template <class T, class Alloc>
+OperationCount CountOperations(const TermNode<T, Alloc>* pHead)
+{
+    typedef TermNode<T, Alloc> TermNode;
+
+    OperationCount count;
+    if (pHead == nullptr)
+    {
+        return count;
+    }
+
+    std::stack<const TermNode*> nodeStack;
+    nodeStack.push(pHead);
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNode = nodeStack.top();
+        nodeStack.pop();
+
+        CountOperation(pNode, count);
+        for (std::size_t i = pNode->operandCount(); i-- > 0;)
+        {
+            nodeStack.push(pNode->operand(i));
+        }
+    }
+    return count;
+}
+
+} // namespace Internal
+} // namespace Emblem
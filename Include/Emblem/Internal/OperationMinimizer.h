@@ -0,0 +1,853 @@
+/**
+* \file OperationMinimizer.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "BinaryTree.h"
+#include "OperationCount.h"
+#include "StrengthReduction.h"
+#include "TermNode.h"
+
+#include "../CostModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stack>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class OperationMinimizer
+* \brief Rewrites sums of products to need fewer operations.
+*
+* Every region of additions, subtractions, multiplications and negations
+* is flattened into terms c * f1^n1 * f2^n2 ..., where the factors are the
+* minimized operands of the region compared structurally. Like terms are
+* collected, factors shared by several terms are pulled out, largest
+* sharing first, and a coefficient shared by all terms is multiplied once.
+* A region is only replaced if the result is cheaper under the cost model.
+*
+* The rewrites are exact in real arithmetic, in floating point results may
+* differ by rounding.
+*/
+template <class T, class Alloc>
+class OperationMinimizer
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef ConstantNode<T, Alloc> ConstantNode;
+    typedef BinaryOperator<T> BinaryOperator;
+    typedef UnaryOperator<T> UnaryOperator;
+    typedef StrengthReduction<T, Alloc> StrengthReduction;
+public:
+    explicit OperationMinimizer(const CostModel& rCostModel)
+        : mCostModel(rCostModel)
+    {
+    }
+
+    /** \brief Returns a new tree computing the same value, the input is left as is. */
+    TermNode* run(const TermNode* pHead) const;
+
+private:
+    /** \brief Factor id and the power it is raised to. */
+    typedef std::pair<std::size_t, unsigned> Factor;
+
+    /** \brief coefficient * product of factors, factors sorted by id. */
+    struct Term
+    {
+        T coefficient;
+        std::vector<Factor> factors;
+    };
+
+    /** \brief Owns the distinct factors of one region. */
+    class FactorTable
+    {
+    public:
+        explicit FactorTable(const CostModel& rCostModel)
+            : mCostModel(rCostModel)
+        {
+        }
+
+        ~FactorTable()
+        {
+            for (TermNode* pFactor : mFactors)
+            {
+                BinaryTree<TermNode> tree;
+                tree.insertToHead(pFactor);
+            }
+        }
+
+        /** \brief Takes ownership of the factor and returns its id. */
+        std::size_t intern(TermNode* pFactor);
+
+        const TermNode* get(std::size_t id) const
+        {
+            return mFactors[id];
+        }
+
+        double cost(std::size_t id) const
+        {
+            return mCosts[id];
+        }
+
+        std::size_t size() const
+        {
+            return mFactors.size();
+        }
+
+    private:
+        FactorTable(const FactorTable&);
+        FactorTable& operator=(const FactorTable&);
+
+        const CostModel& mCostModel;
+        std::vector<TermNode*> mFactors;
+        std::vector<double> mCosts;
+        std::unordered_multimap<std::uint64_t, std::size_t> mIds;
+    };
+
+    /**
+    * \brief Terms of a region, their factors indexing the factor nodes in
+    * the order they were found, before those are minimized.
+    */
+    struct Region
+    {
+        std::vector<Term> terms;
+        std::vector<const TermNode*> factorNodes;
+    };
+
+    TermNode* minimize(const TermNode* pHead) const;
+    /**
+    * \brief Builds the region from its minimized factor nodes, which it
+    * takes ownership of. Returns nullptr if the result is not cheaper.
+    */
+    TermNode* minimizeRegion(const TermNode* pNode, Region& rRegion,
+                             TermNode* const* ppFactors) const;
+    /** \brief Returns false if the region has too many terms. */
+    bool collectTerms(const TermNode* pNode, Region& rRegion) const;
+    void collectFactors(const TermNode* pNode, Term& rTerm,
+                        std::vector<const TermNode*>& rFactorNodes) const;
+    TermNode* buildSum(const std::vector<Term>& rTerms, const FactorTable& rFactors) const;
+    double cost(const TermNode* pNode) const;
+
+    static void MergeFactors(Term& rTerm);
+    static void CollectLikeTerms(std::vector<Term>& rTerms);
+    /**
+    * \brief Splits the terms sharing the factor held by most of them into
+    * inner * factor^power, with the power taken out, and the rest. Returns
+    * false if no factor is shared.
+    */
+    static bool FactorOut(const std::vector<Term>& rTerms, const FactorTable& rFactors,
+                          std::size_t& rFactor, unsigned& rPower, bool& rIsNegative,
+                          std::vector<Term>& rInner, std::vector<Term>& rRest);
+    static TermNode* BuildUnfactoredSum(const std::vector<Term>& rTerms,
+                                        const FactorTable& rFactors);
+    static TermNode* BuildLinearSum(std::vector<Term> terms, const FactorTable& rFactors);
+    static TermNode* BuildProduct(const Term& rTerm, const FactorTable& rFactors);
+    static TermNode* BuildPower(const TermNode* pFactor, unsigned power);
+    static TermNode* CloneTree(const TermNode* pNode);
+    static bool IsRegion(const TermNode* pNode);
+
+    const CostModel& mCostModel;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t OperationMinimizer<T, Alloc>::FactorTable::intern(TermNode* pFactor)
+{
+    const std::uint64_t hash = pFactor->GetHash();
+    const auto range = mIds.equal_range(hash);
+    for (auto idIter = range.first; idIter != range.second; ++idIter)
+    {
+        if (IsStructurallyEqual<T, Alloc>(mFactors[idIter->second], pFactor))
+        {
+            BinaryTree<TermNode> tree;
+            tree.insertToHead(pFactor);
+            return idIter->second;
+        }
+    }
+
+    const std::size_t id = mFactors.size();
+    mFactors.push_back(pFactor);
+    mCosts.push_back(CountOperations(pFactor).cost(mCostModel));
+    mIds.insert(std::make_pair(hash, id));
+    return id;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::run(const TermNode* pHead) const
+{
+    if (pHead == nullptr)
+    {
+        return nullptr;
+    }
+    return minimize(pHead);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::minimize(const TermNode* pHead) const
+{
+    struct Frame
+    {
+        const TermNode* pNode;
+        bool isExpanded;
+        Region region;
+    };
+
+    // Post-order with an explicit stack. A region waits on the factors
+    // found in it, any other operator on its operands, and every finished
+    // node leaves its minimized copy on the result stack.
+    std::vector<Frame> nodeStack;
+    std::vector<TermNode*> results;
+    nodeStack.push_back(Frame());
+    nodeStack.back().pNode = pHead;
+    nodeStack.back().isExpanded = false;
+    while (!nodeStack.empty())
+    {
+        const std::size_t frameIndex = nodeStack.size() - 1;
+        const TermNode* pNode = nodeStack[frameIndex].pNode;
+        const bool isRegion = IsRegion(pNode);
+        if (!nodeStack[frameIndex].isExpanded)
+        {
+            nodeStack[frameIndex].isExpanded = true;
+            if (pNode->isLeaf() ||
+                    (isRegion && !collectTerms(pNode, nodeStack[frameIndex].region)))
+            {
+                results.push_back(CloneTree(pNode));
+                nodeStack.pop_back();
+                continue;
+            }
+
+            // Pushed last first, so they finish in order.
+            const std::size_t count = isRegion
+                                      ? nodeStack[frameIndex].region.factorNodes.size()
+                                      : pNode->operandCount();
+            for (std::size_t i = count; i-- > 0;)
+            {
+                Frame operand;
+                operand.pNode = isRegion ? nodeStack[frameIndex].region.factorNodes[i]
+                                : pNode->operand(i);
+                operand.isExpanded = false;
+                nodeStack.push_back(std::move(operand));
+            }
+            continue;
+        }
+
+        Frame& rFrame = nodeStack.back();
+        const std::size_t count = isRegion ? rFrame.region.factorNodes.size()
+                                  : pNode->operandCount();
+        TermNode* const* ppOperands = results.data() + (results.size() - count);
+        TermNode* pResult = nullptr;
+        if (isRegion)
+        {
+            pResult = minimizeRegion(pNode, rFrame.region, ppOperands);
+            if (pResult == nullptr)
+            {
+                pResult = CloneTree(pNode);
+            }
+        }
+        else
+        {
+            // Any other operator is kept, only its operands are minimized.
+            pResult = pNode->clone();
+            pResult->mpParentNode = nullptr;
+            pResult->mpLeftNode = nullptr;
+            pResult->mpRightNode = nullptr;
+            std::size_t operand = 0;
+            if (pNode->mpLeftNode != nullptr)
+            {
+                pResult->setLeft(ppOperands[operand++]);
+            }
+            if (pNode->mpRightNode != nullptr)
+            {
+                pResult->setRight(ppOperands[operand++]);
+            }
+        }
+
+        results.resize(results.size() - count);
+        results.push_back(pResult);
+        nodeStack.pop_back();
+    }
+
+    return results.back();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::minimizeRegion(
+    const TermNode* pNode, Region& rRegion, TermNode* const* ppFactors) const
+{
+    FactorTable factors(mCostModel);
+    std::vector<std::size_t> ids(rRegion.factorNodes.size());
+    for (std::size_t i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = factors.intern(ppFactors[i]);
+    }
+    for (Term& rTerm : rRegion.terms)
+    {
+        for (Factor& rFactor : rTerm.factors)
+        {
+            rFactor.first = ids[rFactor.first];
+        }
+        MergeFactors(rTerm);
+    }
+
+    CollectLikeTerms(rRegion.terms);
+    TermNode* pResult = buildSum(rRegion.terms, factors);
+    if (cost(pResult) < cost(pNode))
+    {
+        return pResult;
+    }
+
+    BinaryTree<TermNode> tree;
+    tree.insertToHead(pResult);
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool OperationMinimizer<T, Alloc>::collectTerms(const TermNode* pNode, Region& rRegion) const
+{
+    std::vector<Term>& rTerms = rRegion.terms;
+    std::stack<std::pair<const TermNode*, T>> nodeStack;
+    nodeStack.push(std::make_pair(pNode, T(1)));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pTermNode = nodeStack.top().first;
+        const T sign = nodeStack.top().second;
+        nodeStack.pop();
+
+        if (IsNaryOperation(pTermNode, BinaryOperator::Addition))
+        {
+            for (std::size_t i = pTermNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push(std::make_pair((const TermNode*)pTermNode->operand(i), sign));
+            }
+        }
+        else if (IsBinaryOperation(pTermNode, BinaryOperator::Addition))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pTermNode->mpRightNode, sign));
+            nodeStack.push(std::make_pair((const TermNode*)pTermNode->mpLeftNode, sign));
+        }
+        else if (IsBinaryOperation(pTermNode, BinaryOperator::Subtraction))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pTermNode->mpRightNode, -sign));
+            nodeStack.push(std::make_pair((const TermNode*)pTermNode->mpLeftNode, sign));
+        }
+        else if (IsUnaryOperation(pTermNode, UnaryOperator::Negate))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pTermNode->mpLeftNode, -sign));
+        }
+        else
+        {
+            if (rTerms.size() == mCostModel.maxSumTerms)
+            {
+                return false;
+            }
+            Term term;
+            term.coefficient = sign;
+            collectFactors(pTermNode, term, rRegion.factorNodes);
+            rTerms.push_back(term);
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void OperationMinimizer<T, Alloc>::collectFactors(
+    const TermNode* pNode, Term& rTerm, std::vector<const TermNode*>& rFactorNodes) const
+{
+    const unsigned maxPower = StrengthReduction::MaxExponent;
+
+    std::stack<std::pair<const TermNode*, unsigned>> nodeStack;
+    nodeStack.push(std::make_pair(pNode, 1u));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pFactorNode = nodeStack.top().first;
+        const unsigned power = nodeStack.top().second;
+        nodeStack.pop();
+
+        T value;
+        if (IsNaryOperation(pFactorNode, BinaryOperator::Multiplication))
+        {
+            for (std::size_t i = pFactorNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push(std::make_pair((const TermNode*)pFactorNode->operand(i), power));
+            }
+            continue;
+        }
+        if (IsBinaryOperation(pFactorNode, BinaryOperator::Multiplication))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pFactorNode->mpRightNode, power));
+            nodeStack.push(std::make_pair((const TermNode*)pFactorNode->mpLeftNode, power));
+            continue;
+        }
+        if (IsUnaryOperation(pFactorNode, UnaryOperator::Negate))
+        {
+            if ((power % 2) == 1)
+            {
+                rTerm.coefficient = -rTerm.coefficient;
+            }
+            nodeStack.push(std::make_pair((const TermNode*)pFactorNode->mpLeftNode, power));
+            continue;
+        }
+        if (IsUnaryOperation(pFactorNode, UnaryOperator::Square) && (power * 2 <= maxPower))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pFactorNode->mpLeftNode, power * 2));
+            continue;
+        }
+        if (IsUnaryOperation(pFactorNode, UnaryOperator::Cube) && (power * 3 <= maxPower))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pFactorNode->mpLeftNode, power * 3));
+            continue;
+        }
+        if (IsBinaryOperation(pFactorNode, BinaryOperator::Pow) &&
+                GetConstant(pFactorNode->mpRightNode, value) &&
+                (value >= T(1)) && (value * T(power) <= T(maxPower)) &&
+                (value == T(static_cast<int>(value))))
+        {
+            nodeStack.push(std::make_pair((const TermNode*)pFactorNode->mpLeftNode,
+                                          power * static_cast<unsigned>(value)));
+            continue;
+        }
+        if (GetConstant(pFactorNode, value))
+        {
+            for (unsigned i = 0; i < power; ++i)
+            {
+                rTerm.coefficient *= value;
+            }
+            continue;
+        }
+
+        // Minimized and told apart once the whole region is collected.
+        rTerm.factors.push_back(Factor(rFactorNodes.size(), power));
+        rFactorNodes.push_back(pFactorNode);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void OperationMinimizer<T, Alloc>::MergeFactors(Term& rTerm)
+{
+    std::vector<Factor>& rFactors = rTerm.factors;
+    std::sort(rFactors.begin(), rFactors.end());
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < rFactors.size(); ++i)
+    {
+        if ((count != 0) && (rFactors[count - 1].first == rFactors[i].first))
+        {
+            rFactors[count - 1].second += rFactors[i].second;
+        }
+        else
+        {
+            rFactors[count++] = rFactors[i];
+        }
+    }
+    rFactors.resize(count);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void OperationMinimizer<T, Alloc>::CollectLikeTerms(std::vector<Term>& rTerms)
+{
+    std::vector<Term> collected;
+    std::map<std::vector<Factor>, std::size_t> indices;
+    for (Term& rTerm : rTerms)
+    {
+        std::sort(rTerm.factors.begin(), rTerm.factors.end());
+        const auto inserted = indices.insert(std::make_pair(rTerm.factors, collected.size()));
+        if (inserted.second)
+        {
+            collected.push_back(rTerm);
+        }
+        else
+        {
+            collected[inserted.first->second].coefficient += rTerm.coefficient;
+        }
+    }
+
+    collected.erase(std::remove_if(collected.begin(), collected.end(),
+                                   [](const Term& rTerm)
+    {
+        return rTerm.coefficient == T(0);
+    }), collected.end());
+    rTerms.swap(collected);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::buildSum(
+    const std::vector<Term>& rTerms, const FactorTable& rFactors) const
+{
+    struct Task
+    {
+        Task()
+            : depth(0), isCombine(false), isNegative(false), hasRest(false), factor(0), power(0)
+        {
+        }
+
+        std::vector<Term> terms;
+        std::size_t depth;
+        bool isCombine;
+        bool isNegative;
+        bool hasRest;
+        std::size_t factor;
+        unsigned power;
+    };
+
+    // Factoring leaves rest + inner * factor^power. Both sums are tasks
+    // run from a stack, the rest first, and a combine task below them
+    // joins the two sums they leave on the result stack.
+    std::vector<Task> tasks;
+    std::vector<TermNode*> results;
+    tasks.push_back(Task());
+    tasks.back().terms = rTerms;
+    while (!tasks.empty())
+    {
+        Task task = std::move(tasks.back());
+        tasks.pop_back();
+
+        if (task.isCombine)
+        {
+            TermNode* pProduct = StrengthReduction::MakeBinary(
+                                     BinaryOperator::Multiplication, results.back(),
+                                     BuildPower(rFactors.get(task.factor), task.power));
+            results.pop_back();
+            if (!task.hasRest)
+            {
+                results.push_back(task.isNegative
+                                  ? StrengthReduction::MakeUnary(UnaryOperator::Negate, pProduct)
+                                  : pProduct);
+            }
+            else
+            {
+                results.back() = StrengthReduction::MakeBinary(
+                                     task.isNegative ? BinaryOperator::Subtraction
+                                     : BinaryOperator::Addition,
+                                     results.back(), pProduct);
+            }
+            continue;
+        }
+
+        if (task.terms.empty())
+        {
+            results.push_back(new ConstantNode(T(0)));
+            continue;
+        }
+        if (task.terms.size() == 1)
+        {
+            results.push_back(BuildLinearSum(task.terms, rFactors));
+            continue;
+        }
+
+        Task combine;
+        std::vector<Term> inner;
+        std::vector<Term> rest;
+        if ((task.depth >= mCostModel.maxFactoringDepth) ||
+                !FactorOut(task.terms, rFactors, combine.factor, combine.power,
+                           combine.isNegative, inner, rest))
+        {
+            results.push_back(BuildUnfactoredSum(task.terms, rFactors));
+            continue;
+        }
+
+        combine.depth = task.depth;
+        combine.isCombine = true;
+        combine.hasRest = !rest.empty();
+        tasks.push_back(std::move(combine));
+
+        Task innerTask;
+        innerTask.terms.swap(inner);
+        innerTask.depth = task.depth + 1;
+        tasks.push_back(std::move(innerTask));
+
+        if (!rest.empty())
+        {
+            Task restTask;
+            restTask.terms.swap(rest);
+            restTask.depth = task.depth;
+            tasks.push_back(std::move(restTask));
+        }
+    }
+
+    return results.back();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool OperationMinimizer<T, Alloc>::FactorOut(
+    const std::vector<Term>& rTerms, const FactorTable& rFactors,
+    std::size_t& rFactor, unsigned& rPower, bool& rIsNegative,
+    std::vector<Term>& rInner, std::vector<Term>& rRest)
+{
+    // The factor shared by the most terms, the costlier one on ties.
+    std::vector<std::size_t> counts(rFactors.size(), 0);
+    for (const Term& rTerm : rTerms)
+    {
+        for (const Factor& rFactor : rTerm.factors)
+        {
+            ++counts[rFactor.first];
+        }
+    }
+
+    std::size_t best = rFactors.size();
+    for (std::size_t id = 0; id < counts.size(); ++id)
+    {
+        if ((counts[id] >= 2) &&
+                ((best == rFactors.size()) || (counts[id] > counts[best]) ||
+                 ((counts[id] == counts[best]) && (rFactors.cost(id) > rFactors.cost(best)))))
+        {
+            best = id;
+        }
+    }
+    if (best == rFactors.size())
+    {
+        return false;
+    }
+
+    unsigned power = std::numeric_limits<unsigned>::max();
+    for (const Term& rTerm : rTerms)
+    {
+        for (const Factor& rFactor : rTerm.factors)
+        {
+            if (rFactor.first == best)
+            {
+                power = std::min(power, rFactor.second);
+            }
+        }
+    }
+
+    for (const Term& rTerm : rTerms)
+    {
+        auto factorIter = std::find_if(
+                              rTerm.factors.begin(), rTerm.factors.end(),
+                              [best](const Factor& rFactor)
+        {
+            return rFactor.first == best;
+        });
+        if (factorIter == rTerm.factors.end())
+        {
+            rRest.push_back(rTerm);
+            continue;
+        }
+
+        Term reduced = rTerm;
+        Factor& rReduced = reduced.factors[factorIter - rTerm.factors.begin()];
+        rReduced.second -= power;
+        if (rReduced.second == 0)
+        {
+            reduced.factors.erase(reduced.factors.begin() +
+                                  (factorIter - rTerm.factors.begin()));
+        }
+        rInner.push_back(reduced);
+    }
+
+    // -a*x - a*y is built as -(a*(x + y)) rather than a*(-x - y).
+    const bool isNegative = std::all_of(rInner.begin(), rInner.end(),
+                                        [](const Term& rTerm)
+    {
+        return rTerm.coefficient < T(0);
+    });
+    if (isNegative)
+    {
+        for (Term& rTerm : rInner)
+        {
+            rTerm.coefficient = -rTerm.coefficient;
+        }
+    }
+
+    rFactor = best;
+    rPower = power;
+    rIsNegative = isNegative;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::BuildUnfactoredSum(
+    const std::vector<Term>& rTerms, const FactorTable& rFactors)
+{
+    // A coefficient shared by all terms up to sign is multiplied once.
+    const T magnitude = std::abs(rTerms.front().coefficient);
+    const bool isShared = std::all_of(rTerms.begin(), rTerms.end(),
+                                      [&magnitude](const Term& rTerm)
+    {
+        return std::abs(rTerm.coefficient) == magnitude;
+    });
+    if (isShared && (magnitude != T(1)))
+    {
+        std::vector<Term> scaled(rTerms);
+        for (Term& rTerm : scaled)
+        {
+            rTerm.coefficient = (rTerm.coefficient < T(0)) ? T(-1) : T(1);
+        }
+        return StrengthReduction::MakeBinary(
+                   BinaryOperator::Multiplication, new ConstantNode(magnitude),
+                   BuildLinearSum(scaled, rFactors));
+    }
+
+    return BuildLinearSum(rTerms, rFactors);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::BuildLinearSum(
+    std::vector<Term> terms, const FactorTable& rFactors)
+{
+    assert(!terms.empty());
+
+    // Start from a positive term so the others are added or subtracted
+    // without negations, a constant term is folded into its sign.
+    auto positiveIter = std::find_if(terms.begin(), terms.end(), [](const Term& rTerm)
+    {
+        return !(rTerm.coefficient < T(0));
+    });
+    const bool isNegative = (positiveIter == terms.end()) &&
+                            ((terms.size() > 1) || !terms.front().factors.empty());
+    if (isNegative)
+    {
+        for (Term& rTerm : terms)
+        {
+            rTerm.coefficient = -rTerm.coefficient;
+        }
+    }
+    else if (positiveIter != terms.end())
+    {
+        std::rotate(terms.begin(), positiveIter, positiveIter + 1);
+    }
+
+    TermNode* pSum = BuildProduct(terms.front(), rFactors);
+    for (std::size_t i = 1; i < terms.size(); ++i)
+    {
+        Term magnitude = terms[i];
+        const bool isSubtracted = (magnitude.coefficient < T(0));
+        if (isSubtracted)
+        {
+            magnitude.coefficient = -magnitude.coefficient;
+        }
+        pSum = StrengthReduction::MakeBinary(
+                   isSubtracted ? BinaryOperator::Subtraction : BinaryOperator::Addition,
+                   pSum, BuildProduct(magnitude, rFactors));
+    }
+
+    return isNegative ? StrengthReduction::MakeUnary(UnaryOperator::Negate, pSum) : pSum;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::BuildProduct(
+    const Term& rTerm, const FactorTable& rFactors)
+{
+    TermNode* pProduct = nullptr;
+    for (const Factor& rFactor : rTerm.factors)
+    {
+        TermNode* pPower = BuildPower(rFactors.get(rFactor.first), rFactor.second);
+        pProduct = (pProduct != nullptr)
+                   ? StrengthReduction::MakeBinary(BinaryOperator::Multiplication, pProduct, pPower)
+                   : pPower;
+    }
+
+    if (pProduct == nullptr)
+    {
+        return new ConstantNode(rTerm.coefficient);
+    }
+    if (rTerm.coefficient != T(1))
+    {
+        pProduct = StrengthReduction::MakeBinary(
+                       BinaryOperator::Multiplication, new ConstantNode(rTerm.coefficient), pProduct);
+    }
+    return pProduct;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::BuildPower(
+    const TermNode* pFactor, unsigned power)
+{
+    TermNode* pBase = CloneTree(pFactor);
+    if (power == 1)
+    {
+        return pBase;
+    }
+    if (StrengthReduction::IsIntegerPowerReducible(pBase, static_cast<int>(power)))
+    {
+        return StrengthReduction::IntegerPower(pBase, static_cast<int>(power));
+    }
+    return StrengthReduction::MakeBinary(
+               BinaryOperator::Pow, pBase, new ConstantNode(T(power)));
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* OperationMinimizer<T, Alloc>::CloneTree(const TermNode* pNode)
+{
+    TermNode* pClone = pNode->cloneTree();
+    pClone->mpParentNode = nullptr;
+    return pClone;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+double OperationMinimizer<T, Alloc>::cost(const TermNode* pNode) const
+{
+    return CountOperations(pNode).cost(mCostModel);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool OperationMinimizer<T, Alloc>::IsRegion(const TermNode* pNode)
+{
+    return IsBinaryOperation(pNode, BinaryOperator::Addition) ||
+           IsBinaryOperation(pNode, BinaryOperator::Subtraction) ||
+           IsBinaryOperation(pNode, BinaryOperator::Multiplication) ||
+           IsNaryOperation(pNode, BinaryOperator::Addition) ||
+           IsNaryOperation(pNode, BinaryOperator::Multiplication) ||
+           IsUnaryOperation(pNode, UnaryOperator::Negate);
+}
+
+} // namespace Internal
+} // namespace Emblem
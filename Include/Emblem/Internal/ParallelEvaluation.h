@@ -0,0 +1,379 @@
+/**
+* \file ParallelEvaluation.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "TermNode.h"
+
+#include "../ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class ParallelEvaluation
+* \brief Splits one expression into tasks that evaluate independent
+* subtrees concurrently.
+*
+* Subtree sizes are cached with the node hashes, so only the subtrees of
+* at least the threshold are walked when splitting. Wherever a node has
+* two or more such operands, each of them becomes a task. A task reads the
+* values of the tasks split off below it, and whichever of those finishes
+* last goes on to run it.
+*
+* An exception thrown by a task, such as for a symbol without a value,
+* stops the tasks not yet started and is rethrown from evaluate() once
+* every task already submitted has returned.
+*/
+template <class T, class Alloc>
+class ParallelEvaluation
+{
+public:
+    typedef TermNode<T, Alloc> TermNode;
+    typedef typename TermNode::ValueMap ValueMap;
+
+    ParallelEvaluation(const TermNode* pHead, std::size_t taskThreshold);
+
+    /** \brief Number of tasks, one if the expression is not split. */
+    std::size_t taskCount() const
+    {
+        return mTasks.size();
+    }
+
+    /**
+    * \brief Runs the tasks on the pool, helping with queued tasks while
+    * waiting for them.
+    */
+    T evaluate(const ValueMap& rValues, ThreadPool& rPool) const;
+
+private:
+    static const std::size_t NoTask = static_cast<std::size_t>(-1);
+
+    /** \brief Task split off below another, and the node it replaces. */
+    typedef std::pair<const TermNode*, std::size_t> Input;
+
+    struct Task
+    {
+        const TermNode* pRoot;
+        std::size_t parent;
+        std::size_t firstInput;
+        std::size_t inputCount;
+    };
+
+    /** \brief State of one call to evaluate(). */
+    struct Run
+    {
+        const ValueMap* pValues;
+        std::vector<T> values;
+        std::unique_ptr<std::atomic<std::size_t>[]> pPendingInputs;
+        std::mutex mutex;
+        std::condition_variable condition;
+        // Submitted tasks that have not returned, guarded by the mutex.
+        std::size_t runningTasks;
+        std::atomic<bool> hasFailed;
+        std::exception_ptr pError;
+    };
+
+    void runTask(Run& rRun, std::size_t task) const;
+    T evaluateTask(const Run& rRun, std::size_t task) const;
+
+    std::size_t mTaskThreshold;
+    // Head first, every task after its parent.
+    std::vector<Task> mTasks;
+    std::vector<Input> mInputs;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::size_t ParallelEvaluation<T, Alloc>::NoTask;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+ParallelEvaluation<T, Alloc>::ParallelEvaluation(
+    const TermNode* pHead, std::size_t taskThreshold)
+    : mTaskThreshold(std::max<std::size_t>(taskThreshold, 1))
+{
+    const Task head = { pHead, NoTask, 0, 0 };
+    mTasks.push_back(head);
+    if (pHead->GetSubtreeSize() < 2 * mTaskThreshold)
+    {
+        return;
+    }
+
+    std::vector<std::pair<const TermNode*, std::size_t>> nodeStack;
+    nodeStack.reserve(64);
+    nodeStack.push_back(std::make_pair(pHead, (std::size_t)0));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNode = nodeStack.back().first;
+        const std::size_t task = nodeStack.back().second;
+        nodeStack.pop_back();
+
+        const std::size_t count = pNode->operandCount();
+        std::size_t largeOperandCount = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (pNode->operand(i)->GetSubtreeSize() >= mTaskThreshold)
+            {
+                ++largeOperandCount;
+            }
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const TermNode* pOperand = pNode->operand(i);
+            if (pOperand->GetSubtreeSize() < mTaskThreshold)
+            {
+                continue;
+            }
+
+            if (largeOperandCount < 2)
+            {
+                nodeStack.push_back(std::make_pair(pOperand, task));
+                continue;
+            }
+
+            const Task operandTask = { pOperand, task, 0, 0 };
+            nodeStack.push_back(std::make_pair(pOperand, mTasks.size()));
+            mTasks.push_back(operandTask);
+            ++mTasks[task].inputCount;
+        }
+    }
+
+    if (mTasks.size() == 1)
+    {
+        return;
+    }
+
+    // Group the inputs by task, sorted for lookup while evaluating.
+    std::size_t firstInput = 0;
+    for (Task& rTask : mTasks)
+    {
+        rTask.firstInput = firstInput;
+        firstInput += rTask.inputCount;
+    }
+
+    mInputs.resize(firstInput);
+    std::vector<std::size_t> inputCounts(mTasks.size(), 0);
+    for (std::size_t i = 1; i < mTasks.size(); ++i)
+    {
+        const std::size_t parent = mTasks[i].parent;
+        mInputs[mTasks[parent].firstInput + inputCounts[parent]++] =
+            std::make_pair(mTasks[i].pRoot, i);
+    }
+
+    for (const Task& rTask : mTasks)
+    {
+        std::sort(mInputs.begin() + rTask.firstInput,
+                  mInputs.begin() + rTask.firstInput + rTask.inputCount,
+                  [](const Input& rA, const Input& rB)
+        {
+            return std::less<const TermNode*>()(rA.first, rB.first);
+        });
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T ParallelEvaluation<T, Alloc>::evaluate(const ValueMap& rValues, ThreadPool& rPool) const
+{
+    if (mTasks.size() == 1)
+    {
+        return mTasks.front().pRoot->evaluate(rValues);
+    }
+
+    Run run;
+    run.pValues = &rValues;
+    run.values.resize(mTasks.size());
+    run.pPendingInputs.reset(new std::atomic<std::size_t>[mTasks.size()]);
+    run.runningTasks = 0;
+    run.hasFailed = false;
+    for (std::size_t i = 0; i < mTasks.size(); ++i)
+    {
+        run.pPendingInputs[i] = mTasks[i].inputCount;
+        run.runningTasks += (mTasks[i].inputCount == 0) ? 1 : 0;
+    }
+
+    for (std::size_t i = 0; i < mTasks.size(); ++i)
+    {
+        if (mTasks[i].inputCount == 0)
+        {
+            Run* pRun = &run;
+            rPool.submit([this, pRun, i]()
+            {
+                runTask(*pRun, i);
+            });
+        }
+    }
+
+    // Once the queue is empty every task left is already running, so
+    // blocking cannot starve the pool even when called from a task. The
+    // run has to outlive every submitted task, also after a failure.
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(run.mutex);
+            if (run.runningTasks == 0)
+            {
+                break;
+            }
+        }
+
+        if (!rPool.runPendingTask())
+        {
+            std::unique_lock<std::mutex> lock(run.mutex);
+            run.condition.wait(lock, [&run]() { return run.runningTasks == 0; });
+            break;
+        }
+    }
+
+    if (run.pError)
+    {
+        std::rethrow_exception(run.pError);
+    }
+    return run.values.front();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void ParallelEvaluation<T, Alloc>::runTask(Run& rRun, std::size_t task) const
+{
+    // The parents of a failed task never become ready, so the run is
+    // over once every submitted task has returned.
+    try
+    {
+        while (!rRun.hasFailed)
+        {
+            rRun.values[task] = evaluateTask(rRun, task);
+
+            const std::size_t parent = mTasks[task].parent;
+            if ((parent == NoTask) || (--rRun.pPendingInputs[parent] != 0))
+            {
+                break;
+            }
+            task = parent;
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(rRun.mutex);
+        if (!rRun.pError)
+        {
+            rRun.pError = std::current_exception();
+        }
+        rRun.hasFailed = true;
+    }
+
+    std::lock_guard<std::mutex> lock(rRun.mutex);
+    if (--rRun.runningTasks == 0)
+    {
+        rRun.condition.notify_all();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T ParallelEvaluation<T, Alloc>::evaluateTask(const Run& rRun, std::size_t task) const
+{
+    const Task& rTask = mTasks[task];
+    const ValueMap& rValues = *rRun.pValues;
+    if (rTask.inputCount == 0)
+    {
+        return rTask.pRoot->evaluate(rValues);
+    }
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    const Input* pFirstInput = mInputs.data() + rTask.firstInput;
+    const Input* pLastInput = pFirstInput + rTask.inputCount;
+
+    // As TermNode::evaluate(), except that inputs are read from the tasks
+    // computing them. Subtrees below the threshold cannot hold an input
+    // and are evaluated directly.
+    std::vector<Frame> nodeStack;
+    std::vector<T> values;
+    nodeStack.reserve(64);
+    values.reserve(64);
+
+    const Frame head = { rTask.pRoot, rTask.pRoot->operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            if (pOperand->GetSubtreeSize() < mTaskThreshold)
+            {
+                values.push_back(pOperand->evaluate(rValues));
+                continue;
+            }
+
+            const Input* pInput = std::lower_bound(
+                                      pFirstInput, pLastInput, pOperand,
+                                      [](const Input& rInput, const TermNode* pNode)
+            {
+                return std::less<const TermNode*>()(rInput.first, pNode);
+            });
+            if ((pInput != pLastInput) && (pInput->first == pOperand))
+            {
+                values.push_back(rRun.values[pInput->second]);
+                continue;
+            }
+
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const std::size_t first = values.size() - rFrame.operandCount;
+        const T value = rFrame.pNode->apply(values.data() + first, rValues);
+        values.erase(values.begin() + first, values.end());
+        values.push_back(value);
+        nodeStack.pop_back();
+    }
+
+    return values.back();
+}
+
+} // namespace Internal
+} // namespace Emblem
@@ -0,0 +1,488 @@
+/**
+* \file PrecisionAnalysis.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "IntervalArithmetic.h"
+#include "TermNode.h"
+
+#include "../Interval.h"
+#include "../Program.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class PrecisionAnalysis
+* \brief Bounds the rounding error of an expression when some of its
+* subtrees are computed in float rather than in T.
+*
+* The ranges of the symbols are propagated through the tree by interval
+* arithmetic. The error bound is first order: each operation contributes
+* its rounding, at most half an ulp of the largest value in its range, or
+* a few ulps for the library functions, and passes on its operands' errors
+* scaled by the largest derivative over the operands' ranges.
+*/
+template <class T, class Alloc>
+class PrecisionAnalysis
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef SymbolNode<T, Alloc> SymbolNode;
+    typedef ConstantNode<T, Alloc> ConstantNode;
+public:
+    typedef float Low;
+    typedef std::unordered_map<std::string, Interval<T>> RangeMap;
+
+    /** \brief Fewest operations worth converting the inputs of a subtree to float. */
+    static const std::size_t MinLowOperations = 4;
+    /** \brief Most subtrees tried when choosing the float ones. */
+    static const std::size_t MaxCandidates = 256;
+
+    /** \brief Symbols missing from rRanges may take any value. */
+    PrecisionAnalysis(const TermNode* pHead, const RangeMap& rRanges);
+
+    /** \brief Number of nodes, in post-order with the head last. */
+    std::size_t nodeCount() const
+    {
+        return mNodes.size();
+    }
+
+    const TermNode* node(std::size_t index) const
+    {
+        return mNodes[index].pNode;
+    }
+
+    /** \brief Index of the first node of the subtree under the node, in post-order. */
+    std::size_t subtreeBegin(std::size_t index) const
+    {
+        return mNodes[index].subtreeBegin;
+    }
+
+    bool isOperation(std::size_t index) const
+    {
+        return mNodes[index].operandCount != 0;
+    }
+
+    /** \brief Range of the result. */
+    const Interval<T>& range() const
+    {
+        return mNodes.back().range;
+    }
+
+    /**
+    * \brief Bound on the error of the result relative to its smallest
+    * magnitude, or to its largest if the range holds zero, with the nodes
+    * marked in rIsLow computed in float.
+    */
+    T relativeError(const std::vector<char>& rIsLow) const;
+
+    /**
+    * \brief Marks the nodes to compute in float, whole subtrees at a time.
+    *
+    * Subtrees are tried largest first and kept while the relative error
+    * bound stays within targetRelativeError.
+    * \param rBound Receives the bound of the plan returned.
+    */
+    std::vector<char> selectLowPrecision(T targetRelativeError, T& rBound) const;
+
+private:
+    struct Node
+    {
+        const TermNode* pNode;
+        OpCode opCode;
+        std::uint32_t subtreeBegin;
+        std::uint32_t firstOperand;
+        std::uint32_t operandCount;
+        Interval<T> range;
+    };
+
+    /** \brief Error passed on by a binary operation, before its own rounding. */
+    static T PropagateError(OpCode opCode, const Interval<T>& rA, T errorA,
+                            const Interval<T>& rB, T errorB, const Interval<T>& rResult);
+
+    static T PropagateError(OpCode opCode, const Interval<T>& rA, T errorA,
+                            const Interval<T>& rResult);
+
+    /** \brief Rounding of the operation in units of half an ulp. */
+    static T RoundingUnits(OpCode opCode);
+
+    std::vector<Node> mNodes;
+    std::vector<std::uint32_t> mOperands;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::size_t PrecisionAnalysis<T, Alloc>::MinLowOperations;
+
+template <class T, class Alloc>
+const std::size_t PrecisionAnalysis<T, Alloc>::MaxCandidates;
+
+template <class T, class Alloc>
+PrecisionAnalysis<T, Alloc>::PrecisionAnalysis(const TermNode* pHead, const RangeMap& rRanges)
+{
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+        std::uint32_t subtreeBegin;
+    };
+
+    std::vector<Frame> nodeStack;
+    std::vector<std::uint32_t> values;
+    const Frame head = { pHead, pHead->operandCount(), 0, 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0,
+                                    static_cast<std::uint32_t>(mNodes.size())
+                                  };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const TermNode* pNode = rFrame.pNode;
+        Node node = { pNode, OpCode::PushConstant, rFrame.subtreeBegin,
+                      static_cast<std::uint32_t>(mOperands.size()),
+                      static_cast<std::uint32_t>(rFrame.operandCount), Interval<T>()
+                    };
+        const std::size_t first = values.size() - rFrame.operandCount;
+        mOperands.insert(mOperands.end(), values.begin() + first, values.end());
+        values.resize(first);
+
+        if (pNode->isSymbol())
+        {
+            node.opCode = OpCode::PushSymbol;
+            const auto found = rRanges.find(static_cast<const SymbolNode*>(pNode)->GetSymbol().toString());
+            if (found != rRanges.end())
+            {
+                node.range = found->second;
+            }
+        }
+        else if (!pNode->isOperator())
+        {
+            node.range = Interval<T>::Point(static_cast<const ConstantNode*>(pNode)->GetValue());
+        }
+        else if (const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode))
+        {
+            node.opCode = ToOpCode(pNaryOp->GetOperator());
+            node.range = mNodes[mOperands[node.firstOperand]].range;
+            for (std::uint32_t i = 1; i < node.operandCount; ++i)
+            {
+                node.range = IntervalOf(node.opCode, node.range,
+                                        mNodes[mOperands[node.firstOperand + i]].range);
+            }
+        }
+        else if (const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode))
+        {
+            node.opCode = ToOpCode(pBinaryOp->GetOperator());
+            node.range = IntervalOf(node.opCode, mNodes[mOperands[node.firstOperand]].range,
+                                    mNodes[mOperands[node.firstOperand + 1]].range);
+        }
+        else
+        {
+            node.opCode = ToOpCode(static_cast<const UnaryOperatorNode*>(pNode)->GetOperator());
+            node.range = IntervalOf(node.opCode, mNodes[mOperands[node.firstOperand]].range);
+        }
+
+        values.push_back(static_cast<std::uint32_t>(mNodes.size()));
+        mNodes.push_back(node);
+        nodeStack.pop_back();
+    }
+}
+
+template <class T, class Alloc>
+T PrecisionAnalysis<T, Alloc>::RoundingUnits(OpCode opCode)
+{
+    switch (opCode)
+    {
+    case OpCode::Identity:
+    case OpCode::Abs:
+    case OpCode::Negate:
+        return T(0);
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Sqrt:
+    case OpCode::Square:
+    case OpCode::Reciprocal:
+        return T(1);
+    case OpCode::Cube:
+        return T(2);
+    default:
+        // The library functions are within an ulp or two.
+        return T(4);
+    }
+}
+
+template <class T, class Alloc>
+T PrecisionAnalysis<T, Alloc>::PropagateError(OpCode opCode, const Interval<T>& rA, T errorA,
+        const Interval<T>& rB, T errorB, const Interval<T>& rResult)
+{
+    const T infinity = std::numeric_limits<T>::infinity();
+    switch (opCode)
+    {
+    case OpCode::Add:
+    case OpCode::Subtract:
+        return errorA + errorB;
+    case OpCode::Multiply:
+        return rB.magnitude() * errorA + rA.magnitude() * errorB + errorA * errorB;
+    case OpCode::Divide:
+    {
+        const T divisor = rB.mignitude() - errorB;
+        if (divisor <= 0)
+        {
+            return infinity;
+        }
+        return (errorA + rResult.magnitude() * errorB) / divisor;
+    }
+    case OpCode::Pow:
+    {
+        if ((errorA == 0) && (errorB == 0))
+        {
+            return T(0);
+        }
+        // d(a^b) = a^b * (b / a * da + ln(a) * db)
+        if (rA.lower > 0)
+        {
+            T error = T(0);
+            if (errorA != 0)
+            {
+                error += rB.magnitude() * errorA / rA.lower;
+            }
+            if (errorB != 0)
+            {
+                error += std::max(std::abs(std::log(rA.lower)), std::abs(std::log(rA.upper))) * errorB;
+            }
+            return rResult.magnitude() * error;
+        }
+        // Otherwise only a constant integer exponent n is defined, with
+        // derivative n * a^(n - 1).
+        const T n = rB.lower;
+        if ((errorB != 0) || (n < 1))
+        {
+            return infinity;
+        }
+        return n * std::pow(rA.magnitude() + errorA, n - 1) * errorA;
+    }
+    default:
+        break;
+    }
+    assert(0);
+    return infinity;
+}
+
+template <class T, class Alloc>
+T PrecisionAnalysis<T, Alloc>::PropagateError(OpCode opCode, const Interval<T>& rA, T errorA,
+        const Interval<T>& rResult)
+{
+    if (errorA == 0)
+    {
+        return T(0);
+    }
+
+    const T infinity = std::numeric_limits<T>::infinity();
+    const T mignitude = rA.mignitude() - errorA;
+    switch (opCode)
+    {
+    case OpCode::Sin:
+    case OpCode::Cos:
+    case OpCode::Identity:
+    case OpCode::Abs:
+    case OpCode::Negate:
+        return errorA;
+    case OpCode::Tan:
+        return (1 + rResult.magnitude() * rResult.magnitude()) * errorA;
+    case OpCode::Exp:
+        return std::exp(rA.upper + errorA) * errorA;
+    case OpCode::Ln:
+    case OpCode::Log10:
+    {
+        if ((rA.lower <= 0) || (mignitude <= 0))
+        {
+            return infinity;
+        }
+        const T error = errorA / mignitude;
+        return (opCode == OpCode::Ln) ? error : error / std::log(T(10));
+    }
+    case OpCode::Sqrt:
+        if ((rA.lower <= 0) || (mignitude <= 0))
+        {
+            return infinity;
+        }
+        return errorA / (2 * std::sqrt(mignitude));
+    case OpCode::Square:
+        return (2 * rA.magnitude() + errorA) * errorA;
+    case OpCode::Cube:
+    {
+        const T magnitude = rA.magnitude() + errorA;
+        return 3 * magnitude * magnitude * errorA;
+    }
+    case OpCode::Reciprocal:
+        if (mignitude <= 0)
+        {
+            return infinity;
+        }
+        return errorA / (mignitude * mignitude);
+    default:
+        break;
+    }
+    assert(0);
+    return infinity;
+}
+
+template <class T, class Alloc>
+T PrecisionAnalysis<T, Alloc>::relativeError(const std::vector<char>& rIsLow) const
+{
+    const T infinity = std::numeric_limits<T>::infinity();
+    const T lowUnit = T(std::numeric_limits<Low>::epsilon()) / 2;
+    const T highUnit = std::numeric_limits<T>::epsilon() / 2;
+    const T lowMax = T(std::numeric_limits<Low>::max()) / 2;
+
+    std::vector<T> errors(mNodes.size());
+    for (std::size_t i = 0; i < mNodes.size(); ++i)
+    {
+        const Node& rNode = mNodes[i];
+        const bool isLow = rIsLow[i] != 0;
+        const T unit = isLow ? lowUnit : highUnit;
+        if (isLow && !(rNode.range.magnitude() <= lowMax))
+        {
+            return infinity;
+        }
+
+        T error = T(0);
+        if (rNode.opCode == OpCode::PushSymbol)
+        {
+            error = isLow ? unit * rNode.range.magnitude() : T(0);
+        }
+        else if (rNode.opCode == OpCode::PushConstant)
+        {
+            const T value = rNode.range.lower;
+            error = (isLow && (T(static_cast<Low>(value)) != value)) ? unit * std::abs(value) : T(0);
+        }
+        else if (rNode.operandCount == 1)
+        {
+            const std::uint32_t a = mOperands[rNode.firstOperand];
+            error = PropagateError(rNode.opCode, mNodes[a].range, errors[a], rNode.range)
+                    + RoundingUnits(rNode.opCode) * unit * rNode.range.magnitude();
+        }
+        else
+        {
+            // Sums and products round after every operand.
+            const std::uint32_t first = mOperands[rNode.firstOperand];
+            Interval<T> range = mNodes[first].range;
+            error = errors[first];
+            for (std::uint32_t j = 1; j < rNode.operandCount; ++j)
+            {
+                const std::uint32_t b = mOperands[rNode.firstOperand + j];
+                const Interval<T> result = IntervalOf(rNode.opCode, range, mNodes[b].range);
+                error = PropagateError(rNode.opCode, range, error, mNodes[b].range, errors[b], result)
+                        + RoundingUnits(rNode.opCode) * unit * result.magnitude();
+                range = result;
+            }
+        }
+        errors[i] = (error == error) ? error : infinity;
+    }
+
+    const Interval<T>& rRange = mNodes.back().range;
+    const T scale = (rRange.mignitude() > 0) ? rRange.mignitude() : rRange.magnitude();
+    if (errors.back() == 0)
+    {
+        return T(0);
+    }
+    return (scale > 0) ? errors.back() / scale : infinity;
+}
+
+template <class T, class Alloc>
+std::vector<char> PrecisionAnalysis<T, Alloc>::selectLowPrecision(T targetRelativeError, T& rBound) const
+{
+    std::vector<char> isLow(mNodes.size(), 0);
+    rBound = relativeError(isLow);
+
+    // Operations in a subtree, counted from its node count in post-order.
+    std::vector<std::size_t> operationCounts(mNodes.size());
+    std::vector<std::uint32_t> candidates;
+    for (std::size_t i = 0; i < mNodes.size(); ++i)
+    {
+        std::size_t count = isOperation(i) ? 1 : 0;
+        for (std::uint32_t j = 0; j < mNodes[i].operandCount; ++j)
+        {
+            count += operationCounts[mOperands[mNodes[i].firstOperand + j]];
+        }
+        operationCounts[i] = count;
+        if (count >= MinLowOperations)
+        {
+            candidates.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [&operationCounts](std::uint32_t a, std::uint32_t b)
+    {
+        return operationCounts[a] > operationCounts[b];
+    });
+    if (candidates.size() > MaxCandidates)
+    {
+        candidates.resize(MaxCandidates);
+    }
+
+    // Subtrees nest or are disjoint, and larger ones come first, so a
+    // candidate is either inside a kept subtree or wholly outside them.
+    for (const std::uint32_t candidate : candidates)
+    {
+        if (isLow[candidate])
+        {
+            continue;
+        }
+        const std::size_t begin = mNodes[candidate].subtreeBegin;
+        std::fill(isLow.begin() + begin, isLow.begin() + candidate + 1, char(1));
+        const T bound = relativeError(isLow);
+        if (bound <= targetRelativeError)
+        {
+            rBound = bound;
+        }
+        else
+        {
+            std::fill(isLow.begin() + begin, isLow.begin() + candidate + 1, char(0));
+        }
+    }
+    return isLow;
+}
+
+} // namespace Internal
+} // namespace Emblem
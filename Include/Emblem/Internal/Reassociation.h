@@ -0,0 +1,228 @@
+/**
+* \file Reassociation.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "TermNode.h"
+
+#include <cstddef>
+#include <stack>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class Reassociation
+* \brief Regroups chains of additions or multiplications into balanced
+* trees, keeping the order of their operands.
+*
+* A chain built by repeatedly adding to a sum is n deep, after rebalancing
+* it is log2(n) deep. Sums and products of many operands are split up the
+* same way. Binary nodes of the chain are reused, and the whole pass is
+* iterative so arbitrarily deep trees can be processed.
+*/
+template <class T, class Alloc>
+class Reassociation
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef BinaryOperator<T> BinaryOperator;
+public:
+    /** \brief Takes ownership of the tree and returns the rebalanced head. */
+    TermNode* run(TermNode* pHead) const;
+
+private:
+    /** \brief A node and the operand position it hangs from. */
+    struct Slot
+    {
+        TermNode* pNode;
+        TermNode* pParent;
+        std::size_t index;
+    };
+
+    /** \brief Builds a balanced tree over operands [begin, end). */
+    static TermNode* Build(
+        const std::vector<Slot>& rOperands, std::size_t begin, std::size_t end,
+        std::vector<TermNode*>& rNodes);
+
+    /** \brief The chain operator of an addition or multiplication node. */
+    static const BinaryOperator* ChainOperator(const TermNode* pNode);
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* Reassociation<T, Alloc>::run(TermNode* pHead) const
+{
+    if (pHead == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Top down, each node is reached with the slot it hangs from, so a
+    // rebuilt chain can be linked back in its place.
+    std::vector<Slot> operands;
+    std::vector<TermNode*> nodes;
+    std::vector<NaryOperatorNode*> naryNodes;
+    std::stack<Slot> slotStack;
+    slotStack.push(Slot{ pHead, nullptr, 0 });
+    while (!slotStack.empty())
+    {
+        const Slot slot = slotStack.top();
+        slotStack.pop();
+
+        TermNode* pNode = slot.pNode;
+        const BinaryOperator* pOperator = ChainOperator(pNode);
+        if (pOperator == nullptr)
+        {
+            for (std::size_t i = pNode->operandCount(); i-- > 0;)
+            {
+                slotStack.push(Slot{ pNode->operand(i), pNode, i });
+            }
+            continue;
+        }
+
+        // Operands left to right, and the chain's nodes.
+        operands.clear();
+        nodes.clear();
+        naryNodes.clear();
+        std::stack<Slot> chainStack;
+        chainStack.push(slot);
+        while (!chainStack.empty())
+        {
+            const Slot chainSlot = chainStack.top();
+            chainStack.pop();
+
+            TermNode* pChainNode = chainSlot.pNode;
+            if (IsBinaryOperation(pChainNode, *pOperator))
+            {
+                nodes.push_back(pChainNode);
+            }
+            else if (IsNaryOperation(pChainNode, *pOperator))
+            {
+                naryNodes.push_back(static_cast<NaryOperatorNode*>(pChainNode));
+            }
+            else
+            {
+                operands.push_back(chainSlot);
+                continue;
+            }
+
+            for (std::size_t i = pChainNode->operandCount(); i-- > 0;)
+            {
+                chainStack.push(Slot{ pChainNode->operand(i), pChainNode, i });
+            }
+        }
+
+        if (operands.size() > 3)
+        {
+            for (TermNode* pChainNode : nodes)
+            {
+                pChainNode->mpParentNode = nullptr;
+                pChainNode->mpLeftNode = nullptr;
+                pChainNode->mpRightNode = nullptr;
+            }
+            for (NaryOperatorNode* pNaryNode : naryNodes)
+            {
+                pNaryNode->releaseOperands();
+                delete pNaryNode;
+            }
+            for (Slot& rOperand : operands)
+            {
+                rOperand.pNode->mpParentNode = nullptr;
+            }
+            while (nodes.size() + 1 < operands.size())
+            {
+                nodes.push_back(new BinaryOperatorNode(*pOperator));
+            }
+
+            pNode = Build(operands, 0, operands.size(), nodes);
+            assert(nodes.empty());
+            if (slot.pParent == nullptr)
+            {
+                pHead = pNode;
+            }
+            else
+            {
+                slot.pParent->setOperand(slot.index, pNode);
+            }
+
+            for (Slot& rOperand : operands)
+            {
+                rOperand.pParent = rOperand.pNode->mpParentNode;
+                rOperand.index = (rOperand.pParent->mpLeftNode == rOperand.pNode) ? 0 : 1;
+            }
+        }
+
+        // Operands may hold chains of other operators.
+        for (const Slot& rOperand : operands)
+        {
+            slotStack.push(rOperand);
+        }
+    }
+
+    pHead->mpParentNode = nullptr;
+    return pHead;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* Reassociation<T, Alloc>::Build(
+    const std::vector<Slot>& rOperands, std::size_t begin, std::size_t end,
+    std::vector<TermNode*>& rNodes)
+{
+    if (end - begin == 1)
+    {
+        return rOperands[begin].pNode;
+    }
+
+    const std::size_t middle = begin + (end - begin) / 2;
+    TermNode* pNode = rNodes.back();
+    rNodes.pop_back();
+    pNode->setLeft(Build(rOperands, begin, middle, rNodes));
+    pNode->setRight(Build(rOperands, middle, end, rNodes));
+    return pNode;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const BinaryOperator<T>* Reassociation<T, Alloc>::ChainOperator(const TermNode* pNode)
+{
+    if (IsBinaryOperation(pNode, BinaryOperator::Addition) ||
+            IsNaryOperation(pNode, BinaryOperator::Addition))
+    {
+        return &BinaryOperator::Addition;
+    }
+    if (IsBinaryOperation(pNode, BinaryOperator::Multiplication) ||
+            IsNaryOperation(pNode, BinaryOperator::Multiplication))
+    {
+        return &BinaryOperator::Multiplication;
+    }
+    return nullptr;
+}
+
+} // namespace Internal
+} // namespace Emblem
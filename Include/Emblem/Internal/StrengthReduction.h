@@ -0,0 +1,714 @@
+/**
+* \file StrengthReduction.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "BinaryTree.h"
+#include "TermNode.h"
+
+#include "../OptimizationFlags.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stack>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class StrengthReduction
+* \brief Replaces expensive operations with cheaper equivalents.
+*
+* Always applied:
+* - pow(x, 2) and pow(x, 3) become a square and a cube; pow(x, -1) and
+*   1 / x become a reciprocal.
+* - x * x becomes a square and x * x^2 a cube, as does a chain of
+*   products starting with x * x or x * x * x.
+* - Division by a power of two becomes an exact multiply.
+* - sqrt of a constant is folded.
+*
+* With OptimizationFlags::fastMath:
+* - pow(x, n) for integer n up to MaxExponent becomes nested squares and
+*   cubes, with extra multiplies by x when x is a leaf. Every multiply
+*   rounds, so the result can be several ulps away from pow.
+* - Division by any constant becomes multiplication by its reciprocal.
+* - a/d + b/d becomes (a + b)/d, also for any terms of a longer sum, and
+*   chained divisions become one.
+* - Equal factors anywhere in a chain of products are gathered into one
+*   power.
+* - Negative powers become reciprocals of the positive power.
+* - pow(x, n + 1/2) becomes x^n * sqrt(x), which differs from pow at -0
+*   and -inf.
+* - sqrt(x^2) becomes |x|, (sqrt x)^2 becomes x, 1/(1/x) becomes x.
+*/
+template <class T, class Alloc>
+class StrengthReduction
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef SumNode<T, Alloc> SumNode;
+    typedef ConstantNode<T, Alloc> ConstantNode;
+    typedef BinaryOperator<T> BinaryOperator;
+    typedef UnaryOperator<T> UnaryOperator;
+public:
+    /** \brief Largest n for which pow(x, n) is expanded without fastMath. */
+    static const int MaxExactExponent = 3;
+    /** \brief Largest |n| for which pow(x, n) is expanded under fastMath. */
+    static const int MaxExponent = 16;
+
+    explicit StrengthReduction(const OptimizationFlags& rFlags)
+        : mFlags(rFlags)
+    {
+    }
+
+    /** \brief Takes ownership of the tree and returns the rewritten head. */
+    TermNode* run(TermNode* pHead) const;
+
+    /** \brief Builds x^n from squares, cubes and, for leaves, multiplies. */
+    static TermNode* IntegerPower(TermNode* pBase, int n);
+    /** \brief Whether IntegerPower() can build x^n without repeating x. */
+    static bool IsIntegerPowerReducible(const TermNode* pBase, int n);
+
+    /** \brief Builds a detached operator node owning its operands. */
+    static TermNode* MakeUnary(const UnaryOperator& rOperator, TermNode* pOperand);
+    static TermNode* MakeBinary(
+        const BinaryOperator& rOperator, TermNode* pLeft, TermNode* pRight);
+
+private:
+    /** \brief Rewrites a node whose children have already been rewritten. */
+    TermNode* reduce(TermNode* pNode) const;
+    TermNode* reducePow(TermNode* pNode, const T& rExponent) const;
+    TermNode* reduceDivision(TermNode* pNode) const;
+    TermNode* reduceSum(TermNode* pNode, const BinaryOperator& rOperator) const;
+    TermNode* reduceMultiplication(TermNode* pNode) const;
+    TermNode* reduceUnary(TermNode* pNode, const UnaryOperator& rOperator) const;
+    TermNode* reduceNarySum(NaryOperatorNode* pNode) const;
+    TermNode* reduceNaryProduct(NaryOperatorNode* pNode) const;
+
+    static TermNode* TakeLeft(TermNode* pNode);
+    static TermNode* TakeRight(TermNode* pNode);
+    static void DeleteTree(TermNode* pNode);
+    /** \brief Refills the emptied chain, or replaces it when it is too short. */
+    static TermNode* RebuildChain(NaryOperatorNode* pNode, const std::vector<TermNode*>& rOperands);
+    static bool IsSameTree(const TermNode* pA, const TermNode* pB)
+    {
+        return (pA->GetHash() == pB->GetHash()) && IsStructurallyEqual<T, Alloc>(pA, pB);
+    }
+
+    static bool IsExactReciprocal(const T& rValue, std::true_type /*isFloatingPoint*/);
+    static bool IsExactReciprocal(const T&, std::false_type /*isFloatingPoint*/)
+    {
+        return false;
+    }
+
+    const OptimizationFlags& mFlags;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const int StrengthReduction<T, Alloc>::MaxExactExponent;
+template <class T, class Alloc>
+const int StrengthReduction<T, Alloc>::MaxExponent;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::run(TermNode* pHead) const
+{
+    if (pHead == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Post-order, every node is rewritten after its children and the
+    // rewritten children are linked back in before it.
+    std::vector<TermNode*> results;
+    std::stack<std::pair<TermNode*, bool>> nodeStack;
+    nodeStack.push(std::make_pair(pHead, false));
+    while (!nodeStack.empty())
+    {
+        TermNode* pNode = nodeStack.top().first;
+        const bool isExpanded = nodeStack.top().second;
+        nodeStack.pop();
+
+        if (pNode->isLeaf())
+        {
+            results.push_back(pNode);
+            continue;
+        }
+
+        if (!isExpanded)
+        {
+            nodeStack.push(std::make_pair(pNode, true));
+            for (std::size_t i = pNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push(std::make_pair(pNode->operand(i), false));
+            }
+            continue;
+        }
+
+        for (std::size_t i = pNode->operandCount(); i-- > 0;)
+        {
+            TermNode* pOperand = results.back();
+            results.pop_back();
+            if (pOperand != pNode->operand(i))
+            {
+                pNode->setOperand(i, pOperand);
+            }
+        }
+
+        results.push_back(reduce(pNode));
+    }
+
+    assert(results.size() == 1);
+    results.back()->mpParentNode = nullptr;
+    return results.back();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduce(TermNode* pNode) const
+{
+    NaryOperatorNode* pChain = dynamic_cast<NaryOperatorNode*>(pNode);
+    if (pChain != nullptr)
+    {
+        return (pChain->GetOperator() == BinaryOperator::Multiplication)
+               ? reduceNaryProduct(pChain) : reduceNarySum(pChain);
+    }
+
+    const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode);
+    if (pBinaryOp == nullptr)
+    {
+        return reduceUnary(pNode, static_cast<const UnaryOperatorNode*>(pNode)->GetOperator());
+    }
+
+    const BinaryOperator& rOperator = pBinaryOp->GetOperator();
+    T exponent;
+    if ((rOperator == BinaryOperator::Pow) && GetConstant(pNode->mpRightNode, exponent))
+    {
+        return reducePow(pNode, exponent);
+    }
+    if (rOperator == BinaryOperator::Division)
+    {
+        return reduceDivision(pNode);
+    }
+    if (rOperator == BinaryOperator::Multiplication)
+    {
+        return reduceMultiplication(pNode);
+    }
+    if ((rOperator == BinaryOperator::Addition) || (rOperator == BinaryOperator::Subtraction))
+    {
+        return reduceSum(pNode, rOperator);
+    }
+    return pNode;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reducePow(
+    TermNode* pNode, const T& rExponent) const
+{
+    const TermNode* pBase = pNode->mpLeftNode;
+    if (!(rExponent >= T(-MaxExponent)) || !(rExponent <= T(MaxExponent)))
+    {
+        return pNode;
+    }
+    const bool isInteger = (rExponent == T(int(rExponent)));
+    const T twiceExponent = rExponent + rExponent;
+    const bool isHalfInteger = !isInteger && (twiceExponent == T(int(twiceExponent)));
+
+    TermNode* pResult = nullptr;
+    if (isInteger)
+    {
+        const int n = int(rExponent);
+        if (n == 0)
+        {
+            pResult = new ConstantNode(T(1));
+        }
+        else if (n == -1)
+        {
+            pResult = MakeUnary(UnaryOperator::Reciprocal, TakeLeft(pNode));
+        }
+        else if ((n > 0) && ((n <= MaxExactExponent) || mFlags.fastMath) &&
+                 IsIntegerPowerReducible(pBase, n))
+        {
+            pResult = IntegerPower(TakeLeft(pNode), n);
+        }
+        else if ((n < 0) && mFlags.fastMath && IsIntegerPowerReducible(pBase, -n))
+        {
+            pResult = MakeUnary(UnaryOperator::Reciprocal, IntegerPower(TakeLeft(pNode), -n));
+        }
+    }
+    else if (isHalfInteger && mFlags.fastMath)
+    {
+        // x^(n + 1/2) = x^n * sqrt(x), which needs x twice unless n is zero.
+        const int n = int(rExponent - T(0.5));
+        if (n == 0)
+        {
+            pResult = MakeUnary(UnaryOperator::Sqrt, TakeLeft(pNode));
+        }
+        else if (n == -1)
+        {
+            pResult = MakeUnary(UnaryOperator::Reciprocal,
+                                MakeUnary(UnaryOperator::Sqrt, TakeLeft(pNode)));
+        }
+        else if ((n > 0) && pBase->isLeaf())
+        {
+            TermNode* pSqrt = MakeUnary(UnaryOperator::Sqrt, pBase->clone());
+            pResult = MakeBinary(BinaryOperator::Multiplication,
+                                 IntegerPower(TakeLeft(pNode), n), pSqrt);
+        }
+    }
+
+    if (pResult == nullptr)
+    {
+        return pNode;
+    }
+    DeleteTree(pNode);
+    return pResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduceDivision(TermNode* pNode) const
+{
+    TermNode* pResult = nullptr;
+
+    T value;
+    if (GetConstant(pNode->mpRightNode, value))
+    {
+        const bool isExact = IsExactReciprocal(value, std::is_floating_point<T>());
+        if ((value != T(0)) && (isExact || mFlags.fastMath))
+        {
+            pResult = MakeBinary(BinaryOperator::Multiplication,
+                                 TakeLeft(pNode), new ConstantNode(T(1) / value));
+        }
+    }
+    else if (GetConstant(pNode->mpLeftNode, value) && (value == T(1)))
+    {
+        pResult = MakeUnary(UnaryOperator::Reciprocal, TakeRight(pNode));
+    }
+    else if (mFlags.fastMath && IsBinaryOperation(pNode->mpLeftNode, BinaryOperator::Division))
+    {
+        // (a / b) / c = a / (b * c)
+        TermNode* pInner = TakeLeft(pNode);
+        TermNode* pDenominator = MakeBinary(BinaryOperator::Multiplication,
+                                            TakeRight(pInner), TakeRight(pNode));
+        pResult = MakeBinary(BinaryOperator::Division, TakeLeft(pInner), pDenominator);
+        DeleteTree(pInner);
+    }
+    else if (mFlags.fastMath && IsBinaryOperation(pNode->mpRightNode, BinaryOperator::Division))
+    {
+        // a / (b / c) = (a * c) / b
+        TermNode* pInner = TakeRight(pNode);
+        TermNode* pNumerator = MakeBinary(BinaryOperator::Multiplication,
+                                          TakeLeft(pNode), TakeRight(pInner));
+        pResult = MakeBinary(BinaryOperator::Division, pNumerator, TakeLeft(pInner));
+        DeleteTree(pInner);
+    }
+
+    if (pResult == nullptr)
+    {
+        return pNode;
+    }
+    DeleteTree(pNode);
+    return pResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduceSum(
+    TermNode* pNode, const BinaryOperator& rOperator) const
+{
+    // a/d +- b/d = (a +- b)/d
+    TermNode* pLeft = pNode->mpLeftNode;
+    TermNode* pRight = pNode->mpRightNode;
+    if (!mFlags.fastMath ||
+            !IsBinaryOperation(pLeft, BinaryOperator::Division) ||
+            !IsBinaryOperation(pRight, BinaryOperator::Division) ||
+            !IsStructurallyEqual(pLeft->mpRightNode, pRight->mpRightNode))
+    {
+        return pNode;
+    }
+
+    pLeft = TakeLeft(pNode);
+    pRight = TakeRight(pNode);
+    TermNode* pNumerator = MakeBinary(rOperator, TakeLeft(pLeft), TakeLeft(pRight));
+    TermNode* pResult = MakeBinary(BinaryOperator::Division, pNumerator, TakeRight(pLeft));
+
+    DeleteTree(pLeft);
+    DeleteTree(pRight);
+    DeleteTree(pNode);
+    return pResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduceMultiplication(TermNode* pNode) const
+{
+    TermNode* pLeft = pNode->mpLeftNode;
+    TermNode* pRight = pNode->mpRightNode;
+
+    TermNode* pResult = nullptr;
+    if (IsStructurallyEqual<T, Alloc>(pLeft, pRight))
+    {
+        pResult = MakeUnary(UnaryOperator::Square, TakeLeft(pNode));
+    }
+    else if (IsUnaryOperation(pLeft, UnaryOperator::Square) &&
+             IsStructurallyEqual<T, Alloc>(pLeft->mpLeftNode, pRight))
+    {
+        pResult = MakeUnary(UnaryOperator::Cube, TakeRight(pNode));
+    }
+    else if (IsUnaryOperation(pRight, UnaryOperator::Square) &&
+             IsStructurallyEqual<T, Alloc>(pRight->mpLeftNode, pLeft))
+    {
+        pResult = MakeUnary(UnaryOperator::Cube, TakeLeft(pNode));
+    }
+
+    if (pResult == nullptr)
+    {
+        return pNode;
+    }
+    DeleteTree(pNode);
+    return pResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduceUnary(
+    TermNode* pNode, const UnaryOperator& rOperator) const
+{
+    TermNode* pOperand = pNode->mpLeftNode;
+
+    TermNode* pResult = nullptr;
+    T value;
+    if ((rOperator == UnaryOperator::Sqrt) && GetConstant(pOperand, value))
+    {
+        pResult = new ConstantNode(rOperator(value));
+    }
+    else if (mFlags.fastMath && (rOperator == UnaryOperator::Sqrt) &&
+             IsUnaryOperation(pOperand, UnaryOperator::Square))
+    {
+        pResult = MakeUnary(UnaryOperator::Abs, TakeLeft(pOperand));
+    }
+    else if (mFlags.fastMath &&
+             (((rOperator == UnaryOperator::Square) && IsUnaryOperation(pOperand, UnaryOperator::Sqrt)) ||
+              ((rOperator == UnaryOperator::Reciprocal) &&
+               IsUnaryOperation(pOperand, UnaryOperator::Reciprocal))))
+    {
+        pResult = TakeLeft(pOperand);
+    }
+
+    if (pResult == nullptr)
+    {
+        return pNode;
+    }
+    DeleteTree(pNode);
+    return pResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduceNarySum(NaryOperatorNode* pNode) const
+{
+    // Terms over the same denominator are summed first, so the result
+    // takes one division per denominator: a/d + b + c/d = (a + c)/d + b
+    if (!mFlags.fastMath)
+    {
+        return pNode;
+    }
+
+    std::vector<TermNode*> operands = pNode->releaseOperands();
+    std::vector<TermNode*> terms;
+    for (std::size_t i = 0; i < operands.size(); ++i)
+    {
+        TermNode* pTerm = operands[i];
+        if ((pTerm == nullptr) || !IsBinaryOperation(pTerm, BinaryOperator::Division))
+        {
+            if (pTerm != nullptr)
+            {
+                terms.push_back(pTerm);
+            }
+            continue;
+        }
+
+        std::vector<TermNode*> numerators(1, pTerm->mpLeftNode);
+        for (std::size_t j = i + 1; j < operands.size(); ++j)
+        {
+            TermNode* pOther = operands[j];
+            if ((pOther != nullptr) && IsBinaryOperation(pOther, BinaryOperator::Division) &&
+                    IsSameTree(pTerm->mpRightNode, pOther->mpRightNode))
+            {
+                numerators.push_back(TakeLeft(pOther));
+                DeleteTree(pOther);
+                operands[j] = nullptr;
+            }
+        }
+        if (numerators.size() == 1)
+        {
+            terms.push_back(pTerm);
+            continue;
+        }
+
+        numerators[0] = TakeLeft(pTerm);
+        TermNode* pNumerator = nullptr;
+        if (numerators.size() == 2)
+        {
+            pNumerator = MakeBinary(BinaryOperator::Addition, numerators[0], numerators[1]);
+        }
+        else
+        {
+            SumNode* pSum = new SumNode();
+            for (TermNode* pOperand : numerators)
+            {
+                pSum->append(pOperand);
+            }
+            pNumerator = pSum;
+        }
+        terms.push_back(MakeBinary(BinaryOperator::Division, pNumerator, TakeRight(pTerm)));
+        DeleteTree(pTerm);
+    }
+
+    return RebuildChain(pNode, terms);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::reduceNaryProduct(NaryOperatorNode* pNode) const
+{
+    const std::size_t count = pNode->operandCount();
+    std::size_t leadingRun = 1;
+    while ((leadingRun < count) && IsSameTree(pNode->operand(0), pNode->operand(leadingRun)))
+    {
+        ++leadingRun;
+    }
+    if (!mFlags.fastMath && (leadingRun == 1))
+    {
+        return pNode;
+    }
+
+    std::vector<TermNode*> operands = pNode->releaseOperands();
+    std::vector<TermNode*> factors;
+    if (!mFlags.fastMath)
+    {
+        // x * x * x * y already multiplies the leading x first, so a square
+        // or cube of it rounds the same way.
+        const std::size_t power = std::min<std::size_t>(leadingRun, MaxExactExponent);
+        factors.push_back(IntegerPower(operands[0], int(power)));
+        for (std::size_t i = 1; i < power; ++i)
+        {
+            DeleteTree(operands[i]);
+        }
+        factors.insert(factors.end(), operands.begin() + power, operands.end());
+        return RebuildChain(pNode, factors);
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        TermNode* pFactor = operands[i];
+        if (pFactor == nullptr)
+        {
+            continue;
+        }
+
+        std::vector<std::size_t> copies;
+        for (std::size_t j = i + 1; j < count; ++j)
+        {
+            if ((operands[j] != nullptr) && IsSameTree(pFactor, operands[j]))
+            {
+                copies.push_back(j);
+            }
+        }
+        const int power = int(copies.size()) + 1;
+        if ((power == 1) || (power > MaxExponent) || !IsIntegerPowerReducible(pFactor, power))
+        {
+            factors.push_back(pFactor);
+            continue;
+        }
+
+        for (std::size_t j : copies)
+        {
+            DeleteTree(operands[j]);
+            operands[j] = nullptr;
+        }
+        factors.push_back(IntegerPower(pFactor, power));
+    }
+
+    return RebuildChain(pNode, factors);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::IntegerPower(TermNode* pBase, int n)
+{
+    assert(n >= 1);
+    if (n == 1)
+    {
+        return pBase;
+    }
+    if ((n % 2) == 0)
+    {
+        return MakeUnary(UnaryOperator::Square, IntegerPower(pBase, n / 2));
+    }
+    if ((n % 3) == 0)
+    {
+        return MakeUnary(UnaryOperator::Cube, IntegerPower(pBase, n / 3));
+    }
+
+    assert(pBase->isLeaf());
+    TermNode* pExtra = pBase->clone();
+    return MakeBinary(BinaryOperator::Multiplication, IntegerPower(pBase, n - 1), pExtra);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool StrengthReduction<T, Alloc>::IsIntegerPowerReducible(const TermNode* pBase, int n)
+{
+    // Only leaves can be repeated, anything else has to be reached
+    // through squares and cubes.
+    if (pBase->isLeaf())
+    {
+        return true;
+    }
+    while ((n % 2) == 0)
+    {
+        n /= 2;
+    }
+    while ((n % 3) == 0)
+    {
+        n /= 3;
+    }
+    return n == 1;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::MakeUnary(
+    const UnaryOperator& rOperator, TermNode* pOperand)
+{
+    TermNode* pNode = new UnaryOperatorNode(rOperator);
+    pNode->setLeft(pOperand);
+    return pNode;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::MakeBinary(
+    const BinaryOperator& rOperator, TermNode* pLeft, TermNode* pRight)
+{
+    TermNode* pNode = new BinaryOperatorNode(rOperator);
+    pNode->setLeft(pLeft);
+    pNode->setRight(pRight);
+    return pNode;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::TakeLeft(TermNode* pNode)
+{
+    TermNode* pChild = pNode->mpLeftNode;
+    pNode->mpLeftNode = nullptr;
+    pChild->mpParentNode = nullptr;
+    return pChild;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::TakeRight(TermNode* pNode)
+{
+    TermNode* pChild = pNode->mpRightNode;
+    pNode->mpRightNode = nullptr;
+    pChild->mpParentNode = nullptr;
+    return pChild;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void StrengthReduction<T, Alloc>::DeleteTree(TermNode* pNode)
+{
+    BinaryTree<TermNode> tree;
+    tree.insertToHead(pNode);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+TermNode<T, Alloc>* StrengthReduction<T, Alloc>::RebuildChain(
+    NaryOperatorNode* pNode, const std::vector<TermNode*>& rOperands)
+{
+    assert(pNode->operandCount() == 0);
+    if (rOperands.size() > 2)
+    {
+        for (TermNode* pOperand : rOperands)
+        {
+            pNode->append(pOperand);
+        }
+        return pNode;
+    }
+
+    TermNode* pResult = (rOperands.size() == 1)
+                        ? rOperands[0]
+                        : MakeBinary(pNode->GetOperator(), rOperands[0], rOperands[1]);
+    DeleteTree(pNode);
+    return pResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool StrengthReduction<T, Alloc>::IsExactReciprocal(
+    const T& rValue, std::true_type /*isFloatingPoint*/)
+{
+    // Powers of two, whose reciprocal is representable exactly.
+    if ((rValue == T(0)) || !std::isfinite(rValue))
+    {
+        return false;
+    }
+    int exponent;
+    const T reciprocal = T(1) / rValue;
+    return std::isfinite(reciprocal) && (std::abs(std::frexp(rValue, &exponent)) == T(0.5)) &&
+           (std::abs(std::frexp(reciprocal, &exponent)) == T(0.5));
+}
+
+} // namespace Internal
+} // namespace Emblem
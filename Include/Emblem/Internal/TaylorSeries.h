@@ -0,0 +1,492 @@
+/**
+* \file TaylorSeries.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class MonomialBasis
+* \brief Monomials in a number of variables up to a total degree, ordered
+* by degree, with the index of each product precomputed.
+*
+* A monomial multiplies only those whose degree fits in the rest of the
+* order, so each keeps a row of those products alone. Twenty variables at
+* order four need some 136 thousand entries.
+*/
+class MonomialBasis
+{
+public:
+    MonomialBasis(std::size_t variableCount, std::size_t order);
+
+    std::size_t size() const
+    {
+        return mDegreeBegins.back();
+    }
+
+    std::size_t variableCount() const
+    {
+        return mVariableCount;
+    }
+
+    std::size_t order() const
+    {
+        return mDegreeBegins.size() - 2;
+    }
+
+    /** \brief First monomial of the degree, size() past the order. */
+    std::size_t degreeBegin(std::size_t degree) const
+    {
+        return mDegreeBegins[degree];
+    }
+
+    /** \brief Index of the monomial of the first degree in the variable. */
+    std::size_t variable(std::size_t variable) const
+    {
+        return 1 + variable;
+    }
+
+    /** \brief Index of the product of two monomials within the order. */
+    std::size_t product(std::size_t a, std::size_t b) const
+    {
+        assert(mRowBegins[a] + b < mRowBegins[a + 1]);
+        return mProducts[mRowBegins[a] + b];
+    }
+
+private:
+    std::size_t mVariableCount;
+    std::vector<std::size_t> mDegreeBegins;
+    // Products of monomial a with monomials 0, 1, ... up to the degree
+    // left, from mProducts[mRowBegins[a]].
+    std::vector<std::size_t> mRowBegins;
+    std::vector<std::uint32_t> mProducts;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+inline MonomialBasis::MonomialBasis(std::size_t variableCount, std::size_t order)
+    : mVariableCount(variableCount)
+{
+    // A monomial is the sorted list of its variables, found from its
+    // parent, the list without the last variable, by appending a variable
+    // no lower than that. Listing the children of each parent in turn
+    // orders every degree lexicographically.
+    std::vector<std::uint32_t> parents(1, 0);
+    std::vector<std::uint32_t> lasts(1, 0);
+    std::vector<std::uint32_t> firstChildren(1, 0);
+    std::vector<std::uint32_t> degrees(1, 0);
+    mDegreeBegins.push_back(0);
+    for (std::size_t degree = 1; degree <= order; ++degree)
+    {
+        mDegreeBegins.push_back(parents.size());
+        for (std::size_t i = mDegreeBegins[degree - 1]; i < mDegreeBegins[degree]; ++i)
+        {
+            firstChildren[i] = static_cast<std::uint32_t>(parents.size());
+            for (std::size_t v = lasts[i]; v < variableCount; ++v)
+            {
+                parents.push_back(static_cast<std::uint32_t>(i));
+                lasts.push_back(static_cast<std::uint32_t>(v));
+                firstChildren.push_back(0);
+                degrees.push_back(static_cast<std::uint32_t>(degree));
+            }
+        }
+    }
+    mDegreeBegins.push_back(parents.size());
+
+    // m * x_v for every m below the order. With v below the last variable
+    // of m it is parent(m) * x_v, itself a parent, times that variable.
+    const std::size_t count = parents.size();
+    std::vector<std::uint32_t> times((order > 0) ? mDegreeBegins[order] * variableCount : 0);
+    for (std::size_t m = 0; (order > 0) && (m < mDegreeBegins[order]); ++m)
+    {
+        for (std::size_t v = 0; v < variableCount; ++v)
+        {
+            if (v >= lasts[m])
+            {
+                times[m * variableCount + v] = static_cast<std::uint32_t>(firstChildren[m] + v - lasts[m]);
+            }
+            else
+            {
+                const std::uint32_t x = times[parents[m] * variableCount + v];
+                times[m * variableCount + v] = firstChildren[x] + lasts[m] - lasts[x];
+            }
+        }
+    }
+
+    // a * b = (a * parent(b)) * x_last(b), found earlier in the row.
+    mRowBegins.reserve(count + 1);
+    for (std::size_t a = 0; a < count; ++a)
+    {
+        const std::size_t rowBegin = mProducts.size();
+        const std::size_t rowLength = mDegreeBegins[order - degrees[a] + 1];
+        mRowBegins.push_back(rowBegin);
+        mProducts.push_back(static_cast<std::uint32_t>(a));
+        for (std::size_t b = 1; b < rowLength; ++b)
+        {
+            const std::uint32_t partial = mProducts[rowBegin + parents[b]];
+            mProducts.push_back(times[partial * variableCount + lasts[b]]);
+        }
+    }
+    mRowBegins.push_back(mProducts.size());
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class TaylorSeries
+* \brief Power series truncated at the order of its basis, standing in for
+* a value in Taylor-mode automatic differentiation.
+*
+* Coefficient i is that of monomial i of the basis in the offsets of the
+* variables from the expansion point. A series without a basis is a
+* constant and takes the basis of the series it meets.
+*
+* Functions of a series follow from the ODE they satisfy, split into
+* homogeneous parts with the Euler operator, which scales the part of
+* degree k by k. exp(g), for instance, gives k f_k = sum j g_j f_(k-j).
+* Each part costs the products of lower parts, so a whole series costs
+* about as much as one multiplication.
+*/
+template <class T>
+class TaylorSeries
+{
+public:
+    typedef std::shared_ptr<const MonomialBasis> BasisPtr;
+
+    TaylorSeries(const T& rConstant = T())
+        : mCoefficients(1, rConstant)
+    {
+    }
+
+    /** \brief The variable of the basis, around the value. */
+    static TaylorSeries Variable(const BasisPtr& pBasis, std::size_t variable, const T& rValue)
+    {
+        TaylorSeries result(pBasis, rValue);
+        if (pBasis->order() > 0)
+        {
+            result.mCoefficients[pBasis->variable(variable)] = T(1);
+        }
+        return result;
+    }
+
+    const BasisPtr& basis() const
+    {
+        return mpBasis;
+    }
+
+    /** \brief Coefficient of the monomial, zero past those stored. */
+    T operator[](std::size_t monomial) const
+    {
+        return (monomial < mCoefficients.size()) ? mCoefficients[monomial] : T(0);
+    }
+
+    /** \brief Value at the expansion point. */
+    const T& value() const
+    {
+        return mCoefficients[0];
+    }
+
+    /** \brief Whether every coefficient past the value is zero. */
+    bool isConstant() const
+    {
+        for (std::size_t i = 1; i < mCoefficients.size(); ++i)
+        {
+            if (mCoefficients[i] != T(0))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    TaylorSeries operator-() const
+    {
+        TaylorSeries result(*this);
+        for (T& rCoefficient : result.mCoefficients)
+        {
+            rCoefficient = -rCoefficient;
+        }
+        return result;
+    }
+
+    friend TaylorSeries operator+(const TaylorSeries& rA, const TaylorSeries& rB)
+    {
+        TaylorSeries result(Basis(rA, rB), T(0));
+        for (std::size_t i = 0; i < result.mCoefficients.size(); ++i)
+        {
+            result.mCoefficients[i] = rA[i] + rB[i];
+        }
+        return result;
+    }
+
+    friend TaylorSeries operator-(const TaylorSeries& rA, const TaylorSeries& rB)
+    {
+        TaylorSeries result(Basis(rA, rB), T(0));
+        for (std::size_t i = 0; i < result.mCoefficients.size(); ++i)
+        {
+            result.mCoefficients[i] = rA[i] - rB[i];
+        }
+        return result;
+    }
+
+    friend TaylorSeries operator*(const TaylorSeries& rA, const TaylorSeries& rB)
+    {
+        TaylorSeries result(Basis(rA, rB), T(0));
+        const std::size_t order = result.order();
+        for (std::size_t k = 0; k <= order; ++k)
+        {
+            for (std::size_t j = 0; j <= k; ++j)
+            {
+                result.accumulate(rA, j, rB, k - j, T(1));
+            }
+        }
+        return result;
+    }
+
+    /** \brief q_k = (a_k - sum_(j >= 1) b_j q_(k-j)) / b_0 */
+    friend TaylorSeries operator/(const TaylorSeries& rA, const TaylorSeries& rB)
+    {
+        TaylorSeries result(Basis(rA, rB), T(0));
+        const std::size_t order = result.order();
+        const T b0 = rB.value();
+        for (std::size_t k = 0; k <= order; ++k)
+        {
+            result.addPart(rA, k, T(1));
+            for (std::size_t j = 1; j <= k; ++j)
+            {
+                result.accumulate(rB, j, result, k - j, T(-1));
+            }
+            result.scalePart(k, T(1) / b0);
+        }
+        return result;
+    }
+
+    friend TaylorSeries exp(const TaylorSeries& rA)
+    {
+        using std::exp;
+        TaylorSeries result(rA.mpBasis, exp(rA.value()));
+        for (std::size_t k = 1; k <= result.order(); ++k)
+        {
+            for (std::size_t j = 1; j <= k; ++j)
+            {
+                result.accumulate(rA, j, result, k - j, T(j) / T(k));
+            }
+        }
+        return result;
+    }
+
+    /** \brief f_k = (g_k - sum_(j < k) j f_j g_(k-j) / k) / g_0 */
+    friend TaylorSeries log(const TaylorSeries& rA)
+    {
+        using std::log;
+        TaylorSeries result(rA.mpBasis, log(rA.value()));
+        for (std::size_t k = 1; k <= result.order(); ++k)
+        {
+            result.addPart(rA, k, T(1));
+            for (std::size_t j = 1; j < k; ++j)
+            {
+                result.accumulate(result, j, rA, k - j, -T(j) / T(k));
+            }
+            result.scalePart(k, T(1) / rA.value());
+        }
+        return result;
+    }
+
+    friend TaylorSeries log10(const TaylorSeries& rA)
+    {
+        using std::log;
+        TaylorSeries result = log(rA);
+        const T scale = T(1) / log(T(10));
+        for (T& rCoefficient : result.mCoefficients)
+        {
+            rCoefficient *= scale;
+        }
+        return result;
+    }
+
+    friend TaylorSeries sin(const TaylorSeries& rA)
+    {
+        TaylorSeries sine, cosine;
+        SinCos(rA, sine, cosine);
+        return sine;
+    }
+
+    friend TaylorSeries cos(const TaylorSeries& rA)
+    {
+        TaylorSeries sine, cosine;
+        SinCos(rA, sine, cosine);
+        return cosine;
+    }
+
+    friend TaylorSeries tan(const TaylorSeries& rA)
+    {
+        TaylorSeries sine, cosine;
+        SinCos(rA, sine, cosine);
+        return sine / cosine;
+    }
+
+    friend TaylorSeries sqrt(const TaylorSeries& rA)
+    {
+        return Power(rA, T(0.5));
+    }
+
+    /** \brief The branch of the value, which has no series at zero. */
+    friend TaylorSeries abs(const TaylorSeries& rA)
+    {
+        return (rA.value() < T(0)) ? -rA : rA;
+    }
+
+    friend TaylorSeries pow(const TaylorSeries& rA, const TaylorSeries& rB)
+    {
+        return rB.isConstant() ? Power(rA, rB.value()) : exp(rB * log(rA));
+    }
+
+private:
+    TaylorSeries(const BasisPtr& pBasis, const T& rValue)
+        : mpBasis(pBasis), mCoefficients(pBasis ? pBasis->size() : 1, T(0))
+    {
+        mCoefficients[0] = rValue;
+    }
+
+    std::size_t order() const
+    {
+        return mpBasis ? mpBasis->order() : 0;
+    }
+
+    static BasisPtr Basis(const TaylorSeries& rA, const TaylorSeries& rB)
+    {
+        assert(!rA.mpBasis || !rB.mpBasis || (rA.mpBasis == rB.mpBasis));
+        return rA.mpBasis ? rA.mpBasis : rB.mpBasis;
+    }
+
+    /** \brief Adds scale times the product of part j of a and part k of b. */
+    void accumulate(const TaylorSeries& rA, std::size_t j, const TaylorSeries& rB,
+                    std::size_t k, const T& rScale)
+    {
+        if (!mpBasis)
+        {
+            mCoefficients[0] += rScale * rA.mCoefficients[0] * rB.mCoefficients[0];
+            return;
+        }
+        const std::size_t aEnd = std::min(mpBasis->degreeBegin(j + 1), rA.mCoefficients.size());
+        const std::size_t bEnd = std::min(mpBasis->degreeBegin(k + 1), rB.mCoefficients.size());
+        for (std::size_t a = mpBasis->degreeBegin(j); a < aEnd; ++a)
+        {
+            const T aScaled = rScale * rA.mCoefficients[a];
+            if (aScaled == T(0))
+            {
+                continue;
+            }
+            for (std::size_t b = mpBasis->degreeBegin(k); b < bEnd; ++b)
+            {
+                mCoefficients[mpBasis->product(a, b)] += aScaled * rB.mCoefficients[b];
+            }
+        }
+    }
+
+    void addPart(const TaylorSeries& rA, std::size_t k, const T& rScale)
+    {
+        const std::size_t end = mpBasis ? mpBasis->degreeBegin(k + 1) : 1;
+        for (std::size_t i = mpBasis ? mpBasis->degreeBegin(k) : 0; i < end; ++i)
+        {
+            mCoefficients[i] += rScale * rA[i];
+        }
+    }
+
+    void scalePart(std::size_t k, const T& rScale)
+    {
+        const std::size_t end = mpBasis ? mpBasis->degreeBegin(k + 1) : 1;
+        for (std::size_t i = mpBasis ? mpBasis->degreeBegin(k) : 0; i < end; ++i)
+        {
+            mCoefficients[i] *= rScale;
+        }
+    }
+
+    /** \brief s_k = sum j g_j c_(k-j) / k and c_k = -sum j g_j s_(k-j) / k */
+    static void SinCos(const TaylorSeries& rA, TaylorSeries& rSin, TaylorSeries& rCos)
+    {
+        using std::sin;
+        using std::cos;
+        rSin = TaylorSeries(rA.mpBasis, sin(rA.value()));
+        rCos = TaylorSeries(rA.mpBasis, cos(rA.value()));
+        for (std::size_t k = 1; k <= rA.order(); ++k)
+        {
+            for (std::size_t j = 1; j <= k; ++j)
+            {
+                rSin.accumulate(rA, j, rCos, k - j, T(j) / T(k));
+                rCos.accumulate(rA, j, rSin, k - j, -T(j) / T(k));
+            }
+        }
+    }
+
+    /**
+    * \brief g^r. Small whole powers are multiplied out, which also holds
+    * at g_0 = 0. Otherwise g f' = r f g' gives
+    * k g_0 f_k = sum_(j >= 1) (r j - (k - j)) g_j f_(k-j).
+    */
+    static TaylorSeries Power(const TaylorSeries& rA, const T& rExponent)
+    {
+        using std::pow;
+        if ((rExponent >= T(0)) && (rExponent <= T(64)) && (std::floor(rExponent) == rExponent))
+        {
+            TaylorSeries result(T(1));
+            TaylorSeries square = rA;
+            for (unsigned n = static_cast<unsigned>(rExponent); n != 0; n /= 2)
+            {
+                if ((n & 1) != 0)
+                {
+                    result = result * square;
+                }
+                if (n > 1)
+                {
+                    square = square * square;
+                }
+            }
+            return result;
+        }
+
+        TaylorSeries result(rA.mpBasis, pow(rA.value(), rExponent));
+        for (std::size_t k = 1; k <= result.order(); ++k)
+        {
+            for (std::size_t j = 1; j <= k; ++j)
+            {
+                const T weight = (rExponent * T(j) - T(k - j)) / (T(k) * rA.value());
+                result.accumulate(rA, j, result, k - j, weight);
+            }
+        }
+        return result;
+    }
+
+    BasisPtr mpBasis;
+    std::vector<T> mCoefficients;
+};
+
+} // namespace Internal
+} // namespace Emblem
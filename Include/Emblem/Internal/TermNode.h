@@ -18,14 +18,20 @@
 
 #pragma once
 
+#include "BinaryTree.h"
 #include "BinaryOperators.h"
 #include "UnaryOperators.h"
+#include "Hash.h"
 
 #include <allocators>
 #include <string>
 #include <unordered_map>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <stack>
+#include <utility>
+#include <vector>
 
 namespace Emblem
 {
@@ -35,6 +41,18 @@ namespace Internal
 
 /////////////////////////////////////////////////
 
+/** \brief Distinguishes node kinds in structural hashes. */
+enum class HashTag : std::uint64_t
+{
+    BinaryOperator = 1,
+    UnaryOperator = 2,
+    Symbol = 3,
+    Constant = 4,
+    NaryOperator = 5
+};
+
+/////////////////////////////////////////////////
+
 template <class T, class Allocator>
 class TermNode : public Internal::Node<TermNode<T, Allocator>>
 {
@@ -44,21 +62,373 @@ public:
         std::equal_to<std::string>, Allocator> ValueMap;
 
     TermNode()
-        : Internal::Node<TermNode<T, Allocator>>()
+        : Internal::Node<TermNode<T, Allocator>>(),
+          mHash(0), mSubtreeSize(0), mIsHashValid(false)
     {
 
     }
 
-    virtual T evaluate(const ValueMap& rValueMap) const = 0;
-    virtual void Output(bool withParens, std::ostream& rOut) const = 0;
+    /**
+    * \brief Value of the subtree rooted at this node.
+    *
+    * The subtree is walked with an explicit stack, so its depth is not
+    * limited by the call stack.
+    */
+    T evaluate(const ValueMap& rValueMap) const;
+
+    /**
+    * \brief Value of this node alone, given the values of its operands
+    * from left to right. Leaves ignore the operand values.
+    */
+    virtual T apply(const T* pOperandValues, const ValueMap& rValueMap) const = 0;
+
+    /**
+    * \brief Writes the subtree in infix form. The subtree is walked with
+    * an explicit stack, see OutputPart().
+    */
+    void Output(bool withParens, std::ostream& rOut) const;
+
+    /**
+    * \brief Writes the text of this node alone that precedes the operand at
+    * the index, or follows the last operand when index is operandCount().
+    */
+    virtual void OutputPart(std::size_t index, bool withParens, std::ostream& rOut) const = 0;
+
+    /** \brief Whether the operand at the index is written in brackets. */
+    virtual bool isOperandBracketed(std::size_t index, bool withParens) const
+    {
+        return true;
+    }
 
     virtual bool isOperand() const { return false; }
     virtual bool isOperator() const { return false; }
     virtual bool isSymbol() const { return false; }
+
+    /**
+    * \brief Operator of a sum or product, binary or n-ary, null for other
+    * nodes. These hash and compare as their operand lists, with any chain
+    * of the same operator in the first operand spliced in, so a left-nested
+    * chain equals the n-ary node it folds like.
+    */
+    virtual const BinaryOperator<T>* chainOperator() const { return nullptr; }
+
+    /**
+    * \brief Number of operands. Sums and products may have any number,
+    * other operators have one or two.
+    */
+    virtual std::size_t operandCount() const
+    {
+        return ((this->mpLeftNode != nullptr) ? 1 : 0) +
+               ((this->mpRightNode != nullptr) ? 1 : 0);
+    }
+
+    /** \brief Operand by position, left to right. */
+    virtual TermNode* operand(std::size_t index) const
+    {
+        assert(index < operandCount());
+        return ((index == 0) && (this->mpLeftNode != nullptr))
+               ? this->mpLeftNode : this->mpRightNode;
+    }
+
+    /** \brief Links a new operand at the position, the old one is not deleted. */
+    virtual void setOperand(std::size_t index, TermNode* pOperand)
+    {
+        assert(index < operandCount());
+        if ((index == 0) && (this->mpLeftNode != nullptr))
+        {
+            this->setLeft(pOperand);
+        }
+        else
+        {
+            this->setRight(pOperand);
+        }
+    }
+
+    /**
+    * \brief Whether the node has no operands. Hides Node::isLeaf(), which
+    * does not see the operands of sums and products.
+    */
+    bool isLeaf() const
+    {
+        return operandCount() == 0;
+    }
+
+    /**
+    * \brief Deep copy of the subtree, made without recursion. Hides
+    * Node::cloneTree(), which does not see the operands of sums and
+    * products.
+    */
+    TermNode* cloneTree() const;
+
+    /**
+    * \brief Structural hash of the subtree rooted at this node.
+    *
+    * The hash is cached per node. Nodes built on top of hashed subtrees
+    * only combine their children's hashes, and changing a child only
+    * invalidates the path up to the head.
+    */
+    std::uint64_t GetHash() const;
+
+    /** \brief Number of nodes in the subtree, cached along with the hash. */
+    std::size_t GetSubtreeSize() const
+    {
+        GetHash();
+        return mSubtreeSize;
+    }
+
+    /** \brief Compares this node alone against another, ignoring children. */
+    virtual bool isEquivalent(const TermNode& rOther) const = 0;
+
+    void onChildChanged() override
+    {
+        invalidateHash();
+    }
+
+protected:
+    /** \brief Hash of this node, given that its children's hashes are valid. */
+    virtual std::uint64_t computeHash() const = 0;
+
+    bool isHashValid() const
+    {
+        return mIsHashValid;
+    }
+
+    /**
+    * \brief Links an operand of a fresh clone, leaving the cached hashes
+    * alone. See cloneTree().
+    */
+    virtual void linkOperand(std::size_t index, TermNode* pOperand)
+    {
+        pOperand->mpParentNode = this;
+        if ((index == 0) && (this->mpLeftNode != nullptr))
+        {
+            this->mpLeftNode = pOperand;
+        }
+        else
+        {
+            this->mpRightNode = pOperand;
+        }
+    }
+
+    /** \brief Stores a hash updated in place, invalidating the ancestors. */
+    void setHash(std::uint64_t hash, std::size_t subtreeSize)
+    {
+        invalidateHash();
+        mHash = hash;
+        mSubtreeSize = subtreeSize;
+        mIsHashValid = true;
+    }
+
+private:
+    void invalidateHash()
+    {
+        mIsHashValid = false;
+        TermNode* pNode = this->mpParentNode;
+        while ((pNode != nullptr) && pNode->mIsHashValid)
+        {
+            pNode->mIsHashValid = false;
+            pNode = pNode->mpParentNode;
+        }
+    }
+
+    mutable std::uint64_t mHash;
+    mutable std::size_t mSubtreeSize;
+    mutable bool mIsHashValid;
 };
 
 /////////////////////////////////////////////////
 
+template <class T, class Allocator>
+std::uint64_t TermNode<T, Allocator>::GetHash() const
+{
+    if (mIsHashValid)
+    {
+        return mHash;
+    }
+
+    // Post-order over the stale part of the subtree only. The stack is
+    // kept per thread and used above its current size, so it is allocated
+    // once and stays valid if a hash is computed from within another.
+    static thread_local std::vector<std::pair<const TermNode*, bool>> nodeStack;
+    const std::size_t stackBase = nodeStack.size();
+    nodeStack.push_back(std::make_pair(this, false));
+    while (nodeStack.size() > stackBase)
+    {
+        const TermNode* pNode = nodeStack.back().first;
+        const bool isExpanded = nodeStack.back().second;
+        nodeStack.pop_back();
+        if (pNode->mIsHashValid)
+        {
+            continue;
+        }
+
+        if (!isExpanded)
+        {
+            nodeStack.push_back(std::make_pair(pNode, true));
+            for (std::size_t i = pNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push_back(std::make_pair((const TermNode*)pNode->operand(i), false));
+            }
+            continue;
+        }
+
+        std::size_t subtreeSize = 1;
+        for (std::size_t i = pNode->operandCount(); i-- > 0;)
+        {
+            subtreeSize += pNode->operand(i)->mSubtreeSize;
+        }
+        pNode->mHash = pNode->computeHash();
+        pNode->mSubtreeSize = subtreeSize;
+        pNode->mIsHashValid = true;
+    }
+
+    return mHash;
+}
+
+/////////////////////////////////////////////////
+
+template <class T, class Allocator>
+T TermNode<T, Allocator>::evaluate(const ValueMap& rValueMap) const
+{
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    // Post-order: every operand pushes its value, then the operator
+    // replaces the values of its operands with its own. The stacks are
+    // kept per thread and used above their current size, as in GetHash().
+    static thread_local std::vector<Frame> nodeStack;
+    static thread_local std::vector<T> values;
+    const std::size_t stackBase = nodeStack.size();
+
+    const Frame head = { this, operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (nodeStack.size() > stackBase)
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            if (operand.operandCount == 0)
+            {
+                values.push_back(pOperand->apply(nullptr, rValueMap));
+            }
+            else
+            {
+                nodeStack.push_back(operand);
+            }
+            continue;
+        }
+
+        const std::size_t first = values.size() - rFrame.operandCount;
+        const T value = rFrame.pNode->apply(values.data() + first, rValueMap);
+        values.erase(values.begin() + first, values.end());
+        values.push_back(value);
+        nodeStack.pop_back();
+    }
+
+    const T value = values.back();
+    values.pop_back();
+    return value;
+}
+
+/////////////////////////////////////////////////
+
+template <class T, class Allocator>
+TermNode<T, Allocator>* TermNode<T, Allocator>::cloneTree() const
+{
+    // Operands are linked directly rather than through setOperand(), the
+    // clone is identical so any state cached on it is still valid.
+    TermNode* pRoot = this->clone();
+    pRoot->mpParentNode = nullptr;
+
+    static thread_local std::vector<std::pair<const TermNode*, TermNode*>> nodeStack;
+    const std::size_t stackBase = nodeStack.size();
+    nodeStack.push_back(std::make_pair(this, pRoot));
+    while (nodeStack.size() > stackBase)
+    {
+        const TermNode* pOriginal = nodeStack.back().first;
+        TermNode* pClone = nodeStack.back().second;
+        nodeStack.pop_back();
+
+        const std::size_t count = pOriginal->operandCount();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const TermNode* pOperand = pOriginal->operand(i);
+            TermNode* pOperandClone = pOperand->clone();
+            pClone->linkOperand(i, pOperandClone);
+            nodeStack.push_back(std::make_pair(pOperand, pOperandClone));
+        }
+    }
+
+    return pRoot;
+}
+
+/////////////////////////////////////////////////
+
+template <class T, class Allocator>
+void TermNode<T, Allocator>::Output(bool withParens, std::ostream& rOut) const
+{
+    struct Frame
+    {
+        const TermNode* pNode;
+        bool withParens;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    // Each node writes its part before every operand and after the last.
+    std::vector<Frame> nodeStack;
+    const Frame head = { this, withParens, operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        rFrame.pNode->OutputPart(rFrame.nextOperand, rFrame.withParens, rOut);
+        if (rFrame.nextOperand == rFrame.operandCount)
+        {
+            nodeStack.pop_back();
+            continue;
+        }
+
+        const std::size_t index = rFrame.nextOperand++;
+        const TermNode* pOperand = rFrame.pNode->operand(index);
+        const Frame operand =
+        {
+            pOperand, rFrame.pNode->isOperandBracketed(index, rFrame.withParens),
+            pOperand->operandCount(), 0
+        };
+        nodeStack.push_back(operand);
+    }
+}
+
+/////////////////////////////////////////////////
+
+/**
+* \brief Hash of a sum or product up to its first operand: that of the
+* first operand itself where it is a chain of the same operator, so the
+* rest of the operands extend it. See TermNode::chainOperator().
+*/
+template <class T, class Allocator>
+std::uint64_t ChainHashStart(const BinaryOperator<T>& rOperator,
+                             const TermNode<T, Allocator>* pFirst, std::uint64_t firstHash)
+{
+    const BinaryOperator<T>* pFirstOperator = pFirst->chainOperator();
+    if ((pFirstOperator != nullptr) && (*pFirstOperator == rOperator))
+    {
+        return firstHash;
+    }
+    const std::uint64_t hash = HashCombine(static_cast<std::uint64_t>(HashTag::NaryOperator),
+                                           static_cast<std::uint64_t>(rOperator.GetType()));
+    return HashCombine(hash, firstHash);
+}
+
+/////////////////////////////////////////////////
+
 template <class T, class Allocator>
 class BinaryOperatorNode : public TermNode<T, Allocator>
 {
@@ -66,49 +436,40 @@ public:
     BinaryOperatorNode(const BinaryOperator<T>& rBinaryOperator)
         : TermNode(), mBinaryOperator(rBinaryOperator) {}
 
-    T evaluate(const ValueMap& rValueMap) const override
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
     {
         assert(mpLeftNode != nullptr);
         assert(mpRightNode != nullptr);
 
-        const T leftVal = ((TermNode*)mpLeftNode)->evaluate(rValueMap);
-        const T rightVal = ((TermNode*)mpRightNode)->evaluate(rValueMap);
-
-        return mBinaryOperator(leftVal, rightVal);
+        return mBinaryOperator(pOperandValues[0], pOperandValues[1]);
     }
 
-    void Output(bool withParens, std::ostream& rOut) const override
+    void OutputPart(std::size_t index, bool withParens, std::ostream& rOut) const override
     {
-        if (withParens)
+        if (index == 1)
         {
-            rOut << '(';
+            rOut << mBinaryOperator.GetOperatorString();
         }
-
-        // Output left node
-        const BinaryOperatorNode* pLeftOperation =
-            dynamic_cast<BinaryOperatorNode*>(mpLeftNode);
-        const bool isLeftOpEqual =
-            (pLeftOperation != nullptr) &&
-            (mBinaryOperator == pLeftOperation->mBinaryOperator);
-        mpLeftNode->Output(!isLeftOpEqual, rOut);
-
-        // Output operator
-        rOut << mBinaryOperator.GetOperatorString();
-
-        // Output right node
-        const BinaryOperatorNode* pRightOperation =
-            dynamic_cast<BinaryOperatorNode*>(mpLeftNode);
-        const bool isRightOpEqual =
-            (pRightOperation != nullptr) &&
-            (mBinaryOperator == pRightOperation->mBinaryOperator);
-        mpRightNode->Output(!isRightOpEqual, rOut);
-
-        if (withParens)
+        else if (withParens)
         {
-            rOut << ')';
+            rOut << ((index == 0) ? '(' : ')');
         }
     }
 
+    bool isOperandBracketed(std::size_t index, bool withParens) const override
+    {
+        // An operand repeating the operator is unbracketed on the left, and
+        // on the right only where regrouping is harmless
+        const BinaryOperatorNode* pOperation =
+            dynamic_cast<const BinaryOperatorNode*>((index == 0) ? mpLeftNode : mpRightNode);
+        const bool isOpEqual =
+            (pOperation != nullptr) && (mBinaryOperator == pOperation->mBinaryOperator);
+        const bool isAssociative =
+            (mBinaryOperator == BinaryOperator<T>::Addition) ||
+            (mBinaryOperator == BinaryOperator<T>::Multiplication);
+        return !isOpEqual || ((index == 1) && !isAssociative);
+    }
+
     virtual TermNode* clone() const override
     {
         return new BinaryOperatorNode(*this);
@@ -120,6 +481,39 @@ public:
     }
 
     virtual bool isOperator() const { return true; }
+
+    const BinaryOperator<T>* chainOperator() const override
+    {
+        const bool isAssociative =
+            (mBinaryOperator == BinaryOperator<T>::Addition) ||
+            (mBinaryOperator == BinaryOperator<T>::Multiplication);
+        return isAssociative ? &mBinaryOperator : nullptr;
+    }
+
+    bool isEquivalent(const TermNode& rOther) const override
+    {
+        const BinaryOperatorNode* pOther =
+            dynamic_cast<const BinaryOperatorNode*>(&rOther);
+        return (pOther != nullptr) && (mBinaryOperator == pOther->mBinaryOperator);
+    }
+
+protected:
+    std::uint64_t computeHash() const override
+    {
+        if (chainOperator() != nullptr)
+        {
+            const std::uint64_t hash =
+                ChainHashStart(mBinaryOperator, mpLeftNode, mpLeftNode->GetHash());
+            return HashCombine(hash, mpRightNode->GetHash());
+        }
+
+        std::uint64_t hash = HashCombine(
+                                 static_cast<std::uint64_t>(HashTag::BinaryOperator),
+                                 static_cast<std::uint64_t>(mBinaryOperator.GetType()));
+        hash = HashCombine(hash, mpLeftNode->GetHash());
+        return HashCombine(hash, mpRightNode->GetHash());
+    }
+
 private:
     BinaryOperator<T> mBinaryOperator;
 };
@@ -133,23 +527,33 @@ public:
     UnaryOperatorNode(const UnaryOperator<T>& rUnaryOperator)
         : TermNode(), mUnaryOperator(rUnaryOperator) {}
 
-    T evaluate(const ValueMap& rValueMap) const override
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
     {
-        if (mpLeftNode != nullptr)
+        return mUnaryOperator(pOperandValues[0]);
+    }
+
+    void OutputPart(std::size_t index, bool withParens, std::ostream& rOut) const override
+    {
+        // Negate and identity print no brackets of their own
+        const bool isBracketed = withParens && (mUnaryOperator == UnaryOperator<T>::Negate);
+        if ((index == 0) && isBracketed)
         {
-            const T val = ((TermNode*)mpLeftNode)->evaluate(rValueMap);
-            return mUnaryOperator(val);
+            rOut << '(';
+        }
+        rOut << ((index == 0) ? mUnaryOperator.GetOpenString() : mUnaryOperator.GetCloseString());
+        if ((index == 1) && isBracketed)
+        {
+            rOut << ')';
         }
-
-        const T val = ((TermNode*)mpRightNode)->evaluate(rValueMap);
-        return mUnaryOperator(val);
     }
 
-    void Output(bool withParens, std::ostream& rOut) const override
+    bool isOperandBracketed(std::size_t index, bool withParens) const override
     {
-        rOut << mUnaryOperator.GetOpenString();
-        mpLeftNode->Output(false, rOut);
-        rOut << mUnaryOperator.GetCloseString();
+        if (mUnaryOperator == UnaryOperator<T>::Identity)
+        {
+            return withParens;
+        }
+        return (mUnaryOperator == UnaryOperator<T>::Negate) && (mpLeftNode->operandCount() > 1);
     }
 
     virtual TermNode* clone() const override
@@ -163,12 +567,271 @@ public:
     }
 
     virtual bool isOperator() const { return true; }
+
+    bool isEquivalent(const TermNode& rOther) const override
+    {
+        const UnaryOperatorNode* pOther =
+            dynamic_cast<const UnaryOperatorNode*>(&rOther);
+        return (pOther != nullptr) && (mUnaryOperator == pOther->mUnaryOperator);
+    }
+
+protected:
+    std::uint64_t computeHash() const override
+    {
+        const TermNode* pOperand = (mpLeftNode != nullptr) ? mpLeftNode : mpRightNode;
+        const std::uint64_t hash = HashCombine(
+                                       static_cast<std::uint64_t>(HashTag::UnaryOperator),
+                                       static_cast<std::uint64_t>(mUnaryOperator.GetType()));
+        return HashCombine(hash, pOperand->GetHash());
+    }
+
 private:
     UnaryOperator<T> mUnaryOperator;
 };
 
 /////////////////////////////////////////////////
 
+/**
+* \brief Sum or product of any number of operands, held in one array.
+*
+* Expression builds these when a chain of additions or multiplications
+* grows past two operands. Operands are combined left to right, exactly
+* as the equivalent left-deep chain of binary nodes would, and are owned
+* by the node. Like the other nodes, a copy does not copy the operands,
+* its slots are left empty for cloneTree() to fill.
+*/
+template <class T, class Allocator>
+class NaryOperatorNode : public TermNode<T, Allocator>
+{
+public:
+    NaryOperatorNode(const BinaryOperator<T>& rBinaryOperator)
+        : TermNode(), mBinaryOperator(rBinaryOperator)
+    {
+        assert((rBinaryOperator == BinaryOperator<T>::Addition) ||
+               (rBinaryOperator == BinaryOperator<T>::Multiplication));
+    }
+
+    NaryOperatorNode(const NaryOperatorNode& rOther)
+        : TermNode(rOther), mOperands(rOther.mOperands.size(), nullptr),
+          mBinaryOperator(rOther.mBinaryOperator)
+    {
+    }
+
+    ~NaryOperatorNode()
+    {
+        BinaryTree<TermNode> tree;
+        for (TermNode* pOperand : mOperands)
+        {
+            if (pOperand != nullptr)
+            {
+                tree.insertToHead(pOperand);
+            }
+        }
+    }
+
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
+    {
+        T value = pOperandValues[0];
+        for (std::size_t i = 1; i < mOperands.size(); ++i)
+        {
+            value = mBinaryOperator(value, pOperandValues[i]);
+        }
+        return value;
+    }
+
+    void OutputPart(std::size_t index, bool withParens, std::ostream& rOut) const override
+    {
+        if ((index != 0) && (index != mOperands.size()))
+        {
+            rOut << mBinaryOperator.GetOperatorString();
+        }
+        else if (withParens)
+        {
+            rOut << ((index == 0) ? '(' : ')');
+        }
+    }
+
+    virtual TermNode* clone() const override
+    {
+        return new NaryOperatorNode(*this);
+    }
+
+    const BinaryOperator<T>& GetOperator() const
+    {
+        return mBinaryOperator;
+    }
+
+    virtual bool isOperator() const { return true; }
+
+    const BinaryOperator<T>* chainOperator() const override
+    {
+        return &mBinaryOperator;
+    }
+
+    std::size_t operandCount() const override
+    {
+        return mOperands.size();
+    }
+
+    TermNode* operand(std::size_t index) const override
+    {
+        assert(index < mOperands.size());
+        return mOperands[index];
+    }
+
+    void setOperand(std::size_t index, TermNode* pOperand) override
+    {
+        assert(index < mOperands.size());
+        pOperand->mpParentNode = this;
+        mOperands[index] = pOperand;
+        this->onChildChanged();
+    }
+
+    void detachChildren(std::vector<TermNode*>& rChildren) override
+    {
+        for (TermNode* pOperand : mOperands)
+        {
+            if (pOperand != nullptr)
+            {
+                rChildren.push_back(pOperand);
+            }
+        }
+        mOperands.clear();
+    }
+
+    /**
+    * \brief Takes ownership of the operand and appends it.
+    *
+    * A valid hash is extended in place, so building a long chain one
+    * operand at a time stays linear.
+    */
+    void append(TermNode* pOperand)
+    {
+        pOperand->mpParentNode = this;
+        mOperands.push_back(pOperand);
+        if (this->isHashValid())
+        {
+            this->setHash(HashCombine(this->GetHash(), pOperand->GetHash()),
+                          this->GetSubtreeSize() + pOperand->GetSubtreeSize());
+        }
+        else
+        {
+            this->onChildChanged();
+        }
+    }
+
+    /** \brief Gives up ownership of every operand, leaving the node empty. */
+    std::vector<TermNode*> releaseOperands()
+    {
+        std::vector<TermNode*> operands;
+        operands.swap(mOperands);
+        for (TermNode* pOperand : operands)
+        {
+            pOperand->mpParentNode = nullptr;
+        }
+        this->onChildChanged();
+        return operands;
+    }
+
+    bool isEquivalent(const TermNode& rOther) const override
+    {
+        const NaryOperatorNode* pOther =
+            dynamic_cast<const NaryOperatorNode*>(&rOther);
+        return (pOther != nullptr) && (mBinaryOperator == pOther->mBinaryOperator) &&
+               (mOperands.size() == pOther->mOperands.size());
+    }
+
+protected:
+    void linkOperand(std::size_t index, TermNode* pOperand) override
+    {
+        pOperand->mpParentNode = this;
+        mOperands[index] = pOperand;
+    }
+
+    std::uint64_t computeHash() const override
+    {
+        std::uint64_t hash = ChainHashStart(mBinaryOperator, mOperands[0], mOperands[0]->GetHash());
+        for (std::size_t i = 1; i < mOperands.size(); ++i)
+        {
+            hash = HashCombine(hash, mOperands[i]->GetHash());
+        }
+        return hash;
+    }
+
+    std::vector<TermNode*> mOperands;
+
+private:
+    NaryOperatorNode& operator=(const NaryOperatorNode&);
+
+    BinaryOperator<T> mBinaryOperator;
+};
+
+/////////////////////////////////////////////////
+
+/** \brief Sum of any number of operands, see NaryOperatorNode. */
+template <class T, class Allocator>
+class SumNode : public NaryOperatorNode<T, Allocator>
+{
+    typedef NaryOperatorNode<T, Allocator> NaryOperatorNode;
+    typedef TermNode<T, Allocator> TermNode;
+    typedef typename TermNode::ValueMap ValueMap;
+public:
+    SumNode()
+        : NaryOperatorNode(BinaryOperator<T>::Addition)
+    {
+    }
+
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
+    {
+        const std::size_t count = this->mOperands.size();
+        T sum = pOperandValues[0];
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            sum += pOperandValues[i];
+        }
+        return sum;
+    }
+
+    virtual TermNode* clone() const override
+    {
+        return new SumNode(*this);
+    }
+};
+
+/////////////////////////////////////////////////
+
+/** \brief Product of any number of operands, see NaryOperatorNode. */
+template <class T, class Allocator>
+class ProductNode : public NaryOperatorNode<T, Allocator>
+{
+    typedef NaryOperatorNode<T, Allocator> NaryOperatorNode;
+    typedef TermNode<T, Allocator> TermNode;
+    typedef typename TermNode::ValueMap ValueMap;
+public:
+    ProductNode()
+        : NaryOperatorNode(BinaryOperator<T>::Multiplication)
+    {
+    }
+
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
+    {
+        const std::size_t count = this->mOperands.size();
+        T product = pOperandValues[0];
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            product *= pOperandValues[i];
+        }
+        return product;
+    }
+
+    virtual TermNode* clone() const override
+    {
+        return new ProductNode(*this);
+    }
+};
+
+/////////////////////////////////////////////////
+
 template <class T, class Allocator>
 class SymbolNode : public TermNode<T, Allocator>
 {
@@ -178,12 +841,12 @@ public:
         : TermNode(), mSymbol(rSymbol)
     {}
 
-    T evaluate(const ValueMap& rValueMap) const override
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
     {
         return rValueMap.at(mSymbol.toString());
     }
 
-    void Output(bool withParens, std::ostream& rOut) const override
+    void OutputPart(std::size_t index, bool withParens, std::ostream& rOut) const override
     {
         rOut << mSymbol;
     }
@@ -200,6 +863,19 @@ public:
 
     virtual bool isOperand() const { return true; }
     virtual bool isSymbol() const { return true; }
+
+    bool isEquivalent(const TermNode& rOther) const override
+    {
+        const SymbolNode* pOther = dynamic_cast<const SymbolNode*>(&rOther);
+        return (pOther != nullptr) && (mSymbol == pOther->mSymbol);
+    }
+
+protected:
+    std::uint64_t computeHash() const override
+    {
+        return HashCombine(static_cast<std::uint64_t>(HashTag::Symbol),
+                           HashString(mSymbol.toString()));
+    }
 };
 
 /////////////////////////////////////////////////
@@ -215,19 +891,28 @@ public:
     }
 
     ConstantNode(const ConstantNode& rOther)
-        : mpData(mAllocator.allocate(1))
+        : TermNode(rOther), mpData(mAllocator.allocate(1))
     {
         *mpData = *rOther.mpData;
     }
 
-    T evaluate(const ValueMap& rValueMap) const override
+    T apply(const T* pOperandValues, const ValueMap& rValueMap) const override
     {
         return *mpData;
     }
 
-    void Output(bool withParens, std::ostream& rOut) const override
+    void OutputPart(std::size_t index, bool withParens, std::ostream& rOut) const override
     {
+        const bool isNegative = (*mpData < T());
+        if (withParens && isNegative)
+        {
+            rOut << '(';
+        }
         rOut << *mpData;
+        if (withParens && isNegative)
+        {
+            rOut << ')';
+        }
     }
 
     virtual TermNode* clone() const override
@@ -235,6 +920,11 @@ public:
         return new ConstantNode(*this);
     }
 
+    const T& GetValue() const
+    {
+        return *mpData;
+    }
+
     ~ConstantNode()
     {
         mAllocator.deallocate(mpData, 1);
@@ -242,6 +932,20 @@ public:
     }
 
     virtual bool isOperand() const { return true; }
+
+    bool isEquivalent(const TermNode& rOther) const override
+    {
+        const ConstantNode* pOther = dynamic_cast<const ConstantNode*>(&rOther);
+        return (pOther != nullptr) && IsBitwiseEqual(*mpData, *pOther->mpData);
+    }
+
+protected:
+    std::uint64_t computeHash() const override
+    {
+        return HashCombine(static_cast<std::uint64_t>(HashTag::Constant),
+                           HashValue(*mpData));
+    }
+
 private:
     ConstantNode& operator=(const ConstantNode&);
 
@@ -249,5 +953,167 @@ private:
     T* mpData;
 };
 
+/////////////////////////////////////////////////
+
+/**
+* \brief Appends the operands of a sum or product, last first, with those
+* of the chains of the same operator along its first operand spliced in.
+*/
+template <class T, class Allocator>
+void AppendChainOperandsReversed(const TermNode<T, Allocator>* pNode,
+                                 std::vector<const TermNode<T, Allocator>*>& rOperands)
+{
+    const BinaryOperator<T>& rOperator = *pNode->chainOperator();
+    while (true)
+    {
+        for (std::size_t i = pNode->operandCount(); i-- > 1;)
+        {
+            rOperands.push_back(pNode->operand(i));
+        }
+        const TermNode<T, Allocator>* pFirst = pNode->operand(0);
+        const BinaryOperator<T>* pFirstOperator = pFirst->chainOperator();
+        if ((pFirstOperator == nullptr) || !(*pFirstOperator == rOperator))
+        {
+            rOperands.push_back(pFirst);
+            return;
+        }
+        pNode = pFirst;
+    }
+}
+
+/**
+* \brief Whether both nodes are sums or both products, with equally many
+* operands once flattened. The flattened operands are left in the lists,
+* last first.
+*/
+template <class T, class Allocator>
+bool FlattenChainPair(const TermNode<T, Allocator>* pA, const TermNode<T, Allocator>* pB,
+                      std::vector<const TermNode<T, Allocator>*>& rOperandsA,
+                      std::vector<const TermNode<T, Allocator>*>& rOperandsB)
+{
+    const BinaryOperator<T>* pOperatorB = pB->chainOperator();
+    if ((pOperatorB == nullptr) || !(*pA->chainOperator() == *pOperatorB))
+    {
+        return false;
+    }
+    rOperandsA.clear();
+    rOperandsB.clear();
+    AppendChainOperandsReversed(pA, rOperandsA);
+    AppendChainOperandsReversed(pB, rOperandsB);
+    return rOperandsA.size() == rOperandsB.size();
+}
+
+/**
+* \brief Compares two subtrees node by node, sums and products by their
+* flattened operands, see TermNode::chainOperator().
+*
+* Pairs of subtrees whose cached hashes differ are rejected without being
+* walked.
+*/
+template <class T, class Allocator>
+bool IsStructurallyEqual(
+    const TermNode<T, Allocator>* pA, const TermNode<T, Allocator>* pB)
+{
+    typedef TermNode<T, Allocator> TermNode;
+
+    std::vector<const TermNode*> operandsA;
+    std::vector<const TermNode*> operandsB;
+    std::stack<std::pair<const TermNode*, const TermNode*>> nodeStack;
+    nodeStack.push(std::make_pair(pA, pB));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNodeA = nodeStack.top().first;
+        const TermNode* pNodeB = nodeStack.top().second;
+        nodeStack.pop();
+
+        if (pNodeA == pNodeB)
+        {
+            continue;
+        }
+
+        if ((pNodeA == nullptr) || (pNodeB == nullptr))
+        {
+            return false;
+        }
+
+        if (pNodeA->GetHash() != pNodeB->GetHash())
+        {
+            return false;
+        }
+
+        if (pNodeA->chainOperator() != nullptr)
+        {
+            if (!FlattenChainPair(pNodeA, pNodeB, operandsA, operandsB))
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < operandsA.size(); ++i)
+            {
+                nodeStack.push(std::make_pair(operandsA[i], operandsB[i]));
+            }
+            continue;
+        }
+
+        if (!pNodeA->isEquivalent(*pNodeB))
+        {
+            return false;
+        }
+
+        if (pNodeA->operandCount() != pNodeB->operandCount())
+        {
+            return false;
+        }
+        for (std::size_t i = pNodeA->operandCount(); i-- > 0;)
+        {
+            nodeStack.push(std::make_pair(
+                               (const TermNode*)pNodeA->operand(i),
+                               (const TermNode*)pNodeB->operand(i)));
+        }
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////
+
+/** \brief Whether the node is a binary operation of the given kind. */
+template <class T, class Allocator>
+bool IsBinaryOperation(const TermNode<T, Allocator>* pNode, const BinaryOperator<T>& rOperator)
+{
+    const BinaryOperatorNode<T, Allocator>* pBinaryOp =
+        dynamic_cast<const BinaryOperatorNode<T, Allocator>*>(pNode);
+    return (pBinaryOp != nullptr) && (pBinaryOp->GetOperator() == rOperator);
+}
+
+/** \brief Whether the node is a unary operation of the given kind. */
+template <class T, class Allocator>
+bool IsUnaryOperation(const TermNode<T, Allocator>* pNode, const UnaryOperator<T>& rOperator)
+{
+    const UnaryOperatorNode<T, Allocator>* pUnaryOp =
+        dynamic_cast<const UnaryOperatorNode<T, Allocator>*>(pNode);
+    return (pUnaryOp != nullptr) && (pUnaryOp->GetOperator() == rOperator);
+}
+
+/** \brief Whether the node is a sum or product of the given kind with any number of operands. */
+template <class T, class Allocator>
+bool IsNaryOperation(const TermNode<T, Allocator>* pNode, const BinaryOperator<T>& rOperator)
+{
+    const NaryOperatorNode<T, Allocator>* pNaryOp =
+        dynamic_cast<const NaryOperatorNode<T, Allocator>*>(pNode);
+    return (pNaryOp != nullptr) && (pNaryOp->GetOperator() == rOperator);
+}
+
+/** \brief Reads the value of a constant node, returns false for other nodes. */
+template <class T, class Allocator>
+bool GetConstant(const TermNode<T, Allocator>* pNode, T& rValue)
+{
+    if ((pNode == nullptr) || pNode->isOperator() || pNode->isSymbol())
+    {
+        return false;
+    }
+    rValue = static_cast<const ConstantNode<T, Allocator>*>(pNode)->GetValue();
+    return true;
+}
+
 } // namespace Internal
 } // namespace Emblem
\ No newline at end of file
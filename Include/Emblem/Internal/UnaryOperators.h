@@ -32,11 +32,30 @@ class UnaryOperator
 {
     typedef T(*Operator)(const T&);
 public:
+    /** \brief Identifies the operation independently of its function pointer. */
+    enum class Type
+    {
+        Sin,
+        Cos,
+        Tan,
+        Identity,
+        Abs,
+        Negate,
+        Exp,
+        Ln,
+        Log10,
+        Sqrt,
+        Square,
+        Cube,
+        Reciprocal
+    };
+
     UnaryOperator(
+        Type type,
         Operator op,
         const std::string& rOpenString,
         const std::string& rCloseString)
-        : mOperator(op), mOpenString(rOpenString),
+        : mType(type), mOperator(op), mOpenString(rOpenString),
           mCloseString(rCloseString)
     {
     }
@@ -56,6 +75,16 @@ public:
         return mCloseString;
     }
 
+    Type GetType() const
+    {
+        return mType;
+    }
+
+    bool operator==(const UnaryOperator& rOther) const
+    {
+        return mOperator == rOther.mOperator;
+    }
+
     static UnaryOperator Sin;
     static UnaryOperator Cos;
     static UnaryOperator Tan;
@@ -66,8 +95,12 @@ public:
     static UnaryOperator Ln;
     static UnaryOperator Log10;
     static UnaryOperator Sqrt;
+    static UnaryOperator Square;
+    static UnaryOperator Cube;
+    static UnaryOperator Reciprocal;
 
 private:
+    const Type mType;
     const Operator mOperator;
     std::string mOpenString;
     std::string mCloseString;
@@ -89,7 +122,7 @@ template <class T>
 T FuncIdentity(const T& rA) { return rA; }
 
 template <class T>
-T FuncAbs(const T& rA) { return std::abs(rA); }
+T FuncAbs(const T& rA) { using std::abs; return abs(rA); }
 
 template <class T>
 T FuncNegate(const T& rA) { return -rA; }
@@ -106,37 +139,55 @@ T FuncLog10(const T& rA) { return log10(rA); }
 template <class T>
 T FuncSqrt(const T& rA) { return sqrt(rA); }
 
+template <class T>
+T FuncSquare(const T& rA) { return rA * rA; }
+
+template <class T>
+T FuncCube(const T& rA) { return rA * rA * rA; }
+
+template <class T>
+T FuncReciprocal(const T& rA) { return T(1) / rA; }
+
 ///////////////////////////////////////////////////////////////////////
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Sin(FuncSin<T>, "sin(", ")");
+UnaryOperator<T> UnaryOperator<T>::Sin(Type::Sin, FuncSin<T>, "sin(", ")");
+
+template <class T>
+UnaryOperator<T> UnaryOperator<T>::Cos(Type::Cos, FuncCos<T>, "cos(", ")");
+
+template <class T>
+UnaryOperator<T> UnaryOperator<T>::Tan(Type::Tan, FuncTan<T>, "tan(", ")");
+
+template <class T>
+UnaryOperator<T> UnaryOperator<T>::Identity(Type::Identity, FuncIdentity<T>, "", "");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Cos(FuncCos<T>, "cos(", ")");
+UnaryOperator<T> UnaryOperator<T>::Abs(Type::Abs, FuncAbs<T>, "|", "|");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Tan(FuncTan<T>, "tan(", ")");
+UnaryOperator<T> UnaryOperator<T>::Negate(Type::Negate, FuncNegate<T>, "-", "");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Identity(FuncIdentity<T>, "", "");
+UnaryOperator<T> UnaryOperator<T>::Exp(Type::Exp, FuncExp<T>, "e^(", ")");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Abs(FuncAbs<T>, "|", "|");
+UnaryOperator<T> UnaryOperator<T>::Ln(Type::Ln, FuncLn<T>, "ln(", ")");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Negate(FuncNegate<T>, "-", "");
+UnaryOperator<T> UnaryOperator<T>::Log10(Type::Log10, FuncLog10<T>, "log10(", ")");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Exp(FuncExp<T>, "e^(", ")");
+UnaryOperator<T> UnaryOperator<T>::Sqrt(Type::Sqrt, FuncSqrt<T>, "(", ")^(1/2)");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Ln(FuncLn<T>, "ln(", ")");
+UnaryOperator<T> UnaryOperator<T>::Square(Type::Square, FuncSquare<T>, "(", ")^2");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Log10(FuncLog10<T>, "log10(", ")");
+UnaryOperator<T> UnaryOperator<T>::Cube(Type::Cube, FuncCube<T>, "(", ")^3");
 
 template <class T>
-UnaryOperator<T> UnaryOperator<T>::Sqrt(FuncSqrt<T>, "(", ")^(1/2)");
+UnaryOperator<T> UnaryOperator<T>::Reciprocal(Type::Reciprocal, FuncReciprocal<T>, "1/(", ")");
 
 } // namespace Internal
 } // namespace Emblem
\ No newline at end of file
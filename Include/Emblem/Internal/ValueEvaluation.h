@@ -0,0 +1,194 @@
+/**
+* \file ValueEvaluation.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "TermNode.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Applies the operator to a value of another type than the tree's. */
+template <class V, class T>
+V ApplyOperator(const UnaryOperator<T>& rOperator, const V& rA)
+{
+    typedef typename UnaryOperator<T>::Type Type;
+    switch (rOperator.GetType())
+    {
+    case Type::Sin: return FuncSin(rA);
+    case Type::Cos: return FuncCos(rA);
+    case Type::Tan: return FuncTan(rA);
+    case Type::Identity: return FuncIdentity(rA);
+    case Type::Abs: return FuncAbs(rA);
+    case Type::Negate: return FuncNegate(rA);
+    case Type::Exp: return FuncExp(rA);
+    case Type::Ln: return FuncLn(rA);
+    case Type::Log10: return FuncLog10(rA);
+    case Type::Sqrt: return FuncSqrt(rA);
+    case Type::Square: return FuncSquare(rA);
+    case Type::Cube: return FuncCube(rA);
+    case Type::Reciprocal: return FuncReciprocal(rA);
+    }
+    assert(0);
+    return V();
+}
+
+template <class V, class T>
+V ApplyOperator(const BinaryOperator<T>& rOperator, const V& rA, const V& rB)
+{
+    typedef typename BinaryOperator<T>::Type Type;
+    switch (rOperator.GetType())
+    {
+    case Type::Addition: return FuncAdd(rA, rB);
+    case Type::Subtraction: return FuncSub(rA, rB);
+    case Type::Multiplication: return FuncMul(rA, rB);
+    case Type::Division: return FuncDiv(rA, rB);
+    case Type::Pow: return FuncPow(rA, rB);
+    }
+    assert(0);
+    return V();
+}
+
+/** \brief The operator of the same kind for values of type U. */
+template <class U, class T>
+const UnaryOperator<U>& ConvertOperator(const UnaryOperator<T>& rOperator)
+{
+    typedef typename UnaryOperator<T>::Type Type;
+    switch (rOperator.GetType())
+    {
+    case Type::Sin: return UnaryOperator<U>::Sin;
+    case Type::Cos: return UnaryOperator<U>::Cos;
+    case Type::Tan: return UnaryOperator<U>::Tan;
+    case Type::Identity: return UnaryOperator<U>::Identity;
+    case Type::Abs: return UnaryOperator<U>::Abs;
+    case Type::Negate: return UnaryOperator<U>::Negate;
+    case Type::Exp: return UnaryOperator<U>::Exp;
+    case Type::Ln: return UnaryOperator<U>::Ln;
+    case Type::Log10: return UnaryOperator<U>::Log10;
+    case Type::Sqrt: return UnaryOperator<U>::Sqrt;
+    case Type::Square: return UnaryOperator<U>::Square;
+    case Type::Cube: return UnaryOperator<U>::Cube;
+    case Type::Reciprocal: return UnaryOperator<U>::Reciprocal;
+    }
+    assert(0);
+    return UnaryOperator<U>::Identity;
+}
+
+template <class U, class T>
+const BinaryOperator<U>& ConvertOperator(const BinaryOperator<T>& rOperator)
+{
+    typedef typename BinaryOperator<T>::Type Type;
+    switch (rOperator.GetType())
+    {
+    case Type::Addition: return BinaryOperator<U>::Addition;
+    case Type::Subtraction: return BinaryOperator<U>::Subtraction;
+    case Type::Multiplication: return BinaryOperator<U>::Multiplication;
+    case Type::Division: return BinaryOperator<U>::Division;
+    case Type::Pow: return BinaryOperator<U>::Pow;
+    }
+    assert(0);
+    return BinaryOperator<U>::Addition;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Evaluates the tree with values of type V, which must be
+* constructible from the tree's constants of type T.
+*
+* The walk is iterative and post-order, as TermNode::evaluate(). Sums and
+* products are folded left to right.
+*/
+template <class V, class T, class Alloc>
+V EvaluateAs(const TermNode<T, Alloc>* pHead, const std::unordered_map<std::string, V>& rValues)
+{
+    typedef TermNode<T, Alloc> TermNode;
+    typedef BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef SymbolNode<T, Alloc> SymbolNode;
+    typedef ConstantNode<T, Alloc> ConstantNode;
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    std::vector<Frame> nodeStack;
+    std::vector<V> values;
+    const Frame head = { pHead, pHead->operandCount(), 0 };
+    nodeStack.push_back(head);
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const TermNode* pNode = rFrame.pNode;
+        const std::size_t first = values.size() - rFrame.operandCount;
+        if (pNode->isSymbol())
+        {
+            values.push_back(rValues.at(static_cast<const SymbolNode*>(pNode)->GetSymbol().toString()));
+        }
+        else if (!pNode->isOperator())
+        {
+            values.push_back(V(static_cast<const ConstantNode*>(pNode)->GetValue()));
+        }
+        else if (const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode))
+        {
+            V result = values[first];
+            for (std::size_t i = first + 1; i < values.size(); ++i)
+            {
+                result = ApplyOperator(pNaryOp->GetOperator(), result, values[i]);
+            }
+            values.resize(first);
+            values.push_back(result);
+        }
+        else if (const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode))
+        {
+            const V result = ApplyOperator(pBinaryOp->GetOperator(), values[first], values[first + 1]);
+            values.resize(first);
+            values.push_back(result);
+        }
+        else
+        {
+            values.back() = ApplyOperator(
+                                static_cast<const UnaryOperatorNode*>(pNode)->GetOperator(), values.back());
+        }
+        nodeStack.pop_back();
+    }
+    return values.back();
+}
+
+} // namespace Internal
+} // namespace Emblem
@@ -0,0 +1,91 @@
+/**
+* \file Interval.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Emblem
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \struct Interval
+* \brief Closed range [lower, upper] of values a symbol or a subexpression
+* may take.
+*
+* An unknown range is Everything(), with infinite bounds.
+*/
+template <class T>
+struct Interval
+{
+    Interval()
+        : lower(-std::numeric_limits<T>::infinity()),
+          upper(std::numeric_limits<T>::infinity())
+    {
+    }
+
+    Interval(const T& rLower, const T& rUpper)
+        : lower(rLower), upper(rUpper)
+    {
+    }
+
+    static Interval Point(const T& rValue)
+    {
+        return Interval(rValue, rValue);
+    }
+
+    static Interval Everything()
+    {
+        return Interval();
+    }
+
+    bool contains(const T& rValue) const
+    {
+        return (lower <= rValue) && (rValue <= upper);
+    }
+
+    bool isPoint() const
+    {
+        return lower == upper;
+    }
+
+    bool isBounded() const
+    {
+        return std::isfinite(lower) && std::isfinite(upper);
+    }
+
+    /** \brief Largest absolute value in the range. */
+    T magnitude() const
+    {
+        return std::max(std::abs(lower), std::abs(upper));
+    }
+
+    /** \brief Smallest absolute value in the range. */
+    T mignitude() const
+    {
+        return contains(T(0)) ? T(0) : std::min(std::abs(lower), std::abs(upper));
+    }
+
+    T lower;
+    T upper;
+};
+
+} // namespace Emblem
@@ -0,0 +1,207 @@
+/**
+* \file LookupTable.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Interval.h"
+#include "Program.h"
+#include "Internal\IntervalArithmetic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Largest |f''| of the operation over the domain, infinite where
+* the operation has no table or the domain reaches a singularity.
+*/
+template <class T>
+T SecondDerivativeBound(OpCode opCode, const Interval<T>& rDomain)
+{
+    const T infinity = std::numeric_limits<T>::infinity();
+    if (!rDomain.isBounded())
+    {
+        return infinity;
+    }
+
+    switch (opCode)
+    {
+    case OpCode::Sin:
+    case OpCode::Cos:
+        return T(1);
+    case OpCode::Tan:
+    {
+        // |tan''| = 2 |tan| (1 + tan^2) grows away from the zeros of tan
+        // on each branch, so an endpoint holds the largest.
+        const T pi = T(3.14159265358979323846);
+        if (ContainsPeriodicPoint(rDomain, pi / 2, pi))
+        {
+            return infinity;
+        }
+        const T largest = std::max(std::abs(std::tan(rDomain.lower)), std::abs(std::tan(rDomain.upper)));
+        return 2 * largest * (1 + largest * largest);
+    }
+    case OpCode::Exp:
+        return std::exp(rDomain.upper);
+    case OpCode::Ln:
+    case OpCode::Log10:
+    {
+        if (rDomain.lower <= 0)
+        {
+            return infinity;
+        }
+        const T bound = 1 / (rDomain.lower * rDomain.lower);
+        return (opCode == OpCode::Ln) ? bound : bound / std::log(T(10));
+    }
+    default:
+        return infinity;
+    }
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class LookupTable
+* \brief Values of a unary operation at evenly spaced points of a bounded
+* domain, interpolated linearly in between.
+*
+* Linear interpolation over segments of width h is off by at most h^2 / 8
+* times the largest |f''| on the domain, from which the table is sized
+* for the error allowed. Half the error is left for rounding. Arguments
+* outside the domain extend the first or last segment and are not
+* accurate.
+*
+* Lookups neither branch nor call, so loops over them vectorize with
+* gathers.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T>
+class LookupTable
+{
+    typedef Internal::OpCode OpCode;
+public:
+    /** \brief Most segments of a table, 8 MiB of doubles. */
+    static const std::size_t MaxSegments = 1 << 20;
+
+    /**
+    * \brief Tabulates sin, cos, tan, exp, ln or log10 over the domain,
+    * within maxError of the exact values.
+    *
+    * Returns null for other operations, for domains that are unbounded or
+    * reach a singularity, or if the table would need more than
+    * MaxSegments or an error below the rounding of T.
+    */
+    static std::shared_ptr<const LookupTable> Create(OpCode opCode, const Interval<T>& rDomain, T maxError);
+
+    T operator()(const T& rX) const
+    {
+        const T position = (rX - mDomain.lower) * mInverseStep;
+        const T clamped = std::max(T(0), std::min(position, mLastSegment));
+        const std::int32_t segment = static_cast<std::int32_t>(clamped);
+        const T t = position - static_cast<T>(segment);
+        return mValues[segment] + t * (mValues[segment + 1] - mValues[segment]);
+    }
+
+    const Interval<T>& domain() const
+    {
+        return mDomain;
+    }
+
+    std::size_t segmentCount() const
+    {
+        return mValues.size() - 1;
+    }
+
+    /** \brief Bound on the error of any argument within the domain. */
+    T maxError() const
+    {
+        return mMaxError;
+    }
+
+    std::size_t memoryUsage() const
+    {
+        return sizeof(LookupTable) + mValues.size() * sizeof(T);
+    }
+
+private:
+    LookupTable(OpCode opCode, const Interval<T>& rDomain, std::size_t segmentCount, T maxError);
+
+    Interval<T> mDomain;
+    T mInverseStep;
+    T mLastSegment;
+    T mMaxError;
+    std::vector<T> mValues;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+const std::size_t LookupTable<T>::MaxSegments;
+
+template <class T>
+std::shared_ptr<const LookupTable<T>> LookupTable<T>::Create(
+    OpCode opCode, const Interval<T>& rDomain, T maxError)
+{
+    const T curvature = Internal::SecondDerivativeBound(opCode, rDomain);
+    const T largestValue = Internal::IntervalOf(opCode, rDomain).magnitude();
+    if (!(curvature < std::numeric_limits<T>::infinity()) ||
+            !(maxError > 8 * std::numeric_limits<T>::epsilon() * largestValue))
+    {
+        return std::shared_ptr<const LookupTable>();
+    }
+
+    // h^2 / 8 * curvature <= maxError / 2
+    const T width = rDomain.upper - rDomain.lower;
+    const T segments = std::ceil(width * std::sqrt(curvature / (4 * maxError)));
+    if (!(segments <= T(MaxSegments)))
+    {
+        return std::shared_ptr<const LookupTable>();
+    }
+    const std::size_t segmentCount = std::max<std::size_t>(static_cast<std::size_t>(segments), 1);
+    return std::shared_ptr<const LookupTable>(new LookupTable(opCode, rDomain, segmentCount, maxError));
+}
+
+template <class T>
+LookupTable<T>::LookupTable(OpCode opCode, const Interval<T>& rDomain,
+                            std::size_t segmentCount, T maxError)
+    : mDomain(rDomain), mLastSegment(static_cast<T>(segmentCount - 1)), mMaxError(maxError),
+      mValues(segmentCount + 1)
+{
+    const T width = rDomain.upper - rDomain.lower;
+    mInverseStep = (width > 0) ? static_cast<T>(segmentCount) / width : T(0);
+    for (std::size_t i = 0; i <= segmentCount; ++i)
+    {
+        const T x = (i == segmentCount) ? rDomain.upper
+                    : rDomain.lower + width * static_cast<T>(i) / static_cast<T>(segmentCount);
+        mValues[i] = Internal::ApplyUnary(opCode, x);
+    }
+}
+
+} // namespace Emblem
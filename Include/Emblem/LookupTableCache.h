@@ -0,0 +1,244 @@
+/**
+* \file LookupTableCache.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "LookupTable.h"
+#include "Internal\Hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace Emblem
+{
+
+/**
+* \class LookupTableCache
+* \brief Thread-safe LRU cache of lookup tables, shared by every
+* expression tabulating the same operation over the same domain.
+*
+* Tables are keyed by operation, domain and error bound. Entries are
+* evicted least recently used first once the memory budget is exceeded;
+* evaluators holding an evicted table keep it alive.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T>
+class LookupTableCache
+{
+    typedef Internal::OpCode OpCode;
+public:
+    typedef std::shared_ptr<const LookupTable<T>> TablePtr;
+
+    struct Statistics
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::size_t entryCount;
+        std::size_t memoryUsage;
+        std::size_t memoryBudget;
+    };
+
+    static const std::size_t DefaultMemoryBudget = 64 * 1024 * 1024;
+
+    explicit LookupTableCache(std::size_t memoryBudget = DefaultMemoryBudget)
+        : mMemoryBudget(memoryBudget), mMemoryUsage(0),
+          mHits(0), mMisses(0), mEvictions(0)
+    {
+    }
+
+    /** \brief Process-wide cache. */
+    static LookupTableCache& Instance()
+    {
+        static LookupTableCache sCache;
+        return sCache;
+    }
+
+    /**
+    * \brief Returns the cached table, building and caching one on a miss.
+    * Null where LookupTable::Create() returns null.
+    *
+    * Tables are built without the cache locked, so concurrent misses on
+    * the same key may both build; the first one inserted is kept.
+    */
+    TablePtr getOrCreate(OpCode opCode, const Interval<T>& rDomain, T maxError);
+
+    void setMemoryBudget(std::size_t memoryBudget)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mMemoryBudget = memoryBudget;
+        evict();
+    }
+
+    std::size_t memoryBudget() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMemoryBudget;
+    }
+
+    /** \brief Drops all entries. Counters are left untouched. */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEntries.clear();
+        mIndex.clear();
+        mMemoryUsage = 0;
+    }
+
+    Statistics statistics() const;
+
+private:
+    LookupTableCache(const LookupTableCache&);
+    LookupTableCache& operator=(const LookupTableCache&);
+
+    struct Key
+    {
+        bool operator==(const Key& rOther) const
+        {
+            return (opCode == rOther.opCode) && (lower == rOther.lower) &&
+                   (upper == rOther.upper) && (maxError == rOther.maxError);
+        }
+
+        OpCode opCode;
+        T lower;
+        T upper;
+        T maxError;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& rKey) const
+        {
+            std::uint64_t hash = static_cast<std::uint64_t>(rKey.opCode);
+            hash = Internal::HashCombine(hash, Internal::HashBytes(&rKey.lower, sizeof(T)));
+            hash = Internal::HashCombine(hash, Internal::HashBytes(&rKey.upper, sizeof(T)));
+            hash = Internal::HashCombine(hash, Internal::HashBytes(&rKey.maxError, sizeof(T)));
+            return static_cast<std::size_t>(hash);
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        TablePtr pTable;
+        std::size_t size;
+    };
+    typedef std::list<Entry> EntryList;
+
+    void evict();
+
+    mutable std::mutex mMutex;
+
+    // Most recently used first.
+    EntryList mEntries;
+    std::unordered_map<Key, typename EntryList::iterator, KeyHash> mIndex;
+
+    std::size_t mMemoryBudget;
+    std::size_t mMemoryUsage;
+    std::uint64_t mHits;
+    std::uint64_t mMisses;
+    std::uint64_t mEvictions;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+const std::size_t LookupTableCache<T>::DefaultMemoryBudget;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+typename LookupTableCache<T>::TablePtr LookupTableCache<T>::getOrCreate(
+    OpCode opCode, const Interval<T>& rDomain, T maxError)
+{
+    const Key key = { opCode, rDomain.lower, rDomain.upper, maxError };
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto indexIter = mIndex.find(key);
+        if (indexIter != mIndex.end())
+        {
+            ++mHits;
+            mEntries.splice(mEntries.begin(), mEntries, indexIter->second);
+            return indexIter->second->pTable;
+        }
+        ++mMisses;
+    }
+
+    TablePtr pTable = LookupTable<T>::Create(opCode, rDomain, maxError);
+    if (pTable == nullptr)
+    {
+        return pTable;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto indexIter = mIndex.find(key);
+    if (indexIter != mIndex.end())
+    {
+        // Another thread built the same table first.
+        mEntries.splice(mEntries.begin(), mEntries, indexIter->second);
+        return indexIter->second->pTable;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.pTable = pTable;
+    entry.size = sizeof(Entry) + pTable->memoryUsage();
+
+    mMemoryUsage += entry.size;
+    mEntries.push_front(std::move(entry));
+    mIndex[key] = mEntries.begin();
+    evict();
+    return pTable;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+typename LookupTableCache<T>::Statistics LookupTableCache<T>::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Statistics statistics;
+    statistics.hits = mHits;
+    statistics.misses = mMisses;
+    statistics.evictions = mEvictions;
+    statistics.entryCount = mEntries.size();
+    statistics.memoryUsage = mMemoryUsage;
+    statistics.memoryBudget = mMemoryBudget;
+    return statistics;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T>
+void LookupTableCache<T>::evict()
+{
+    while ((mMemoryUsage > mMemoryBudget) && !mEntries.empty())
+    {
+        const Entry& rEntry = mEntries.back();
+        mMemoryUsage -= rEntry.size;
+        mIndex.erase(rEntry.key);
+        mEntries.pop_back();
+        ++mEvictions;
+    }
+}
+
+} // namespace Emblem
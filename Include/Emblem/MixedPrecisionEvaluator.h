@@ -0,0 +1,384 @@
+/**
+* \file MixedPrecisionEvaluator.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "BatchEvaluator.h"
+#include "Expression.h"
+#include "Interval.h"
+#include "Internal\PrecisionAnalysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Emblem
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class MixedPrecisionEvaluator
+* \brief Evaluates batches with as much of the expression as possible in
+* float, keeping the error of the result within a requested bound.
+*
+* Given the range of every symbol, the subtrees that can be computed in
+* float without the first-order error bound of the result exceeding the
+* target are moved to float. Each runs as a BatchEvaluator<float> on float
+* copies of its inputs, and its results feed the rest of the expression,
+* evaluated in T. Float columns hold twice the rows per vector register and
+* per cache line, which is where the time is saved.
+*
+* The bound assumes every input stays within its range. predictedError()
+* reports it for the plan chosen, and measureError() checks the plan
+* against a plain evaluation in T on samples drawn from the ranges.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T = double, class Alloc = std::allocator<T>>
+class MixedPrecisionEvaluator
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::PrecisionAnalysis<T, Alloc> PrecisionAnalysis;
+    typedef typename PrecisionAnalysis::Low Low;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Low> LowAlloc;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef Emblem::BatchInput<T> BatchInput;
+    typedef std::unordered_map<std::string, Interval<T>> RangeMap;
+
+    /** \brief Rows converted and computed at a time. */
+    static const std::size_t ChunkRows = 4096;
+
+    /**
+    * \param rRanges Range of each symbol, a symbol without one may take any
+    * value and keeps its operations in T.
+    * \param targetRelativeError Bound on the error relative to the
+    * smallest magnitude of the result, or to its largest where its range
+    * holds zero.
+    */
+    MixedPrecisionEvaluator(const ExpressionType& rExpression, const RangeMap& rRanges,
+                            T targetRelativeError);
+
+    /**
+    * \brief Evaluates every row of the batch.
+    * \param pInputs One input per entry of symbols(), in that order.
+    */
+    void evaluate(const BatchInput* pInputs, std::size_t rowCount, T* pResults) const;
+
+    /** \brief Symbol names in positional order. */
+    const std::vector<std::string>& symbols() const
+    {
+        return mSymbols;
+    }
+
+    /** \brief Bound on the relative error of the plan chosen. */
+    T predictedError() const
+    {
+        return mPredictedError;
+    }
+
+    /** \brief Number of operations in the expression. */
+    std::size_t operationCount() const
+    {
+        return mOperationCount;
+    }
+
+    /** \brief Number of operations computed in float. */
+    std::size_t lowPrecisionOperationCount() const
+    {
+        return mLowOperationCount;
+    }
+
+    /**
+    * \brief Largest relative error against a plain evaluation in T, over
+    * sampleCount rows drawn uniformly from the symbol ranges.
+    *
+    * The error is relative to the same scale as predictedError(), or to
+    * the largest result sampled when the range of the result is unbounded.
+    * Unbounded symbol ranges are sampled within [-1, 1] of their finite
+    * bound, or of zero.
+    */
+    T measureError(std::size_t sampleCount) const;
+
+private:
+    /** \brief Subtree computed in float. */
+    struct LowPart
+    {
+        std::unique_ptr<BatchEvaluator<Low, LowAlloc>> pEvaluator;
+        // Position in mSymbols of each of the evaluator's symbols.
+        std::vector<std::size_t> inputs;
+    };
+
+    /** \brief Position of each entry of rNames in mSymbols, or past it for the float results. */
+    std::vector<std::size_t> findInputs(const std::vector<std::string>& rNames) const;
+
+    static std::string LowResultName(std::size_t part)
+    {
+        return "\x1f" + std::to_string(part);
+    }
+
+    ExpressionType mExpression;
+    RangeMap mRanges;
+    std::vector<std::string> mSymbols;
+    std::vector<LowPart> mLowParts;
+    std::unique_ptr<BatchEvaluator<T, Alloc>> mpHighEvaluator;
+    // Whether the whole expression is computed in float.
+    bool mIsLowHead;
+    std::vector<std::size_t> mHighInputs;
+    T mPredictedError;
+    T mScale;
+    std::size_t mOperationCount;
+    std::size_t mLowOperationCount;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::size_t MixedPrecisionEvaluator<T, Alloc>::ChunkRows;
+
+template <class T, class Alloc>
+MixedPrecisionEvaluator<T, Alloc>::MixedPrecisionEvaluator(
+    const ExpressionType& rExpression, const RangeMap& rRanges, T targetRelativeError)
+    : mExpression(rExpression), mRanges(rRanges), mIsLowHead(false),
+      mPredictedError(T(0)), mScale(T(0)),
+      mOperationCount(0), mLowOperationCount(0)
+{
+    const TermNode* pHead = rExpression.mExpressionTree.head();
+    if (pHead == nullptr)
+    {
+        assert(0);
+        return;
+    }
+    rExpression.canonicalHash(mSymbols);
+
+    const PrecisionAnalysis analysis(pHead, rRanges);
+    const std::vector<char> isLow = analysis.selectLowPrecision(targetRelativeError, mPredictedError);
+    for (std::size_t i = 0; i < analysis.nodeCount(); ++i)
+    {
+        mOperationCount += analysis.isOperation(i) ? 1 : 0;
+    }
+    const Interval<T>& rRange = analysis.range();
+    mScale = (rRange.mignitude() > 0) ? rRange.mignitude() : rRange.magnitude();
+
+    // Walking back from the head in post-order, the first float node met
+    // heads a float subtree, which is then skipped.
+    std::unordered_map<const TermNode*, std::size_t> lowHeads;
+    for (std::size_t i = analysis.nodeCount(); i-- > 0;)
+    {
+        if (!isLow[i])
+        {
+            continue;
+        }
+        lowHeads[analysis.node(i)] = mLowParts.size();
+        for (std::size_t j = analysis.subtreeBegin(i); j <= i; ++j)
+        {
+            mLowOperationCount += analysis.isOperation(j) ? 1 : 0;
+        }
+
+        LowPart part;
+        const Expression<Low, LowAlloc> low = ExpressionType::template Convert<Low, LowAlloc>(
+                analysis.node(i), [](const TermNode*, Expression<Low, LowAlloc>&) { return false; });
+        part.pEvaluator.reset(new BatchEvaluator<Low, LowAlloc>(low));
+        part.inputs = findInputs(part.pEvaluator->symbols());
+        mLowParts.push_back(std::move(part));
+        i = analysis.subtreeBegin(i);
+    }
+
+    mIsLowHead = isLow.back() != 0;
+    const ExpressionType high = ExpressionType::template Convert<T, Alloc>(
+                                    pHead, [&lowHeads](const TermNode* pNode, ExpressionType& rResult)
+    {
+        const auto found = lowHeads.find(pNode);
+        if (found == lowHeads.end())
+        {
+            return false;
+        }
+        rResult = ExpressionType(Symbol<T, Alloc>(LowResultName(found->second).c_str()));
+        return true;
+    });
+    mpHighEvaluator.reset(new BatchEvaluator<T, Alloc>(high));
+    mHighInputs = findInputs(mpHighEvaluator->symbols());
+}
+
+template <class T, class Alloc>
+std::vector<std::size_t> MixedPrecisionEvaluator<T, Alloc>::findInputs(
+    const std::vector<std::string>& rNames) const
+{
+    std::vector<std::size_t> inputs;
+    inputs.reserve(rNames.size());
+    for (const std::string& rName : rNames)
+    {
+        const auto found = std::find(mSymbols.begin(), mSymbols.end(), rName);
+        if (found != mSymbols.end())
+        {
+            inputs.push_back(static_cast<std::size_t>(found - mSymbols.begin()));
+            continue;
+        }
+        for (std::size_t part = 0; part < mLowParts.size(); ++part)
+        {
+            if (rName == LowResultName(part))
+            {
+                inputs.push_back(mSymbols.size() + part);
+                break;
+            }
+        }
+    }
+    assert(inputs.size() == rNames.size());
+    return inputs;
+}
+
+template <class T, class Alloc>
+void MixedPrecisionEvaluator<T, Alloc>::evaluate(
+    const BatchInput* pInputs, std::size_t rowCount, T* pResults) const
+{
+    if (!mpHighEvaluator)
+    {
+        return;
+    }
+
+    std::vector<std::vector<Low>> lowColumns(mSymbols.size());
+    std::vector<char> isConverted(mSymbols.size());
+    std::vector<std::vector<T>> partColumns(mLowParts.size());
+    std::vector<Low> partResults;
+    std::vector<BatchInput> highInputs(mHighInputs.size());
+    std::vector<Emblem::BatchInput<Low>> lowInputs;
+    for (std::size_t begin = 0; begin < rowCount; begin += ChunkRows)
+    {
+        const std::size_t rows = std::min(ChunkRows, rowCount - begin);
+        std::fill(isConverted.begin(), isConverted.end(), char(0));
+        for (std::size_t part = 0; part < mLowParts.size(); ++part)
+        {
+            const LowPart& rPart = mLowParts[part];
+            lowInputs.resize(rPart.inputs.size());
+            for (std::size_t i = 0; i < rPart.inputs.size(); ++i)
+            {
+                const std::size_t symbol = rPart.inputs[i];
+                const BatchInput& rInput = pInputs[symbol];
+                if (rInput.isUniform())
+                {
+                    lowInputs[i] = Emblem::BatchInput<Low>::Uniform(static_cast<Low>(rInput.value));
+                    continue;
+                }
+                std::vector<Low>& rColumn = lowColumns[symbol];
+                if (!isConverted[symbol])
+                {
+                    rColumn.resize(rows);
+                    const char* pRow = reinterpret_cast<const char*>(rInput.pData) + begin * rInput.stride;
+                    if (rInput.stride == static_cast<std::ptrdiff_t>(sizeof(T)))
+                    {
+                        const T* pColumn = reinterpret_cast<const T*>(pRow);
+                        std::transform(pColumn, pColumn + rows, rColumn.begin(),
+                                       [](const T& rValue) { return static_cast<Low>(rValue); });
+                    }
+                    else
+                    {
+                        for (std::size_t row = 0; row < rows; ++row, pRow += rInput.stride)
+                        {
+                            rColumn[row] = static_cast<Low>(*reinterpret_cast<const T*>(pRow));
+                        }
+                    }
+                    isConverted[symbol] = 1;
+                }
+                lowInputs[i] = Emblem::BatchInput<Low>::Varying(rColumn.data());
+            }
+
+            partResults.resize(rows);
+            rPart.pEvaluator->evaluate(lowInputs.data(), rows, partResults.data());
+            T* pPartColumn = pResults + begin;
+            if (!mIsLowHead)
+            {
+                partColumns[part].resize(rows);
+                pPartColumn = partColumns[part].data();
+            }
+            std::copy(partResults.begin(), partResults.end(), pPartColumn);
+        }
+        if (mIsLowHead)
+        {
+            continue;
+        }
+
+        for (std::size_t i = 0; i < mHighInputs.size(); ++i)
+        {
+            const std::size_t input = mHighInputs[i];
+            if (input >= mSymbols.size())
+            {
+                highInputs[i] = BatchInput::Varying(partColumns[input - mSymbols.size()].data());
+                continue;
+            }
+            highInputs[i] = pInputs[input];
+            if (!highInputs[i].isUniform())
+            {
+                highInputs[i].pData = reinterpret_cast<const T*>(
+                                          reinterpret_cast<const char*>(highInputs[i].pData)
+                                          + begin * highInputs[i].stride);
+            }
+        }
+        mpHighEvaluator->evaluate(highInputs.data(), rows, pResults + begin);
+    }
+}
+
+template <class T, class Alloc>
+T MixedPrecisionEvaluator<T, Alloc>::measureError(std::size_t sampleCount) const
+{
+    if (!mpHighEvaluator || (sampleCount == 0))
+    {
+        return T(0);
+    }
+
+    std::mt19937 generator(static_cast<std::uint32_t>(sampleCount));
+    std::vector<std::vector<T>> columns(mSymbols.size());
+    std::vector<BatchInput> inputs(mSymbols.size());
+    for (std::size_t i = 0; i < mSymbols.size(); ++i)
+    {
+        const auto found = mRanges.find(mSymbols[i]);
+        const Interval<T> range = (found != mRanges.end()) ? found->second : Interval<T>();
+        const T lower = std::isfinite(range.lower) ? range.lower
+                        : (std::isfinite(range.upper) ? range.upper - 1 : T(-1));
+        const T upper = std::isfinite(range.upper) ? range.upper : lower + ((lower < 0) ? 2 : 1);
+        std::uniform_real_distribution<T> distribution(lower, upper);
+        columns[i].resize(sampleCount);
+        for (T& rValue : columns[i])
+        {
+            rValue = distribution(generator);
+        }
+        inputs[i] = BatchInput::Varying(columns[i].data());
+    }
+
+    std::vector<T> mixed(sampleCount);
+    std::vector<T> reference(sampleCount);
+    evaluate(inputs.data(), sampleCount, mixed.data());
+    const BatchEvaluator<T, Alloc> plain(mExpression);
+    plain.evaluate(inputs.data(), sampleCount, reference.data());
+
+    T largestError = T(0);
+    T largestResult = T(0);
+    for (std::size_t row = 0; row < sampleCount; ++row)
+    {
+        largestError = std::max(largestError, std::abs(mixed[row] - reference[row]));
+        largestResult = std::max(largestResult, std::abs(reference[row]));
+    }
+    const T scale = (std::isfinite(mScale) && (mScale > 0)) ? mScale : largestResult;
+    return (scale > 0) ? largestError / scale : largestError;
+}
+
+} // namespace Emblem
@@ -0,0 +1,77 @@
+/**
+* \file OptimizationFlags.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <cmath>
+
+namespace Emblem
+{
+
+/**
+* \struct OptimizationFlags
+* \brief Selects the rewrites Expression::optimize() may apply.
+*
+* With the default flags only rewrites that keep results within rounding
+* of the original are made.
+*/
+struct OptimizationFlags
+{
+    OptimizationFlags()
+        : fastMath(false),
+          reassociate(false),
+#ifdef FP_FAST_FMA
+          fuseMultiplyAdd(true)
+#else
+          fuseMultiplyAdd(false)
+#endif
+    {
+    }
+
+    /**
+    * \brief Allows rewrites that may change results in special cases, such
+    * as overflow, signed zeros or NaNs, or by more than rounding.
+    *
+    * Division by a constant becomes multiplication by its reciprocal,
+    * divisions are merged, and pow with integer exponents above 3 or
+    * below -1 becomes multiplies, or a reciprocal of multiplies.
+    */
+    bool fastMath;
+
+    /**
+    * \brief Rebalances long chains of additions or multiplications into
+    * trees of logarithmic depth.
+    *
+    * Operands keep their order, only the grouping changes. Independent
+    * partial results can then be computed in parallel and traversals stay
+    * shallow, but floating point results may differ by rounding.
+    */
+    bool reassociate;
+
+    /**
+    * \brief Compiles a * b + c into a fused multiply-add, which rounds
+    * once instead of twice.
+    *
+    * On by default where the target has hardware FMA, as signalled by
+    * FP_FAST_FMA; elsewhere std::fma is emulated and slower than a
+    * separate multiply and add.
+    */
+    bool fuseMultiplyAdd;
+};
+
+} // namespace Emblem
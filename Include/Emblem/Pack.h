@@ -0,0 +1,233 @@
+/**
+* \file Pack.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+namespace Emblem
+{
+
+/**
+* \class Pack
+* \brief N values of T operated on lane by lane, so that one evaluation of
+* an expression computes N results.
+*
+* Scalars convert to packs by broadcasting to every lane, which is how the
+* constants of an expression enter a pack evaluation. The lane loops are
+* written for the compiler to vectorize: arithmetic maps to SIMD
+* instructions, and the math functions to vector library calls where the
+* compiler provides them.
+* \tparam T Type of each lane.
+* \tparam N Number of lanes.
+*/
+template <class T, std::size_t N>
+class Pack
+{
+public:
+    static const std::size_t Size = N;
+
+    Pack()
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            mLanes[i] = T();
+        }
+    }
+
+    /** \brief Broadcasts the value to every lane. */
+    Pack(const T& rValue)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            mLanes[i] = rValue;
+        }
+    }
+
+    /** \brief Loads N consecutive values. */
+    static Pack Load(const T* pValues)
+    {
+        Pack pack;
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            pack.mLanes[i] = pValues[i];
+        }
+        return pack;
+    }
+
+    /** \brief Stores the lanes to N consecutive values. */
+    void store(T* pValues) const
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            pValues[i] = mLanes[i];
+        }
+    }
+
+    T& operator[](std::size_t lane)
+    {
+        return mLanes[lane];
+    }
+
+    const T& operator[](std::size_t lane) const
+    {
+        return mLanes[lane];
+    }
+
+    /** \brief Applies the function to every lane. */
+    template <class Function>
+    Pack map(Function function) const
+    {
+        Pack result;
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            result.mLanes[i] = function(mLanes[i]);
+        }
+        return result;
+    }
+
+    /** \brief Applies the function to every pair of lanes. */
+    template <class Function>
+    Pack map(const Pack& rB, Function function) const
+    {
+        Pack result;
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            result.mLanes[i] = function(mLanes[i], rB.mLanes[i]);
+        }
+        return result;
+    }
+
+    Pack operator-() const
+    {
+        return map([](const T& rA) { return -rA; });
+    }
+
+    Pack& operator+=(const Pack& rB)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            mLanes[i] += rB.mLanes[i];
+        }
+        return *this;
+    }
+
+    Pack& operator-=(const Pack& rB)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            mLanes[i] -= rB.mLanes[i];
+        }
+        return *this;
+    }
+
+    Pack& operator*=(const Pack& rB)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            mLanes[i] *= rB.mLanes[i];
+        }
+        return *this;
+    }
+
+    Pack& operator/=(const Pack& rB)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            mLanes[i] /= rB.mLanes[i];
+        }
+        return *this;
+    }
+
+    friend Pack operator+(Pack a, const Pack& rB)
+    {
+        return a += rB;
+    }
+
+    friend Pack operator-(Pack a, const Pack& rB)
+    {
+        return a -= rB;
+    }
+
+    friend Pack operator*(Pack a, const Pack& rB)
+    {
+        return a *= rB;
+    }
+
+    friend Pack operator/(Pack a, const Pack& rB)
+    {
+        return a /= rB;
+    }
+
+    // Found by argument dependent lookup from the operator wrappers, as
+    // std::sin and the like are for scalars.
+    friend Pack sin(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::sin; return sin(rX); });
+    }
+
+    friend Pack cos(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::cos; return cos(rX); });
+    }
+
+    friend Pack tan(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::tan; return tan(rX); });
+    }
+
+    friend Pack abs(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::abs; return abs(rX); });
+    }
+
+    friend Pack exp(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::exp; return exp(rX); });
+    }
+
+    friend Pack log(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::log; return log(rX); });
+    }
+
+    friend Pack log10(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::log10; return log10(rX); });
+    }
+
+    friend Pack sqrt(const Pack& rA)
+    {
+        return rA.map([](const T& rX) { using std::sqrt; return sqrt(rX); });
+    }
+
+    friend Pack pow(const Pack& rA, const Pack& rB)
+    {
+        return rA.map(rB, [](const T& rX, const T& rY) { using std::pow; return pow(rX, rY); });
+    }
+
+private:
+    T mLanes[N];
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, std::size_t N>
+const std::size_t Pack<T, N>::Size;
+
+} // namespace Emblem
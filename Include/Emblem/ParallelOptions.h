@@ -0,0 +1,48 @@
+/**
+* \file ParallelOptions.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <cstddef>
+
+namespace Emblem
+{
+
+class ThreadPool;
+
+/**
+* \struct ParallelOptions
+* \brief Controls how Expression::evaluateParallel() splits the work.
+*/
+struct ParallelOptions
+{
+    ParallelOptions()
+        : taskThreshold(16384), pThreadPool(nullptr)
+    {
+    }
+
+    /**
+    * \brief Fewest nodes in a subtree split off into its own task.
+    * Expressions with less than twice as many are evaluated sequentially.
+    */
+    std::size_t taskThreshold;
+
+    /** \brief Pool the tasks run on, ThreadPool::Instance() if null. */
+    ThreadPool* pThreadPool;
+};
+
+} // namespace Emblem
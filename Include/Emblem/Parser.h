@@ -0,0 +1,482 @@
+/**
+* \file Parser.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Expression.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Emblem
+{
+
+/**
+* \class Parser
+* \brief Builds expressions from text in the syntax Output() writes.
+*
+* The grammar is that of Output(): + - * / and ^ between operands, all
+* left associative as Output() leaves them unbracketed only on the left,
+* with ^ binding tightest. A leading - negates what follows up to the
+* next + - * or /. Functions are sin(, cos(, tan(, ln(, log10(, e^(
+* and 1/(, |x| is the absolute value, and a bracketed group directly
+* followed by ^2, ^3 or ^(1/2) is its square, cube or square root. For
+* text written by hand, exp(, log(, sqrt( and abs( are accepted too.
+* Symbols are names of letters, digits and underscores.
+*
+* The text is read once, left to right, with operator precedence kept
+* on an explicit stack, so nesting depth is not limited by the call
+* stack. Nodes are linked straight into the tree of the result. A parser
+* keeps its stacks between calls, so reusing one for many formulas
+* allocates only the nodes.
+*
+* On failure parse() leaves the result untouched and error() gives the
+* offset in the text and the reason.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T = double, class Alloc = std::allocator<T>>
+class Parser
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::SymbolNode<T, Alloc> SymbolNode;
+    typedef Internal::ConstantNode<T, Alloc> ConstantNode;
+    typedef Internal::BinaryOperator<T> BinaryOperator;
+    typedef Internal::UnaryOperator<T> UnaryOperator;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef Emblem::Symbol<T, Alloc> Symbol;
+
+    struct Error
+    {
+        /** \brief Offset of the offending character in the text. */
+        std::size_t position;
+        const char* pMessage;
+    };
+
+    Parser()
+    {
+        mError.position = 0;
+        mError.pMessage = "";
+    }
+
+    ~Parser()
+    {
+        clearOperands();
+    }
+
+    bool parse(const char* pText, std::size_t length, ExpressionType& rResult);
+
+    bool parse(const std::string& rText, ExpressionType& rResult)
+    {
+        return parse(rText.data(), rText.size(), rResult);
+    }
+
+    /** \brief Where and why the last parse() failed. */
+    const Error& error() const
+    {
+        return mError;
+    }
+
+private:
+    Parser(const Parser&);
+    Parser& operator=(const Parser&);
+
+    enum class Entry
+    {
+        Binary,
+        Negate,
+        Group,
+        Function,
+        Abs
+    };
+
+    /**
+    * \brief Pending operator or opening bracket, and where it was read.
+    * pUnary is the function applied when a Function closes.
+    */
+    struct Pending
+    {
+        Entry entry;
+        const BinaryOperator* pBinary;
+        const UnaryOperator* pUnary;
+        std::size_t position;
+    };
+
+    static int Precedence(const Pending& rPending)
+    {
+        if (rPending.entry == Entry::Negate)
+        {
+            return 3;
+        }
+        if (rPending.pBinary == &BinaryOperator::Pow)
+        {
+            return 4;
+        }
+        return ((rPending.pBinary == &BinaryOperator::Multiplication) ||
+                (rPending.pBinary == &BinaryOperator::Division)) ? 2 : 1;
+    }
+
+    static bool IsNameCharacter(char c)
+    {
+        return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+               ((c >= '0') && (c <= '9')) || (c == '_');
+    }
+
+    static bool IsDigit(char c)
+    {
+        return (c >= '0') && (c <= '9');
+    }
+
+    static const UnaryOperator* FunctionNamed(const char* pName, std::size_t length);
+
+    bool fail(std::size_t position, const char* pMessage)
+    {
+        mError.position = position;
+        mError.pMessage = pMessage;
+        clearOperands();
+        mPending.clear();
+        return false;
+    }
+
+    void clearOperands()
+    {
+        for (TermNode* pOperand : mOperands)
+        {
+            Internal::BinaryTree<TermNode> tree;
+            tree.insertToHead(pOperand);
+        }
+        mOperands.clear();
+    }
+
+    /** \brief Applies the operator on top of the pending stack. */
+    void reduce()
+    {
+        const Pending& rTop = mPending.back();
+        if (rTop.entry == Entry::Negate)
+        {
+            applyUnary(UnaryOperator::Negate);
+        }
+        else
+        {
+            TermNode* pRight = mOperands.back();
+            mOperands.pop_back();
+            TermNode* pNode = new BinaryOperatorNode(*rTop.pBinary);
+            pNode->setLeft(mOperands.back());
+            pNode->setRight(pRight);
+            mOperands.back() = pNode;
+        }
+        mPending.pop_back();
+    }
+
+    void applyUnary(const UnaryOperator& rOperator)
+    {
+        TermNode* pNode = new UnaryOperatorNode(rOperator);
+        pNode->setLeft(mOperands.back());
+        mOperands.back() = pNode;
+    }
+
+    /** \brief Reduces down to the innermost open bracket, false if none. */
+    bool reduceToBracket()
+    {
+        while (!mPending.empty() &&
+                ((mPending.back().entry == Entry::Binary) || (mPending.back().entry == Entry::Negate)))
+        {
+            reduce();
+        }
+        return !mPending.empty();
+    }
+
+    std::size_t readNumber(const char* pText, std::size_t position, std::size_t length);
+
+    std::vector<TermNode*> mOperands;
+    std::vector<Pending> mPending;
+    std::string mBuffer;
+    Error mError;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const Internal::UnaryOperator<T>* Parser<T, Alloc>::FunctionNamed(
+    const char* pName, std::size_t length)
+{
+    struct Function
+    {
+        const char* pName;
+        const UnaryOperator* pOperator;
+    };
+    static const Function functions[] =
+    {
+        { "sin", &UnaryOperator::Sin },
+        { "cos", &UnaryOperator::Cos },
+        { "tan", &UnaryOperator::Tan },
+        { "ln", &UnaryOperator::Ln },
+        { "log", &UnaryOperator::Ln },
+        { "log10", &UnaryOperator::Log10 },
+        { "exp", &UnaryOperator::Exp },
+        { "sqrt", &UnaryOperator::Sqrt },
+        { "abs", &UnaryOperator::Abs }
+    };
+    for (const Function& rFunction : functions)
+    {
+        if ((std::strlen(rFunction.pName) == length) && (std::memcmp(rFunction.pName, pName, length) == 0))
+        {
+            return rFunction.pOperator;
+        }
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t Parser<T, Alloc>::readNumber(const char* pText, std::size_t position, std::size_t length)
+{
+    // Finds the end of the literal, then converts a terminated copy.
+    std::size_t end = position;
+    while ((end < length) && IsDigit(pText[end]))
+    {
+        ++end;
+    }
+    if ((end < length) && (pText[end] == '.'))
+    {
+        ++end;
+        while ((end < length) && IsDigit(pText[end]))
+        {
+            ++end;
+        }
+    }
+    if ((end < length) && ((pText[end] == 'e') || (pText[end] == 'E')))
+    {
+        std::size_t exponent = end + 1;
+        if ((exponent < length) && ((pText[exponent] == '+') || (pText[exponent] == '-')))
+        {
+            ++exponent;
+        }
+        if ((exponent < length) && IsDigit(pText[exponent]))
+        {
+            end = exponent;
+            while ((end < length) && IsDigit(pText[end]))
+            {
+                ++end;
+            }
+        }
+    }
+    if ((end == position + 1) && (pText[position] == '.'))
+    {
+        return position;
+    }
+
+    mBuffer.assign(pText + position, end - position);
+    mOperands.push_back(new ConstantNode(static_cast<T>(std::strtod(mBuffer.c_str(), nullptr))));
+    return end;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool Parser<T, Alloc>::parse(const char* pText, std::size_t length, ExpressionType& rResult)
+{
+    clearOperands();
+    mPending.clear();
+
+    bool isOperandNext = true;
+    std::size_t position = 0;
+    while (true)
+    {
+        while ((position < length) &&
+                ((pText[position] == ' ') || (pText[position] == '\t') ||
+                 (pText[position] == '\r') || (pText[position] == '\n')))
+        {
+            ++position;
+        }
+        if (position == length)
+        {
+            break;
+        }
+
+        const char c = pText[position];
+        const char* pRest = pText + position;
+        const std::size_t restLength = length - position;
+        if (isOperandNext)
+        {
+            const Pending opening = { Entry::Function, nullptr, nullptr, position };
+            if (c == '-')
+            {
+                Pending negate = opening;
+                negate.entry = Entry::Negate;
+                mPending.push_back(negate);
+                ++position;
+            }
+            else if (c == '(')
+            {
+                Pending group = opening;
+                group.entry = Entry::Group;
+                mPending.push_back(group);
+                ++position;
+            }
+            else if (c == '|')
+            {
+                Pending abs = opening;
+                abs.entry = Entry::Abs;
+                mPending.push_back(abs);
+                ++position;
+            }
+            else if ((restLength >= 3) && (std::memcmp(pRest, "1/(", 3) == 0))
+            {
+                Pending reciprocal = opening;
+                reciprocal.pUnary = &UnaryOperator::Reciprocal;
+                mPending.push_back(reciprocal);
+                position += 3;
+            }
+            else if ((restLength >= 3) && (std::memcmp(pRest, "e^(", 3) == 0))
+            {
+                Pending exp = opening;
+                exp.pUnary = &UnaryOperator::Exp;
+                mPending.push_back(exp);
+                position += 3;
+            }
+            else if (IsDigit(c) || (c == '.'))
+            {
+                const std::size_t end = readNumber(pText, position, length);
+                if (end == position)
+                {
+                    return fail(position, "malformed number");
+                }
+                position = end;
+                isOperandNext = false;
+            }
+            else if (IsNameCharacter(c))
+            {
+                std::size_t end = position;
+                while ((end < length) && IsNameCharacter(pText[end]))
+                {
+                    ++end;
+                }
+                const UnaryOperator* pFunction = ((end < length) && (pText[end] == '('))
+                                                 ? FunctionNamed(pRest, end - position) : nullptr;
+                if (pFunction != nullptr)
+                {
+                    Pending function = opening;
+                    function.pUnary = pFunction;
+                    mPending.push_back(function);
+                    position = end + 1;
+                }
+                else
+                {
+                    mBuffer.assign(pRest, end - position);
+                    mOperands.push_back(new SymbolNode(Symbol(mBuffer.c_str())));
+                    position = end;
+                    isOperandNext = false;
+                }
+            }
+            else
+            {
+                return fail(position, "expected an operand");
+            }
+            continue;
+        }
+
+        const BinaryOperator* pBinary =
+            (c == '+') ? &BinaryOperator::Addition :
+            (c == '-') ? &BinaryOperator::Subtraction :
+            (c == '*') ? &BinaryOperator::Multiplication :
+            (c == '/') ? &BinaryOperator::Division :
+            (c == '^') ? &BinaryOperator::Pow : nullptr;
+        if (pBinary != nullptr)
+        {
+            const Pending binary = { Entry::Binary, pBinary, nullptr, position };
+            while (!mPending.empty() &&
+                    ((mPending.back().entry == Entry::Binary) || (mPending.back().entry == Entry::Negate)) &&
+                    (Precedence(mPending.back()) >= Precedence(binary)))
+            {
+                reduce();
+            }
+            mPending.push_back(binary);
+            ++position;
+            isOperandNext = true;
+            continue;
+        }
+
+        if ((c != ')') && (c != '|'))
+        {
+            return fail(position, "expected an operator");
+        }
+        if (!reduceToBracket() || ((mPending.back().entry == Entry::Abs) != (c == '|')))
+        {
+            return fail(position, (c == ')') ? "unmatched ')'" : "unmatched '|'");
+        }
+
+        const Pending opening = mPending.back();
+        mPending.pop_back();
+        ++position;
+        if (opening.entry == Entry::Abs)
+        {
+            applyUnary(UnaryOperator::Abs);
+        }
+        else if (opening.entry == Entry::Function)
+        {
+            applyUnary(*opening.pUnary);
+        }
+        else if ((position < length) && (pText[position] == '^'))
+        {
+            // Square, cube and square root are written as a group with a
+            // suffix, which must not run on into a longer literal.
+            pRest = pText + position;
+            const std::size_t suffixLength = length - position;
+            const bool isEnd = (suffixLength == 2) || ((suffixLength > 2) && !IsNameCharacter(pRest[2]) &&
+                                                       (pRest[2] != '.'));
+            if ((suffixLength >= 6) && (std::memcmp(pRest, "^(1/2)", 6) == 0))
+            {
+                applyUnary(UnaryOperator::Sqrt);
+                position += 6;
+            }
+            else if (isEnd && (pRest[1] == '2'))
+            {
+                applyUnary(UnaryOperator::Square);
+                position += 2;
+            }
+            else if (isEnd && (pRest[1] == '3'))
+            {
+                applyUnary(UnaryOperator::Cube);
+                position += 2;
+            }
+        }
+    }
+
+    if (isOperandNext)
+    {
+        return fail(length, "unexpected end of text");
+    }
+    if (reduceToBracket())
+    {
+        const Pending& rOpening = mPending.back();
+        return fail(rOpening.position, (rOpening.entry == Entry::Abs) ? "unclosed '|'" : "unclosed '('");
+    }
+
+    rResult.mExpressionTree.insertToHead(mOperands.back());
+    mOperands.clear();
+    return true;
+}
+
+} // namespace Emblem
@@ -0,0 +1,847 @@
+/**
+* \file Polynomial.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "Expression.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <stack>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief x^n for n >= 1 by repeated squaring, using only multiplies. */
+template <class T>
+T IntegerPower(T x, std::uint32_t n)
+{
+    assert(n >= 1);
+    T result = x;
+    std::uint32_t bit = 1u << 31;
+    while ((bit & n) == 0)
+    {
+        bit >>= 1;
+    }
+    for (bit >>= 1; bit != 0; bit >>= 1)
+    {
+        result = result * result;
+        if ((n & bit) != 0)
+        {
+            result = result * x;
+        }
+    }
+    return result;
+}
+
+/** \brief Number of multiplies IntegerPower() performs. */
+inline std::size_t IntegerPowerCost(std::uint32_t n)
+{
+    assert(n >= 1);
+    // One square per bit below the leading one, one multiply per other set bit.
+    std::size_t cost = 0;
+    for (; n > 1; n >>= 1)
+    {
+        cost += 1 + (n & 1);
+    }
+    return cost;
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class Polynomial
+* \brief Sparse multivariate polynomial.
+*
+* Stored as a list of monomials, each an exponent per symbol and a
+* coefficient, kept sorted in descending lexicographic order of the
+* exponents with like terms merged and zero terms removed. Symbols are
+* kept sorted by name.
+*
+* Evaluation uses a recursive Horner scheme: the terms are grouped by
+* the exponent of the first symbol, each group is evaluated on the
+* remaining symbols, and the groups are combined by multiplying through
+* by powers of the first symbol. Powers are formed by repeated squaring,
+* so no pow calls are made.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class Polynomial
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::SymbolNode<T, Alloc> SymbolNode;
+    typedef Internal::ConstantNode<T, Alloc> ConstantNode;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef typename ExpressionType::ValueMap ValueMap;
+    typedef std::uint32_t Exponent;
+
+    /** \brief Layout of the expression built by toExpression(). */
+    enum class Form
+    {
+        /** \brief Sum of monomials. */
+        Expanded,
+        /** \brief Nested Horner scheme, matching evaluate(). */
+        Horner
+    };
+
+    /** \brief Largest constant exponent accepted by FromExpression(). */
+    static const Exponent MaxExponent = 64;
+
+    /** \brief The zero polynomial. */
+    Polynomial() {}
+
+    Polynomial(const T& rConstant)
+    {
+        if (rConstant != T(0))
+        {
+            mCoefficients.push_back(rConstant);
+        }
+    }
+
+    /** \brief The polynomial consisting of the single symbol. */
+    static Polynomial Variable(const std::string& rSymbol)
+    {
+        Polynomial polynomial;
+        polynomial.mSymbols.push_back(rSymbol);
+        polynomial.mExponents.push_back(1);
+        polynomial.mCoefficients.push_back(T(1));
+        return polynomial;
+    }
+
+    /**
+    * \brief Converts the expression into a polynomial.
+    *
+    * Accepts sums, differences, products, negation, division by a
+    * constant and Pow with a constant non-negative integer exponent of at
+    * most MaxExponent. Anything else is rejected.
+    * \return False, leaving rPolynomial untouched, if the expression is
+    * empty or not a polynomial.
+    */
+    static bool FromExpression(const ExpressionType& rExpression, Polynomial& rPolynomial);
+
+    /** \brief Builds an expression computing the polynomial. */
+    ExpressionType toExpression(Form form = Form::Horner) const;
+
+    /**
+    * \brief Evaluates the polynomial with the Horner scheme.
+    * \param pSymbolValues One value per entry of symbols(), in that order.
+    */
+    T evaluate(const T* pSymbolValues) const;
+
+    T evaluate(const ValueMap& rValues) const
+    {
+        std::vector<T> symbolValues;
+        symbolValues.reserve(mSymbols.size());
+        for (const std::string& rSymbol : mSymbols)
+        {
+            symbolValues.push_back(rValues.at(rSymbol));
+        }
+        return evaluate(symbolValues.data());
+    }
+
+    Polynomial operator+(const Polynomial& rB) const
+    {
+        return Combine(*this, rB, T(1));
+    }
+
+    Polynomial operator-(const Polynomial& rB) const
+    {
+        return Combine(*this, rB, T(-1));
+    }
+
+    Polynomial operator-() const
+    {
+        Polynomial result(*this);
+        for (T& rCoefficient : result.mCoefficients)
+        {
+            rCoefficient = -rCoefficient;
+        }
+        return result;
+    }
+
+    Polynomial operator*(const Polynomial& rB) const;
+
+    /** \brief Divides every coefficient by the constant. */
+    Polynomial operator/(const T& rDivisor) const
+    {
+        Polynomial result(*this);
+        for (T& rCoefficient : result.mCoefficients)
+        {
+            rCoefficient = rCoefficient / rDivisor;
+        }
+        result.normalize();
+        return result;
+    }
+
+    /** \brief Raises the polynomial to the power by repeated squaring. */
+    Polynomial pow(Exponent exponent) const;
+
+    /** \brief Symbol names, sorted. */
+    const std::vector<std::string>& symbols() const
+    {
+        return mSymbols;
+    }
+
+    std::size_t termCount() const
+    {
+        return mCoefficients.size();
+    }
+
+    /** \brief Exponents of the term, one per entry of symbols(). */
+    const Exponent* exponents(std::size_t term) const
+    {
+        return mExponents.data() + term * mSymbols.size();
+    }
+
+    const T& coefficient(std::size_t term) const
+    {
+        return mCoefficients[term];
+    }
+
+    /** \brief Coefficient of the monomial with the exponents, zero if absent. */
+    T coefficient(const std::vector<Exponent>& rExponents) const;
+
+    /** \brief Highest total degree of any term, zero for constants. */
+    Exponent degree() const;
+
+    bool isZero() const
+    {
+        return mCoefficients.empty();
+    }
+
+    bool isConstant() const
+    {
+        return (mCoefficients.size() == 1) &&
+               std::all_of(mExponents.begin(), mExponents.end(),
+                           [](Exponent exponent) { return exponent == 0; });
+    }
+
+    /** \brief Multiplies evaluate() performs. */
+    std::size_t multiplyCount() const
+    {
+        return mCoefficients.empty() ? 0 : countMultiplies(0, mCoefficients.size(), 0);
+    }
+
+private:
+    static Polynomial Combine(const Polynomial& rA, const Polynomial& rB, const T& rSign);
+
+    /** \brief Rewrites the exponents for a superset of the symbols. */
+    std::vector<Exponent> remap(const std::vector<std::string>& rSymbols) const;
+
+    /** \brief Sorts the terms, merges like terms and drops zero terms. */
+    void normalize();
+
+    /**
+    * \brief Terms in [begin, end) share their first `symbol` exponents;
+    * each visitor works on the remaining ones.
+    */
+    T evaluateRange(std::size_t begin, std::size_t end, std::size_t symbol,
+                    const T* pSymbolValues) const;
+    ExpressionType buildRange(std::size_t begin, std::size_t end, std::size_t symbol) const;
+    std::size_t countMultiplies(std::size_t begin, std::size_t end, std::size_t symbol) const;
+
+    /** \brief End of the run of terms starting at begin with the same exponent. */
+    std::size_t groupEnd(std::size_t begin, std::size_t end, std::size_t symbol) const
+    {
+        const Exponent exponent = exponents(begin)[symbol];
+        std::size_t groupEnd = begin + 1;
+        while ((groupEnd < end) && (exponents(groupEnd)[symbol] == exponent))
+        {
+            ++groupEnd;
+        }
+        return groupEnd;
+    }
+
+    ExpressionType symbolPower(std::size_t symbol, Exponent exponent) const;
+
+    std::vector<std::string> mSymbols;
+    std::vector<Exponent> mExponents;
+    std::vector<T> mCoefficients;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const typename Polynomial<T, Alloc>::Exponent Polynomial<T, Alloc>::MaxExponent;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool Polynomial<T, Alloc>::FromExpression(
+    const ExpressionType& rExpression, Polynomial& rPolynomial)
+{
+    typedef Internal::BinaryOperator<T> BinaryOperator;
+    typedef Internal::UnaryOperator<T> UnaryOperator;
+
+    const TermNode* pHead = rExpression.mExpressionTree.head();
+    if (pHead == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<Polynomial> operands;
+    std::stack<std::pair<const TermNode*, bool>> nodeStack;
+    nodeStack.push(std::make_pair(pHead, false));
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNode = nodeStack.top().first;
+        const bool isExpanded = nodeStack.top().second;
+        nodeStack.pop();
+
+        if (pNode->isSymbol())
+        {
+            operands.push_back(Variable(
+                                   static_cast<const SymbolNode*>(pNode)->GetSymbol().toString()));
+            continue;
+        }
+        if (!pNode->isOperator())
+        {
+            operands.push_back(Polynomial(static_cast<const ConstantNode*>(pNode)->GetValue()));
+            continue;
+        }
+
+        if (!isExpanded)
+        {
+            nodeStack.push(std::make_pair(pNode, true));
+            for (std::size_t i = pNode->operandCount(); i-- > 0;)
+            {
+                nodeStack.push(std::make_pair((const TermNode*)pNode->operand(i), false));
+            }
+            continue;
+        }
+
+        const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode);
+        if (pNaryOp != nullptr)
+        {
+            const std::size_t first = operands.size() - pNaryOp->operandCount();
+            const bool isSum = (pNaryOp->GetOperator() == BinaryOperator::Addition);
+            for (std::size_t i = first + 1; i < operands.size(); ++i)
+            {
+                operands[first] = isSum ? (operands[first] + operands[i])
+                                  : (operands[first] * operands[i]);
+            }
+            operands.erase(operands.begin() + first + 1, operands.end());
+            continue;
+        }
+
+        const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode);
+        if (pBinaryOp == nullptr)
+        {
+            const UnaryOperator& rOperator =
+                static_cast<const UnaryOperatorNode*>(pNode)->GetOperator();
+            if (rOperator == UnaryOperator::Negate)
+            {
+                operands.back() = -operands.back();
+            }
+            else if (rOperator == UnaryOperator::Square)
+            {
+                operands.back() = operands.back().pow(2);
+            }
+            else if (rOperator == UnaryOperator::Cube)
+            {
+                operands.back() = operands.back().pow(3);
+            }
+            else if (!(rOperator == UnaryOperator::Identity))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        const Polynomial right = std::move(operands.back());
+        operands.pop_back();
+        Polynomial& rLeft = operands.back();
+
+        const BinaryOperator& rOperator = pBinaryOp->GetOperator();
+        if (rOperator == BinaryOperator::Addition)
+        {
+            rLeft = rLeft + right;
+        }
+        else if (rOperator == BinaryOperator::Subtraction)
+        {
+            rLeft = rLeft - right;
+        }
+        else if (rOperator == BinaryOperator::Multiplication)
+        {
+            rLeft = rLeft * right;
+        }
+        else
+        {
+            // Division and Pow need a constant right hand side.
+            if (!right.isZero() && !right.isConstant())
+            {
+                return false;
+            }
+            const T value = right.isZero() ? T(0) : right.mCoefficients.front();
+
+            if (rOperator == BinaryOperator::Division)
+            {
+                if (right.isZero())
+                {
+                    return false;
+                }
+                rLeft = rLeft / value;
+            }
+            else
+            {
+                assert(rOperator == BinaryOperator::Pow);
+                const Exponent exponent = static_cast<Exponent>(value);
+                if ((value < T(0)) || (value > T(MaxExponent)) || (T(exponent) != value))
+                {
+                    return false;
+                }
+                rLeft = rLeft.pow(exponent);
+            }
+        }
+    }
+
+    assert(operands.size() == 1);
+    rPolynomial = std::move(operands.back());
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename Polynomial<T, Alloc>::ExpressionType
+Polynomial<T, Alloc>::toExpression(Form form) const
+{
+    if (mCoefficients.empty())
+    {
+        return ExpressionType(T(0));
+    }
+
+    if (form == Form::Horner)
+    {
+        return buildRange(0, mCoefficients.size(), 0);
+    }
+
+    ExpressionType sum;
+    for (std::size_t term = 0; term < mCoefficients.size(); ++term)
+    {
+        ExpressionType monomial(mCoefficients[term]);
+        bool isUnit = (mCoefficients[term] == T(1));
+        for (std::size_t symbol = 0; symbol < mSymbols.size(); ++symbol)
+        {
+            const Exponent exponent = exponents(term)[symbol];
+            if (exponent == 0)
+            {
+                continue;
+            }
+
+            // Drop a unit coefficient instead of multiplying by it.
+            monomial = isUnit ? symbolPower(symbol, exponent) :
+                       std::move(monomial) * symbolPower(symbol, exponent);
+            isUnit = false;
+        }
+
+        sum = (term == 0) ? std::move(monomial) : std::move(sum) + std::move(monomial);
+    }
+    return sum;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Polynomial<T, Alloc>::evaluate(const T* pSymbolValues) const
+{
+    if (mCoefficients.empty())
+    {
+        return T(0);
+    }
+    return evaluateRange(0, mCoefficients.size(), 0, pSymbolValues);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Polynomial<T, Alloc> Polynomial<T, Alloc>::operator*(const Polynomial& rB) const
+{
+    if (isZero() || rB.isZero())
+    {
+        return Polynomial();
+    }
+
+    Polynomial result;
+    std::set_union(mSymbols.begin(), mSymbols.end(),
+                   rB.mSymbols.begin(), rB.mSymbols.end(),
+                   std::back_inserter(result.mSymbols));
+    const std::size_t symbolCount = result.mSymbols.size();
+    const std::vector<Exponent> exponentsA = remap(result.mSymbols);
+    const std::vector<Exponent> exponentsB = rB.remap(result.mSymbols);
+
+    const std::size_t termCountA = mCoefficients.size();
+    const std::size_t termCountB = rB.mCoefficients.size();
+    result.mExponents.resize(termCountA * termCountB * symbolCount);
+    result.mCoefficients.resize(termCountA * termCountB);
+
+    Exponent* pOut = result.mExponents.data();
+    for (std::size_t a = 0; a < termCountA; ++a)
+    {
+        const Exponent* pA = exponentsA.data() + a * symbolCount;
+        for (std::size_t b = 0; b < termCountB; ++b)
+        {
+            const Exponent* pB = exponentsB.data() + b * symbolCount;
+            for (std::size_t symbol = 0; symbol < symbolCount; ++symbol)
+            {
+                *pOut++ = pA[symbol] + pB[symbol];
+            }
+            result.mCoefficients[a * termCountB + b] = mCoefficients[a] * rB.mCoefficients[b];
+        }
+    }
+
+    result.normalize();
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Polynomial<T, Alloc> Polynomial<T, Alloc>::pow(Exponent exponent) const
+{
+    Polynomial result(T(1));
+    Polynomial square(*this);
+    while (exponent != 0)
+    {
+        if ((exponent & 1) != 0)
+        {
+            result = result * square;
+        }
+        exponent >>= 1;
+        if (exponent != 0)
+        {
+            square = square * square;
+        }
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Polynomial<T, Alloc>::coefficient(const std::vector<Exponent>& rExponents) const
+{
+    assert(rExponents.size() == mSymbols.size());
+    for (std::size_t term = 0; term < mCoefficients.size(); ++term)
+    {
+        if (std::equal(rExponents.begin(), rExponents.end(), exponents(term)))
+        {
+            return mCoefficients[term];
+        }
+    }
+    return T(0);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename Polynomial<T, Alloc>::Exponent Polynomial<T, Alloc>::degree() const
+{
+    Exponent maxDegree = 0;
+    for (std::size_t term = 0; term < mCoefficients.size(); ++term)
+    {
+        const Exponent* pExponents = exponents(term);
+        const Exponent termDegree =
+            std::accumulate(pExponents, pExponents + mSymbols.size(), Exponent(0));
+        maxDegree = std::max(maxDegree, termDegree);
+    }
+    return maxDegree;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Polynomial<T, Alloc> Polynomial<T, Alloc>::Combine(
+    const Polynomial& rA, const Polynomial& rB, const T& rSign)
+{
+    Polynomial result;
+    std::set_union(rA.mSymbols.begin(), rA.mSymbols.end(),
+                   rB.mSymbols.begin(), rB.mSymbols.end(),
+                   std::back_inserter(result.mSymbols));
+
+    result.mExponents = rA.remap(result.mSymbols);
+    const std::vector<Exponent> exponentsB = rB.remap(result.mSymbols);
+    result.mExponents.insert(result.mExponents.end(), exponentsB.begin(), exponentsB.end());
+
+    result.mCoefficients = rA.mCoefficients;
+    for (const T& rCoefficient : rB.mCoefficients)
+    {
+        result.mCoefficients.push_back(rSign * rCoefficient);
+    }
+
+    result.normalize();
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::vector<typename Polynomial<T, Alloc>::Exponent>
+Polynomial<T, Alloc>::remap(const std::vector<std::string>& rSymbols) const
+{
+    if (rSymbols == mSymbols)
+    {
+        return mExponents;
+    }
+
+    // Both symbol lists are sorted, so positions can be matched in one pass.
+    std::vector<std::size_t> positions(mSymbols.size());
+    std::size_t position = 0;
+    for (std::size_t symbol = 0; symbol < mSymbols.size(); ++symbol)
+    {
+        while (rSymbols[position] != mSymbols[symbol])
+        {
+            ++position;
+        }
+        positions[symbol] = position;
+    }
+
+    std::vector<Exponent> remapped(mCoefficients.size() * rSymbols.size(), 0);
+    for (std::size_t term = 0; term < mCoefficients.size(); ++term)
+    {
+        for (std::size_t symbol = 0; symbol < mSymbols.size(); ++symbol)
+        {
+            remapped[term * rSymbols.size() + positions[symbol]] = exponents(term)[symbol];
+        }
+    }
+    return remapped;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Polynomial<T, Alloc>::normalize()
+{
+    const std::size_t symbolCount = mSymbols.size();
+    std::vector<std::size_t> order(mCoefficients.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+    {
+        return std::lexicographical_compare(
+                   exponents(b), exponents(b) + symbolCount,
+                   exponents(a), exponents(a) + symbolCount);
+    });
+
+    std::vector<Exponent> sortedExponents;
+    std::vector<T> sortedCoefficients;
+    sortedExponents.reserve(mExponents.size());
+    sortedCoefficients.reserve(mCoefficients.size());
+    for (std::size_t i = 0; i < order.size();)
+    {
+        const Exponent* pExponents = exponents(order[i]);
+        T coefficient = mCoefficients[order[i]];
+        for (++i; (i < order.size()) &&
+                std::equal(pExponents, pExponents + symbolCount, exponents(order[i])); ++i)
+        {
+            coefficient = coefficient + mCoefficients[order[i]];
+        }
+
+        if (coefficient != T(0))
+        {
+            sortedExponents.insert(sortedExponents.end(), pExponents, pExponents + symbolCount);
+            sortedCoefficients.push_back(coefficient);
+        }
+    }
+
+    mExponents.swap(sortedExponents);
+    mCoefficients.swap(sortedCoefficients);
+
+    // Symbols can cancel out entirely, as in x - x.
+    std::vector<bool> isUsed(symbolCount, false);
+    for (std::size_t i = 0; i < mExponents.size(); ++i)
+    {
+        isUsed[i % symbolCount] = isUsed[i % symbolCount] || (mExponents[i] != 0);
+    }
+    if (std::find(isUsed.begin(), isUsed.end(), false) == isUsed.end())
+    {
+        return;
+    }
+
+    std::vector<std::string> usedSymbols;
+    std::vector<Exponent> usedExponents;
+    for (std::size_t symbol = 0; symbol < symbolCount; ++symbol)
+    {
+        if (isUsed[symbol])
+        {
+            usedSymbols.push_back(mSymbols[symbol]);
+        }
+    }
+    for (std::size_t i = 0; i < mExponents.size(); ++i)
+    {
+        if (isUsed[i % symbolCount])
+        {
+            usedExponents.push_back(mExponents[i]);
+        }
+    }
+    mSymbols.swap(usedSymbols);
+    mExponents.swap(usedExponents);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Polynomial<T, Alloc>::evaluateRange(
+    std::size_t begin, std::size_t end, std::size_t symbol, const T* pSymbolValues) const
+{
+    if (symbol == mSymbols.size())
+    {
+        assert(end == begin + 1);
+        return mCoefficients[begin];
+    }
+
+    // Groups come in descending exponent order; p = ((g0 x^d0 + g1) x^d1 + ...) x^dn.
+    std::size_t group = groupEnd(begin, end, symbol);
+    Exponent exponent = exponents(begin)[symbol];
+    T result = evaluateRange(begin, group, symbol + 1, pSymbolValues);
+    while (group != end)
+    {
+        const std::size_t next = groupEnd(group, end, symbol);
+        const Exponent nextExponent = exponents(group)[symbol];
+        result = result * Internal::IntegerPower(pSymbolValues[symbol], exponent - nextExponent) +
+                 evaluateRange(group, next, symbol + 1, pSymbolValues);
+        exponent = nextExponent;
+        group = next;
+    }
+
+    if (exponent != 0)
+    {
+        result = result * Internal::IntegerPower(pSymbolValues[symbol], exponent);
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename Polynomial<T, Alloc>::ExpressionType
+Polynomial<T, Alloc>::buildRange(std::size_t begin, std::size_t end, std::size_t symbol) const
+{
+    if (symbol == mSymbols.size())
+    {
+        assert(end == begin + 1);
+        return ExpressionType(mCoefficients[begin]);
+    }
+
+    std::size_t group = groupEnd(begin, end, symbol);
+    Exponent exponent = exponents(begin)[symbol];
+    ExpressionType result = buildRange(begin, group, symbol + 1);
+    while (group != end)
+    {
+        const std::size_t next = groupEnd(group, end, symbol);
+        const Exponent nextExponent = exponents(group)[symbol];
+        result = std::move(result) * symbolPower(symbol, exponent - nextExponent) +
+                 buildRange(group, next, symbol + 1);
+        exponent = nextExponent;
+        group = next;
+    }
+
+    if (exponent != 0)
+    {
+        result = std::move(result) * symbolPower(symbol, exponent);
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t Polynomial<T, Alloc>::countMultiplies(
+    std::size_t begin, std::size_t end, std::size_t symbol) const
+{
+    if (symbol == mSymbols.size())
+    {
+        return 0;
+    }
+
+    std::size_t group = groupEnd(begin, end, symbol);
+    Exponent exponent = exponents(begin)[symbol];
+    std::size_t count = countMultiplies(begin, group, symbol + 1);
+    while (group != end)
+    {
+        const std::size_t next = groupEnd(group, end, symbol);
+        const Exponent nextExponent = exponents(group)[symbol];
+        count += 1 + Internal::IntegerPowerCost(exponent - nextExponent) +
+                 countMultiplies(group, next, symbol + 1);
+        exponent = nextExponent;
+        group = next;
+    }
+
+    if (exponent != 0)
+    {
+        count += 1 + Internal::IntegerPowerCost(exponent);
+    }
+    return count;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename Polynomial<T, Alloc>::ExpressionType
+Polynomial<T, Alloc>::symbolPower(std::size_t symbol, Exponent exponent) const
+{
+    typedef typename ExpressionType::Symbol SymbolType;
+    typedef Internal::StrengthReduction<T, Alloc> StrengthReduction;
+
+    // Squares and cubes of the symbol, as optimize() builds powers.
+    assert(exponent >= 1);
+    const SymbolType variable(mSymbols[symbol].c_str());
+    TermNode* pPower = StrengthReduction::IntegerPower(
+                           new SymbolNode(variable), static_cast<int>(exponent));
+    pPower->GetHash();
+
+    ExpressionType power;
+    power.mExpressionTree.insertToHead(pPower);
+    return power;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Multiplies out a polynomial expression into a sum of monomials
+* with like terms collected.
+*
+* Expressions that are not polynomials are returned unchanged.
+*/
+template <class T, class Alloc>
+Expression<T, Alloc> Expand(const Expression<T, Alloc>& rExpression)
+{
+    Polynomial<T, Alloc> polynomial;
+    if (!Polynomial<T, Alloc>::FromExpression(rExpression, polynomial))
+    {
+        return rExpression;
+    }
+    return polynomial.toExpression(Polynomial<T, Alloc>::Form::Expanded);
+}
+
+} // namespace Emblem
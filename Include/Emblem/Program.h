@@ -0,0 +1,891 @@
+/**
+* \file Program.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "Expression.h"
+#include "FastMath.h"
+#include "OptimizationFlags.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stack>
+#include <type_traits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief Instructions of the Program stack machine. */
+enum class OpCode : std::uint8_t
+{
+    PushConstant,
+    PushSymbol,
+
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Pow,
+
+    Sin,
+    Cos,
+    Tan,
+    Identity,
+    Abs,
+    Negate,
+    Exp,
+    Ln,
+    Log10,
+    Sqrt,
+    Square,
+    Cube,
+    Reciprocal,
+
+    /** \brief a b c -> a * b + c */
+    MultiplyAdd,
+    /** \brief c a b -> c + a * b */
+    AddMultiply,
+    /** \brief a b c -> a * b - c */
+    MultiplySubtract,
+    /** \brief c a b -> c - a * b */
+    SubtractMultiply,
+
+    /**
+    * \brief x -> sin(x), storing sin(x) and cos(x) in the temporaries at
+    * operand and operand + 1.
+    */
+    SinCos,
+    /** \brief As SinCos, but leaves cos(x) on the stack. */
+    CosSin,
+    /** \brief Pushes the temporary at operand. */
+    LoadTemporary,
+
+    Count
+};
+
+/**
+* \brief Single stack machine instruction.
+*
+* The operand indexes the constant or symbol table for the push
+* instructions, the temporaries for SinCos, CosSin and LoadTemporary,
+* and is unused otherwise.
+*/
+struct Instruction
+{
+    OpCode opCode;
+    std::uint8_t reserved[3];
+    std::uint32_t operand;
+};
+
+inline Instruction MakeInstruction(OpCode opCode, std::uint32_t operand = 0)
+{
+    Instruction instruction;
+    instruction.opCode = opCode;
+    instruction.reserved[0] = instruction.reserved[1] = instruction.reserved[2] = 0;
+    instruction.operand = operand;
+    return instruction;
+}
+
+template <class T>
+OpCode ToOpCode(const BinaryOperator<T>& rOperator)
+{
+    typedef typename BinaryOperator<T>::Type Type;
+    switch (rOperator.GetType())
+    {
+    case Type::Addition: return OpCode::Add;
+    case Type::Subtraction: return OpCode::Subtract;
+    case Type::Multiplication: return OpCode::Multiply;
+    case Type::Division: return OpCode::Divide;
+    case Type::Pow: return OpCode::Pow;
+    }
+    assert(0);
+    return OpCode::Count;
+}
+
+template <class T>
+OpCode ToOpCode(const UnaryOperator<T>& rOperator)
+{
+    typedef typename UnaryOperator<T>::Type Type;
+    switch (rOperator.GetType())
+    {
+    case Type::Sin: return OpCode::Sin;
+    case Type::Cos: return OpCode::Cos;
+    case Type::Tan: return OpCode::Tan;
+    case Type::Identity: return OpCode::Identity;
+    case Type::Abs: return OpCode::Abs;
+    case Type::Negate: return OpCode::Negate;
+    case Type::Exp: return OpCode::Exp;
+    case Type::Ln: return OpCode::Ln;
+    case Type::Log10: return OpCode::Log10;
+    case Type::Sqrt: return OpCode::Sqrt;
+    case Type::Square: return OpCode::Square;
+    case Type::Cube: return OpCode::Cube;
+    case Type::Reciprocal: return OpCode::Reciprocal;
+    }
+    assert(0);
+    return OpCode::Count;
+}
+
+/** \brief Number of values the instruction pops, it always pushes one. */
+inline int StackInputs(OpCode opCode)
+{
+    switch (opCode)
+    {
+    case OpCode::PushConstant:
+    case OpCode::PushSymbol:
+    case OpCode::LoadTemporary:
+        return 0;
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Pow:
+        return 2;
+    case OpCode::MultiplyAdd:
+    case OpCode::AddMultiply:
+    case OpCode::MultiplySubtract:
+    case OpCode::SubtractMultiply:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/** \brief Change in stack depth caused by executing the instruction. */
+inline int StackEffect(OpCode opCode)
+{
+    return 1 - StackInputs(opCode);
+}
+
+/** \brief Applies a binary arithmetic opcode. */
+template <class T>
+T ApplyBinary(OpCode opCode, const T& rA, const T& rB)
+{
+    switch (opCode)
+    {
+    case OpCode::Add: return FuncAdd(rA, rB);
+    case OpCode::Subtract: return FuncSub(rA, rB);
+    case OpCode::Multiply: return FuncMul(rA, rB);
+    case OpCode::Divide: return FuncDiv(rA, rB);
+    case OpCode::Pow: return FuncPow(rA, rB);
+    default: break;
+    }
+    assert(0);
+    return T();
+}
+
+/** \brief Applies a unary opcode. */
+template <class T>
+T ApplyUnary(OpCode opCode, const T& rA)
+{
+    switch (opCode)
+    {
+    case OpCode::Sin: return FuncSin(rA);
+    case OpCode::Cos: return FuncCos(rA);
+    case OpCode::Tan: return FuncTan(rA);
+    case OpCode::Identity: return FuncIdentity(rA);
+    case OpCode::Abs: return FuncAbs(rA);
+    case OpCode::Negate: return FuncNegate(rA);
+    case OpCode::Exp: return FuncExp(rA);
+    case OpCode::Ln: return FuncLn(rA);
+    case OpCode::Log10: return FuncLog10(rA);
+    case OpCode::Sqrt: return FuncSqrt(rA);
+    case OpCode::Square: return FuncSquare(rA);
+    case OpCode::Cube: return FuncCube(rA);
+    case OpCode::Reciprocal: return FuncReciprocal(rA);
+    default: break;
+    }
+    assert(0);
+    return T();
+}
+
+/**
+* \brief Sine and cosine of the same argument, in one call where the C
+* library offers sincos. Elsewhere both functions reduce the argument.
+*/
+template <class T>
+void FuncSinCos(const T& rA, T& rSin, T& rCos)
+{
+    rSin = sin(rA);
+    rCos = cos(rA);
+}
+
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+inline void FuncSinCos(const double& rA, double& rSin, double& rCos)
+{
+    ::sincos(rA, &rSin, &rCos);
+}
+
+inline void FuncSinCos(const float& rA, float& rSin, float& rCos)
+{
+    ::sincosf(rA, &rSin, &rCos);
+}
+#endif
+
+/** \brief Applies a unary opcode with the tier's approximation, if it has one. */
+template <Accuracy A>
+struct ApproximateUnary
+{
+    template <class T>
+    static T Apply(OpCode opCode, const T& rA)
+    {
+        switch (opCode)
+        {
+        case OpCode::Sin: return FastSin<A>(rA);
+        case OpCode::Cos: return FastCos<A>(rA);
+        case OpCode::Tan: return FastTan<A>(rA);
+        case OpCode::Exp: return FastExp<A>(rA);
+        case OpCode::Ln: return FastLn<A>(rA);
+        case OpCode::Log10: return FastLog10<A>(rA);
+        default: return ApplyUnary(opCode, rA);
+        }
+    }
+
+    template <class T>
+    static void SinCos(const T& rA, T& rSin, T& rCos)
+    {
+        FastSinCos<A>(rA, rSin, rCos);
+    }
+};
+
+template <>
+struct ApproximateUnary<Accuracy::Exact>
+{
+    template <class T>
+    static T Apply(OpCode opCode, const T& rA)
+    {
+        return ApplyUnary(opCode, rA);
+    }
+
+    template <class T>
+    static void SinCos(const T& rA, T& rSin, T& rCos)
+    {
+        FuncSinCos(rA, rSin, rCos);
+    }
+};
+
+/** \brief Unary operation on one value, approximated as far as the accuracy allows. */
+template <class T>
+T ApplyUnary(OpCode opCode, Accuracy accuracy, const T& rA)
+{
+    switch (accuracy)
+    {
+    case Accuracy::High: return ApproximateUnary<Accuracy::High>::Apply(opCode, rA);
+    case Accuracy::Medium: return ApproximateUnary<Accuracy::Medium>::Apply(opCode, rA);
+    case Accuracy::Low: return ApproximateUnary<Accuracy::Low>::Apply(opCode, rA);
+    default: return ApplyUnary(opCode, rA);
+    }
+}
+
+/** \brief Sine and cosine of one value, approximated as far as the accuracy allows. */
+template <class T>
+void ApplySinCos(Accuracy accuracy, const T& rA, T& rSin, T& rCos)
+{
+    switch (accuracy)
+    {
+    case Accuracy::High: ApproximateUnary<Accuracy::High>::SinCos(rA, rSin, rCos); break;
+    case Accuracy::Medium: ApproximateUnary<Accuracy::Medium>::SinCos(rA, rSin, rCos); break;
+    case Accuracy::Low: ApproximateUnary<Accuracy::Low>::SinCos(rA, rSin, rCos); break;
+    default: FuncSinCos(rA, rSin, rCos); break;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/** \brief a * b + c, rounded once where the type supports it. */
+template <class T>
+T FuncFma(const T& rA, const T& rB, const T& rC, std::true_type /*isFloatingPoint*/)
+{
+    return std::fma(rA, rB, rC);
+}
+
+template <class T>
+T FuncFma(const T& rA, const T& rB, const T& rC, std::false_type /*isFloatingPoint*/)
+{
+    return rA * rB + rC;
+}
+
+template <class T>
+T FuncFma(const T& rA, const T& rB, const T& rC)
+{
+    return FuncFma(rA, rB, rC, std::is_floating_point<T>());
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class Program
+* \brief Expression compiled to a flat postfix program for a stack machine.
+*
+* Evaluating a program is a single loop over its instructions, with no
+* virtual calls or map lookups. Symbols are bound by position, in order of
+* first occurrence in the expression; see symbols().
+*
+* While compiling, x * y + z patterns become fused multiply-adds when
+* OptimizationFlags::fuseMultiplyAdd is set, and sin and cos of
+* structurally equal arguments are computed together: the argument is
+* evaluated once, one SinCos instruction fills two temporaries, and every
+* other use of either result loads a temporary.
+*
+* With setAccuracy() the transcendental functions use the approximations
+* of FastMath.h.
+* \tparam T Type of evaluation in expression.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class Program
+{
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::ConstantNode<T, Alloc> ConstantNode;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef typename ExpressionType::ValueMap ValueMap;
+    typedef Internal::Instruction Instruction;
+
+    Program()
+        : mStackSize(0), mTemporaryCount(0), mHash(0), mAccuracy(Accuracy::Exact)
+    {
+    }
+
+    /** \brief Compiles the expression. */
+    explicit Program(const ExpressionType& rExpression,
+                     const OptimizationFlags& rFlags = OptimizationFlags());
+
+    /**
+    * \brief Evaluates the program with symbol values given by position.
+    * \param pSymbolValues One value per entry of symbols(), in that order.
+    */
+    T evaluate(const T* pSymbolValues) const;
+
+    /** \brief Evaluates the program, looking the symbols up in the map. */
+    T evaluate(const ValueMap& rValues) const;
+
+    /** \brief Symbol names in positional order. */
+    const std::vector<std::string>& symbols() const
+    {
+        return mSymbols;
+    }
+
+    const std::vector<Instruction>& instructions() const
+    {
+        return mInstructions;
+    }
+
+    const std::vector<T>& constants() const
+    {
+        return mConstants;
+    }
+
+    /** \brief Deepest stack the program needs. */
+    std::size_t stackSize() const
+    {
+        return mStackSize;
+    }
+
+    /** \brief Number of temporaries holding fused sin and cos results. */
+    std::size_t temporaryCount() const
+    {
+        return mTemporaryCount;
+    }
+
+    /** \brief Structural hash of the expression the program was compiled from. */
+    std::uint64_t hash() const
+    {
+        return mHash;
+    }
+
+    /** \brief Flags the program was compiled with. */
+    const OptimizationFlags& flags() const
+    {
+        return mFlags;
+    }
+
+    bool empty() const
+    {
+        return mInstructions.empty();
+    }
+
+    std::size_t memoryUsage() const;
+
+    /** \brief Sets how accurate sin, cos, tan, exp, ln and log10 must be, Exact by default. */
+    void setAccuracy(Accuracy accuracy)
+    {
+        mAccuracy = accuracy;
+    }
+
+    Accuracy accuracy() const
+    {
+        return mAccuracy;
+    }
+
+private:
+    template <class, class> friend class ProgramCache;
+
+    /** \brief Sin and cos uses sharing one argument. */
+    struct SinCosGroup
+    {
+        const TermNode* pArgument;
+        bool hasSin;
+        bool hasCos;
+        bool isEmitted;
+        std::uint32_t temporary;
+    };
+
+    void findSinCosGroups(
+        const TermNode* pHead, std::vector<SinCosGroup>& rGroups,
+        std::unordered_map<const TermNode*, std::size_t>& rGroupOfNode);
+
+    static const std::size_t LocalStackSize = 32;
+
+    std::vector<Instruction> mInstructions;
+    std::vector<T> mConstants;
+    std::vector<std::string> mSymbols;
+    std::size_t mStackSize;
+    std::size_t mTemporaryCount;
+    std::uint64_t mHash;
+    OptimizationFlags mFlags;
+    Accuracy mAccuracy;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::size_t Program<T, Alloc>::LocalStackSize;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Program<T, Alloc>::Program(
+    const ExpressionType& rExpression, const OptimizationFlags& rFlags)
+    : mStackSize(0), mTemporaryCount(0), mHash(rExpression.hash()), mFlags(rFlags),
+      mAccuracy(Accuracy::Exact)
+{
+    using namespace Internal;
+    typedef BinaryOperator<T> BinaryOperator;
+    typedef UnaryOperator<T> UnaryOperator;
+
+    const TermNode* pHead = rExpression.mExpressionTree.head();
+    if (pHead == nullptr)
+    {
+        return;
+    }
+
+    // Symbols are numbered in order of first occurrence, which matches
+    // Expression::canonicalHash() and so EvaluatorCache.
+    rExpression.canonicalHash(mSymbols);
+    std::unordered_map<std::string, std::uint32_t> symbolSlots;
+    for (std::size_t i = 0; i < mSymbols.size(); ++i)
+    {
+        symbolSlots[mSymbols[i]] = static_cast<std::uint32_t>(i);
+    }
+
+    std::vector<SinCosGroup> sinCosGroups;
+    std::unordered_map<const TermNode*, std::size_t> groupOfNode;
+    findSinCosGroups(pHead, sinCosGroups, groupOfNode);
+
+    // Nodes are visited depth first, left to right; an operator pushes the
+    // instruction it emits below its operands so it runs after them.
+    struct Task
+    {
+        const TermNode* pNode;
+        bool isVisit;
+        Instruction instruction;
+    };
+    const auto visit = [](const TermNode* pNode)
+    {
+        Task task = { pNode, true, MakeInstruction(OpCode::Count) };
+        return task;
+    };
+    const auto emit = [](const Instruction& rInstruction)
+    {
+        Task task = { nullptr, false, rInstruction };
+        return task;
+    };
+    const auto isMultiplication = [](const TermNode* pNode)
+    {
+        const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode);
+        return (pBinaryOp != nullptr) &&
+               (pBinaryOp->GetOperator() == BinaryOperator::Multiplication);
+    };
+
+    std::size_t depth = 0;
+    std::stack<Task> taskStack;
+    taskStack.push(visit(pHead));
+    while (!taskStack.empty())
+    {
+        const Task task = taskStack.top();
+        taskStack.pop();
+
+        if (!task.isVisit)
+        {
+            depth += StackEffect(task.instruction.opCode);
+            if (depth > mStackSize)
+            {
+                mStackSize = depth;
+            }
+            mInstructions.push_back(task.instruction);
+            continue;
+        }
+
+        const TermNode* pNode = task.pNode;
+        if (pNode->isSymbol())
+        {
+            const std::string& rName =
+                static_cast<const SymbolNode<T, Alloc>*>(pNode)->GetSymbol().toString();
+            taskStack.push(emit(MakeInstruction(OpCode::PushSymbol, symbolSlots[rName])));
+            continue;
+        }
+        if (!pNode->isOperator())
+        {
+            const ConstantNode* pConstant = static_cast<const ConstantNode*>(pNode);
+            taskStack.push(emit(MakeInstruction(
+                                    OpCode::PushConstant,
+                                    static_cast<std::uint32_t>(mConstants.size()))));
+            mConstants.push_back(pConstant->GetValue());
+            continue;
+        }
+
+        const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode);
+        if (pNaryOp != nullptr)
+        {
+            // Operands are combined left to right, multiplies among the
+            // operands of a sum are fused as they are for binary nodes.
+            const BinaryOperator& rOperator = pNaryOp->GetOperator();
+            const bool isFused = rFlags.fuseMultiplyAdd && (rOperator == BinaryOperator::Addition);
+            const std::size_t count = pNaryOp->operandCount();
+            const bool isFirstFused = isFused && isMultiplication(pNaryOp->operand(0)) &&
+                                      !isMultiplication(pNaryOp->operand(1));
+            for (std::size_t i = count; i-- > (isFirstFused ? 2 : 1);)
+            {
+                const TermNode* pOperand = pNaryOp->operand(i);
+                if (isFused && isMultiplication(pOperand))
+                {
+                    // sum + a * b
+                    taskStack.push(emit(MakeInstruction(OpCode::AddMultiply)));
+                    taskStack.push(visit(pOperand->mpRightNode));
+                    taskStack.push(visit(pOperand->mpLeftNode));
+                    continue;
+                }
+                taskStack.push(emit(MakeInstruction(ToOpCode(rOperator))));
+                taskStack.push(visit(pOperand));
+            }
+
+            if (isFirstFused)
+            {
+                // a * b + c
+                const TermNode* pFirst = pNaryOp->operand(0);
+                taskStack.push(emit(MakeInstruction(OpCode::MultiplyAdd)));
+                taskStack.push(visit(pNaryOp->operand(1)));
+                taskStack.push(visit(pFirst->mpRightNode));
+                taskStack.push(visit(pFirst->mpLeftNode));
+                continue;
+            }
+            taskStack.push(visit(pNaryOp->operand(0)));
+            continue;
+        }
+
+        const TermNode* pLeft = pNode->mpLeftNode;
+        const TermNode* pRight = pNode->mpRightNode;
+        const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode);
+        if (pBinaryOp == nullptr)
+        {
+            const UnaryOperator& rOperator =
+                static_cast<const UnaryOperatorNode*>(pNode)->GetOperator();
+            const auto groupIter = groupOfNode.find(pNode);
+            if (groupIter != groupOfNode.end())
+            {
+                SinCosGroup& rGroup = sinCosGroups[groupIter->second];
+                const bool isCos = (rOperator == UnaryOperator::Cos);
+                if (rGroup.isEmitted)
+                {
+                    taskStack.push(emit(MakeInstruction(
+                                            OpCode::LoadTemporary, rGroup.temporary + (isCos ? 1 : 0))));
+                    continue;
+                }
+
+                rGroup.isEmitted = true;
+                taskStack.push(emit(MakeInstruction(
+                                        isCos ? OpCode::CosSin : OpCode::SinCos, rGroup.temporary)));
+                taskStack.push(visit(pLeft));
+                continue;
+            }
+
+            taskStack.push(emit(MakeInstruction(ToOpCode(rOperator))));
+            taskStack.push(visit(pLeft));
+            continue;
+        }
+
+        const BinaryOperator& rOperator = pBinaryOp->GetOperator();
+        const bool isSum = (rOperator == BinaryOperator::Addition) ||
+                           (rOperator == BinaryOperator::Subtraction);
+        const bool isAddition = (rOperator == BinaryOperator::Addition);
+        if (rFlags.fuseMultiplyAdd && isSum && isMultiplication(pLeft))
+        {
+            // a * b +- c
+            taskStack.push(emit(MakeInstruction(
+                                    isAddition ? OpCode::MultiplyAdd : OpCode::MultiplySubtract)));
+            taskStack.push(visit(pRight));
+            taskStack.push(visit(pLeft->mpRightNode));
+            taskStack.push(visit(pLeft->mpLeftNode));
+            continue;
+        }
+        if (rFlags.fuseMultiplyAdd && isSum && isMultiplication(pRight))
+        {
+            // c +- a * b
+            taskStack.push(emit(MakeInstruction(
+                                    isAddition ? OpCode::AddMultiply : OpCode::SubtractMultiply)));
+            taskStack.push(visit(pRight->mpRightNode));
+            taskStack.push(visit(pRight->mpLeftNode));
+            taskStack.push(visit(pLeft));
+            continue;
+        }
+
+        taskStack.push(emit(MakeInstruction(ToOpCode(rOperator))));
+        taskStack.push(visit(pRight));
+        taskStack.push(visit(pLeft));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+void Program<T, Alloc>::findSinCosGroups(
+    const TermNode* pHead, std::vector<SinCosGroup>& rGroups,
+    std::unordered_map<const TermNode*, std::size_t>& rGroupOfNode)
+{
+    typedef Internal::UnaryOperator<T> UnaryOperator;
+
+    std::unordered_multimap<std::uint64_t, std::size_t> groupsByHash;
+    std::stack<const TermNode*> nodeStack;
+    nodeStack.push(pHead);
+    while (!nodeStack.empty())
+    {
+        const TermNode* pNode = nodeStack.top();
+        nodeStack.pop();
+        for (std::size_t i = pNode->operandCount(); i-- > 0;)
+        {
+            nodeStack.push(pNode->operand(i));
+        }
+
+        const UnaryOperatorNode* pUnaryOp = dynamic_cast<const UnaryOperatorNode*>(pNode);
+        if ((pUnaryOp == nullptr) ||
+                (!(pUnaryOp->GetOperator() == UnaryOperator::Sin) &&
+                 !(pUnaryOp->GetOperator() == UnaryOperator::Cos)))
+        {
+            continue;
+        }
+
+        const TermNode* pArgument = pNode->mpLeftNode;
+        const std::uint64_t hash = pArgument->GetHash();
+        std::size_t group = rGroups.size();
+        const auto range = groupsByHash.equal_range(hash);
+        for (auto groupIter = range.first; groupIter != range.second; ++groupIter)
+        {
+            if (Internal::IsStructurallyEqual(rGroups[groupIter->second].pArgument, pArgument))
+            {
+                group = groupIter->second;
+                break;
+            }
+        }
+        if (group == rGroups.size())
+        {
+            SinCosGroup newGroup = { pArgument, false, false, false, 0 };
+            rGroups.push_back(newGroup);
+            groupsByHash.insert(std::make_pair(hash, group));
+        }
+
+        const bool isSin = (pUnaryOp->GetOperator() == UnaryOperator::Sin);
+        rGroups[group].hasSin = rGroups[group].hasSin || isSin;
+        rGroups[group].hasCos = rGroups[group].hasCos || !isSin;
+        rGroupOfNode[pNode] = group;
+    }
+
+    // Only arguments used by both sin and cos are worth fusing.
+    for (auto nodeIter = rGroupOfNode.begin(); nodeIter != rGroupOfNode.end();)
+    {
+        const SinCosGroup& rGroup = rGroups[nodeIter->second];
+        nodeIter = (rGroup.hasSin && rGroup.hasCos) ? std::next(nodeIter) :
+                   rGroupOfNode.erase(nodeIter);
+    }
+    for (SinCosGroup& rGroup : rGroups)
+    {
+        if (rGroup.hasSin && rGroup.hasCos)
+        {
+            rGroup.temporary = static_cast<std::uint32_t>(mTemporaryCount);
+            mTemporaryCount += 2;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Program<T, Alloc>::evaluate(const T* pSymbolValues) const
+{
+    using namespace Internal;
+
+    if (mInstructions.empty())
+    {
+        assert(0);
+        return T();
+    }
+
+    // The temporaries live above the deepest point of the stack.
+    T localStack[LocalStackSize];
+    std::vector<T> heapStack;
+    T* pStack = localStack;
+    if (mStackSize + mTemporaryCount > LocalStackSize)
+    {
+        heapStack.resize(mStackSize + mTemporaryCount);
+        pStack = heapStack.data();
+    }
+    T* pTemporaries = pStack + mStackSize;
+
+    // Index of the next free slot, the top of the stack is pStack[top - 1].
+    std::size_t top = 0;
+    for (const Instruction& rInstruction : mInstructions)
+    {
+        switch (rInstruction.opCode)
+        {
+        case OpCode::PushConstant:
+            pStack[top++] = mConstants[rInstruction.operand];
+            break;
+        case OpCode::PushSymbol:
+            pStack[top++] = pSymbolValues[rInstruction.operand];
+            break;
+
+        case OpCode::Add:
+            --top;
+            pStack[top - 1] = FuncAdd(pStack[top - 1], pStack[top]);
+            break;
+        case OpCode::Subtract:
+            --top;
+            pStack[top - 1] = FuncSub(pStack[top - 1], pStack[top]);
+            break;
+        case OpCode::Multiply:
+            --top;
+            pStack[top - 1] = FuncMul(pStack[top - 1], pStack[top]);
+            break;
+        case OpCode::Divide:
+            --top;
+            pStack[top - 1] = FuncDiv(pStack[top - 1], pStack[top]);
+            break;
+        case OpCode::Pow:
+            --top;
+            pStack[top - 1] = FuncPow(pStack[top - 1], pStack[top]);
+            break;
+
+        case OpCode::Sin:
+        case OpCode::Cos:
+        case OpCode::Tan:
+        case OpCode::Exp:
+        case OpCode::Ln:
+        case OpCode::Log10:
+            pStack[top - 1] = ApplyUnary(rInstruction.opCode, mAccuracy, pStack[top - 1]);
+            break;
+        case OpCode::Identity: break;
+        case OpCode::Abs: pStack[top - 1] = FuncAbs(pStack[top - 1]); break;
+        case OpCode::Negate: pStack[top - 1] = FuncNegate(pStack[top - 1]); break;
+        case OpCode::Sqrt: pStack[top - 1] = FuncSqrt(pStack[top - 1]); break;
+        case OpCode::Square: pStack[top - 1] = FuncSquare(pStack[top - 1]); break;
+        case OpCode::Cube: pStack[top - 1] = FuncCube(pStack[top - 1]); break;
+        case OpCode::Reciprocal: pStack[top - 1] = FuncReciprocal(pStack[top - 1]); break;
+
+        case OpCode::MultiplyAdd:
+            top -= 2;
+            pStack[top - 1] = FuncFma(pStack[top - 1], pStack[top], pStack[top + 1]);
+            break;
+        case OpCode::AddMultiply:
+            top -= 2;
+            pStack[top - 1] = FuncFma(pStack[top], pStack[top + 1], pStack[top - 1]);
+            break;
+        case OpCode::MultiplySubtract:
+            top -= 2;
+            pStack[top - 1] = FuncFma(pStack[top - 1], pStack[top], -pStack[top + 1]);
+            break;
+        case OpCode::SubtractMultiply:
+            top -= 2;
+            pStack[top - 1] = FuncFma(-pStack[top], pStack[top + 1], pStack[top - 1]);
+            break;
+
+        case OpCode::SinCos:
+        case OpCode::CosSin:
+        {
+            T* pResults = pTemporaries + rInstruction.operand;
+            ApplySinCos(mAccuracy, pStack[top - 1], pResults[0], pResults[1]);
+            pStack[top - 1] = pResults[(rInstruction.opCode == OpCode::SinCos) ? 0 : 1];
+            break;
+        }
+        case OpCode::LoadTemporary:
+            pStack[top++] = pTemporaries[rInstruction.operand];
+            break;
+
+        default:
+            assert(0);
+            break;
+        }
+    }
+
+    assert(top == 1);
+    return pStack[0];
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+T Program<T, Alloc>::evaluate(const ValueMap& rValues) const
+{
+    std::vector<T> symbolValues;
+    symbolValues.reserve(mSymbols.size());
+    for (const std::string& rSymbol : mSymbols)
+    {
+        symbolValues.push_back(rValues.at(rSymbol));
+    }
+    return evaluate(symbolValues.data());
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::size_t Program<T, Alloc>::memoryUsage() const
+{
+    std::size_t usage = sizeof(Program);
+    usage += mInstructions.capacity() * sizeof(Instruction);
+    usage += mConstants.capacity() * sizeof(T);
+    for (const std::string& rSymbol : mSymbols)
+    {
+        usage += sizeof(std::string) + rSymbol.capacity();
+    }
+    return usage;
+}
+
+} // namespace Emblem
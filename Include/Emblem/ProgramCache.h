@@ -0,0 +1,494 @@
+/**
+* \file ProgramCache.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "Program.h"
+#include "Serialization.h"
+#include "Internal/FileSystem.h"
+#include "Internal/Hash.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Name of the instruction set the headers were compiled for.
+*
+* Programs compiled for one target are kept apart from those of another,
+* so that a cache directory shared between builds never hands out code
+* produced under different floating point settings.
+*/
+inline const char* TargetIsa()
+{
+#if defined(__AVX512F__)
+    return "x86_64-avx512f";
+#elif defined(__AVX2__)
+    return "x86_64-avx2";
+#elif defined(__AVX__)
+    return "x86_64-avx";
+#elif defined(_M_X64) || defined(__x86_64__)
+    return "x86_64-sse2";
+#elif defined(_M_IX86) || defined(__i386__)
+    return "x86";
+#elif defined(_M_ARM64) || defined(__aarch64__)
+    return "aarch64";
+#else
+    return "generic";
+#endif
+}
+
+/**
+* \brief Fixed size header at the start of every cached program file.
+*
+* It is followed by the payload: the instructions, the raw constants,
+* every symbol name as a 32-bit length and its characters, and last the
+* expression as Serializer encodes it.
+*/
+struct ProgramFileHeader
+{
+    char magic[4];
+    std::uint32_t formatVersion;
+    std::uint64_t expressionHash;
+    char targetIsa[24];
+    std::uint32_t valueSize;
+    std::uint32_t instructionCount;
+    std::uint32_t constantCount;
+    std::uint32_t symbolCount;
+    std::uint32_t symbolBytes;
+    std::uint32_t stackSize;
+    std::uint32_t temporaryCount;
+    std::uint32_t flags;
+    std::uint32_t expressionBytes;
+    std::uint32_t reserved;
+    std::uint64_t payloadChecksum;
+};
+
+static_assert(sizeof(ProgramFileHeader) == 88, "Cached program header must not be padded");
+static_assert(sizeof(Instruction) == 8, "Cached instructions must not be padded");
+
+const char ProgramFileMagic[4] = {'E', 'M', 'B', 'P'};
+
+/** \brief The flags that change how programs are compiled, one bit each. */
+inline std::uint32_t ProgramFlagBits(const OptimizationFlags& rFlags)
+{
+    return (rFlags.fastMath ? 1u : 0u) | (rFlags.reassociate ? 2u : 0u) |
+           (rFlags.fuseMultiplyAdd ? 4u : 0u);
+}
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class ProgramCache
+* \brief Persistent on-disk cache of compiled programs.
+*
+* Programs are stored as
+* <directory>/v<FormatVersion>/<target ISA>/<structural hash>-<flags>.ebp
+* and read back through a memory mapping. A file is only used when its
+* header matches the format version, target ISA, value type, expression
+* hash and optimization flags, its checksum is intact, its instructions
+* are well formed and the expression stored with it has the structure of
+* the one looked up, so a hash collision cannot return another program.
+* Anything else is treated as a miss and the expression is compiled again, which
+* also replaces the bad file. Files are written atomically so that several
+* processes may share a directory.
+* \tparam T Type of evaluation in expression, stored by its bytes.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class ProgramCache
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Cached programs store their constants as raw bytes");
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+    typedef Emblem::Program<T, Alloc> ProgramType;
+
+    /** \brief Bumped whenever the file layout or the instruction set changes. */
+    static const std::uint32_t FormatVersion = 4;
+
+    struct Statistics
+    {
+        /** \brief Programs read from disk. */
+        std::uint64_t loads;
+        /** \brief Programs compiled because no usable file existed. */
+        std::uint64_t compilations;
+        /** \brief Files found but rejected as corrupt or stale. */
+        std::uint64_t rejections;
+    };
+
+    explicit ProgramCache(const std::string& rDirectory)
+        : mDirectory(rDirectory + "/v" + std::to_string(FormatVersion) + "/" +
+                     Internal::TargetIsa()),
+          mLoads(0), mCompilations(0), mRejections(0)
+    {
+    }
+
+    /**
+    * \brief Loads the program for the expression and flags, compiling and
+    * storing it if no valid file exists.
+    */
+    ProgramType getOrCompile(const ExpressionType& rExpression,
+                             const OptimizationFlags& rFlags = OptimizationFlags());
+
+    /**
+    * \brief Reads and validates the cached program for the expression.
+    * \return False, leaving rProgram untouched, on a miss or invalid file.
+    */
+    bool load(const ExpressionType& rExpression, ProgramType& rProgram,
+              const OptimizationFlags& rFlags = OptimizationFlags());
+
+    /**
+    * \brief Writes the program compiled from the expression to the cache,
+    * returns false on I/O failure.
+    */
+    bool store(const ExpressionType& rExpression, const ProgramType& rProgram);
+
+    /** \brief File the program of an expression with this hash and flags is stored in. */
+    std::string path(std::uint64_t expressionHash,
+                     const OptimizationFlags& rFlags = OptimizationFlags()) const;
+
+    /** \brief Versioned, target specific directory holding the files. */
+    const std::string& directory() const
+    {
+        return mDirectory;
+    }
+
+    Statistics statistics() const
+    {
+        Statistics statistics;
+        statistics.loads = mLoads;
+        statistics.compilations = mCompilations;
+        statistics.rejections = mRejections;
+        return statistics;
+    }
+
+private:
+    bool read(const unsigned char* pData, std::size_t size, const ExpressionType& rExpression,
+              const OptimizationFlags& rFlags, ProgramType& rProgram) const;
+
+    std::string mDirectory;
+
+    std::atomic<std::uint64_t> mLoads;
+    std::atomic<std::uint64_t> mCompilations;
+    std::atomic<std::uint64_t> mRejections;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::uint32_t ProgramCache<T, Alloc>::FormatVersion;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename ProgramCache<T, Alloc>::ProgramType
+ProgramCache<T, Alloc>::getOrCompile(const ExpressionType& rExpression,
+                                     const OptimizationFlags& rFlags)
+{
+    ProgramType program;
+    if (load(rExpression, program, rFlags))
+    {
+        return program;
+    }
+
+    program = ProgramType(rExpression, rFlags);
+    ++mCompilations;
+    if (!program.empty())
+    {
+        store(rExpression, program);
+    }
+    return program;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool ProgramCache<T, Alloc>::load(
+    const ExpressionType& rExpression, ProgramType& rProgram, const OptimizationFlags& rFlags)
+{
+    Internal::MappedFile file;
+    if (!file.open(path(rExpression.hash(), rFlags)))
+    {
+        return false;
+    }
+
+    if (!read(file.data(), file.size(), rExpression, rFlags, rProgram))
+    {
+        ++mRejections;
+        return false;
+    }
+
+    ++mLoads;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool ProgramCache<T, Alloc>::store(const ExpressionType& rExpression, const ProgramType& rProgram)
+{
+    using namespace Internal;
+
+    assert(rExpression.hash() == rProgram.mHash);
+    if (!CreateDirectories(mDirectory))
+    {
+        return false;
+    }
+
+    std::size_t symbolBytes = 0;
+    for (const std::string& rSymbol : rProgram.mSymbols)
+    {
+        symbolBytes += sizeof(std::uint32_t) + rSymbol.size();
+    }
+
+    const std::size_t instructionBytes = rProgram.mInstructions.size() * sizeof(Instruction);
+    const std::size_t constantBytes = rProgram.mConstants.size() * sizeof(T);
+    std::vector<unsigned char> encoding;
+    Serializer<T, Alloc>::Serialize(rExpression, encoding);
+    std::vector<unsigned char> buffer(
+        sizeof(ProgramFileHeader) + instructionBytes + constantBytes + symbolBytes + encoding.size());
+
+    unsigned char* pPayload = buffer.data() + sizeof(ProgramFileHeader);
+    unsigned char* pOut = pPayload;
+    if (instructionBytes != 0)
+    {
+        std::memcpy(pOut, rProgram.mInstructions.data(), instructionBytes);
+        pOut += instructionBytes;
+    }
+    if (constantBytes != 0)
+    {
+        std::memcpy(pOut, rProgram.mConstants.data(), constantBytes);
+        pOut += constantBytes;
+    }
+    for (const std::string& rSymbol : rProgram.mSymbols)
+    {
+        const std::uint32_t length = static_cast<std::uint32_t>(rSymbol.size());
+        std::memcpy(pOut, &length, sizeof(length));
+        pOut += sizeof(length);
+        std::memcpy(pOut, rSymbol.data(), rSymbol.size());
+        pOut += rSymbol.size();
+    }
+    std::memcpy(pOut, encoding.data(), encoding.size());
+
+    ProgramFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ProgramFileMagic, sizeof(header.magic));
+    header.formatVersion = FormatVersion;
+    header.expressionHash = rProgram.mHash;
+    std::strncpy(header.targetIsa, TargetIsa(), sizeof(header.targetIsa) - 1);
+    header.valueSize = sizeof(T);
+    header.instructionCount = static_cast<std::uint32_t>(rProgram.mInstructions.size());
+    header.constantCount = static_cast<std::uint32_t>(rProgram.mConstants.size());
+    header.symbolCount = static_cast<std::uint32_t>(rProgram.mSymbols.size());
+    header.symbolBytes = static_cast<std::uint32_t>(symbolBytes);
+    header.stackSize = static_cast<std::uint32_t>(rProgram.mStackSize);
+    header.temporaryCount = static_cast<std::uint32_t>(rProgram.mTemporaryCount);
+    header.flags = ProgramFlagBits(rProgram.mFlags);
+    header.expressionBytes = static_cast<std::uint32_t>(encoding.size());
+    header.payloadChecksum = HashBytes(pPayload, buffer.size() - sizeof(header));
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    return WriteFileAtomically(path(rProgram.mHash, rProgram.mFlags), buffer.data(), buffer.size());
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+std::string ProgramCache<T, Alloc>::path(std::uint64_t expressionHash,
+                                         const OptimizationFlags& rFlags) const
+{
+    static const char Digits[] = "0123456789abcdef";
+
+    std::string fileName(19, '-');
+    for (int i = 15; i >= 0; --i)
+    {
+        fileName[i] = Digits[expressionHash & 0xf];
+        expressionHash >>= 4;
+    }
+    const std::uint32_t flags = Internal::ProgramFlagBits(rFlags);
+    fileName[17] = Digits[(flags >> 4) & 0xf];
+    fileName[18] = Digits[flags & 0xf];
+    return mDirectory + "/" + fileName + ".ebp";
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+bool ProgramCache<T, Alloc>::read(
+    const unsigned char* pData, std::size_t size, const ExpressionType& rExpression,
+    const OptimizationFlags& rFlags, ProgramType& rProgram) const
+{
+    using namespace Internal;
+
+    ProgramFileHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, pData, sizeof(header));
+
+    // Stale files: another layout, target, value type, expression or flags.
+    if ((std::memcmp(header.magic, ProgramFileMagic, sizeof(header.magic)) != 0) ||
+            (header.formatVersion != FormatVersion) ||
+            (header.expressionHash != rExpression.hash()) ||
+            (header.flags != ProgramFlagBits(rFlags)) ||
+            (header.targetIsa[sizeof(header.targetIsa) - 1] != '\0') ||
+            (std::strcmp(header.targetIsa, TargetIsa()) != 0) ||
+            (header.valueSize != sizeof(T)))
+    {
+        return false;
+    }
+
+    // Corrupt files: truncated, padded or modified payload.
+    const std::uint64_t instructionBytes =
+        std::uint64_t(header.instructionCount) * sizeof(Instruction);
+    const std::uint64_t constantBytes = std::uint64_t(header.constantCount) * sizeof(T);
+    const std::uint64_t payloadBytes =
+        instructionBytes + constantBytes + header.symbolBytes + header.expressionBytes;
+    if ((payloadBytes != size - sizeof(header)) || (header.instructionCount == 0))
+    {
+        return false;
+    }
+
+    const unsigned char* pPayload = pData + sizeof(header);
+    if (HashBytes(pPayload, static_cast<std::size_t>(payloadBytes)) != header.payloadChecksum)
+    {
+        return false;
+    }
+
+    std::vector<Instruction> instructions(header.instructionCount);
+    std::memcpy(instructions.data(), pPayload, static_cast<std::size_t>(instructionBytes));
+
+    // The program must run without under- or overflowing its stack, and
+    // only read temporaries it has written.
+    if (((header.temporaryCount % 2) != 0) ||
+            (header.temporaryCount > 2 * std::uint64_t(header.instructionCount)))
+    {
+        return false;
+    }
+    std::vector<bool> isTemporaryWritten(header.temporaryCount, false);
+    std::size_t depth = 0;
+    std::size_t stackSize = 0;
+    for (const Instruction& rInstruction : instructions)
+    {
+        const OpCode opCode = rInstruction.opCode;
+        const std::uint32_t operand = rInstruction.operand;
+        if ((opCode >= OpCode::Count) ||
+                ((opCode == OpCode::PushConstant) && (operand >= header.constantCount)) ||
+                ((opCode == OpCode::PushSymbol) && (operand >= header.symbolCount)))
+        {
+            return false;
+        }
+
+        if ((opCode == OpCode::SinCos) || (opCode == OpCode::CosSin))
+        {
+            if ((operand % 2 != 0) || (operand >= header.temporaryCount))
+            {
+                return false;
+            }
+            isTemporaryWritten[operand] = isTemporaryWritten[operand + 1] = true;
+        }
+        else if ((opCode == OpCode::LoadTemporary) &&
+                 ((operand >= header.temporaryCount) || !isTemporaryWritten[operand]))
+        {
+            return false;
+        }
+
+        if (depth < std::size_t(StackInputs(opCode)))
+        {
+            return false;
+        }
+        depth += StackEffect(opCode);
+        if (depth > stackSize)
+        {
+            stackSize = depth;
+        }
+    }
+    if ((depth != 1) || (stackSize != header.stackSize))
+    {
+        return false;
+    }
+
+    std::vector<T> constants(header.constantCount);
+    if (constantBytes != 0)
+    {
+        std::memcpy(constants.data(), pPayload + instructionBytes,
+                    static_cast<std::size_t>(constantBytes));
+    }
+
+    std::vector<std::string> symbols;
+    symbols.reserve(header.symbolCount);
+    const unsigned char* pSymbol = pPayload + instructionBytes + constantBytes;
+    const unsigned char* pEnd = pData + size - header.expressionBytes;
+    for (std::uint32_t i = 0; i < header.symbolCount; ++i)
+    {
+        std::uint32_t length;
+        if (std::size_t(pEnd - pSymbol) < sizeof(length))
+        {
+            return false;
+        }
+        std::memcpy(&length, pSymbol, sizeof(length));
+        pSymbol += sizeof(length);
+        if (std::size_t(pEnd - pSymbol) < length)
+        {
+            return false;
+        }
+        symbols.push_back(std::string(reinterpret_cast<const char*>(pSymbol), length));
+        pSymbol += length;
+    }
+    if (pSymbol != pEnd)
+    {
+        return false;
+    }
+
+    // Guards against hash collisions, the file must bind the same symbols
+    // and have been compiled from an expression of the same structure.
+    std::vector<std::string> expectedSymbols;
+    rExpression.canonicalHash(expectedSymbols);
+    std::vector<unsigned char> encoding;
+    Serializer<T, Alloc>::Serialize(rExpression, encoding);
+    if ((symbols != expectedSymbols) || (encoding.size() != header.expressionBytes) ||
+            (std::memcmp(encoding.data(), pEnd, encoding.size()) != 0))
+    {
+        return false;
+    }
+
+    rProgram.mInstructions.swap(instructions);
+    rProgram.mConstants.swap(constants);
+    rProgram.mSymbols.swap(symbols);
+    rProgram.mStackSize = stackSize;
+    rProgram.mTemporaryCount = header.temporaryCount;
+    rProgram.mHash = header.expressionHash;
+    rProgram.mFlags = rFlags;
+    return true;
+}
+
+} // namespace Emblem
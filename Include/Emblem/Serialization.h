@@ -0,0 +1,717 @@
+/**
+* \file Serialization.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include "Expression.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace Emblem
+{
+namespace Internal
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \brief Fixed size header of a serialized expression.
+*
+* It is followed by the nodes in post-order, each a tag byte and its
+* arguments, up to an End tag. Counts and symbol indices are LEB128
+* varints, constants are the raw bytes of T, and a symbol is spelled out
+* with its length at its first use and referred to by index after.
+*/
+struct SerializedExpressionHeader
+{
+    char magic[4];
+    std::uint32_t formatVersion;
+    std::uint32_t valueSize;
+    std::uint32_t byteOrder;
+};
+
+static_assert(sizeof(SerializedExpressionHeader) == 16, "Serialized header must not be padded");
+
+const char SerializedExpressionMagic[4] = {'E', 'M', 'B', 'X'};
+
+/** \brief Written as is, so a reader of the other byte order sees it reversed. */
+const std::uint32_t SerializedByteOrder = 0x01020304;
+
+/**
+* \brief Tag of a serialized node. The values are part of the format and
+* must never be reused.
+*/
+enum class SerializedTag : std::uint8_t
+{
+    End = 0,
+    Constant = 1,
+    Symbol = 2,
+    NewSymbol = 3,
+    Sum = 4,
+    Product = 5,
+
+    Add = 16,
+    Subtract = 17,
+    Multiply = 18,
+    Divide = 19,
+    Pow = 20,
+
+    Sin = 32,
+    Cos = 33,
+    Tan = 34,
+    Identity = 35,
+    Abs = 36,
+    Negate = 37,
+    Exp = 38,
+    Ln = 39,
+    Log10 = 40,
+    Sqrt = 41,
+    Square = 42,
+    Cube = 43,
+    Reciprocal = 44
+};
+
+/** \brief Appends to a byte vector. */
+class VectorSink
+{
+public:
+    explicit VectorSink(std::vector<unsigned char>& rBuffer)
+        : mrBuffer(rBuffer)
+    {
+    }
+
+    void write(const void* pData, std::size_t size)
+    {
+        const std::size_t used = mrBuffer.size();
+        mrBuffer.resize(used + size);
+        std::memcpy(mrBuffer.data() + used, pData, size);
+    }
+
+    void writeByte(unsigned char byte)
+    {
+        mrBuffer.push_back(byte);
+    }
+
+private:
+    std::vector<unsigned char>& mrBuffer;
+};
+
+/** \brief Writes to a stream buffer through a block of its own. */
+class StreamSink
+{
+public:
+    static const std::size_t BlockSize = 64 * 1024;
+
+    explicit StreamSink(std::streambuf* pStream)
+        : mpStream(pStream), mUsed(0), mIsGood(pStream != nullptr), mBlock(BlockSize)
+    {
+    }
+
+    void write(const void* pData, std::size_t size)
+    {
+        if (mUsed + size > BlockSize)
+        {
+            flush();
+        }
+        if (size > BlockSize)
+        {
+            put(pData, size);
+            return;
+        }
+        std::memcpy(mBlock.data() + mUsed, pData, size);
+        mUsed += size;
+    }
+
+    void writeByte(unsigned char byte)
+    {
+        if (mUsed == BlockSize)
+        {
+            flush();
+        }
+        mBlock[mUsed++] = byte;
+    }
+
+    /** \brief Hands the block to the stream, false if any write failed. */
+    bool flush()
+    {
+        put(mBlock.data(), mUsed);
+        mUsed = 0;
+        return mIsGood;
+    }
+
+private:
+    void put(const void* pData, std::size_t size)
+    {
+        const std::streamsize count = static_cast<std::streamsize>(size);
+        mIsGood = mIsGood && (mpStream->sputn(static_cast<const char*>(pData), count) == count);
+    }
+
+    std::streambuf* mpStream;
+    std::size_t mUsed;
+    bool mIsGood;
+    std::vector<unsigned char> mBlock;
+};
+
+/** \brief Reads from memory. */
+class BufferSource
+{
+public:
+    BufferSource(const unsigned char* pData, std::size_t size)
+        : mpBegin(pData), mpNext(pData), mpEnd(pData + size)
+    {
+    }
+
+    bool read(void* pData, std::size_t size)
+    {
+        if (static_cast<std::size_t>(mpEnd - mpNext) < size)
+        {
+            return false;
+        }
+        std::memcpy(pData, mpNext, size);
+        mpNext += size;
+        return true;
+    }
+
+    bool readByte(unsigned char& rByte)
+    {
+        if (mpNext == mpEnd)
+        {
+            return false;
+        }
+        rByte = *mpNext++;
+        return true;
+    }
+
+    /** \brief Reads a string of the given size, failing if the input is shorter. */
+    bool readString(std::string& rString, std::size_t size)
+    {
+        if (static_cast<std::size_t>(mpEnd - mpNext) < size)
+        {
+            return false;
+        }
+        rString.assign(reinterpret_cast<const char*>(mpNext), size);
+        mpNext += size;
+        return true;
+    }
+
+    std::size_t consumed() const
+    {
+        return static_cast<std::size_t>(mpNext - mpBegin);
+    }
+
+private:
+    const unsigned char* mpBegin;
+    const unsigned char* mpNext;
+    const unsigned char* mpEnd;
+};
+
+/**
+* \brief Reads from a stream buffer, taking no byte past the end of the
+* expression so that streams may hold several.
+*/
+class StreamSource
+{
+public:
+    explicit StreamSource(std::streambuf* pStream)
+        : mpStream(pStream)
+    {
+    }
+
+    bool read(void* pData, std::size_t size)
+    {
+        const std::streamsize count = static_cast<std::streamsize>(size);
+        return (mpStream != nullptr) && (mpStream->sgetn(static_cast<char*>(pData), count) == count);
+    }
+
+    bool readByte(unsigned char& rByte)
+    {
+        if (mpStream == nullptr)
+        {
+            return false;
+        }
+        const std::streambuf::int_type c = mpStream->sbumpc();
+        if (std::streambuf::traits_type::eq_int_type(c, std::streambuf::traits_type::eof()))
+        {
+            return false;
+        }
+        rByte = static_cast<unsigned char>(std::streambuf::traits_type::to_char_type(c));
+        return true;
+    }
+
+    /**
+    * \brief Reads a string of the given size. The string grows a chunk at
+    * a time, so a corrupt size cannot allocate more than the stream holds.
+    */
+    bool readString(std::string& rString, std::size_t size)
+    {
+        rString.clear();
+        while (rString.size() < size)
+        {
+            const std::size_t used = rString.size();
+            rString.resize(used + std::min<std::size_t>(size - used, StringChunk));
+            if (!read(&rString[used], rString.size() - used))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    enum : std::size_t { StringChunk = 4096 };
+
+    std::streambuf* mpStream;
+};
+
+} // namespace Internal
+
+///////////////////////////////////////////////////////////////////////
+
+/**
+* \class Serializer
+* \brief Compact, versioned binary encoding of expressions, for moving
+* them between processes without the loss of printing constants.
+*
+* Nodes take one tag byte each, plus the raw bytes of a constant or the
+* varint index of a symbol; names are stored once. Sums and products keep
+* their operand lists, so a decoded expression has the same structure
+* and hash as the one encoded. Values are stored in the byte order of the
+* writer, which a reader of the other order rejects.
+*
+* Serialize() and Deserialize() work on memory. Write() and Read() stream
+* through a 64 KiB block, so the encoding of a very large expression is
+* never held whole, and several expressions may follow one another in a
+* stream. Both walk the tree without recursion.
+*
+* Deserialization checks the header and the structure and returns false
+* on anything malformed, leaving the result untouched.
+* \tparam T Type of evaluation in expression, stored by its bytes.
+*/
+template <class T, class Alloc = std::allocator<T>>
+class Serializer
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Serialized constants are stored as raw bytes");
+
+    typedef Internal::TermNode<T, Alloc> TermNode;
+    typedef Internal::BinaryOperatorNode<T, Alloc> BinaryOperatorNode;
+    typedef Internal::UnaryOperatorNode<T, Alloc> UnaryOperatorNode;
+    typedef Internal::NaryOperatorNode<T, Alloc> NaryOperatorNode;
+    typedef Internal::SumNode<T, Alloc> SumNode;
+    typedef Internal::ProductNode<T, Alloc> ProductNode;
+    typedef Internal::SymbolNode<T, Alloc> SymbolNode;
+    typedef Internal::ConstantNode<T, Alloc> ConstantNode;
+    typedef Internal::BinaryOperator<T> BinaryOperator;
+    typedef Internal::UnaryOperator<T> UnaryOperator;
+    typedef Internal::SerializedTag Tag;
+public:
+    typedef Emblem::Expression<T, Alloc> ExpressionType;
+
+    /** \brief Bumped whenever the encoding changes. */
+    static const std::uint32_t FormatVersion = 1;
+
+    /** \brief Appends the encoding of the expression to the buffer. */
+    static void Serialize(const ExpressionType& rExpression, std::vector<unsigned char>& rBuffer)
+    {
+        Internal::VectorSink sink(rBuffer);
+        Encode(rExpression, sink);
+    }
+
+    /**
+    * \brief Decodes an expression from the start of the data.
+    * \return Number of bytes read, zero if the data is malformed.
+    */
+    static std::size_t Deserialize(const unsigned char* pData, std::size_t size, ExpressionType& rResult)
+    {
+        Internal::BufferSource source(pData, size);
+        return Decode(source, rResult) ? source.consumed() : 0;
+    }
+
+    /** \brief Streams the encoding out, false if the stream fails. */
+    static bool Write(const ExpressionType& rExpression, std::ostream& rOut)
+    {
+        Internal::StreamSink sink(rOut.rdbuf());
+        Encode(rExpression, sink);
+        if (!sink.flush())
+        {
+            rOut.setstate(std::ios_base::badbit);
+            return false;
+        }
+        return true;
+    }
+
+    /** \brief Streams one expression in, false if it is malformed or cut short. */
+    static bool Read(std::istream& rIn, ExpressionType& rResult)
+    {
+        Internal::StreamSource source(rIn.rdbuf());
+        if (!Decode(source, rResult))
+        {
+            rIn.setstate(std::ios_base::failbit);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    template <class Sink>
+    static void WriteVarint(Sink& rSink, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            rSink.writeByte(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        rSink.writeByte(static_cast<unsigned char>(value));
+    }
+
+    template <class Source>
+    static bool ReadVarint(Source& rSource, std::uint32_t& rValue)
+    {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            unsigned char byte;
+            if (!rSource.readByte(byte))
+            {
+                return false;
+            }
+            value |= std::uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                rValue = static_cast<std::uint32_t>(value);
+                return value <= 0xffffffffu;
+            }
+        }
+        return false;
+    }
+
+    static Tag TagOf(const TermNode* pNode);
+
+    template <class Sink>
+    static void Encode(const ExpressionType& rExpression, Sink& rSink);
+
+    template <class Source>
+    static bool Decode(Source& rSource, ExpressionType& rResult);
+
+    /** \brief Builds the node of an operator tag, null for other tags. */
+    static TermNode* CreateOperator(Tag tag);
+
+    static void DeleteTrees(std::vector<TermNode*>& rNodes)
+    {
+        for (TermNode* pNode : rNodes)
+        {
+            Internal::BinaryTree<TermNode> tree;
+            tree.insertToHead(pNode);
+        }
+        rNodes.clear();
+    }
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+const std::uint32_t Serializer<T, Alloc>::FormatVersion;
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+Internal::SerializedTag Serializer<T, Alloc>::TagOf(const TermNode* pNode)
+{
+    typedef typename BinaryOperator::Type BinaryType;
+    typedef typename UnaryOperator::Type UnaryType;
+
+    if (pNode->isSymbol())
+    {
+        return Tag::Symbol;
+    }
+    if (!pNode->isOperator())
+    {
+        return Tag::Constant;
+    }
+    if (const NaryOperatorNode* pNaryOp = dynamic_cast<const NaryOperatorNode*>(pNode))
+    {
+        return (pNaryOp->GetOperator() == BinaryOperator::Addition) ? Tag::Sum : Tag::Product;
+    }
+    if (const BinaryOperatorNode* pBinaryOp = dynamic_cast<const BinaryOperatorNode*>(pNode))
+    {
+        switch (pBinaryOp->GetOperator().GetType())
+        {
+        case BinaryType::Addition: return Tag::Add;
+        case BinaryType::Subtraction: return Tag::Subtract;
+        case BinaryType::Multiplication: return Tag::Multiply;
+        case BinaryType::Division: return Tag::Divide;
+        case BinaryType::Pow: return Tag::Pow;
+        }
+    }
+    switch (static_cast<const UnaryOperatorNode*>(pNode)->GetOperator().GetType())
+    {
+    case UnaryType::Sin: return Tag::Sin;
+    case UnaryType::Cos: return Tag::Cos;
+    case UnaryType::Tan: return Tag::Tan;
+    case UnaryType::Identity: return Tag::Identity;
+    case UnaryType::Abs: return Tag::Abs;
+    case UnaryType::Negate: return Tag::Negate;
+    case UnaryType::Exp: return Tag::Exp;
+    case UnaryType::Ln: return Tag::Ln;
+    case UnaryType::Log10: return Tag::Log10;
+    case UnaryType::Sqrt: return Tag::Sqrt;
+    case UnaryType::Square: return Tag::Square;
+    case UnaryType::Cube: return Tag::Cube;
+    case UnaryType::Reciprocal: return Tag::Reciprocal;
+    }
+    assert(0);
+    return Tag::End;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+typename Serializer<T, Alloc>::TermNode* Serializer<T, Alloc>::CreateOperator(Tag tag)
+{
+    switch (tag)
+    {
+    case Tag::Sum: return new SumNode();
+    case Tag::Product: return new ProductNode();
+    case Tag::Add: return new BinaryOperatorNode(BinaryOperator::Addition);
+    case Tag::Subtract: return new BinaryOperatorNode(BinaryOperator::Subtraction);
+    case Tag::Multiply: return new BinaryOperatorNode(BinaryOperator::Multiplication);
+    case Tag::Divide: return new BinaryOperatorNode(BinaryOperator::Division);
+    case Tag::Pow: return new BinaryOperatorNode(BinaryOperator::Pow);
+    case Tag::Sin: return new UnaryOperatorNode(UnaryOperator::Sin);
+    case Tag::Cos: return new UnaryOperatorNode(UnaryOperator::Cos);
+    case Tag::Tan: return new UnaryOperatorNode(UnaryOperator::Tan);
+    case Tag::Identity: return new UnaryOperatorNode(UnaryOperator::Identity);
+    case Tag::Abs: return new UnaryOperatorNode(UnaryOperator::Abs);
+    case Tag::Negate: return new UnaryOperatorNode(UnaryOperator::Negate);
+    case Tag::Exp: return new UnaryOperatorNode(UnaryOperator::Exp);
+    case Tag::Ln: return new UnaryOperatorNode(UnaryOperator::Ln);
+    case Tag::Log10: return new UnaryOperatorNode(UnaryOperator::Log10);
+    case Tag::Sqrt: return new UnaryOperatorNode(UnaryOperator::Sqrt);
+    case Tag::Square: return new UnaryOperatorNode(UnaryOperator::Square);
+    case Tag::Cube: return new UnaryOperatorNode(UnaryOperator::Cube);
+    case Tag::Reciprocal: return new UnaryOperatorNode(UnaryOperator::Reciprocal);
+    default: return nullptr;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+template <class Sink>
+void Serializer<T, Alloc>::Encode(const ExpressionType& rExpression, Sink& rSink)
+{
+    Internal::SerializedExpressionHeader header;
+    std::memcpy(header.magic, Internal::SerializedExpressionMagic, sizeof(header.magic));
+    header.formatVersion = FormatVersion;
+    header.valueSize = sizeof(T);
+    header.byteOrder = Internal::SerializedByteOrder;
+    rSink.write(&header, sizeof(header));
+
+    struct Frame
+    {
+        const TermNode* pNode;
+        std::size_t operandCount;
+        std::size_t nextOperand;
+    };
+
+    const TermNode* pHead = rExpression.mExpressionTree.head();
+    std::vector<Frame> nodeStack;
+    std::unordered_map<std::string, std::uint32_t> symbolIndices;
+    if (pHead != nullptr)
+    {
+        const Frame head = { pHead, pHead->operandCount(), 0 };
+        nodeStack.push_back(head);
+    }
+    while (!nodeStack.empty())
+    {
+        Frame& rFrame = nodeStack.back();
+        if (rFrame.nextOperand < rFrame.operandCount)
+        {
+            const TermNode* pOperand = rFrame.pNode->operand(rFrame.nextOperand++);
+            const Frame operand = { pOperand, pOperand->operandCount(), 0 };
+            nodeStack.push_back(operand);
+            continue;
+        }
+
+        const TermNode* pNode = rFrame.pNode;
+        const Tag tag = TagOf(pNode);
+        if (tag == Tag::Constant)
+        {
+            rSink.writeByte(static_cast<unsigned char>(tag));
+            rSink.write(&static_cast<const ConstantNode*>(pNode)->GetValue(), sizeof(T));
+        }
+        else if (tag == Tag::Symbol)
+        {
+            const std::string& rName = static_cast<const SymbolNode*>(pNode)->GetSymbol().toString();
+            const auto found = symbolIndices.find(rName);
+            if (found == symbolIndices.end())
+            {
+                symbolIndices.insert(std::make_pair(rName, static_cast<std::uint32_t>(symbolIndices.size())));
+                rSink.writeByte(static_cast<unsigned char>(Tag::NewSymbol));
+                WriteVarint(rSink, rName.size());
+                rSink.write(rName.data(), rName.size());
+            }
+            else
+            {
+                rSink.writeByte(static_cast<unsigned char>(Tag::Symbol));
+                WriteVarint(rSink, found->second);
+            }
+        }
+        else
+        {
+            rSink.writeByte(static_cast<unsigned char>(tag));
+            if ((tag == Tag::Sum) || (tag == Tag::Product))
+            {
+                WriteVarint(rSink, rFrame.operandCount);
+            }
+        }
+        nodeStack.pop_back();
+    }
+    rSink.writeByte(static_cast<unsigned char>(Tag::End));
+}
+
+///////////////////////////////////////////////////////////////////////
+
+template <class T, class Alloc>
+template <class Source>
+bool Serializer<T, Alloc>::Decode(Source& rSource, ExpressionType& rResult)
+{
+    Internal::SerializedExpressionHeader header;
+    if (!rSource.read(&header, sizeof(header)) ||
+            (std::memcmp(header.magic, Internal::SerializedExpressionMagic, sizeof(header.magic)) != 0) ||
+            (header.formatVersion != FormatVersion) ||
+            (header.valueSize != sizeof(T)) ||
+            (header.byteOrder != Internal::SerializedByteOrder))
+    {
+        return false;
+    }
+
+    // Operands wait on a stack until their operator is read.
+    std::vector<TermNode*> operands;
+    std::vector<std::string> symbols;
+    std::string name;
+    while (true)
+    {
+        unsigned char byte;
+        if (!rSource.readByte(byte))
+        {
+            DeleteTrees(operands);
+            return false;
+        }
+
+        const Tag tag = static_cast<Tag>(byte);
+        if (tag == Tag::End)
+        {
+            break;
+        }
+
+        bool isValid = true;
+        if (tag == Tag::Constant)
+        {
+            T value;
+            isValid = rSource.read(&value, sizeof(T));
+            if (isValid)
+            {
+                operands.push_back(new ConstantNode(value));
+            }
+        }
+        else if ((tag == Tag::Symbol) || (tag == Tag::NewSymbol))
+        {
+            std::uint32_t value = 0;
+            isValid = ReadVarint(rSource, value);
+            if (isValid && (tag == Tag::NewSymbol))
+            {
+                isValid = (value != 0) && rSource.readString(name, value);
+                symbols.push_back(name);
+                value = static_cast<std::uint32_t>(symbols.size() - 1);
+            }
+            isValid = isValid && (value < symbols.size());
+            if (isValid)
+            {
+                operands.push_back(new SymbolNode(Symbol<T, Alloc>(symbols[value].c_str())));
+            }
+        }
+        else if ((tag == Tag::Sum) || (tag == Tag::Product))
+        {
+            std::uint32_t count = 0;
+            isValid = ReadVarint(rSource, count) && (count >= 2) && (count <= operands.size());
+            if (isValid)
+            {
+                NaryOperatorNode* pNode = static_cast<NaryOperatorNode*>(CreateOperator(tag));
+                const std::size_t first = operands.size() - count;
+                for (std::size_t i = first; i < operands.size(); ++i)
+                {
+                    pNode->append(operands[i]);
+                }
+                operands.resize(first);
+                operands.push_back(pNode);
+            }
+        }
+        else
+        {
+            TermNode* pNode = CreateOperator(tag);
+            const std::size_t operandCount = (byte < static_cast<unsigned char>(Tag::Sin)) ? 2 : 1;
+            isValid = (pNode != nullptr) && (operandCount <= operands.size());
+            if (isValid && (operandCount == 2))
+            {
+                pNode->setRight(operands.back());
+                operands.pop_back();
+            }
+            if (isValid)
+            {
+                pNode->setLeft(operands.back());
+                operands.back() = pNode;
+            }
+            else
+            {
+                delete pNode;
+            }
+        }
+
+        if (!isValid)
+        {
+            DeleteTrees(operands);
+            return false;
+        }
+    }
+
+    if (operands.size() > 1)
+    {
+        DeleteTrees(operands);
+        return false;
+    }
+    if (operands.empty())
+    {
+        rResult.mExpressionTree.clear();
+    }
+    else
+    {
+        rResult.mExpressionTree.insertToHead(operands.back());
+    }
+    return true;
+}
+
+} // namespace Emblem
@@ -48,6 +48,8 @@ template <class T, class Alloc>
 Emblem::Expression<T, Alloc> log10(const Emblem::Symbol<T, Alloc>& rA);
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> sqrt(const Emblem::Symbol<T, Alloc>& rA);
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(const Emblem::Symbol<T, Alloc>& rA, const T& rB);
 
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> operator+(
@@ -132,28 +134,28 @@ public:
                                     rB.mExpressionTree.clone());
     }
 
-    Expression operator+(Expression&& rB)
+    Expression operator+(Expression&& rB) const
     {
         Expression exprA(*this);
         return Expression::BinaryOp(exprA.mExpressionTree, BinaryOperator::Addition,
                                     rB.mExpressionTree);
     }
 
-    Expression operator-(Expression&& rB)
+    Expression operator-(Expression&& rB) const
     {
         Expression exprA(*this);
         return Expression::BinaryOp(exprA.mExpressionTree, BinaryOperator::Subtraction,
                                     rB.mExpressionTree);
     }
 
-    Expression operator*(Expression&& rB)
+    Expression operator*(Expression&& rB) const
     {
         Expression exprA(*this);
         return Expression::BinaryOp(exprA.mExpressionTree, BinaryOperator::Multiplication,
                                     rB.mExpressionTree);
     }
 
-    Expression operator/(Expression&& rB)
+    Expression operator/(Expression&& rB) const
     {
         Expression exprA(*this);
         return Expression::BinaryOp(exprA.mExpressionTree, BinaryOperator::Division,
@@ -177,6 +179,7 @@ private:
     friend Emblem::Expression<T, Alloc>(::log)(const Emblem::Symbol<T, Alloc>& rA);
     friend Emblem::Expression<T, Alloc>(::log10)(const Emblem::Symbol<T, Alloc>& rA);
     friend Emblem::Expression<T, Alloc>(::sqrt)(const Emblem::Symbol<T, Alloc>& rA);
+    friend Emblem::Expression<T, Alloc>(::pow)(const Emblem::Symbol<T, Alloc>& rA, const T& rB);
 
     friend Emblem::Expression<T, Alloc> (::operator+)(const T& rA, const Emblem::Symbol<T, Alloc>& rB);
     friend Emblem::Expression<T, Alloc> (::operator-)(const T& rA, const Emblem::Symbol<T, Alloc>& rB);
@@ -286,6 +289,19 @@ Emblem::Expression<T, Alloc> sqrt(const Emblem::Symbol<T, Alloc>& rA)
 
 ///////////////////////////////////////////////////////////////////////
 
+template <class T, class Alloc>
+Emblem::Expression<T, Alloc> pow(const Emblem::Symbol<T, Alloc>& rA, const T& rB)
+{
+    using namespace Emblem;
+    using namespace Emblem::Internal;
+    Expression<T, Alloc> exprA(rA);
+    Expression<T, Alloc> exprB(rB);
+    return Expression<T, Alloc>::BinaryOp(exprA.mExpressionTree, BinaryOperator<T>::Pow,
+                                          exprB.mExpressionTree);
+}
+
+///////////////////////////////////////////////////////////////////////
+
 template <class T, class Alloc>
 Emblem::Expression<T, Alloc> operator+(
     const T& rA, const Emblem::Symbol<T, Alloc>& rB)
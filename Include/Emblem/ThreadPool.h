@@ -0,0 +1,150 @@
+/**
+* \file ThreadPool.h
+
+* Copyright (c) 2016, Kevin Knifsend, https://nullbreak.wordpress.com/
+
+* Permission to use, copy, modify, and/or distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+
+* THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+* WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+* ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+* WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+* ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+* OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Emblem
+{
+
+/**
+* \class ThreadPool
+* \brief Fixed set of worker threads running queued tasks in FIFO order.
+*
+* Threads waiting on tasks they queued should help with runPendingTask()
+* rather than block, so that waiting from inside a task cannot starve
+* the pool.
+*/
+class ThreadPool
+{
+public:
+    /** \brief Starts the workers, one per hardware thread by default. */
+    explicit ThreadPool(std::size_t threadCount = DefaultThreadCount())
+        : mIsStopping(false)
+    {
+        mThreads.reserve(threadCount);
+        for (std::size_t i = 0; i < threadCount; ++i)
+        {
+            mThreads.push_back(std::thread(&ThreadPool::work, this));
+        }
+    }
+
+    /** \brief Finishes the queued tasks and joins the workers. */
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mIsStopping = true;
+        }
+        mCondition.notify_all();
+        for (std::thread& rThread : mThreads)
+        {
+            rThread.join();
+        }
+    }
+
+    /** \brief Process-wide pool with the default number of threads. */
+    static ThreadPool& Instance()
+    {
+        static ThreadPool sPool;
+        return sPool;
+    }
+
+    static std::size_t DefaultThreadCount()
+    {
+        const unsigned int count = std::thread::hardware_concurrency();
+        return (count != 0) ? count : 1;
+    }
+
+    std::size_t threadCount() const
+    {
+        return mThreads.size();
+    }
+
+    /**
+    * \brief Queues the task.
+    *
+    * Tasks must not throw. An exception escaping a task calls
+    * std::terminate on a worker and leaves runPendingTask() on a caller.
+    */
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTasks.push_back(std::move(task));
+        }
+        mCondition.notify_one();
+    }
+
+    /**
+    * \brief Runs the oldest queued task on the calling thread.
+    * \return Returns false if the queue was empty.
+    */
+    bool runPendingTask()
+    {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mTasks.empty())
+            {
+                return false;
+            }
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void work()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondition.wait(lock, [this]() { return mIsStopping || !mTasks.empty(); });
+                if (mTasks.empty())
+                {
+                    return;
+                }
+                task = std::move(mTasks.front());
+                mTasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<std::function<void()>> mTasks;
+    std::vector<std::thread> mThreads;
+    bool mIsStopping;
+};
+
+} // namespace Emblem
@@ -17,13 +17,16 @@
 */
 
 #include <iostream>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <thread>
 #include <vector>
 
 using namespace std;
 
 #include "Emblem/Expression.h"
+#include "Emblem/BatchEvaluator.h"
 using namespace Emblem;
 
 
@@ -37,6 +40,70 @@ double eval(Expression<double>::ValueMap& values)
     return sin(((x * y) + (z - x) / 5.0) + z);
 }
 
+/**
+* \brief Compares the cost and accuracy of Taylor polynomials of a heavy
+* expression with the expression itself, on rows scattered around the
+* expansion point.
+*/
+void benchmarkTaylor()
+{
+    Expression<double>::Symbol x("x"), y("y");
+    const Expression<double> expr =
+        exp(-(x * x)) * sin(x * y * 3.0) + log(x * x + y * y + 1.0) * cos(y) +
+        sqrt(x + 4.0) / (y * y + 1.0) + tan(x * 0.5 - y * 0.25);
+    const Expression<double>::ValueMap point = { {x, 0.4}, {y, 0.7} };
+
+    const size_t rowCount = 1 << 16;
+    const int repeats = 20;
+    std::vector<double> xs(rowCount), ys(rowCount), exact(rowCount), approximate(rowCount);
+
+    const auto timeRows = [&](const Expression<double>& rExpr, std::vector<double>& rResults)
+    {
+        const BatchEvaluator<double> evaluator(rExpr);
+        std::vector<BatchInput<double>> inputs;
+        for (const std::string& rSymbol : evaluator.symbols())
+        {
+            inputs.push_back(BatchInput<double>::Varying((rSymbol == "x") ? xs.data() : ys.data()));
+        }
+        evaluator.evaluate(inputs.data(), rowCount, rResults.data());
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i)
+        {
+            evaluator.evaluate(inputs.data(), rowCount, rResults.data());
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / (double(repeats) * rowCount);
+    };
+
+    std::cout << "\nTaylor polynomials around x = 0.4, y = 0.7\n";
+    for (const double radius : { 0.01, 0.1 })
+    {
+        for (size_t i = 0; i < rowCount; ++i)
+        {
+            xs[i] = 0.4 + radius * std::sin(double(i));
+            ys[i] = 0.7 + radius * std::cos(double(i) * 1.3);
+        }
+        const double exactTime = timeRows(expr, exact);
+        std::cout << "Radius " << radius << ": expression " << exactTime << " ns/row\n";
+
+        for (size_t order = 1; order <= 5; ++order)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const Expression<double> taylor = expr.taylor(point, order);
+            const std::chrono::duration<double, std::micro> buildTime = std::chrono::steady_clock::now() - start;
+
+            const double time = timeRows(taylor, approximate);
+            double maxError = 0.0;
+            for (size_t i = 0; i < rowCount; ++i)
+            {
+                maxError = std::max(maxError, std::abs(approximate[i] - exact[i]));
+            }
+            std::cout << "  order " << order << ": " << time << " ns/row, max error " << maxError
+                      << ", built in " << buildTime.count() << " us\n";
+        }
+    }
+}
+
 int main()
 {
     Expression<double>::Symbol x("x"), y("y"), z("z");
@@ -54,6 +121,8 @@ int main()
 
     std::cout << "Expression: " << expr << '\n';
 
+    benchmarkTaylor();
+
     std::cout << "\nProgram finished..\n";
     cin.get();
     return 0;
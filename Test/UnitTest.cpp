@@ -4,9 +4,30 @@
 #include "gtest\gtest.h"
 
 #include "Emblem/Expression.h"
+#include "Emblem/IncrementalEvaluator.h"
+#include "Emblem/EvaluatorCache.h"
+#include "Emblem/ProgramCache.h"
+#include "Emblem/Polynomial.h"
+#include "Emblem/BatchEvaluator.h"
+#include "Emblem/ClosureEvaluator.h"
+#include "Emblem/Evaluator.h"
+#include "Emblem/FastMath.h"
+#include "Emblem/LookupTableCache.h"
+#include "Emblem/MixedPrecisionEvaluator.h"
+#include "Emblem/Pack.h"
+#include "Emblem/Parser.h"
+#include "Emblem/Serialization.h"
 using namespace Emblem;
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 const double gDoubleTol = 1e-16;
 
@@ -208,6 +229,1505 @@ TEST(GeneralTest, Derivative)
     int a = 0;
 }
 
+TEST(IncrementalEvaluatorTest, MatchesEvaluate)
+{
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    Expression<double>::ValueMap values = { { x, 4.0 },{ y, 3.0 },{ z, 2.0 } };
+    const Expression<double> expression = sin(((x * y) + (z - x) / 5.0) + z);
+
+    IncrementalEvaluator<double> evaluator(expression);
+    ASSERT_NEAR(evaluator.evaluate(values), expression.evaluate(values), gDoubleTol);
+    ASSERT_EQ(evaluator.recomputedNodeCount(), 5u);
+
+    values[z] = 7.0;
+    ASSERT_NEAR(evaluator.evaluate(values), expression.evaluate(values), gDoubleTol);
+    ASSERT_EQ(evaluator.recomputedNodeCount(), 4u);
+}
+
+TEST(IncrementalEvaluatorTest, OnlyDirtyPathRecomputed)
+{
+    const Expression<double>::Symbol x("x"), y("y"), z("z"), w("w");
+    const Expression<double> expression = (x * y) + (z * w);
+
+    IncrementalEvaluator<double> evaluator(expression);
+    evaluator.setValue(x, 1.0);
+    evaluator.setValue(y, 2.0);
+    evaluator.setValue(z, 3.0);
+    evaluator.setValue(w, 4.0);
+    ASSERT_NEAR(evaluator.evaluate(), 14.0, gDoubleTol);
+    ASSERT_EQ(evaluator.recomputedNodeCount(), 3u);
+
+    evaluator.setValue(w, 5.0);
+    ASSERT_NEAR(evaluator.evaluate(), 17.0, gDoubleTol);
+    ASSERT_EQ(evaluator.recomputedNodeCount(), 2u);
+
+    // Unchanged values do not dirty anything.
+    evaluator.setValue(x, 1.0);
+    ASSERT_NEAR(evaluator.evaluate(), 17.0, gDoubleTol);
+    ASSERT_EQ(evaluator.recomputedNodeCount(), 0u);
+}
+
+TEST(HashTest, EqualExpressions)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double> exprA = sin(x * y) + 2.0;
+    const Expression<double> exprB = sin(x * y) + 2.0;
+    const Expression<double> exprC = sin(y * x) + 2.0;
+    const Expression<double> exprD = sin(x * y) + 3.0;
+
+    ASSERT_EQ(exprA.hash(), exprB.hash());
+    ASSERT_TRUE(exprA == exprB);
+    ASSERT_NE(exprA.hash(), exprC.hash());
+    ASSERT_FALSE(exprA == exprC);
+    ASSERT_TRUE(exprA != exprD);
+
+    const Expression<double> copy = exprA;
+    ASSERT_EQ(copy.hash(), exprA.hash());
+    ASSERT_TRUE(copy == exprA);
+
+    ASSERT_EQ(std::hash<Expression<double>>()(exprA),
+              std::hash<Expression<double>>()(exprB));
+}
+
+TEST(HashTest, SubstitutionUpdatesHash)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    Expression<double> expression = y * y + 10.0;
+    const Expression<double> expected = (1.0 + x) * (1.0 + x) + 10.0;
+    ASSERT_FALSE(expression == expected);
+
+    expression.substitute(y, 1.0 + x);
+    ASSERT_EQ(expression.hash(), expected.hash());
+    ASSERT_TRUE(expression == expected);
+}
+
+/** Evaluator taking its symbol values positionally, for cache tests. */
+struct PositionalEvaluator
+{
+    Expression<double> expression;
+    std::vector<std::string> symbols;
+
+    double evaluate(const std::vector<double>& rArgs) const
+    {
+        Expression<double>::ValueMap values;
+        for (size_t i = 0; i < symbols.size(); ++i)
+        {
+            values[symbols[i]] = rArgs[i];
+        }
+        return expression.evaluate(values);
+    }
+};
+
+typedef EvaluatorCache<PositionalEvaluator> PositionalCache;
+
+std::shared_ptr<const PositionalEvaluator> MakePositionalEvaluator(
+    const Expression<double>& rExpr, const std::vector<std::string>& rSymbols)
+{
+    std::shared_ptr<PositionalEvaluator> pEvaluator(new PositionalEvaluator);
+    pEvaluator->expression = rExpr;
+    pEvaluator->symbols = rSymbols;
+    return pEvaluator;
+}
+
+TEST(EvaluatorCacheTest, HitModuloRenaming)
+{
+    const Expression<double>::Symbol x("x"), y("y"), a("a"), b("b");
+    const Expression<double> exprA = x * y + sin(x);
+    const Expression<double> exprB = a * b + sin(a);
+    const Expression<double> exprC = a * b + sin(b);
+
+    PositionalCache cache;
+    const PositionalCache::Result resultA = cache.getOrCreate(exprA, MakePositionalEvaluator);
+    ASSERT_FALSE(resultA.isHit);
+
+    const PositionalCache::Result resultB = cache.getOrCreate(exprB, MakePositionalEvaluator);
+    ASSERT_TRUE(resultB.isHit);
+    ASSERT_EQ(resultA.pEvaluator, resultB.pEvaluator);
+    ASSERT_EQ(resultB.symbols, std::vector<std::string>({ "a", "b" }));
+
+    const Expression<double>::ValueMap values = { { a, 2.0 },{ b, 3.0 } };
+    ASSERT_NEAR(resultB.pEvaluator->evaluate({ 2.0, 3.0 }), exprB.evaluate(values), gDoubleTol);
+
+    const PositionalCache::Result resultC = cache.getOrCreate(exprC, MakePositionalEvaluator);
+    ASSERT_FALSE(resultC.isHit);
+
+    const PositionalCache::Statistics statistics = cache.statistics();
+    ASSERT_EQ(statistics.hits, 1u);
+    ASSERT_EQ(statistics.misses, 2u);
+    ASSERT_EQ(statistics.entryCount, 2u);
+}
+
+TEST(EvaluatorCacheTest, EvictsLeastRecentlyUsed)
+{
+    const Expression<double>::Symbol x("x");
+    const Expression<double> exprA = sin(x);
+    const Expression<double> exprB = cos(x);
+    const Expression<double> exprC = tan(x);
+
+    PositionalCache cache;
+    cache.getOrCreate(exprA, MakePositionalEvaluator);
+    const size_t entrySize = cache.statistics().memoryUsage;
+    cache.setMemoryBudget(2 * entrySize);
+
+    cache.getOrCreate(exprB, MakePositionalEvaluator);
+    cache.getOrCreate(exprA, MakePositionalEvaluator);
+    cache.getOrCreate(exprC, MakePositionalEvaluator);
+
+    ASSERT_EQ(cache.statistics().evictions, 1u);
+    ASSERT_TRUE(cache.find(exprA).isHit);
+    ASSERT_FALSE(cache.find(exprB).isHit);
+    ASSERT_TRUE(cache.find(exprC).isHit);
+}
+
+TEST(EvaluatorCacheTest, CountsRetainedExpressions)
+{
+    const Expression<double>::Symbol x("x");
+    Expression<double> large = x;
+    for (int i = 1; i < 100; ++i)
+    {
+        large = sin(large) * (double)i - x;
+    }
+
+    // The entries keep a copy of the expression, so a larger tree costs
+    // more of the budget even with an evaluator of fixed size.
+    PositionalCache cache;
+    cache.getOrCreate(sin(x), MakePositionalEvaluator);
+    const size_t smallSize = cache.statistics().memoryUsage;
+    cache.clear();
+    cache.getOrCreate(large, MakePositionalEvaluator);
+    const size_t largeSize = cache.statistics().memoryUsage;
+    ASSERT_GT(largeSize, 3 * smallSize);
+    ASSERT_GE(largeSize, large.nodeCount() * sizeof(Internal::BinaryOperatorNode<double, std::allocator<double>>));
+
+    cache.clear();
+    cache.setMemoryBudget(largeSize + smallSize);
+    cache.getOrCreate(sin(x), MakePositionalEvaluator);
+    cache.getOrCreate(cos(x), MakePositionalEvaluator);
+    cache.getOrCreate(tan(x), MakePositionalEvaluator);
+    cache.getOrCreate(exp(x), MakePositionalEvaluator);
+    ASSERT_EQ(cache.statistics().evictions, 0u);
+
+    cache.getOrCreate(large, MakePositionalEvaluator);
+    ASSERT_EQ(cache.statistics().evictions, 3u);
+    ASSERT_TRUE(cache.find(large).isHit);
+    ASSERT_TRUE(cache.find(exp(x)).isHit);
+}
+
+TEST(EvaluatorCacheTest, ConcurrentAccess)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double> expression = x * y + 1.0;
+    PositionalCache& rCache = PositionalCache::Instance();
+    rCache.clear();
+
+    std::vector<std::thread> threads;
+    std::vector<double> results(8, 0.0);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            for (int j = 0; j < 100; ++j)
+            {
+                const PositionalCache::Result result =
+                    rCache.getOrCreate(expression, MakePositionalEvaluator);
+                results[i] = result.pEvaluator->evaluate({ 2.0, 3.0 });
+            }
+        });
+    }
+    for (std::thread& rThread : threads)
+    {
+        rThread.join();
+    }
+
+    for (double result : results)
+    {
+        ASSERT_NEAR(result, 7.0, gDoubleTol);
+    }
+    ASSERT_EQ(rCache.statistics().entryCount, 1u);
+    ASSERT_EQ(rCache.statistics().hits + rCache.statistics().misses, 800u);
+}
+
+TEST(ProgramTest, MatchesEvaluate)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 0.5}, {y, 3.0} };
+    const Expression<double> expression =
+        sin(x) * y * y - exp(x) / (y + 1.0) + sqrt(abs(-y));
+
+    const Program<double> program(expression);
+    ASSERT_EQ(program.symbols().size(), 2u);
+    ASSERT_NEAR(program.evaluate(values), expression.evaluate(values), gDoubleTol);
+}
+
+TEST(ProgramCacheTest, LoadsStoredProgram)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 2.0}, {y, 5.0} };
+    const Expression<double> expression = x * y + cos(x) - 4.0;
+
+    const std::string directory = ::testing::TempDir() + "EmblemProgramCacheTest";
+    ProgramCache<double> writer(directory);
+    std::remove(writer.path(expression.hash()).c_str());
+    const Program<double> compiled = writer.getOrCompile(expression);
+    ASSERT_EQ(writer.statistics().compilations, 1u);
+
+    ProgramCache<double> reader(directory);
+    const Program<double> loaded = reader.getOrCompile(expression);
+    ASSERT_EQ(reader.statistics().loads, 1u);
+    ASSERT_EQ(reader.statistics().compilations, 0u);
+    ASSERT_EQ(loaded.symbols(), compiled.symbols());
+    ASSERT_NEAR(loaded.evaluate(values), expression.evaluate(values), gDoubleTol);
+
+    // Other flags compile another program.
+    OptimizationFlags flags;
+    flags.fuseMultiplyAdd = !flags.fuseMultiplyAdd;
+    std::remove(reader.path(expression.hash(), flags).c_str());
+    const Program<double> toggled = reader.getOrCompile(expression, flags);
+    ASSERT_EQ(reader.statistics().compilations, 1u);
+    ASSERT_EQ(toggled.flags().fuseMultiplyAdd, flags.fuseMultiplyAdd);
+    ASSERT_EQ(reader.getOrCompile(expression, flags).flags().fuseMultiplyAdd, flags.fuseMultiplyAdd);
+    ASSERT_EQ(reader.statistics().loads, 2u);
+
+    // A file of another expression under a colliding hash is rejected.
+    const Expression<double> other = x - y;
+    std::vector<char> bytes(4096);
+    std::FILE* pFile = std::fopen(writer.path(expression.hash()).c_str(), "rb");
+    ASSERT_NE(pFile, nullptr);
+    bytes.resize(std::fread(bytes.data(), 1, bytes.size(), pFile));
+    std::fclose(pFile);
+    const std::uint64_t otherHash = other.hash();
+    std::memcpy(&bytes[8], &otherHash, sizeof(otherHash));
+    pFile = std::fopen(writer.path(otherHash).c_str(), "wb");
+    ASSERT_NE(pFile, nullptr);
+    std::fwrite(bytes.data(), 1, bytes.size(), pFile);
+    std::fclose(pFile);
+    Program<double> collided;
+    ASSERT_FALSE(reader.load(other, collided));
+    ASSERT_EQ(reader.statistics().rejections, 1u);
+    std::remove(writer.path(otherHash).c_str());
+}
+
+TEST(ProgramCacheTest, CorruptFileIsRecompiled)
+{
+    const Expression<double>::Symbol x("x");
+    const Expression<double>::ValueMap values = { {x, 3.0} };
+    const Expression<double> expression = x * x + 2.0 * x;
+
+    const std::string directory = ::testing::TempDir() + "EmblemProgramCacheTest";
+    ProgramCache<double> cache(directory);
+    cache.store(expression, Program<double>(expression));
+
+    // Flip a byte of the payload.
+    const std::string path = cache.path(expression.hash());
+    std::FILE* pFile = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(pFile, nullptr);
+    std::fseek(pFile, -1, SEEK_END);
+    const int lastByte = std::fgetc(pFile);
+    std::fseek(pFile, -1, SEEK_END);
+    std::fputc(lastByte ^ 0xff, pFile);
+    std::fclose(pFile);
+
+    const Program<double> program = cache.getOrCompile(expression);
+    ASSERT_EQ(cache.statistics().rejections, 1u);
+    ASSERT_EQ(cache.statistics().compilations, 1u);
+    ASSERT_NEAR(program.evaluate(values), 15.0, gDoubleTol);
+
+    // The recompiled program replaced the corrupt file.
+    ProgramCache<double> reader(directory);
+    reader.getOrCompile(expression);
+    ASSERT_EQ(reader.statistics().loads, 1u);
+}
+
+TEST(PolynomialTest, ExpandCollectsLikeTerms)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 1.5}, {y, -2.0} };
+    const Expression<double> expression = (x + y) * (x - y) + 2.0 * (y * y) - x + x;
+
+    Polynomial<double> polynomial;
+    ASSERT_TRUE(Polynomial<double>::FromExpression(expression, polynomial));
+    ASSERT_EQ(polynomial.termCount(), 2u);
+    ASSERT_EQ(polynomial.degree(), 2u);
+    ASSERT_NEAR(polynomial.coefficient({ 2, 0 }), 1.0, gDoubleTol);
+    ASSERT_NEAR(polynomial.coefficient({ 0, 2 }), 1.0, gDoubleTol);
+    ASSERT_NEAR(polynomial.coefficient({ 1, 1 }), 0.0, gDoubleTol);
+
+    const Expression<double> expanded = Expand(expression);
+    ASSERT_NEAR(expanded.evaluate(values), expression.evaluate(values), gDoubleTol);
+
+    // Powers are built from squares and cubes rather than a chain of multiplies.
+    Polynomial<double> power;
+    ASSERT_TRUE(Polynomial<double>::FromExpression(pow(x, 12.0) * y, power));
+    const Expression<double> powerExpression = power.toExpression(Polynomial<double>::Form::Expanded);
+    ASSERT_NEAR(powerExpression.evaluate(values), std::pow(1.5, 12.0) * -2.0, 1e-9);
+    ASSERT_LE(powerExpression.operationCount().multiplications, 5u);
+
+    Polynomial<double> notPolynomial;
+    ASSERT_FALSE(Polynomial<double>::FromExpression(sin(x) * y, notPolynomial));
+    ASSERT_FALSE(Polynomial<double>::FromExpression(x / y, notPolynomial));
+}
+
+TEST(PolynomialTest, HornerMatchesEvaluate)
+{
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    const Expression<double>::ValueMap values = { {x, 0.75}, {y, -1.25}, {z, 2.0} };
+    const Expression<double> expression =
+        (x + 2.0 * y + 1.0) * (x - y * z) * (x * x + 3.0) * (z - 1.0) / 4.0;
+
+    Polynomial<double> polynomial;
+    ASSERT_TRUE(Polynomial<double>::FromExpression(expression, polynomial));
+
+    const double expected = expression.evaluate(values);
+    ASSERT_NEAR(polynomial.evaluate(values), expected, 1e-12);
+    ASSERT_NEAR(polynomial.toExpression().evaluate(values), expected, 1e-12);
+    ASSERT_NEAR(polynomial.toExpression(Polynomial<double>::Form::Expanded).evaluate(values),
+                expected, 1e-12);
+
+    // Horner needs fewer multiplies than evaluating each monomial on its own.
+    size_t monomialMultiplies = 0;
+    for (size_t term = 0; term < polynomial.termCount(); ++term)
+    {
+        for (size_t symbol = 0; symbol < polynomial.symbols().size(); ++symbol)
+        {
+            monomialMultiplies += polynomial.exponents(term)[symbol];
+        }
+    }
+    ASSERT_LT(polynomial.multiplyCount(), monomialMultiplies);
+}
+
+size_t CountOpCode(const Program<double>& rProgram, Internal::OpCode opCode)
+{
+    size_t count = 0;
+    for (const Internal::Instruction& rInstruction : rProgram.instructions())
+    {
+        count += (rInstruction.opCode == opCode) ? 1 : 0;
+    }
+    return count;
+}
+
+TEST(StrengthReductionTest, PowBecomesMultiplies)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 1.25}, {y, 0.5} };
+    Expression<double> expression =
+        pow(x, 5.0) + pow(x * y + 1.0, 6.0) + pow(y, 0.5) + pow(x, 2.5) + pow(x - y, -1.0);
+    const double expected = expression.evaluate(values);
+
+    Expression<double> exact = expression;
+    exact.optimize();
+    ASSERT_NEAR(exact.evaluate(values), expected, 1e-12);
+
+    // Half-integer powers differ from sqrt at -0 and -inf, and expanding
+    // powers above a cube rounds more than pow.
+    const Program<double> program(exact);
+    ASSERT_EQ(CountOpCode(program, Internal::OpCode::Pow), 4u);
+    ASSERT_EQ(CountOpCode(program, Internal::OpCode::Reciprocal), 1u);
+    Expression<double> cube = pow(x, 3.0);
+    cube.optimize();
+    ASSERT_EQ(CountOpCode(Program<double>(cube), Internal::OpCode::Cube), 1u);
+    Expression<double> root = pow(x, 0.5);
+    root.optimize();
+    const Expression<double>::ValueMap negativeZero = { {x, -0.0} };
+    ASSERT_FALSE(std::signbit(root.evaluate(negativeZero)));
+    ASSERT_FALSE(std::signbit(Program<double>(root).evaluate(negativeZero)));
+
+    OptimizationFlags flags;
+    flags.fastMath = true;
+    expression.optimize(flags);
+    ASSERT_NEAR(expression.evaluate(values), expected, 1e-12);
+    ASSERT_EQ(CountOpCode(Program<double>(expression), Internal::OpCode::Pow), 0u);
+
+    // The rewritten powers can still be differentiated.
+    Expression<double> powers = x * x + pow(x, 3.0) - 1.0 / (x * y);
+    powers.optimize();
+    ASSERT_NEAR(powers.derivative(x).evaluate(values), 2 * 1.25 + 3 * 1.25 * 1.25 + 1 / (1.25 * 1.25 * 0.5),
+                1e-12);
+}
+
+TEST(StrengthReductionTest, DivisionNeedsFastMath)
+{
+    const Expression<double>::Symbol x("x"), y("y"), d("d");
+    const Expression<double>::ValueMap values = { {x, 1.5}, {y, -2.0}, {d, 3.0} };
+    const Expression<double> expression = x / 4.0 + y / 3.0 + (x / d - y / d);
+    const double expected = expression.evaluate(values);
+
+    // Only the exact division by a power of two is rewritten by default.
+    Expression<double> exact = expression;
+    exact.optimize();
+    ASSERT_EQ(exact.evaluate(values), expected);
+    ASSERT_EQ(CountOpCode(Program<double>(exact), Internal::OpCode::Divide), 3u);
+
+    OptimizationFlags flags;
+    flags.fastMath = true;
+    Expression<double> fast = expression;
+    fast.optimize(flags);
+    ASSERT_NEAR(fast.evaluate(values), expected, 1e-12);
+    ASSERT_EQ(CountOpCode(Program<double>(fast), Internal::OpCode::Divide), 1u);
+}
+
+TEST(StrengthReductionTest, ReducesLongChains)
+{
+    const Expression<double>::Symbol x("x"), y("y"), a("a"), b("b"), c("c"), d("d");
+    const Expression<double>::ValueMap values =
+        { {x, 1.1}, {y, -0.7}, {a, 0.3}, {b, 2.5}, {c, -1.25}, {d, 3.0} };
+
+    // Chains of three or more operands are n-ary nodes.
+    Expression<double> cube = x * x * x;
+    const double cubeValue = cube.evaluate(values);
+    cube.optimize();
+    ASSERT_EQ(cube.evaluate(values), cubeValue);
+    ASSERT_EQ(CountOpCode(Program<double>(cube), Internal::OpCode::Cube), 1u);
+    ASSERT_EQ(CountOpCode(Program<double>(cube), Internal::OpCode::Multiply), 0u);
+
+    Expression<double> product = x * x * x * x * y;
+    const double productValue = product.evaluate(values);
+    Expression<double> exact = product;
+    exact.optimize();
+    ASSERT_EQ(exact.evaluate(values), productValue);
+    ASSERT_EQ(CountOpCode(Program<double>(exact), Internal::OpCode::Cube), 1u);
+    ASSERT_EQ(CountOpCode(Program<double>(exact), Internal::OpCode::Multiply), 2u);
+
+    // Repeated factors elsewhere in the chain are only gathered under fastMath.
+    OptimizationFlags flags;
+    flags.fastMath = true;
+    Expression<double> scattered = y * x * x * y * x * x;
+    const double scatteredValue = scattered.evaluate(values);
+    scattered.optimize();
+    ASSERT_EQ(CountOpCode(Program<double>(scattered), Internal::OpCode::Multiply), 5u);
+    scattered.optimize(flags);
+    ASSERT_NEAR(scattered.evaluate(values), scatteredValue, 1e-12);
+    ASSERT_EQ(CountOpCode(Program<double>(scattered), Internal::OpCode::Square), 3u);
+    ASSERT_EQ(CountOpCode(Program<double>(scattered), Internal::OpCode::Multiply), 1u);
+
+    Expression<double> sum = a / d + b / d + c / d;
+    const double sumValue = sum.evaluate(values);
+    Expression<double> separate = sum;
+    separate.optimize();
+    ASSERT_EQ(CountOpCode(Program<double>(separate), Internal::OpCode::Divide), 3u);
+    sum.optimize(flags);
+    ASSERT_NEAR(sum.evaluate(values), sumValue, 1e-12);
+    ASSERT_EQ(CountOpCode(Program<double>(sum), Internal::OpCode::Divide), 1u);
+
+    Expression<double> mixed = a / d + x + b / y + c / d;
+    const double mixedValue = mixed.evaluate(values);
+    mixed.optimize(flags);
+    ASSERT_NEAR(mixed.evaluate(values), mixedValue, 1e-12);
+    ASSERT_EQ(CountOpCode(Program<double>(mixed), Internal::OpCode::Divide), 2u);
+}
+
+TEST(ProgramTest, FusesMultiplyAddAndSinCos)
+{
+    const Expression<double>::Symbol a("a"), b("b"), t("t");
+    const Expression<double>::ValueMap values = { {a, 0.3}, {b, -1.7}, {t, 0.9} };
+    const Expression<double> expression =
+        a * sin(t * 2.0) + b * cos(t * 2.0) - a * b + sin(t * 2.0) * cos(t * 2.0);
+    const double expected = expression.evaluate(values);
+
+    OptimizationFlags flags;
+    flags.fuseMultiplyAdd = true;
+    const Program<double> fused(expression, flags);
+    ASSERT_NEAR(fused.evaluate(values), expected, 1e-12);
+    ASSERT_EQ(fused.temporaryCount(), 2u);
+    ASSERT_EQ(CountOpCode(fused, Internal::OpCode::Sin), 0u);
+    ASSERT_EQ(CountOpCode(fused, Internal::OpCode::Cos), 0u);
+    ASSERT_EQ(CountOpCode(fused, Internal::OpCode::SinCos), 1u);
+    ASSERT_EQ(CountOpCode(fused, Internal::OpCode::LoadTemporary), 3u);
+    ASSERT_EQ(CountOpCode(fused, Internal::OpCode::Add) +
+              CountOpCode(fused, Internal::OpCode::Subtract), 0u);
+
+    flags.fuseMultiplyAdd = false;
+    const Program<double> unfused(expression, flags);
+    ASSERT_NEAR(unfused.evaluate(values), expected, 1e-12);
+    ASSERT_LT(fused.instructions().size(), unfused.instructions().size());
+}
+
+TEST(MinimizeOperationsTest, FactorsCommonTerms)
+{
+    const Expression<double>::Symbol a("a"), b("b"), t("t"), x("x"), y("y"), z("z");
+    const Expression<double>::ValueMap values =
+        { {a, 0.3}, {b, -1.7}, {t, 0.9}, {x, 2.5}, {y, -0.4}, {z, 1.1} };
+
+    Expression<double> expression = a * x + a * y + a * z + x + x * 2.0;
+    double expected = expression.evaluate(values);
+    OptimizationReport report = expression.minimizeOperations();
+    ASSERT_EQ(report.before.total(), 8u);
+    ASSERT_LT(report.after.total(), report.before.total());
+    ASSERT_EQ(report.after.total(), expression.operationCount().total());
+    ASSERT_NEAR(expression.evaluate(values), expected, 1e-12);
+
+    expression = a * sin(t) + b * sin(t) - sin(t) * 2.0 * a;
+    expected = expression.evaluate(values);
+    report = expression.minimizeOperations();
+    ASSERT_EQ(report.before.transcendentals, 3u);
+    ASSERT_EQ(report.after.transcendentals, 1u);
+    ASSERT_NEAR(expression.evaluate(values), expected, 1e-12);
+
+    // Nothing to gain, the expression is kept as it is.
+    expression = a * x + b;
+    const std::uint64_t hash = expression.hash();
+    report = expression.minimizeOperations();
+    ASSERT_EQ(report.after.total(), report.before.total());
+    ASSERT_EQ(expression.hash(), hash);
+}
+
+TEST(OptimizeTest, ReassociateBalancesChains)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 0.75}, {y, 1.5} };
+
+    // Built right to left, so every partial sum is pending at once.
+    Expression<double> expression = x;
+    for (int i = 1; i < 1024; ++i)
+    {
+        expression = x * (double)i + std::move(expression);
+    }
+    const double expected = expression.evaluate(values);
+    ASSERT_GE(Program<double>(expression).stackSize(), 1024u);
+
+    OptimizationFlags flags;
+    expression.optimize(flags);
+    ASSERT_GE(Program<double>(expression).stackSize(), 1024u);
+
+    flags.reassociate = true;
+    expression.optimize(flags);
+    ASSERT_LE(Program<double>(expression).stackSize(), 24u);
+    ASSERT_NEAR(expression.evaluate(values), expected, std::abs(expected) * 1e-12);
+}
+
+TEST(NaryNodeTest, LongChainsAreFlattened)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 0.75}, {y, -1.25} };
+
+    Expression<double> sum = x;
+    double expected = 0.75;
+    for (int i = 1; i < 10000; ++i)
+    {
+        sum = std::move(sum) + y * (double)i;
+        expected += -1.25 * i;
+    }
+
+    // Operands are still added left to right, so results are bit identical.
+    ASSERT_EQ(sum.evaluate(values), expected);
+    ASSERT_EQ(sum.operationCount().additions, 9999u);
+    OptimizationFlags flags;
+    flags.fuseMultiplyAdd = false;
+    ASSERT_EQ(Program<double>(sum, flags).evaluate(values), expected);
+    ASSERT_NEAR(sum.derivative(y).evaluate(values), 49995000.0, 1e-6);
+
+    const Expression<double> product = x * y * x * 3.0;
+    ASSERT_TRUE(product == x * y * x * 3.0);
+    ASSERT_NE(product.hash(), (x * y * 3.0).hash());
+    ASSERT_NEAR(product.derivative(x).evaluate(values), 6.0 * 0.75 * -1.25, gDoubleTol);
+
+    Expression<double> substituted = product;
+    substituted.substitute(y, x + 1.0);
+    ASSERT_NEAR(substituted.evaluate(values), 0.75 * 1.75 * 0.75 * 3.0, gDoubleTol);
+}
+
+TEST(DeepTreeTest, MillionLevelsWithoutRecursion)
+{
+    const Expression<double>::Symbol x("x");
+    const Expression<double>::ValueMap values = { {x, 0.5} };
+
+    {
+        Expression<double> deep = x;
+        for (int i = 0; i < 1000000; ++i)
+        {
+            deep = -std::move(deep);
+        }
+        ASSERT_EQ(deep.evaluate(values), 0.5);
+
+        const Expression<double> copy = deep;
+        ASSERT_TRUE(copy == deep);
+        ASSERT_EQ(copy.evaluate(values), 0.5);
+        ASSERT_EQ(deep.derivative(x).evaluate(values), 1.0);
+    }
+
+    // Right-deep chains cannot be flattened into sums.
+    Expression<double> chain = x;
+    for (int i = 0; i < 1000000; ++i)
+    {
+        chain = x - std::move(chain);
+    }
+    ASSERT_EQ(chain.evaluate(values), 0.5);
+    ASSERT_EQ(chain.derivative(x).evaluate(values), 1.0);
+
+    // Output and operation minimization walk the tree with stacks too.
+    std::ostringstream text;
+    text << chain;
+    ASSERT_EQ(text.str().size(), 1000000u * 6 - 1);
+
+    Expression<double> nested = x;
+    for (int i = 0; i < 1000000; ++i)
+    {
+        nested = sin(std::move(nested));
+    }
+    const double expected = nested.evaluate(values);
+    nested.minimizeOperations();
+    ASSERT_EQ(nested.evaluate(values), expected);
+}
+
+TEST(ParallelEvaluationTest, MatchesSequential)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double>::ValueMap values = { {x, 0.25}, {y, -1.5} };
+
+    // Balanced tree of about 100k nodes, alternating sums and differences
+    // so that no level is flattened.
+    std::vector<Expression<double>> terms;
+    for (int i = 0; i < 16384; ++i)
+    {
+        terms.push_back(sin(x * (double)i) + y);
+    }
+    for (bool isSum = true; terms.size() > 1; isSum = !isSum)
+    {
+        std::vector<Expression<double>> combined;
+        for (std::size_t i = 0; i + 1 < terms.size(); i += 2)
+        {
+            combined.push_back(isSum ? std::move(terms[i]) + std::move(terms[i + 1])
+                               : std::move(terms[i]) - std::move(terms[i + 1]));
+        }
+        terms.swap(combined);
+    }
+    const Expression<double>& expression = terms.front();
+    const double expected = expression.evaluate(values);
+
+    // Operations are not reordered, so results are bit identical.
+    ThreadPool pool(4);
+    ParallelOptions options;
+    options.pThreadPool = &pool;
+    options.taskThreshold = 1024;
+    ASSERT_EQ(expression.evaluateParallel(values, options), expected);
+
+    options.taskThreshold = 1u << 30;
+    ASSERT_EQ(expression.evaluateParallel(values, options), expected);
+
+    // Without workers the calling thread runs every task.
+    ThreadPool callerOnly(0);
+    options.pThreadPool = &callerOnly;
+    options.taskThreshold = 1024;
+    ASSERT_EQ(expression.evaluateParallel(values, options), expected);
+    ASSERT_EQ((x * y).evaluateParallel(values), 0.25 * -1.5);
+
+    // A missing symbol fails every task, and the error reaches the caller
+    // only after all of them have returned.
+    const Expression<double>::ValueMap missing = { {x, 0.25} };
+    ASSERT_THROW(expression.evaluateParallel(missing, options), std::out_of_range);
+    options.pThreadPool = &pool;
+    ASSERT_THROW(expression.evaluateParallel(missing, options), std::out_of_range);
+    ASSERT_EQ(expression.evaluateParallel(values, options), expected);
+}
+
+TEST(BatchEvaluatorTest, HoistsUniformSubtrees)
+{
+    const Expression<double>::Symbol x("x"), a("a"), b("b");
+    const Expression<double> expression =
+        sin(a * b) * x + exp(b) / (a + 2.0) - x * x * a + cos(b);
+
+    const std::size_t rowCount = 1000;
+    std::vector<double> xs(rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        xs[i] = 0.001 * i - 0.5;
+    }
+
+    BatchEvaluator<double> evaluator(expression);
+    BatchEvaluator<double>::InputMap inputs;
+    inputs[x] = BatchInput<double>::Varying(xs.data());
+    inputs[a] = BatchInput<double>::Uniform(1.25);
+    inputs[b] = BatchInput<double>::Uniform(-0.75);
+
+    std::vector<double> results(rowCount);
+    evaluator.evaluate(inputs, rowCount, results.data());
+    for (std::size_t i = 0; i < rowCount; i += 37)
+    {
+        const Expression<double>::ValueMap values = { {x, xs[i]}, {a, 1.25}, {b, -0.75} };
+        ASSERT_EQ(results[i], expression.evaluate(values));
+    }
+
+    // Only the steps reading x remain per row.
+    std::vector<BatchInput<double>> positional;
+    for (const std::string& rSymbol : evaluator.symbols())
+    {
+        positional.push_back(inputs[rSymbol]);
+    }
+    ASSERT_EQ(evaluator.rowOperationCount(positional.data()), 5u);
+    ASSERT_LT(evaluator.rowOperationCount(positional.data()), evaluator.operationCount());
+
+    // Uniform inputs throughout still fill every row.
+    inputs[x] = BatchInput<double>::Uniform(0.5);
+    evaluator.evaluate(inputs, rowCount, results.data());
+    const Expression<double>::ValueMap values = { {x, 0.5}, {a, 1.25}, {b, -0.75} };
+    ASSERT_EQ(results.front(), expression.evaluate(values));
+    ASSERT_EQ(results.back(), expression.evaluate(values));
+}
+
+TEST(BatchEvaluatorTest, ReadsStridedInputsInPlace)
+{
+    struct Row
+    {
+        double x;
+        float weight;
+        double y;
+    };
+
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    const Expression<double> expression = sin(x) * y + x / (z + 2.0) - z * y;
+
+    const std::size_t rowCount = 500;
+    std::vector<Row> rows(rowCount);
+    // z is the second channel of a buffer interleaving three.
+    std::vector<double> interleaved(3 * rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        rows[i].x = 0.01 * i - 2.5;
+        rows[i].weight = 1.0f;
+        rows[i].y = 1.0 / (i + 1.0);
+        interleaved[3 * i + 1] = 0.5 * std::cos(0.1 * i);
+    }
+
+    BatchEvaluator<double> evaluator(expression);
+    BatchEvaluator<double>::InputMap inputs;
+    inputs[x] = BatchInput<double>::Member(rows.data(), &Row::x);
+    inputs[y] = BatchInput<double>::Member(rows.data(), &Row::y);
+    inputs[z] = BatchInput<double>::Strided(&interleaved[1], 3 * sizeof(double));
+
+    std::vector<double> results(rowCount);
+    evaluator.evaluate(inputs, rowCount, results.data());
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        const Expression<double>::ValueMap values =
+            { {x, rows[i].x}, {y, rows[i].y}, {z, interleaved[3 * i + 1]} };
+        ASSERT_EQ(results[i], expression.evaluate(values));
+    }
+
+    // Strided operands mix with columns and uniform values.
+    std::vector<double> ys(rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        ys[i] = rows[i].y;
+    }
+    inputs[y] = BatchInput<double>::Varying(ys.data());
+    inputs[z] = BatchInput<double>::Uniform(0.25);
+    std::vector<double> mixed(rowCount);
+    evaluator.evaluate(inputs, rowCount, mixed.data());
+    const Expression<double>::ValueMap values = { {x, rows[7].x}, {y, ys[7]}, {z, 0.25} };
+    ASSERT_EQ(mixed[7], expression.evaluate(values));
+
+    // A lone symbol copies its rows out.
+    const Expression<double> lone(x);
+    BatchEvaluator<double> identity(lone);
+    const BatchInput<double> input = BatchInput<double>::Member(rows.data(), &Row::x);
+    identity.evaluate(&input, rowCount, results.data());
+    ASSERT_EQ(results[123], rows[123].x);
+}
+
+TEST(BatchEvaluatorTest, TilesMatchWholeBatch)
+{
+    const Expression<double>::Symbol x("x"), y("y"), a("a");
+    const Expression<double> expression =
+        sqrt(x * x + y * y) * a - exp(-x) / (y + 3.0) + x * y * a * cos(x);
+
+    // Not a multiple of any tile size, so the last tile is partial.
+    const std::size_t rowCount = 5003;
+    std::vector<double> xy(2 * rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        xy[2 * i] = 0.001 * i;
+        xy[2 * i + 1] = 1.0 - 0.0003 * i;
+    }
+
+    BatchEvaluator<double> evaluator(expression);
+    BatchEvaluator<double>::InputMap inputs;
+    inputs[x] = BatchInput<double>::Strided(&xy[0], 2 * sizeof(double));
+    inputs[y] = BatchInput<double>::Strided(&xy[1], 2 * sizeof(double));
+    inputs[a] = BatchInput<double>::Uniform(0.75);
+
+    evaluator.setTileRows(rowCount);
+    std::vector<double> whole(rowCount);
+    evaluator.evaluate(inputs, rowCount, whole.data());
+
+    const std::size_t tileRows[] = { 1, 64, 1000, 0 };
+    for (std::size_t rows : tileRows)
+    {
+        evaluator.setTileRows(rows);
+        std::vector<double> tiled(rowCount);
+        evaluator.evaluate(inputs, rowCount, tiled.data());
+        ASSERT_EQ(tiled, whole);
+    }
+
+    std::vector<BatchInput<double>> positional;
+    for (const std::string& rSymbol : evaluator.symbols())
+    {
+        positional.push_back(inputs[rSymbol]);
+    }
+    evaluator.setTileRows(96);
+    ASSERT_EQ(evaluator.tileRows(positional.data()), 96u);
+
+    // A pinned budget fixes the tile size.
+    BatchTiling tiling;
+    tiling.setCacheBudget(64 * 1024);
+    ASSERT_EQ(tiling.tileRows(7, sizeof(double)), 1024u);
+    const std::size_t minTileRows = BatchTiling::MinTileRows;
+    ASSERT_EQ(tiling.tileRows(1000, sizeof(double)), minTileRows);
+
+    const std::size_t budget = BatchTiling::Calibrate();
+    ASSERT_GE(budget, 16u * 1024);
+    ASSERT_LE(budget, 4u * 1024 * 1024);
+
+    // The reported cache size is used where there is one.
+    const std::size_t detected = BatchTiling::DetectCacheBudget();
+    ASSERT_GE(detected, 16u * 1024);
+    ASSERT_LE(detected, 4u * 1024 * 1024);
+    const std::size_t cacheSize = Internal::DataCacheSize(2);
+    if ((cacheSize >= 32u * 1024) && (cacheSize <= 8u * 1024 * 1024))
+    {
+        ASSERT_EQ(detected, cacheSize / 2);
+    }
+}
+
+TEST(EvaluatorTest, SelectsBackendFromWorkload)
+{
+    typedef Evaluator<double> EvaluatorType;
+    const BackendCosts costs;
+
+    // A single call is not worth compiling, many are, and large batches
+    // amortize the per-call cost of batch evaluation.
+    ASSERT_EQ(EvaluatorType::SelectBackend(20, 41, 1, 1, 1, costs), EvaluationBackend::TreeWalk);
+    ASSERT_EQ(EvaluatorType::SelectBackend(20, 41, 100, 1, 1, costs), EvaluationBackend::Closure);
+    ASSERT_EQ(EvaluatorType::SelectBackend(20, 41, 1000000, 1, 1, costs), EvaluationBackend::Program);
+    ASSERT_EQ(EvaluatorType::SelectBackend(20, 41, 100, 10000, 1, costs), EvaluationBackend::Batch);
+    ASSERT_EQ(EvaluatorType::SelectBackend(1000000, 2000001, 1, 1, 8, costs),
+              EvaluationBackend::Parallel);
+    ASSERT_EQ(EvaluatorType::SelectBackend(1000000, 2000001, 1, 1, 1, costs),
+              EvaluationBackend::TreeWalk);
+
+    // Whether the tree splits into tasks depends on its nodes, leaves included.
+    const std::size_t threshold = ParallelOptions().taskThreshold;
+    ASSERT_EQ(EvaluatorType::SelectBackend(threshold, 2 * threshold + 1, 1, 1, 8, costs),
+              EvaluationBackend::Parallel);
+    ASSERT_EQ(EvaluatorType::SelectBackend(threshold, threshold + 1, 1, 1, 8, costs),
+              EvaluationBackend::TreeWalk);
+
+    const BackendCosts calibrated = EvaluatorType::CalibrateCosts();
+    ASSERT_GT(calibrated.treeWalkOperation, 0.0);
+    ASSERT_GT(calibrated.closureOperation, 0.0);
+    ASSERT_GT(calibrated.programOperation, 0.0);
+    ASSERT_GT(calibrated.batchOperation, 0.0);
+}
+
+TEST(EvaluatorTest, MatchesExpressionAndTiersUp)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double> expression = sin(x) * y + x / (y + 2.0) - exp(-x * y);
+
+    const std::size_t rowCount = 100;
+    std::vector<double> xs(rowCount), ys(rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        xs[i] = 0.03 * i - 1.5;
+        ys[i] = 1.0 + 0.01 * i;
+    }
+
+    ThreadPool pool(0);
+    EvaluatorOptions options;
+    options.pThreadPool = &pool;
+    options.hotCallCount = 0;
+
+    const std::size_t expectedCalls[] = { 1, 1000000, 1000 };
+    const std::size_t batchSizes[] = { 1, 1, 4096 };
+    const EvaluationBackend backends[] =
+        { EvaluationBackend::TreeWalk, EvaluationBackend::Program, EvaluationBackend::Batch };
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+        options.expectedCalls = expectedCalls[k];
+        options.batchSize = batchSizes[k];
+        Evaluator<double> evaluator(expression, options);
+        ASSERT_EQ(evaluator.backend(), backends[k]);
+
+        std::vector<BatchInput<double>> inputs;
+        for (const std::string& rSymbol : evaluator.symbols())
+        {
+            inputs.push_back(BatchInput<double>::Varying((rSymbol == "x") ? xs.data() : ys.data()));
+        }
+        std::vector<double> results(rowCount);
+        evaluator.evaluate(inputs.data(), rowCount, results.data());
+        for (std::size_t i = 0; i < rowCount; i += 9)
+        {
+            const Expression<double>::ValueMap values = { {x, xs[i]}, {y, ys[i]} };
+            const double expected = expression.evaluate(values);
+            ASSERT_NEAR(results[i], expected, 1e-12);
+            ASSERT_NEAR(evaluator.evaluate(values), expected, 1e-12);
+        }
+    }
+
+    // Once hot, a formula expected to run once moves to closures, and to a
+    // program when hotter still. With no workers the compiles only run when
+    // waited for.
+    options.expectedCalls = 1;
+    options.batchSize = 1;
+    options.hotCallCount = 64;
+    Evaluator<double> evaluator(expression, options);
+    ASSERT_EQ(evaluator.backend(), EvaluationBackend::TreeWalk);
+    const Expression<double>::ValueMap values = { {x, 0.25}, {y, 1.75} };
+    for (std::size_t i = 0; i < 200; ++i)
+    {
+        evaluator.evaluate(values);
+    }
+    ASSERT_TRUE(evaluator.isCompiling());
+    ASSERT_EQ(evaluator.backend(), EvaluationBackend::TreeWalk);
+    evaluator.waitForCompile();
+    ASSERT_FALSE(evaluator.isCompiling());
+    ASSERT_EQ(evaluator.backend(), EvaluationBackend::Closure);
+    ASSERT_EQ(evaluator.evaluate(values), expression.evaluate(values));
+
+    for (std::size_t i = 0; i < 1000; ++i)
+    {
+        evaluator.evaluate(values);
+    }
+    evaluator.waitForCompile();
+    ASSERT_EQ(evaluator.backend(), EvaluationBackend::Program);
+    ASSERT_NEAR(evaluator.evaluate(values), expression.evaluate(values), 1e-12);
+    ASSERT_EQ(evaluator.callCount(), 1202u);
+}
+
+TEST(ClosureEvaluatorTest, MatchesExpression)
+{
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    std::vector<Expression<double>> expressions;
+    expressions.push_back(x * 2.0 + 3.0 / y - z);
+    expressions.push_back(sin(x) * cos(y) + exp(-z) * sqrt(x * x + y * y));
+    expressions.push_back(pow(x, 3.0) - abs(y - z) / log(z + 4.0) + log10(y + 2.0));
+    expressions.push_back(x * y * z * 2.0 + x + y + z + 1.0);
+    expressions.push_back(Expression<double>(x));
+    expressions.push_back(Expression<double>(2.5));
+    for (Expression<double>& rExpression : expressions)
+    {
+        rExpression.optimize();
+    }
+
+    const Expression<double>::ValueMap values = { {x, 0.75}, {y, -1.25}, {z, 2.5} };
+    for (const Expression<double>& rExpression : expressions)
+    {
+        const ClosureEvaluator<double> evaluator(rExpression);
+        ASSERT_FALSE(evaluator.empty());
+        ASSERT_EQ(evaluator.evaluate(values), rExpression.evaluate(values));
+
+        std::vector<double> symbolValues;
+        for (const std::string& rSymbol : evaluator.symbols())
+        {
+            symbolValues.push_back(values.at(rSymbol));
+        }
+        ASSERT_EQ(evaluator.evaluate(symbolValues.data()), rExpression.evaluate(values));
+    }
+
+    // Too deep to evaluate recursively.
+    Expression<double> chain = x;
+    for (std::size_t i = 0; i <= ClosureEvaluator<double>::MaxDepth; ++i)
+    {
+        chain = -std::move(chain);
+    }
+    ASSERT_TRUE(ClosureEvaluator<double>(chain).empty());
+
+    // Wide sums loop over their operands and do not count as deep.
+    Expression<double> sum = x;
+    for (int i = 1; i <= 5000; ++i)
+    {
+        sum = std::move(sum) + y * (double)i;
+    }
+    const ClosureEvaluator<double> wide(sum);
+    ASSERT_FALSE(wide.empty());
+    ASSERT_EQ(wide.evaluate(values), sum.evaluate(values));
+}
+
+TEST(PackTest, EvaluatesOneLanePerInput)
+{
+    typedef Pack<double, 4> Pack4;
+    const Expression<double>::Symbol x("x"), y("y");
+    Expression<double> expression =
+        sin(x) * y + pow(x, 2.0) - abs(y - 1.0) / sqrt(x + 2.0) + exp(-y) * log(x + 3.0) +
+        log10(y + 4.0) + x * y * 3.0 + x + y + 1.0;
+    expression.optimize();
+
+    const double xs[] = { 0.25, 0.5, 1.0, 2.0 };
+    const double ys[] = { -1.0, 0.0, 0.75, 3.0 };
+    std::unordered_map<std::string, Pack4> values;
+    values[x] = Pack4::Load(xs);
+    values[y] = Pack4::Load(ys);
+
+    const Pack4 results = expression.evaluateAs(values);
+    for (std::size_t lane = 0; lane < Pack4::Size; ++lane)
+    {
+        const Expression<double>::ValueMap laneValues = { {x, xs[lane]}, {y, ys[lane]} };
+        ASSERT_EQ(results[lane], expression.evaluate(laneValues));
+    }
+
+    // Constants broadcast to every lane.
+    const Expression<double> constant(2.5);
+    ASSERT_EQ(constant.evaluateAs(values)[3], 2.5);
+}
+
+TEST(MixedPrecisionEvaluatorTest, StaysWithinTargetError)
+{
+    typedef MixedPrecisionEvaluator<double> MixedEvaluator;
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    const Expression<double> expression =
+        (sin(x) * y + x * y * y - exp(y) / (x + 2.0)) * 1e-3 + z;
+
+    const Expression<float> single = expression.cast<float>();
+    const Expression<float>::ValueMap singleValues = { {"x", 0.5f}, {"y", 1.5f}, {"z", 150.0f} };
+    const Expression<double>::ValueMap values = { {x, 0.5}, {y, 1.5}, {z, 150.0} };
+    ASSERT_NEAR(single.evaluate(singleValues), expression.evaluate(values), 1e-4);
+
+    MixedEvaluator::RangeMap ranges;
+    ranges[x] = Interval<double>(0.0, 1.0);
+    ranges[y] = Interval<double>(1.0, 2.0);
+    ranges[z] = Interval<double>(100.0, 200.0);
+
+    // The small term feeding the sum can be computed in float.
+    const MixedEvaluator mixed(expression, ranges, 1e-7);
+    ASSERT_GT(mixed.lowPrecisionOperationCount(), 0u);
+    ASSERT_LT(mixed.lowPrecisionOperationCount(), mixed.operationCount());
+    ASSERT_LE(mixed.predictedError(), 1e-7);
+    ASSERT_LE(mixed.measureError(1000), mixed.predictedError());
+
+    const std::size_t rowCount = 5000;
+    std::vector<double> xs(rowCount), ys(rowCount), mixedResults(rowCount), results(rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        xs[i] = static_cast<double>(i) / rowCount;
+        ys[i] = 1.0 + xs[i];
+    }
+    std::vector<BatchInput<double>> inputs;
+    for (const std::string& rSymbol : mixed.symbols())
+    {
+        inputs.push_back((rSymbol == "x") ? BatchInput<double>::Varying(xs.data())
+                         : (rSymbol == "y") ? BatchInput<double>::Varying(ys.data())
+                         : BatchInput<double>::Uniform(150.0));
+    }
+    mixed.evaluate(inputs.data(), rowCount, mixedResults.data());
+    const BatchEvaluator<double> plain(expression);
+    plain.evaluate(inputs.data(), rowCount, results.data());
+    // The bound is relative to the smallest result, about 100.
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        ASSERT_NEAR(mixedResults[i], results[i], 100.0 * mixed.predictedError());
+    }
+
+    // Too tight a target, or a symbol of unknown range, keeps everything
+    // in double.
+    const MixedEvaluator exact(expression, ranges, 1e-12);
+    ASSERT_EQ(exact.lowPrecisionOperationCount(), 0u);
+    ranges.erase(y);
+    const MixedEvaluator unbounded(expression, ranges, 1e-3);
+    ASSERT_EQ(unbounded.lowPrecisionOperationCount(), 0u);
+}
+
+TEST(FastMathTest, TiersMeetTheirAccuracy)
+{
+    std::vector<double> xs, positives;
+    for (int i = -2000; i <= 2000; ++i)
+    {
+        xs.push_back(i * 0.0137);
+        positives.push_back(std::pow(10.0, i * 0.15));
+    }
+
+    const auto largestError = [](double (*pApproximate)(const double&), double (*pExact)(double),
+                                 const std::vector<double>& rValues, bool isRelative)
+    {
+        double largest = 0.0;
+        for (const double x : rValues)
+        {
+            const double exact = pExact(x);
+            const double error = std::abs(pApproximate(x) - exact);
+            largest = std::max(largest, isRelative ? error / std::abs(exact) : error);
+        }
+        return largest;
+    };
+    double (*pSin)(double) = std::sin;
+    double (*pExp)(double) = std::exp;
+    double (*pLog)(double) = std::log;
+
+    ASSERT_LT(largestError(FastSin<Accuracy::High, double>, pSin, xs, false), 1e-12);
+    ASSERT_LT(largestError(FastSin<Accuracy::Medium, double>, pSin, xs, false), 1e-7);
+    ASSERT_LT(largestError(FastSin<Accuracy::Low, double>, pSin, xs, false), 1e-4);
+    ASSERT_LT(largestError(FastExp<Accuracy::High, double>, pExp, xs, true), 1e-12);
+    ASSERT_LT(largestError(FastExp<Accuracy::Low, double>, pExp, xs, true), 1e-4);
+    ASSERT_LT(largestError(FastLn<Accuracy::High, double>, pLog, positives, true), 1e-12);
+    ASSERT_LT(largestError(FastLn<Accuracy::Medium, double>, pLog, positives, true), 1e-7);
+
+    // The kernels keep the special values of the library functions.
+    ASSERT_EQ(FastLn<Accuracy::Low>(0.0), -std::numeric_limits<double>::infinity());
+    ASSERT_TRUE(std::isnan(FastLn<Accuracy::Low>(-1.0)));
+    ASSERT_EQ(FastExp<Accuracy::Low>(1000.0), std::numeric_limits<double>::infinity());
+    ASSERT_EQ(FastExp<Accuracy::Low>(-1000.0), 0.0);
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double infinity = std::numeric_limits<double>::infinity();
+    ASSERT_TRUE(std::isnan(FastExp<Accuracy::Low>(nan)));
+    ASSERT_TRUE(std::isnan(FastSin<Accuracy::High>(nan)));
+    ASSERT_TRUE(std::isnan(FastCos<Accuracy::High>(infinity)));
+    ASSERT_FALSE(std::isnan(FastSin<Accuracy::High>(1e20)));
+
+    // Column kernels match the scalar functions.
+    std::vector<double> columnResults(xs.size());
+    FastCos<Accuracy::Medium>(xs.data(), xs.size(), columnResults.data());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        ASSERT_NEAR(columnResults[i], FastCos<Accuracy::Medium>(xs[i]), 1e-15);
+    }
+
+    // The fused sine and cosine share a reduction but match the separate ones.
+    for (const double x : xs)
+    {
+        double sine, cosine;
+        FastSinCos<Accuracy::High>(x, sine, cosine);
+        ASSERT_EQ(sine, FastSin<Accuracy::High>(x));
+        ASSERT_EQ(cosine, FastCos<Accuracy::High>(x));
+    }
+
+    // A batch evaluator at a tier uses the kernels.
+    const Expression<double>::Symbol x("x");
+    const Expression<double> expression = sin(x) * exp(x * 0.1) + log(x * x + 1.0);
+    BatchEvaluator<double> evaluator(expression);
+    evaluator.setAccuracy(Accuracy::Medium);
+    const BatchInput<double> input = BatchInput<double>::Varying(xs.data());
+    std::vector<double> results(xs.size());
+    evaluator.evaluate(&input, xs.size(), results.data());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        const Expression<double>::ValueMap values = { {x, xs[i]} };
+        ASSERT_NEAR(results[i], expression.evaluate(values), 1e-6);
+        ASSERT_NEAR(results[i], FastSin<Accuracy::Medium>(xs[i]) * FastExp<Accuracy::Medium>(xs[i] * 0.1)
+                    + FastLn<Accuracy::Medium>(xs[i] * xs[i] + 1.0), 1e-12);
+    }
+
+    // So do programs and closures, also where sin and cos share a sincos.
+    const Expression<double> withCos = expression + cos(x);
+    Program<double> program(withCos);
+    program.setAccuracy(Accuracy::Medium);
+    const ClosureEvaluator<double> closures(withCos, Accuracy::Medium);
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        const double approximate = results[i] + FastCos<Accuracy::Medium>(xs[i]);
+        ASSERT_NEAR(program.evaluate(&xs[i]), approximate, 1e-12);
+        ASSERT_NEAR(closures.evaluate(&xs[i]), approximate, 1e-12);
+    }
+}
+
+TEST(LookupTableTest, DomainsReplaceTranscendentals)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double> expression = sin(x) * exp(y) + log(x + 1.0);
+
+    BatchEvaluator<double>::DomainMap domains;
+    domains["x"] = Interval<double>(0.0, 3.0);
+    domains["y"] = Interval<double>(-1.0, 1.0);
+    BatchEvaluator<double> evaluator(expression);
+    evaluator.setDomains(domains, 1e-7);
+    ASSERT_EQ(evaluator.tableCount(), 3u);
+
+    const std::size_t rowCount = 3001;
+    std::vector<double> xs(rowCount), ys(rowCount), results(rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        xs[i] = 3.0 * static_cast<double>(i) / (rowCount - 1);
+        ys[i] = std::cos(static_cast<double>(i));
+    }
+    std::vector<BatchInput<double>> inputs;
+    for (const std::string& rSymbol : evaluator.symbols())
+    {
+        inputs.push_back(BatchInput<double>::Varying((rSymbol == "x") ? xs.data() : ys.data()));
+    }
+    evaluator.evaluate(inputs.data(), rowCount, results.data());
+    // Each table is within 1e-7, and sin is scaled by at most e.
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        const Expression<double>::ValueMap values = { {x, xs[i]}, {y, ys[i]} };
+        ASSERT_NEAR(results[i], expression.evaluate(values), 5e-7);
+    }
+
+    // Another evaluator over the same domains shares the tables.
+    LookupTableCache<double>& rCache = LookupTableCache<double>::Instance();
+    const std::uint64_t hits = rCache.statistics().hits;
+    BatchEvaluator<double> other(expression);
+    other.setDomains(domains, 1e-7);
+    ASSERT_EQ(rCache.statistics().hits, hits + 3);
+    ASSERT_EQ(rCache.getOrCreate(Internal::OpCode::Sin, domains["x"], 1e-7),
+              rCache.getOrCreate(Internal::OpCode::Sin, domains["x"], 1e-7));
+
+    // Singular or unbounded operands are computed.
+    ASSERT_EQ(LookupTable<double>::Create(Internal::OpCode::Ln, Interval<double>(-1.0, 1.0), 1e-7), nullptr);
+    domains.erase("y");
+    other.setDomains(domains, 1e-7);
+    ASSERT_EQ(other.tableCount(), 2u);
+    other.setDomains(BatchEvaluator<double>::DomainMap(), 1e-7);
+    ASSERT_EQ(other.tableCount(), 0u);
+}
+
+TEST(ChebyshevApproximationTest, MeetsToleranceOverInterval)
+{
+    const Expression<double>::Symbol x("x");
+    const Expression<double> curve = exp(-x) * sin(x * 3.0) + sqrt(x + 1.0);
+
+    const ChebyshevApproximation<double> approximation =
+        curve.approximate(x, Interval<double>(0.0, 4.0), 1e-10);
+    ASSERT_TRUE(approximation.meetsTolerance());
+    ASSERT_LE(approximation.maxObservedError(), 1e-10);
+    ASSERT_LT(approximation.pieceCount(), 64u);
+
+    std::vector<double> xs, results(4001);
+    for (int i = 0; i <= 4000; ++i)
+    {
+        xs.push_back(i * 0.001);
+    }
+    approximation.evaluate(xs.data(), xs.size(), results.data());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        const Expression<double>::ValueMap values = { {x, xs[i]} };
+        ASSERT_NEAR(results[i], curve.evaluate(values), 1e-10);
+    }
+
+    // Steeper functions are split into more pieces.
+    const Expression<double> runge = 1.0 / (x * x * 25.0 + 1.0);
+    const ChebyshevApproximation<double> rungeApproximation =
+        runge.approximate(x, Interval<double>(-1.0, 1.0), 1e-12);
+    ASSERT_TRUE(rungeApproximation.meetsTolerance());
+    ASSERT_GT(rungeApproximation.pieceCount(), approximation.pieceCount());
+    for (int i = -1000; i <= 1000; ++i)
+    {
+        const Expression<double>::ValueMap values = { {x, i * 0.001} };
+        ASSERT_NEAR(rungeApproximation(i * 0.001), runge.evaluate(values), 1e-12);
+    }
+
+    // A polynomial of low degree is fitted by a single short piece.
+    const Expression<double> cubic = x * x * x - x * 2.0 + 1.0;
+    const ChebyshevApproximation<double> cubicApproximation =
+        cubic.approximate(x, Interval<double>(-2.0, 3.0), 1e-9);
+    ASSERT_EQ(cubicApproximation.pieceCount(), 1u);
+    ASSERT_EQ(cubicApproximation.coefficientCount(), 4u);
+
+    // A kink is still unresolved at the deepest bisection, even where the
+    // samples happen to be within the tolerance.
+    const Expression<double> kink = abs(x - 1.0 / 3.0);
+    const ChebyshevApproximation<double> kinkApproximation =
+        kink.approximate(x, Interval<double>(0.0, 1.0), 4e-6);
+    ASSERT_LE(kinkApproximation.maxObservedError(), 4e-6);
+    ASSERT_FALSE(kinkApproximation.meetsTolerance());
+
+    // Other symbols cannot be approximated over.
+    const Expression<double>::Symbol y("y");
+    ASSERT_TRUE((curve * y).approximate(x, Interval<double>(0.0, 1.0), 1e-6).empty());
+    ASSERT_TRUE(curve.approximate(y, Interval<double>(0.0, 1.0), 1e-6).empty());
+}
+
+TEST(TaylorTest, MatchesDerivativesAtPoint)
+{
+    const Expression<double>::Symbol x("x"), y("y");
+    const Expression<double> expression = exp(x) * cos(y) + x / (y + 1.0) + sqrt(x * y + 2.0);
+    const Expression<double>::ValueMap point = { {x, 0.5}, {y, 0.25} };
+
+    // Derivatives up to the order agree at the point.
+    const Expression<double> rational = x * x * y / (y + 1.0) + x / (x * y + 2.0);
+    const Expression<double> rationalTaylor = rational.taylor(point, 3);
+    ASSERT_NEAR(rationalTaylor.evaluate(point), rational.evaluate(point), 1e-14);
+    ASSERT_NEAR(rationalTaylor.derivative(y).evaluate(point),
+                rational.derivative(y).evaluate(point), 1e-12);
+    const Expression<double> polynomial = x * x * y * 3.0 + x * y * y * y - x + 2.0;
+    const Expression<double> taylor = polynomial.taylor(point, 3);
+    const Expression<double> dx = polynomial.derivative(x);
+    const Expression<double> dxy = dx.derivative(y);
+    const Expression<double> dxyy = dxy.derivative(y);
+    ASSERT_NEAR(taylor.derivative(x).evaluate(point), dx.evaluate(point), 1e-12);
+    ASSERT_NEAR(taylor.derivative(x).derivative(y).evaluate(point), dxy.evaluate(point), 1e-12);
+    ASSERT_NEAR(taylor.derivative(x).derivative(y).derivative(y).evaluate(point),
+                dxyy.evaluate(point), 1e-12);
+
+    // The error shrinks with the order near the point.
+    const Expression<double>::ValueMap nearby = { {x, 0.52}, {y, 0.23} };
+    double previousError = 1.0;
+    for (std::size_t order = 1; order <= 5; ++order)
+    {
+        const double error = std::abs(expression.taylor(point, order).evaluate(nearby) -
+                                      expression.evaluate(nearby));
+        ASSERT_LT(error, previousError * 0.1);
+        previousError = error;
+    }
+
+    // In x alone, y keeps its value in the point.
+    const Expression<double> inX = expression.taylor(point, 4, { x });
+    const Expression<double>::ValueMap xOnly = { {x, 0.55} };
+    const Expression<double>::ValueMap xAtY = { {x, 0.55}, {y, 0.25} };
+    ASSERT_NEAR(inX.evaluate(xOnly), expression.evaluate(xAtY), 1e-7);
+
+    // Polynomials are reproduced, also through a zero base.
+    const Expression<double> cubic = pow(x, 3.0) - x * y * 2.0;
+    const Expression<double>::ValueMap origin = { {x, 0.0}, {y, 0.0} };
+    const Expression<double> cubicTaylor = cubic.taylor(origin, 3);
+    ASSERT_NEAR(cubicTaylor.evaluate(nearby), cubic.evaluate(nearby), 1e-15);
+    ASSERT_EQ(cubic.taylor(origin, 1).evaluate(nearby), 0.0);
+
+    // Many symbols at a higher order stay cheap to expand.
+    std::vector<Expression<double>::Symbol> symbols;
+    Expression<double>::ValueMap centre, offset;
+    Expression<double> sum = 0.0;
+    for (int i = 0; i < 20; ++i)
+    {
+        symbols.emplace_back(("s" + std::to_string(i)).c_str());
+        centre[symbols.back()] = 0.1 * i;
+        offset[symbols.back()] = 0.1 * i + 0.01;
+        sum = sum + symbols.back();
+    }
+    const Expression<double> quartic = sum * sum + symbols[0] * symbols[5] * symbols[10] * symbols[19];
+    ASSERT_NEAR(quartic.taylor(centre, 4).evaluate(offset), quartic.evaluate(offset), 1e-9);
+}
+
+TEST(ParserTest, ReadsOutputSyntax)
+{
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    const Expression<double>::ValueMap values = { {x, 0.7}, {y, 1.3}, {z, 2.1} };
+    const Expression<double> expressions[] =
+    {
+        sin((x * y) + (z - x) / 5.0 + z),
+        exp(x) * log(y) - log10(z) / sqrt(x + y),
+        abs(x - z) + pow(x + 1.0, 2.0) * cos(y) - tan(x * 0.5),
+        y - (x * -0.25) + 1.0 / (z * z),
+        (x - y) - (z - x),
+        -(x + y),
+        (x / y) / (z / x),
+        pow(Expression<double>(-2.0), 2.0) * x - x / -(y * z)
+    };
+
+    // Whatever Output() writes reads back to an equal expression.
+    Parser<double> parser;
+    for (const Expression<double>& rExpression : expressions)
+    {
+        std::ostringstream text;
+        text << std::setprecision(17) << rExpression;
+        Expression<double> parsed(0.0);
+        ASSERT_TRUE(parser.parse(text.str(), parsed)) << text.str();
+        ASSERT_DOUBLE_EQ(parsed.evaluate(values), rExpression.evaluate(values)) << text.str();
+    }
+
+    // The suffixed forms, and left associativity.
+    Expression<double> parsed(0.0);
+    ASSERT_TRUE(parser.parse("(x + 1)^2 + (y)^3 - (z)^(1/2) * 1/(x) + e^(y) + ln(z) + |-x|", parsed));
+    const double expected = std::pow(1.7, 2) + std::pow(1.3, 3) - std::sqrt(2.1) * (1 / 0.7) +
+                            std::exp(1.3) + std::log(2.1) + 0.7;
+    ASSERT_NEAR(parsed.evaluate(values), expected, 1e-12);
+    ASSERT_TRUE(parser.parse("2 ^ 3 ^ 2 - 8 / 2 / 2 - -x ^ 2", parsed));
+    ASSERT_NEAR(parsed.evaluate(values), 64.0 - 2.0 + 0.49, 1e-12);
+
+    // Chains read as binary operations equal the sums and products the
+    // operators fold them into, but regrouping them does not.
+    const Expression<double> chain = x * y * z + x + y * 2.0 + z;
+    Expression<double> read(0.0);
+    ASSERT_TRUE(parser.parse("x * y * z + x + y * 2 + z", read));
+    ASSERT_TRUE(read == chain);
+    ASSERT_EQ(read.hash(), chain.hash());
+    std::vector<std::string> readSymbols, chainSymbols;
+    ASSERT_EQ(read.canonicalHash(readSymbols), chain.canonicalHash(chainSymbols));
+    ASSERT_TRUE(read.isRenamingOf(chain));
+    ASSERT_TRUE(parser.parse("x + (y + z)", read));
+    ASSERT_FALSE(read == x + y + z);
+    ASSERT_NE(read.hash(), (x + y + z).hash());
+
+    // Errors give the offset of the offending character.
+    const struct
+    {
+        const char* pText;
+        std::size_t position;
+    } errors[] =
+    {
+        { "x * ", 4 },
+        { "sin(x + y", 0 },
+        { "x + )", 4 },
+        { "x $ y", 2 },
+        { "(x + y|", 6 },
+        { "", 0 }
+    };
+    for (const auto& rError : errors)
+    {
+        ASSERT_FALSE(parser.parse(rError.pText, parsed)) << rError.pText;
+        ASSERT_EQ(parser.error().position, rError.position) << rError.pText;
+    }
+    ASSERT_NEAR(parsed.evaluate(values), 64.0 - 2.0 + 0.49, 1e-12);
+}
+
+TEST(SerializationTest, RoundTripsExactly)
+{
+    const Expression<double>::Symbol x("x"), y("y"), z("z");
+    const Expression<double>::ValueMap values = { {x, 0.7}, {y, 1.3}, {z, 2.1} };
+    Expression<double> flattened = x + y * 3.0 + z + x * y * z;
+    flattened.optimize();
+    const Expression<double> expressions[] =
+    {
+        sin((x * y) + (z - x) / (0.1 + 1e-17) + z) - pow(x, 0.5),
+        exp(x) * log(y) - log10(z) / sqrt(x + y) + abs(-x),
+        flattened,
+        Expression<double>(1.0 / 3.0)
+    };
+
+    // Bit exact constants and the same structure after a round trip.
+    for (const Expression<double>& rExpression : expressions)
+    {
+        std::vector<unsigned char> buffer;
+        Serializer<double>::Serialize(rExpression, buffer);
+        Expression<double> decoded(0.0);
+        ASSERT_EQ(Serializer<double>::Deserialize(buffer.data(), buffer.size(), decoded), buffer.size());
+        ASSERT_EQ(decoded.hash(), rExpression.hash());
+        const double a = decoded.evaluate(values), b = rExpression.evaluate(values);
+        ASSERT_EQ(std::memcmp(&a, &b, sizeof(double)), 0);
+    }
+
+    // Expressions follow one another in a stream.
+    std::stringstream stream;
+    for (const Expression<double>& rExpression : expressions)
+    {
+        ASSERT_TRUE(Serializer<double>::Write(rExpression, stream));
+    }
+    for (const Expression<double>& rExpression : expressions)
+    {
+        Expression<double> decoded(0.0);
+        ASSERT_TRUE(Serializer<double>::Read(stream, decoded));
+        ASSERT_EQ(decoded.hash(), rExpression.hash());
+    }
+    Expression<double> decoded(0.0);
+    ASSERT_FALSE(Serializer<double>::Read(stream, decoded));
+
+    // Truncated or corrupted data, and the wrong value type, are rejected.
+    std::vector<unsigned char> buffer;
+    Serializer<double>::Serialize(expressions[0], buffer);
+    for (std::size_t size = 0; size < buffer.size(); ++size)
+    {
+        ASSERT_EQ(Serializer<double>::Deserialize(buffer.data(), size, decoded), 0u);
+    }
+    for (std::size_t i = 0; i < buffer.size(); ++i)
+    {
+        std::vector<unsigned char> corrupted = buffer;
+        corrupted[i] ^= 0xA5;
+        Expression<double> target(2.0);
+        if (Serializer<double>::Deserialize(corrupted.data(), corrupted.size(), target) == 0)
+        {
+            ASSERT_EQ(target.evaluate(values), 2.0);
+        }
+    }
+    Expression<float> narrow(0.0f);
+    ASSERT_EQ(Serializer<float>::Deserialize(buffer.data(), buffer.size(), narrow), 0u);
+
+    // A symbol name claiming 4 GiB is rejected without reserving them.
+    std::vector<unsigned char> lone;
+    Serializer<double>::Serialize(Expression<double>(x) + 1.0, lone);
+    const unsigned char spelling[] = { 3, 1, 'x' };
+    const auto pLength = std::search(lone.begin(), lone.end(), spelling, spelling + 3) + 1;
+    ASSERT_NE(pLength, lone.end() + 1);
+    const unsigned char hugeLength[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    lone.insert(lone.erase(pLength), hugeLength, hugeLength + 5);
+    ASSERT_EQ(Serializer<double>::Deserialize(lone.data(), lone.size(), decoded), 0u);
+    std::stringstream hugeStream(std::string(lone.begin(), lone.end()));
+    ASSERT_FALSE(Serializer<double>::Read(hugeStream, decoded));
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);